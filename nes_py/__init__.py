@@ -1,6 +1,8 @@
 """The nes-py NES emulator for Python 2 & 3."""
 from .nes_env import NESEnv
+from .nes_batch import NESBatch
+from .nes_shared_batch import NESSharedBatch
 
 
 # explicitly define the outward facing API of this package
-__all__ = [NESEnv.__name__]
+__all__ = [NESEnv.__name__, NESBatch.__name__, NESSharedBatch.__name__]
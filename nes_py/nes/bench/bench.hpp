@@ -0,0 +1,259 @@
+//  Program:      nes-py
+//  File:         bench.hpp
+//  Description:  Shared helpers of the native benchmarks
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "perf_counters.hpp"
+
+namespace NES {
+
+/// Keep a value alive so that the computation of it is not optimized away.
+///
+/// @param value the value to keep alive
+///
+template<typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// Check that a file is an iNES ROM of a mapper that the emulator supports,
+/// since the emulator expects ROMs that the Python code has validated.
+///
+/// @param path the path to the ROM file
+/// @param error the string to write the reason a ROM is rejected to
+/// @return true if the emulator can run the ROM, false otherwise
+///
+inline bool check_rom(const std::string& path, std::string& error) {
+    std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
+    if (!file) {
+        error = "cannot open the file";
+        return false;
+    }
+    auto size = static_cast<std::size_t>(file.tellg());
+    unsigned char header[16] = {0};
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (size < sizeof(header) || header[0] != 'N' || header[1] != 'E' || header[2] != 'S' || header[3] != 0x1a) {
+        error = "not an iNES file";
+        return false;
+    }
+    if (header[4] == 0 || size < sizeof(header) + 0x4000 * header[4] + 0x2000 * header[5]) {
+        error = "truncated PRG or CHR ROM";
+        return false;
+    }
+    // the mappers that MapperFactory creates
+    int mapper = ((header[6] >> 4) & 0xf) | (header[7] & 0xf0);
+    if (mapper > 3) {
+        error = "unsupported mapper " + std::to_string(mapper);
+        return false;
+    }
+    return true;
+}
+
+/// Return a percentile of samples by the nearest rank.
+///
+/// @param samples the samples, which are reordered
+/// @param fraction the fraction of samples at or below the percentile
+/// @return the sample at the percentile (0 without samples)
+///
+inline double percentile(std::vector<double>& samples, double fraction) {
+    if (samples.empty())
+        return 0;
+    auto rank = static_cast<std::size_t>(fraction * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+/// Return the peak resident set size of the process so far in kilobytes.
+inline long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/// Return a string as a JSON string literal.
+///
+/// @param text the string to quote
+/// @return the string in quotes with the special characters escaped
+///
+inline std::string json_string(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+/// The timings of a benchmark case over its repetitions
+struct BenchResult {
+    /// the name of the case
+    std::string name;
+    /// the number of operations of each repetition
+    uint64_t operations;
+    /// the number of emulated frames each operation amounts to (0 if the
+    /// operation is not related to frames)
+    double frames_per_operation;
+    /// the nanoseconds per operation of each repetition
+    std::vector<double> samples;
+    /// the sums of the perf counters over the timed repetitions (empty
+    /// without counters)
+    std::vector<double> perf_counts;
+
+    /// Return the number of frames of the timed repetitions, or of
+    /// operations if the operation is not related to frames.
+    inline double units() const {
+        double units = static_cast<double>(operations) * samples.size();
+        return frames_per_operation > 0 ? units * frames_per_operation : units;
+    }
+
+    /// Return the fastest nanoseconds per operation.
+    inline double min() const { return *std::min_element(samples.begin(), samples.end()); }
+
+    /// Return the median nanoseconds per operation.
+    inline double median() const {
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        auto middle = sorted.size() / 2;
+        return sorted.size() % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+    }
+
+    /// Return the emulated frames per second at the median time, or 0 if
+    /// the operation is not related to frames.
+    inline double frames_per_second() const {
+        return frames_per_operation * 1e9 / median();
+    }
+};
+
+/// Times benchmark cases with warmup and repetitions and reports the time
+/// per operation of each. Each repetition starts from a setup that is not
+/// timed, so cases that change the state of an emulator can restore it.
+class BenchRunner {
+ private:
+    /// the number of untimed repetitions before the timed ones
+    int warmup;
+    /// the number of timed repetitions
+    int repetitions;
+    /// the results of the cases in the order they ran
+    std::vector<BenchResult> results;
+    /// the perf counters to read around the timed code (if any)
+    PerfCounters* perf = nullptr;
+
+ public:
+    /// Initialize a new runner.
+    ///
+    /// @param warmup the number of untimed repetitions of each case
+    /// @param repetitions the number of timed repetitions of each case
+    ///
+    BenchRunner(int warmup, int repetitions) :
+        warmup(warmup), repetitions(std::max(1, repetitions)) { }
+
+    /// Read perf counters around the timed code of every case.
+    ///
+    /// @param counters the counters to read, or nullptr for none
+    ///
+    inline void set_perf_counters(PerfCounters* counters) {
+        perf = counters && counters->available() ? counters : nullptr;
+    }
+
+    /// Time a benchmark case.
+    ///
+    /// @param name the name of the case
+    /// @param operations the number of operations the body performs
+    /// @param frames_per_operation the number of emulated frames each
+    ///        operation amounts to (0 if it is not related to frames)
+    /// @param setup the untimed function called before each repetition
+    /// @param body the timed function that performs the operations
+    ///
+    template<typename Setup, typename Body>
+    void run(
+        const std::string& name,
+        uint64_t operations,
+        double frames_per_operation,
+        Setup setup,
+        Body body
+    ) {
+        BenchResult result{name, operations, frames_per_operation, {}, {}};
+        if (perf)
+            result.perf_counts.assign(perf->get_names().size(), 0);
+        for (int i = 0; i < warmup + repetitions; i++) {
+            setup();
+            // the counters start before and stop after the clock, so their
+            // system calls are not timed
+            if (perf)
+                perf->start();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            std::vector<double> counts = perf ? perf->stop() : std::vector<double>();
+            if (i >= warmup) {
+                double ns = std::chrono::duration<double, std::nano>(end - start).count();
+                result.samples.push_back(ns / operations);
+                for (std::size_t j = 0; j < counts.size(); j++)
+                    result.perf_counts[j] += counts[j];
+            }
+        }
+        results.push_back(result);
+        print(results.back());
+    }
+
+    /// Print a header of the table of results.
+    inline void print_header() const {
+        std::printf("%-40s %12s %12s %14s\n", "case", "median ns/op", "min ns/op", "frames/sec");
+    }
+
+    /// Print the result of a case as a row of the table.
+    ///
+    /// @param result the result of the case to print
+    ///
+    inline void print(const BenchResult& result) const {
+        std::printf("%-40s %12.2f %12.2f", result.name.c_str(), result.median(), result.min());
+        if (result.frames_per_operation > 0)
+            std::printf(" %14.1f", result.frames_per_second());
+        std::printf("\n");
+        if (perf) {
+            // the counts per frame (per operation for the other cases)
+            std::printf("    per %s:", result.frames_per_operation > 0 ? "frame" : "op");
+            const auto& names = perf->get_names();
+            double cycles = 0, instructions = 0;
+            for (std::size_t i = 0; i < names.size(); i++) {
+                double count = result.perf_counts[i] / result.units();
+                std::printf(" %s %.4g", names[i].c_str(), count);
+                if (names[i] == "cycles") cycles = count;
+                if (names[i] == "instructions") instructions = count;
+            }
+            if (cycles > 0 && instructions > 0)
+                std::printf(" IPC %.3f", instructions / cycles);
+            std::printf("\n");
+        }
+        std::fflush(stdout);
+    }
+
+    /// Return the results of the cases in the order they ran.
+    inline const std::vector<BenchResult>& get_results() const { return results; }
+};
+
+}  // namespace NES
+
+#endif  // BENCH_HPP
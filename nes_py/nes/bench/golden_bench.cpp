@@ -0,0 +1,342 @@
+//  Program:      nes-py
+//  File:         golden_bench.cpp
+//  Description:  A determinism and speed gate against golden frame hashes
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <cinttypes>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "counter_rng.hpp"
+#include "emulator.hpp"
+
+using namespace NES;
+
+/// The offset basis of the 64-bit FNV-1a hash
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+/// The prime of the 64-bit FNV-1a hash
+static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+/// The joypad byte of the start button
+static const NES_Byte START = 0b00001000;
+/// The joypad bits of the start and select buttons
+static const NES_Byte START_SELECT = 0b00001100;
+
+/// The hashes of the state of an emulator after a frame
+struct FrameHashes {
+    /// the hash of the 2KB of RAM
+    uint64_t ram;
+    /// the hash of the VRAM and palette RAM
+    uint64_t vram;
+    /// the hash of the screen (0 if the emulator does not render)
+    uint64_t screen;
+};
+
+/// A playthrough of a movie on a ROM
+struct Playthrough {
+    /// the hashes after each frame
+    std::vector<FrameHashes> hashes;
+    /// the seconds spent stepping the emulator (without hashing)
+    double seconds;
+
+    /// Return the frames per second of the steps.
+    inline double fps() const { return hashes.size() / seconds; }
+};
+
+/// Hash bytes with 64-bit FNV-1a.
+///
+/// @param data the bytes to hash
+/// @param size the number of bytes to hash
+/// @param hash the hash to continue from
+/// @return the hash of the bytes
+///
+static uint64_t fnv1a(const NES_Byte* data, std::size_t size, uint64_t hash = FNV_OFFSET) {
+    for (std::size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    return hash;
+}
+
+/// Hash the state of an emulator after a frame.
+///
+/// @param emulator the emulator to hash
+/// @param headless whether the emulator does not render
+/// @return the hashes of the RAM, VRAM, and screen of the emulator
+///
+static FrameHashes hash_frame(Emulator& emulator, bool headless) {
+    FrameHashes hashes;
+    hashes.ram = fnv1a(emulator.get_memory_buffer(), MainBus::RAM_SIZE);
+    const auto& picture_bus = emulator.get_picture_bus();
+    hashes.vram = fnv1a(picture_bus.get_vram().data(), picture_bus.get_vram().size());
+    hashes.vram = fnv1a(picture_bus.get_palette().data(), picture_bus.get_palette().size(), hashes.vram);
+    hashes.screen = 0;
+    if (!headless) {
+        // hash the rows without the padding of a caller-owned buffer
+        const ScreenView& view = emulator.get_screen_view();
+        hashes.screen = FNV_OFFSET;
+        for (int y = 0; y < SCREEN_HEIGHT; y++)
+            hashes.screen = fnv1a(view.row(y), row_size(view.format), hashes.screen);
+    }
+    return hashes;
+}
+
+/// Create the fixed input movie of a seed. The movie idles, presses start
+/// to leave the title screen, then holds random buttons other than start
+/// and select for 1 to 8 frames at a time.
+///
+/// @param frames the number of frames of the movie
+/// @param seed the seed of the random buttons
+/// @return the joypad byte of the first controller in each frame
+///
+static std::vector<NES_Byte> make_movie(int frames, uint64_t seed) {
+    CounterRNG rng;
+    rng.seed(seed);
+    std::vector<NES_Byte> movie;
+    for (int i = 0; i < 60; i++)
+        movie.push_back(0);
+    for (int i = 0; i < 5; i++) {
+        movie.push_back(START);
+        movie.push_back(0);
+    }
+    while (static_cast<int>(movie.size()) < frames) {
+        NES_Byte buttons = rng.up_to(255) & ~START_SELECT;
+        for (int hold = 1 + rng.up_to(7); hold > 0; hold--)
+            movie.push_back(buttons);
+    }
+    movie.resize(frames);
+    return movie;
+}
+
+/// Play a movie on a ROM from power on and hash every frame.
+///
+/// @param rom_path the path to the ROM to play
+/// @param movie the joypad byte of the first controller in each frame
+/// @param headless whether to play without rendering
+/// @return the hashes after each frame and the time of the steps
+///
+static Playthrough play(const std::string& rom_path, const std::vector<NES_Byte>& movie, bool headless) {
+    Emulator emulator(rom_path, headless);
+    emulator.reset();
+    Playthrough playthrough{{}, 0};
+    playthrough.hashes.reserve(movie.size());
+    for (auto buttons : movie) {
+        emulator.set_action(buttons);
+        auto start = std::chrono::steady_clock::now();
+        emulator.step();
+        auto end = std::chrono::steady_clock::now();
+        playthrough.seconds += std::chrono::duration<double>(end - start).count();
+        playthrough.hashes.push_back(hash_frame(emulator, headless));
+    }
+    return playthrough;
+}
+
+/// Return the path of the golden file of a ROM.
+///
+/// @param directory the directory of the golden files
+/// @param rom_path the path to the ROM
+/// @return the path of the golden file, named after the ROM
+///
+static std::string golden_path(const std::string& directory, const std::string& rom_path) {
+    std::string name = rom_path.substr(rom_path.find_last_of('/') + 1);
+    return directory + "/" + name.substr(0, name.find_last_of('.')) + ".golden";
+}
+
+/// Write the golden file of a playthrough.
+///
+/// @param path the path of the golden file
+/// @param rom_path the path to the ROM of the playthrough
+/// @param seed the seed of the movie of the playthrough
+/// @param hashes the hashes after each frame
+/// @return true if the file was written, false otherwise
+///
+static bool write_golden(
+    const std::string& path,
+    const std::string& rom_path,
+    uint64_t seed,
+    const std::vector<FrameHashes>& hashes
+) {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+    std::string name = rom_path.substr(rom_path.find_last_of('/') + 1);
+    std::fprintf(file, "# rom %s\n", name.c_str());
+    std::fprintf(file, "# frames %zu seed %" PRIu64 "\n", hashes.size(), seed);
+    std::fprintf(file, "# frame ram vram screen (64-bit FNV-1a)\n");
+    for (std::size_t i = 0; i < hashes.size(); i++) {
+        std::fprintf(file, "%zu %016" PRIx64 " %016" PRIx64 " %016" PRIx64 "\n",
+            i, hashes[i].ram, hashes[i].vram, hashes[i].screen);
+    }
+    return std::fclose(file) == 0;
+}
+
+/// Read a golden file.
+///
+/// @param path the path of the golden file
+/// @param seed the seed of the movie to read
+/// @param hashes the hashes after each frame to read
+/// @param error the string to write a description of an error to
+/// @return true if the file was read, false otherwise
+///
+static bool read_golden(
+    const std::string& path,
+    uint64_t& seed,
+    std::vector<FrameHashes>& hashes,
+    std::string& error
+) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::size_t frames = 0;
+    bool has_header = false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("# frames ", 0) == 0) {
+            std::istringstream header(line.substr(2));
+            std::string frames_key, seed_key;
+            has_header = static_cast<bool>(header >> frames_key >> frames >> seed_key >> seed);
+            continue;
+        }
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream row(line);
+        std::size_t frame;
+        FrameHashes frame_hashes;
+        row >> frame >> std::hex >> frame_hashes.ram >> frame_hashes.vram >> frame_hashes.screen;
+        if (!row || frame != hashes.size()) {
+            error = "malformed line " + std::to_string(hashes.size()) + " in " + path;
+            return false;
+        }
+        hashes.push_back(frame_hashes);
+    }
+    if (!has_header || hashes.size() != frames || frames == 0) {
+        error = "missing or inconsistent header in " + path;
+        return false;
+    }
+    return true;
+}
+
+/// Verify a ROM against its golden file, rendering and headless.
+///
+/// @param rom_path the path to the ROM to verify
+/// @param directory the directory of the golden files
+/// @param min_fps the frames per second the rendering playthrough must reach
+/// @return true if the playthroughs match the golden file and are fast
+///         enough, false otherwise
+///
+static bool verify(const std::string& rom_path, const std::string& directory, double min_fps) {
+    uint64_t seed = 0;
+    std::vector<FrameHashes> golden;
+    std::string error;
+    if (!read_golden(golden_path(directory, rom_path), seed, golden, error)) {
+        std::printf("FAIL %s: %s\n", rom_path.c_str(), error.c_str());
+        return false;
+    }
+    auto movie = make_movie(golden.size(), seed);
+    auto rendering = play(rom_path, movie, false);
+    // the headless playthrough must emulate the same RAM and VRAM
+    auto headless = play(rom_path, movie, true);
+    for (std::size_t i = 0; i < golden.size(); i++) {
+        const char* mismatch = nullptr;
+        if (rendering.hashes[i].ram != golden[i].ram)
+            mismatch = "RAM";
+        else if (rendering.hashes[i].vram != golden[i].vram)
+            mismatch = "VRAM";
+        else if (rendering.hashes[i].screen != golden[i].screen)
+            mismatch = "screen";
+        else if (headless.hashes[i].ram != golden[i].ram)
+            mismatch = "headless RAM";
+        else if (headless.hashes[i].vram != golden[i].vram)
+            mismatch = "headless VRAM";
+        if (mismatch) {
+            std::printf("FAIL %s: %s differs from the golden file at frame %zu\n",
+                rom_path.c_str(), mismatch, i);
+            return false;
+        }
+    }
+    bool is_fast = rendering.fps() >= min_fps;
+    std::printf("%s %s: %zu frames bit-exact, %.1f fps rendering, %.1f fps headless",
+        is_fast ? "OK  " : "FAIL", rom_path.c_str(), golden.size(), rendering.fps(), headless.fps());
+    if (!is_fast)
+        std::printf(" (below %.1f fps)", min_fps);
+    std::printf("\n");
+    return is_fast;
+}
+
+/// Print the usage of the gate.
+///
+/// @param program the name of the program
+///
+static void usage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s record|verify [options] ROM...\n"
+        "  record           play the movie on each ROM and write its golden file\n"
+        "  verify           check each ROM against its golden file, exits with 1\n"
+        "                   on a mismatch or a rendering playthrough below\n"
+        "                   --min-fps\n"
+        "  --golden DIR     the directory of the golden files (default .)\n"
+        "  --frames N       the frames of the recorded movies (default 600)\n"
+        "  --seed N         the seed of the recorded movies (default 0)\n"
+        "  --min-fps N      the frames per second to verify (default 0)\n",
+        program
+    );
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || (std::string(argv[1]) != "record" && std::string(argv[1]) != "verify")) {
+        usage(argv[0]);
+        return 2;
+    }
+    bool is_recording = std::string(argv[1]) == "record";
+    std::string directory = ".";
+    int frames = 600;
+    uint64_t seed = 0;
+    double min_fps = 0;
+    std::vector<std::string> roms;
+    for (int i = 2; i < argc; i++) {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--golden" && has_value) {
+            directory = argv[++i];
+        } else if (argument == "--frames" && has_value) {
+            frames = std::atoi(argv[++i]);
+        } else if (argument == "--seed" && has_value) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (argument == "--min-fps" && has_value) {
+            min_fps = std::atof(argv[++i]);
+        } else if (argument.rfind("--", 0) == 0) {
+            usage(argv[0]);
+            return 2;
+        } else {
+            roms.push_back(argument);
+        }
+    }
+    if (roms.empty() || frames < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    bool is_passing = true;
+    for (const auto& rom : roms) {
+        std::string error;
+        if (!check_rom(rom, error)) {
+            std::fprintf(stderr, "skipping %s: %s\n", rom.c_str(), error.c_str());
+            continue;
+        }
+        if (!is_recording) {
+            is_passing = verify(rom, directory, min_fps) && is_passing;
+            continue;
+        }
+        auto playthrough = play(rom, make_movie(frames, seed), false);
+        auto path = golden_path(directory, rom);
+        if (!write_golden(path, rom, seed, playthrough.hashes)) {
+            std::fprintf(stderr, "cannot write %s\n", path.c_str());
+            return 1;
+        }
+        std::printf("recorded %s: %d frames to %s\n", rom.c_str(), frames, path.c_str());
+    }
+    return is_passing ? 0 : 1;
+}
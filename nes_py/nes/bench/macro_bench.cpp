@@ -0,0 +1,298 @@
+//  Program:      nes-py
+//  File:         macro_bench.cpp
+//  Description:  End-to-end throughput and scaling of the emulator on ROMs
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <latch>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.hpp"
+#include "counter_rng.hpp"
+#include "emulator.hpp"
+
+using namespace NES;
+
+/// The options of the benchmark
+struct MacroOptions {
+    /// the number of timed frames of each emulator per configuration
+    int frames = 1200;
+    /// the number of untimed frames of each emulator before the timed ones
+    int warmup_frames = 120;
+    /// the largest number of threads to scale to
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    /// the seed of the random inputs
+    uint64_t seed = 0;
+    /// the joypad bytes of a recorded input movie, one per frame (empty for
+    /// random inputs)
+    std::vector<NES_Byte> movie;
+    /// the path of the movie, or "random"
+    std::string inputs = "random";
+    /// the path to write the JSON report to (empty for stdout)
+    std::string output;
+};
+
+/// The measurements of a ROM in a mode at a number of threads
+struct MacroResult {
+    /// the file name of the ROM
+    std::string rom;
+    /// whether the emulators rendered their frames
+    bool rendering;
+    /// the number of threads, each stepping its own emulator
+    int threads;
+    /// the number of timed frames of all the emulators
+    uint64_t frames;
+    /// the wall-clock seconds of the timed frames of all the threads
+    double seconds;
+    /// the median latency of a frame in milliseconds
+    double p50_ms;
+    /// the 99th percentile latency of a frame in milliseconds
+    double p99_ms;
+    /// the peak resident set size of the process so far in kilobytes
+    long peak_rss_kb;
+
+    /// Return the frames per second of all the threads.
+    inline double fps() const { return frames / seconds; }
+};
+
+/// Return the input of a frame of an emulator.
+///
+/// @param options the options with the movie of the inputs
+/// @param rng the generator of random inputs of the emulator
+/// @param frame the index of the frame
+/// @param held the random input that is held and the frames it is held for
+/// @return the joypad byte of the first controller in the frame
+///
+static NES_Byte next_input(
+    const MacroOptions& options,
+    CounterRNG& rng,
+    int frame,
+    std::pair<NES_Byte, int>& held
+) {
+    if (!options.movie.empty())
+        return options.movie[frame % options.movie.size()];
+    // random buttons are held for 1 to 8 frames like a player would
+    if (held.second == 0)
+        held = {static_cast<NES_Byte>(rng.up_to(255)), 1 + static_cast<int>(rng.up_to(7))};
+    held.second--;
+    return held.first;
+}
+
+/// Run the emulators of a configuration on their threads and measure them.
+///
+/// @param options the options of the benchmark
+/// @param rom_path the path to the ROM to run
+/// @param rendering whether the emulators render their frames
+/// @param threads the number of threads, each with its own emulator
+/// @return the measurements of the configuration
+///
+static MacroResult run_configuration(
+    const MacroOptions& options,
+    const std::string& rom_path,
+    bool rendering,
+    int threads
+) {
+    std::vector<std::vector<double>> latencies(threads);
+    // the threads warm up, then start the timed frames together
+    std::latch ready(threads + 1);
+    std::latch start(1);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            Emulator emulator(rom_path, !rendering);
+            CounterRNG rng;
+            rng.seed(options.seed, t);
+            std::pair<NES_Byte, int> held = {0, 0};
+            emulator.reset();
+            int frame = 0;
+            for (; frame < options.warmup_frames; frame++) {
+                emulator.set_action(next_input(options, rng, frame, held));
+                emulator.step();
+            }
+            auto& samples = latencies[t];
+            samples.reserve(options.frames);
+            ready.count_down();
+            start.wait();
+            for (int i = 0; i < options.frames; i++, frame++) {
+                emulator.set_action(next_input(options, rng, frame, held));
+                auto begin = std::chrono::steady_clock::now();
+                emulator.step();
+                auto end = std::chrono::steady_clock::now();
+                samples.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+            }
+        });
+    }
+    ready.arrive_and_wait();
+    auto begin = std::chrono::steady_clock::now();
+    start.count_down();
+    for (auto& worker : workers)
+        worker.join();
+    auto end = std::chrono::steady_clock::now();
+    std::vector<double> samples;
+    for (auto& thread_samples : latencies)
+        samples.insert(samples.end(), thread_samples.begin(), thread_samples.end());
+    MacroResult result;
+    result.rom = rom_path.substr(rom_path.find_last_of('/') + 1);
+    result.rendering = rendering;
+    result.threads = threads;
+    result.frames = samples.size();
+    result.seconds = std::chrono::duration<double>(end - begin).count();
+    result.p50_ms = percentile(samples, 0.50);
+    result.p99_ms = percentile(samples, 0.99);
+    result.peak_rss_kb = peak_rss_kb();
+    return result;
+}
+
+/// Print the usage of the benchmark.
+///
+/// @param program the name of the program
+///
+static void usage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s [options] ROM_OR_DIRECTORY...\n"
+        "  --frames N       the timed frames of each emulator (default 1200)\n"
+        "  --warmup N       the untimed frames before them (default 120)\n"
+        "  --max-threads N  the most threads to scale to (default: cores)\n"
+        "  --seed N         the seed of the random inputs (default 0)\n"
+        "  --movie FILE     play the joypad bytes of a file, one per frame,\n"
+        "                   instead of random inputs\n"
+        "  --output FILE    write the JSON report to a file (default stdout)\n",
+        program
+    );
+}
+
+/// Write the JSON report of the benchmark.
+///
+/// @param file the file to write the report to
+/// @param options the options of the benchmark
+/// @param results the measurements of every configuration
+/// @param skipped the ROMs that were skipped and the reasons
+///
+static void write_report(
+    std::FILE* file,
+    const MacroOptions& options,
+    const std::vector<MacroResult>& results,
+    const std::vector<std::pair<std::string, std::string>>& skipped
+) {
+    std::fprintf(file, "{\n");
+    std::fprintf(file, "  \"frames\": %d,\n", options.frames);
+    std::fprintf(file, "  \"warmup_frames\": %d,\n", options.warmup_frames);
+    std::fprintf(file, "  \"inputs\": %s,\n", json_string(options.inputs).c_str());
+    std::fprintf(file, "  \"seed\": %llu,\n", static_cast<unsigned long long>(options.seed));
+    std::fprintf(file, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+    std::fprintf(file, "  \"results\": [");
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        // the efficiency is relative to the same ROM and mode on one thread
+        double single_fps = 0;
+        for (const auto& other : results)
+            if (other.rom == result.rom && other.rendering == result.rendering && other.threads == 1)
+                single_fps = other.fps();
+        double efficiency = single_fps > 0 ? result.fps() / (result.threads * single_fps) : 0;
+        std::fprintf(file, "%s\n    {\"rom\": %s, \"mode\": \"%s\", \"threads\": %d, "
+            "\"frames\": %llu, \"seconds\": %.6f, \"fps\": %.2f, \"fps_per_thread\": %.2f, "
+            "\"p50_ms\": %.4f, \"p99_ms\": %.4f, \"scaling_efficiency\": %.4f, "
+            "\"peak_rss_kb\": %ld}",
+            i ? "," : "", json_string(result.rom).c_str(),
+            result.rendering ? "rendering" : "headless", result.threads,
+            static_cast<unsigned long long>(result.frames), result.seconds,
+            result.fps(), result.fps() / result.threads, result.p50_ms, result.p99_ms,
+            efficiency, result.peak_rss_kb
+        );
+    }
+    std::fprintf(file, "\n  ],\n  \"skipped\": [");
+    for (std::size_t i = 0; i < skipped.size(); i++) {
+        std::fprintf(file, "%s\n    {\"rom\": %s, \"reason\": %s}", i ? "," : "",
+            json_string(skipped[i].first).c_str(), json_string(skipped[i].second).c_str());
+    }
+    std::fprintf(file, "\n  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    MacroOptions options;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--frames" && has_value) {
+            options.frames = std::atoi(argv[++i]);
+        } else if (argument == "--warmup" && has_value) {
+            options.warmup_frames = std::atoi(argv[++i]);
+        } else if (argument == "--max-threads" && has_value) {
+            options.max_threads = std::atoi(argv[++i]);
+        } else if (argument == "--seed" && has_value) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (argument == "--movie" && has_value) {
+            options.inputs = argv[++i];
+            std::ifstream movie(options.inputs, std::ios_base::binary);
+            options.movie.assign(std::istreambuf_iterator<char>(movie), std::istreambuf_iterator<char>());
+            if (options.movie.empty()) {
+                std::fprintf(stderr, "cannot read a movie from %s\n", options.inputs.c_str());
+                return 2;
+            }
+        } else if (argument == "--output" && has_value) {
+            options.output = argv[++i];
+        } else if (argument.rfind("--", 0) == 0) {
+            usage(argv[0]);
+            return 2;
+        } else {
+            paths.push_back(argument);
+        }
+    }
+    if (paths.empty() || options.frames < 1 || options.warmup_frames < 0 || options.max_threads < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    // expand the directories to the files in them in a stable order
+    std::vector<std::string> roms;
+    for (const auto& path : paths) {
+        if (std::filesystem::is_directory(path)) {
+            std::vector<std::string> files;
+            for (const auto& entry : std::filesystem::directory_iterator(path))
+                if (entry.is_regular_file())
+                    files.push_back(entry.path().string());
+            std::sort(files.begin(), files.end());
+            roms.insert(roms.end(), files.begin(), files.end());
+        } else {
+            roms.push_back(path);
+        }
+    }
+    // the thread counts double up to the largest one
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < options.max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(options.max_threads);
+    std::vector<MacroResult> results;
+    std::vector<std::pair<std::string, std::string>> skipped;
+    for (const auto& rom : roms) {
+        std::string error;
+        if (!check_rom(rom, error)) {
+            skipped.push_back({rom.substr(rom.find_last_of('/') + 1), error});
+            continue;
+        }
+        for (bool rendering : {false, true}) {
+            for (int threads : thread_counts) {
+                results.push_back(run_configuration(options, rom, rendering, threads));
+                const auto& result = results.back();
+                std::fprintf(stderr, "%-36s %-9s %3d threads %10.1f fps  p50 %.3f ms  p99 %.3f ms\n",
+                    result.rom.c_str(), rendering ? "rendering" : "headless", threads,
+                    result.fps(), result.p50_ms, result.p99_ms);
+            }
+        }
+    }
+    std::FILE* file = options.output.empty() ? stdout : std::fopen(options.output.c_str(), "w");
+    if (!file) {
+        std::fprintf(stderr, "cannot write the report to %s\n", options.output.c_str());
+        return 1;
+    }
+    write_report(file, options, results, skipped);
+    if (file != stdout)
+        std::fclose(file);
+    return 0;
+}
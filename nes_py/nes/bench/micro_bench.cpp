@@ -0,0 +1,209 @@
+//  Program:      nes-py
+//  File:         micro_bench.cpp
+//  Description:  Micro-benchmarks of the hot paths of the emulator
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "emulator.hpp"
+
+using namespace NES;
+
+/// The number of operations of the benchmarks of a single bus access
+static const uint64_t BUS_OPERATIONS = 1 << 20;
+/// The number of operations of the benchmarks of saving and loading states
+static const uint64_t STATE_OPERATIONS = 1000;
+/// The number of frames the emulators run before they are benchmarked, so
+/// the games are past their power-on setup
+static const int WARMUP_FRAMES = 120;
+
+/// Print the usage of the benchmark.
+///
+/// @param program the name of the program
+///
+static void usage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s [--warmup N] [--repetitions N] [--frames N] [--perf] ROM...\n"
+        "  --warmup N       the untimed repetitions of each case (default 2)\n"
+        "  --repetitions N  the timed repetitions of each case (default 10)\n"
+        "  --frames N       the frames of each repetition of the frame and\n"
+        "                   cycle cases (default 60)\n"
+        "  --perf           report perf_event counters per frame, hardware ones\n"
+        "                   if available, software ones otherwise\n",
+        program
+    );
+}
+
+/// Benchmark the hot paths of the emulator on a ROM.
+///
+/// @param runner the runner to time the cases with
+/// @param rom_path the path to the ROM to benchmark
+/// @param frames the number of frames of each repetition of the frame and
+///        cycle cases
+///
+static void bench_rom(BenchRunner& runner, const std::string& rom_path, int frames) {
+    std::string name = rom_path.substr(rom_path.find_last_of('/') + 1);
+    std::printf("\n%s\n", name.c_str());
+    runner.print_header();
+    Emulator emulator(rom_path, false);
+    Emulator headless(rom_path, true);
+    for (auto emu : {&emulator, &headless}) {
+        emu->reset();
+        for (int i = 0; i < WARMUP_FRAMES; i++)
+            emu->step();
+        emu->backup();
+    }
+    // every case starts from the same state, so the repetitions do the same
+    // work and the cases that write memory do not derail the game
+    auto restore = [&]() { emulator.restore(); };
+    auto restore_headless = [&]() { headless.restore(); };
+    const uint64_t cycles = static_cast<uint64_t>(frames) * Emulator::CYCLES_PER_FRAME;
+    const double frames_per_cycle = 1.0 / Emulator::CYCLES_PER_FRAME;
+    // whole frames
+    runner.run("Emulator::step", frames, 1, restore, [&]() {
+        for (int i = 0; i < frames; i++)
+            emulator.step();
+    });
+    runner.run("Emulator::step (headless)", frames, 1, restore_headless, [&]() {
+        for (int i = 0; i < frames; i++)
+            headless.step();
+    });
+    // the units that make up a frame, the CPU runs without the PPU, so it
+    // does not take any NMI
+    runner.run("CPU::cycle", cycles, frames_per_cycle, restore, [&]() {
+        auto& cpu = emulator.get_cpu();
+        auto& bus = emulator.get_bus();
+        for (uint64_t i = 0; i < cycles; i++)
+            cpu.cycle(bus);
+    });
+    // the same with the profiler of the emulated code enabled
+    emulator.set_profiling(true);
+    runner.run("CPU::cycle (profiled)", cycles, frames_per_cycle, restore, [&]() {
+        auto& cpu = emulator.get_cpu();
+        auto& bus = emulator.get_bus();
+        for (uint64_t i = 0; i < cycles; i++)
+            cpu.cycle(bus);
+    });
+    emulator.set_profiling(false);
+    // the same with the trace of the instructions enabled
+    emulator.set_cpu_tracing(true);
+    runner.run("CPU::cycle (traced)", cycles, frames_per_cycle, restore, [&]() {
+        auto& cpu = emulator.get_cpu();
+        auto& bus = emulator.get_bus();
+        for (uint64_t i = 0; i < cycles; i++)
+            cpu.cycle(bus);
+    });
+    emulator.set_cpu_tracing(false);
+    runner.run("PPU::cycle", 3 * cycles, frames_per_cycle / 3, restore, [&]() {
+        auto& ppu = emulator.get_ppu();
+        auto& picture_bus = emulator.get_picture_bus();
+        for (uint64_t i = 0; i < 3 * cycles; i++)
+            ppu.cycle(picture_bus);
+    });
+    runner.run("LightPPU::cycle", 3 * cycles, frames_per_cycle / 3, restore_headless, [&]() {
+        auto& ppu = headless.get_ppu();
+        auto& picture_bus = headless.get_picture_bus();
+        for (uint64_t i = 0; i < 3 * cycles; i++)
+            ppu.cycle(picture_bus);
+    });
+    // bus accesses
+    runner.run("MainBus::read (RAM)", BUS_OPERATIONS, 0, restore, [&]() {
+        auto& bus = emulator.get_bus();
+        unsigned sum = 0;
+        for (uint64_t i = 0; i < BUS_OPERATIONS; i++)
+            sum += bus.read(i & 0x7ff);
+        do_not_optimize(sum);
+    });
+    runner.run("MainBus::read (PRG)", BUS_OPERATIONS, 0, restore, [&]() {
+        auto& bus = emulator.get_bus();
+        unsigned sum = 0;
+        for (uint64_t i = 0; i < BUS_OPERATIONS; i++)
+            sum += bus.read(0x8000 | (i & 0x7fff));
+        do_not_optimize(sum);
+    });
+    runner.run("MainBus::write (RAM)", BUS_OPERATIONS, 0, restore, [&]() {
+        auto& bus = emulator.get_bus();
+        for (uint64_t i = 0; i < BUS_OPERATIONS; i++)
+            bus.write(i & 0x7ff, i);
+    });
+    runner.run("PictureBus::read", BUS_OPERATIONS, 0, restore, [&]() {
+        auto& picture_bus = emulator.get_picture_bus();
+        unsigned sum = 0;
+        for (uint64_t i = 0; i < BUS_OPERATIONS; i++)
+            sum += picture_bus.read(i & 0x3fff);
+        do_not_optimize(sum);
+    });
+    // saving and loading states
+    runner.run("Emulator::backup", STATE_OPERATIONS, 0, restore, [&]() {
+        for (uint64_t i = 0; i < STATE_OPERATIONS; i++)
+            emulator.backup();
+    });
+    runner.run("Emulator::restore", STATE_OPERATIONS, 0, restore, [&]() {
+        for (uint64_t i = 0; i < STATE_OPERATIONS; i++)
+            emulator.restore();
+    });
+    std::vector<uint8_t> buffer;
+    runner.run("Emulator::serialize", STATE_OPERATIONS, 0, restore, [&]() {
+        for (uint64_t i = 0; i < STATE_OPERATIONS; i++) {
+            buffer.clear();
+            emulator.serialize(buffer);
+        }
+    });
+    runner.run("Emulator::deserialize", STATE_OPERATIONS, 0, restore, [&]() {
+        for (uint64_t i = 0; i < STATE_OPERATIONS; i++)
+            emulator.deserialize(buffer);
+    });
+}
+
+int main(int argc, char** argv) {
+    int warmup = 2;
+    int repetitions = 10;
+    int frames = 60;
+    bool perf = false;
+    std::vector<std::string> roms;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if ((argument == "--warmup" || argument == "--repetitions" || argument == "--frames") && i + 1 < argc) {
+            int value = std::atoi(argv[++i]);
+            if (argument == "--warmup") warmup = value;
+            else if (argument == "--repetitions") repetitions = value;
+            else frames = value;
+        } else if (argument == "--perf") {
+            perf = true;
+        } else if (argument.rfind("--", 0) == 0) {
+            usage(argv[0]);
+            return 2;
+        } else {
+            roms.push_back(argument);
+        }
+    }
+    if (roms.empty() || frames < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::printf("warmup: %d, repetitions: %d, frames: %d\n", warmup, repetitions, frames);
+    BenchRunner runner(warmup, repetitions);
+    PerfCounters counters;
+    if (perf) {
+        if (!counters.available()) {
+            std::printf("perf counters: unavailable (see /proc/sys/kernel/perf_event_paranoid)\n");
+        } else {
+            std::printf("perf counters: %s\n", counters.is_hardware() ? "hardware" : "software fallback");
+            runner.set_perf_counters(&counters);
+        }
+    }
+    for (const auto& rom : roms) {
+        std::string error;
+        if (!check_rom(rom, error)) {
+            std::fprintf(stderr, "skipping %s: %s\n", rom.c_str(), error.c_str());
+            continue;
+        }
+        bench_rom(runner, rom, frames);
+    }
+    return 0;
+}
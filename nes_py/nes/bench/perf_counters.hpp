@@ -0,0 +1,170 @@
+//  Program:      nes-py
+//  File:         perf_counters.hpp
+//  Description:  Linux perf_event counters of the code the benchmarks time
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace NES {
+
+/// A group of perf_event counters of the calling thread, read together
+/// around the timed code. The group counts the hardware events (cycles,
+/// instructions, branch misses, L1D and LLC read misses) where the kernel
+/// exposes them, and falls back to the software events (task clock, page
+/// faults, context switches) elsewhere, e.g., in containers and VMs.
+class PerfCounters {
+ private:
+    /// An event to count
+    struct Event {
+        /// the name of the event in reports
+        const char* name;
+        /// the perf type of the event
+        uint32_t type;
+        /// the perf config of the event
+        uint64_t config;
+    };
+
+    /// the file descriptors of the events, the first is the group leader
+    std::vector<int> fds;
+    /// the names of the events that opened
+    std::vector<std::string> names;
+    /// whether the group counts hardware events
+    bool hardware = false;
+
+#if defined(__linux__)
+    /// Return the config of a read miss of a hardware cache.
+    static constexpr uint64_t cache_read_miss(uint64_t cache) {
+        return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    }
+
+    /// Open an event of the calling thread in the group.
+    ///
+    /// @param event the event to open
+    /// @return the file descriptor of the event, or -1 if it is unavailable
+    ///
+    int open_event(const Event& event) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event.type;
+        attr.config = event.config;
+        // the leader starts and stops the whole group
+        attr.disabled = fds.empty();
+        // the user-space events are open to unprivileged processes
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int leader = fds.empty() ? -1 : fds[0];
+        return syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    }
+
+    /// Open a group of events, the first of which must open.
+    ///
+    /// @param events the events of the group
+    /// @return true if the group opened, false otherwise
+    ///
+    bool open_group(const std::vector<Event>& events) {
+        for (const auto& event : events) {
+            int fd = open_event(event);
+            if (fd < 0) {
+                if (fds.empty())
+                    return false;
+                continue;  // the other events are optional
+            }
+            fds.push_back(fd);
+            names.push_back(event.name);
+        }
+        return true;
+    }
+#endif
+
+ public:
+    /// Open the counters, hardware ones if possible, software ones else.
+    PerfCounters() {
+#if defined(__linux__)
+        hardware = open_group({
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"L1d-misses", PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_L1D)},
+            {"LLC-misses", PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_LL)},
+        });
+        if (!hardware) {
+            open_group({
+                {"task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+                {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+                {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+            });
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (int fd : fds)
+            close(fd);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /// Return true if any counter opened.
+    inline bool available() const { return !fds.empty(); }
+
+    /// Return true if the counters are hardware events.
+    inline bool is_hardware() const { return hardware; }
+
+    /// Return the names of the counters in the order of their values.
+    inline const std::vector<std::string>& get_names() const { return names; }
+
+    /// Zero the counters and start counting.
+    inline void start() {
+#if defined(__linux__)
+        if (fds.empty())
+            return;
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    /// Stop counting and return the counts since the start.
+    ///
+    /// @return the count of each counter, scaled up if the kernel shared
+    ///         the hardware with other groups for part of the time
+    ///
+    inline std::vector<double> stop() {
+        std::vector<double> counts(fds.size(), 0);
+#if defined(__linux__)
+        if (fds.empty())
+            return counts;
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // the number of events, the times enabled and running, the values
+        std::vector<uint64_t> data(3 + fds.size(), 0);
+        if (read(fds[0], data.data(), data.size() * sizeof(uint64_t)) < 0)
+            return counts;
+        double scale = data[2] > 0 ? static_cast<double>(data[1]) / data[2] : 0;
+        for (std::size_t i = 0; i < fds.size() && i < data[0]; i++)
+            counts[i] = data[3 + i] * scale;
+#endif
+        return counts;
+    }
+};
+
+}  // namespace NES
+
+#endif  // PERF_COUNTERS_HPP
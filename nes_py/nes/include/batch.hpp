@@ -0,0 +1,374 @@
+//  Program:      nes-py
+//  File:         batch.hpp
+//  Description:  A batch of emulators stepped together with auto-reset
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+#include "emulator.hpp"
+#include "lock_free_queue.hpp"
+
+namespace NES {
+
+/// A step of an emulator handed to a worker thread
+struct BatchTask {
+    /// the index of the emulator to step (negative to stop the worker)
+    int32_t index;
+    /// the action to step the emulator with
+    int32_t action;
+    /// the number of frames to hold the action for
+    int32_t frames;
+};
+
+/// Free a buffer of std::aligned_alloc when its std::unique_ptr is destroyed
+struct AlignedFree {
+    inline void operator()(NES_Byte* data) const { std::free(data); }
+};
+
+/// A batch of emulators of the same ROM that are stepped together. The
+/// screens of the emulators are rendered into one contiguous [N, ...]
+/// buffer and the emulators that finish an episode are reset to their
+/// start state within the step that finished them (gymnasium's same-step
+/// autoreset), reporting the final screen in a side buffer.
+class Batch {
+ private:
+    /// the emulators of the batch
+    std::vector<Emulator*> emulators;
+    /// the format the screens are rendered in
+    PixelFormat pixel_format;
+    /// the screens of the emulators, one after another
+    std::vector<NES_Byte> screens;
+    /// the last screen of the episodes that ended in the last step
+    std::vector<NES_Byte> final_screens;
+    /// a caller-owned buffer for the screens, or nullptr for the internal one
+    NES_Byte* screen_buffer;
+    /// a caller-owned buffer for the final screens, or nullptr for the
+    /// internal one
+    NES_Byte* final_screen_buffer;
+    /// the RAM of the emulators, one 64-byte aligned row after another
+    std::unique_ptr<NES_Byte, AlignedFree> ram;
+    /// a caller-owned buffer for the RAM, or nullptr for the internal one
+    NES_Byte* ram_buffer;
+    /// the frame stack rings of the emulators, one after another
+    std::vector<NES_Byte> frame_stacks;
+    /// a caller-owned buffer for the frame stack rings, or nullptr for the
+    /// internal one
+    NES_Byte* frame_stack_buffer;
+    /// the slot of the oldest frame of the stack of each emulator
+    std::vector<int32_t> frame_stack_offsets;
+    /// the number of RAM watch results per emulator
+    int watch_size;
+    /// the RAM watch results of each emulator after the last step (before
+    /// any reset), one row after another
+    std::vector<double> results;
+    /// whether the episode of each emulator was terminated by its RAM watch
+    std::vector<NES_Byte> terminated;
+    /// whether the episode of each emulator hit the step limit
+    std::vector<NES_Byte> truncated;
+    /// the number of steps in the current episode of each emulator
+    std::vector<uint64_t> episode_steps;
+    /// the statistics of the current episode of each emulator
+    std::vector<EpisodeStats> episodes;
+    /// the statistics of the last episode that ended for each emulator
+    std::vector<EpisodeStats> final_episodes;
+    /// the number of steps after which episodes are truncated (0 for none)
+    uint64_t max_episode_steps;
+    /// whether the emulators have a start state to reset to
+    bool has_backup;
+    /// the worker threads that step the emulators asynchronously
+    std::vector<std::thread> workers;
+    /// the queue of steps of each worker, emulator i belongs to worker
+    /// i % workers
+    std::vector<std::unique_ptr<SPSCQueue<BatchTask>>> tasks;
+    /// the indexes of the emulators whose steps finished
+    MPSCQueue<int32_t> finished;
+    /// the number of steps finished by the workers (to sleep on)
+    std::atomic<uint32_t> finished_count;
+    /// whether each emulator has a step in flight
+    std::vector<NES_Byte> is_in_flight;
+    /// the number of steps in flight
+    int in_flight;
+    /// the indexes of the emulators a synchronous step collects, kept to
+    /// not allocate them on every step
+    std::vector<int32_t> step_ready;
+
+    /// Render the screen of an emulator into its slot of the batch.
+    ///
+    /// @param index the index of the emulator
+    ///
+    void bind_screen(int index);
+
+    /// Reset an emulator to its start state.
+    ///
+    /// @param index the index of the emulator
+    ///
+    void reset_emulator(int index);
+
+    /// Step an emulator with an action, resetting it if its episode ends.
+    ///
+    /// @param index the index of the emulator
+    /// @param action the action of the emulator
+    /// @param frames the number of frames to hold the action for
+    ///
+    void step_emulator(int index, int32_t action, int frames);
+
+    /// Run the loop of a worker thread until it pops a stop task.
+    ///
+    /// @param worker the index of the worker
+    ///
+    void run_worker(int worker);
+
+    /// Stop and join the worker threads.
+    void stop_workers();
+
+ public:
+    /// Initialize a new batch of emulators.
+    ///
+    /// @param rom_path the path to the ROM of the emulators
+    /// @param size the number of emulators in the batch
+    /// @param headless whether to disable rendering of the emulators
+    ///
+    Batch(const std::string& rom_path, int size, bool headless);
+
+    /// Stop the worker threads and delete the emulators of the batch.
+    ~Batch();
+
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+
+    /// Return the number of emulators in the batch.
+    inline int size() const { return emulators.size(); }
+
+    /// Return an emulator of the batch.
+    ///
+    /// @param index the index of the emulator
+    /// @return a pointer to the emulator
+    ///
+    inline Emulator* get_emulator(int index) { return emulators[index]; }
+
+    /// Return the format the screens are rendered in.
+    inline PixelFormat get_pixel_format() const { return pixel_format; }
+
+    /// Set the format the screens are rendered in. The screen buffers are
+    /// reallocated, so this should be done before saving a start state.
+    ///
+    /// @param format the new pixel format
+    /// @return true if the format is valid, false otherwise
+    ///
+    bool set_pixel_format(PixelFormat format);
+
+    /// Render the screens to caller-owned buffers, e.g., a shared memory
+    /// region, instead of the internal ones. The buffers must hold the
+    /// screens of all the emulators in the current pixel format.
+    ///
+    /// @param screens the buffer for the screens, or nullptr for the
+    ///        internal one
+    /// @param final_screens the buffer for the final screens, or nullptr for
+    ///        the internal one
+    ///
+    void set_screen_buffers(NES_Byte* screens, NES_Byte* final_screens);
+
+    /// Store the RAM of the emulators in a caller-owned buffer, e.g., a
+    /// shared memory region, instead of the internal block.
+    ///
+    /// @param data the buffer of [N, 2048] bytes, or nullptr for the internal
+    ///        block
+    ///
+    void set_ram_buffer(NES_Byte* data);
+
+    /// Keep a stack of the last frames of every emulator (see
+    /// Emulator::set_frame_stack) in one [N, 2 * depth, height, width]
+    /// block of rings. While the emulators step together their offsets are
+    /// equal, so the stacks of the batch are a strided view of the block.
+    ///
+    /// @param depth the number of frames in each stack (0 to disable them)
+    /// @param downsample the factor to downsample the frames by
+    /// @param buffer a caller-owned buffer of the rings, e.g., in a shared
+    ///        memory region, or nullptr for the internal block
+    /// @return true if the shape of the stacks is valid, false otherwise
+    ///
+    bool set_frame_stack(int depth, int downsample, NES_Byte* buffer = nullptr);
+
+    /// Compile a RAM watch spec for every emulator. The `done` entry is
+    /// the termination predicate of the episodes.
+    ///
+    /// @param spec the text of the watch spec (empty to remove the watch)
+    /// @param error the string to write a description of an error to
+    /// @return true if the spec compiled, false otherwise
+    ///
+    bool set_watch(const std::string& spec, std::string& error);
+
+    /// Set the number of steps after which episodes are truncated.
+    ///
+    /// @param steps the maximal number of steps per episode (0 for none)
+    ///
+    inline void set_max_episode_steps(uint64_t steps) { max_episode_steps = steps; }
+
+    /// Set the table of discrete actions of every emulator.
+    ///
+    /// @param table the joypad bytes of the first and second controller for
+    ///        each action, one action after another
+    /// @param actions the number of actions in the table (0 to remove it)
+    ///
+    void set_action_table(const NES_Byte* table, int actions);
+
+    /// Set the probability of sticky actions of every emulator (see
+    /// Emulator::set_sticky_actions).
+    ///
+    /// @param probability the probability in [0, 1] (0 to disable)
+    ///
+    void set_sticky_actions(double probability);
+
+    /// Set the maximal number of no-op frames after a reset of every
+    /// emulator (see Emulator::set_max_noops).
+    ///
+    /// @param frames the maximal number of no-op frames (0 to disable)
+    ///
+    void set_max_noops(int frames);
+
+    /// Seed the generators of the emulators, each with its own stream.
+    ///
+    /// @param seed the seed of the generators
+    /// @param first_stream the stream of the first emulator, e.g., when the
+    ///        batch is a slice of a larger one
+    ///
+    void seed(uint64_t seed, uint64_t first_stream = 0);
+
+    /// Save the current state of every emulator as its start state.
+    void backup();
+
+    /// Return the bytes of memory the batch uses by component, i.e., the
+    /// sum over its emulators and its own screens, RAM, and frame stacks.
+    /// Buffers owned by the caller are not included.
+    MemoryFootprint get_memory_footprint() const;
+
+    /// Reset every emulator to its start state (or power it on if there is
+    /// no start state) and start new episodes.
+    void reset();
+
+    /// Step every emulator with an action, resetting the emulators whose
+    /// episodes end. With worker threads, the emulators are stepped in
+    /// parallel.
+    ///
+    /// @param actions the action of each emulator, i.e., an index in its
+    ///        action table or the joypad byte of the first controller
+    /// @param frames the number of frames to hold the actions for
+    /// @return false if a step of step_async is in flight (nothing steps)
+    ///
+    bool step(const int32_t* actions, int frames = 1);
+
+    /// Set the number of worker threads that step the emulators. No step
+    /// may be in flight.
+    ///
+    /// @param threads the number of worker threads (0 to step the emulators
+    ///        on the calling thread)
+    ///
+    void set_threads(int threads);
+
+    /// Return the number of worker threads.
+    inline int get_threads() const { return workers.size(); }
+
+    /// Start steps of some emulators and return without waiting for them
+    /// (see `poll`, `wait_any`, and `wait_all`). The screens, results, and
+    /// flags of an emulator must not be read while its step is in flight.
+    /// Without worker threads, the steps finish before this returns. The
+    /// methods of the batch must be called from a single thread, and the
+    /// other methods only when no step is in flight.
+    ///
+    /// @param actions the action of each emulator to step
+    /// @param indexes the indexes of the emulators to step, or nullptr for
+    ///        all of them in order
+    /// @param count the number of emulators to step
+    /// @param frames the number of frames to hold the actions for
+    /// @return false if an index is invalid or in flight (nothing starts)
+    ///
+    bool step_async(const int32_t* actions, const int32_t* indexes, int count, int frames = 1);
+
+    /// Collect the emulators whose steps finished without waiting.
+    ///
+    /// @param ready the buffer to write the indexes of the emulators to
+    /// @param max the number of indexes the buffer holds
+    /// @return the number of indexes written
+    ///
+    int poll(int32_t* ready, int max);
+
+    /// Wait until a step finishes and collect the emulators whose steps
+    /// finished.
+    ///
+    /// @param ready the buffer to write the indexes of the emulators to
+    /// @param max the number of indexes the buffer holds
+    /// @return the number of indexes written (0 if no step is in flight)
+    ///
+    int wait_any(int32_t* ready, int max);
+
+    /// Wait until every step finishes and collect the emulators.
+    ///
+    /// @param ready the buffer to write the indexes of the emulators to
+    /// @param max the number of indexes the buffer holds, the wait stops
+    ///        early if it fills up
+    /// @return the number of indexes written
+    ///
+    int wait_all(int32_t* ready, int max);
+
+    /// Return the number of steps in flight.
+    inline int get_in_flight() const { return in_flight; }
+
+    /// Return the number of bytes of the screen of an emulator.
+    inline std::size_t get_screen_size() const { return screen_size(pixel_format); }
+
+    /// Return a pointer to the screens of the emulators.
+    inline NES_Byte* get_screens() {
+        return screen_buffer ? screen_buffer : screens.data();
+    }
+
+    /// Return a pointer to the final screens of the episodes that ended.
+    inline NES_Byte* get_final_screens() {
+        return final_screen_buffer ? final_screen_buffer : final_screens.data();
+    }
+
+    /// Return a pointer to the RAM of the emulators, one row of 2KB after
+    /// another.
+    inline NES_Byte* get_ram() { return ram_buffer ? ram_buffer : ram.get(); }
+
+    /// Return a pointer to the frame stack rings of the emulators.
+    inline NES_Byte* get_frame_stacks() {
+        return frame_stack_buffer ? frame_stack_buffer : frame_stacks.data();
+    }
+
+    /// Return a pointer to the slot of the oldest frame of the stack of
+    /// each emulator.
+    inline int32_t* get_frame_stack_offsets() { return frame_stack_offsets.data(); }
+
+    /// Return the number of RAM watch results per emulator.
+    inline int get_watch_size() const { return watch_size; }
+
+    /// Return a pointer to the RAM watch results of the emulators.
+    inline double* get_results() { return results.data(); }
+
+    /// Return a pointer to the terminated flags of the emulators.
+    inline NES_Byte* get_terminated() { return terminated.data(); }
+
+    /// Return a pointer to the truncated flags of the emulators.
+    inline NES_Byte* get_truncated() { return truncated.data(); }
+
+    /// Return a pointer to the statistics of the current episodes.
+    inline EpisodeStats* get_episodes() { return episodes.data(); }
+
+    /// Return a pointer to the statistics of the last episode that ended
+    /// for each emulator, i.e., of the episodes flagged by the last step.
+    inline EpisodeStats* get_final_episodes() { return final_episodes.data(); }
+};
+
+}  // namespace NES
+
+#endif  // BATCH_HPP
@@ -11,6 +11,7 @@
 #include <vector>
 #include <string>
 #include "common.hpp"
+#include "footprint.hpp"
 
 namespace NES {
 
@@ -27,13 +28,16 @@ class Cartridge : public Serializable {
     NES_Byte mapper_number;
     /// whether this cartridge uses extended RAM
     bool has_extended_ram;
+    /// the share of the ROM in the ROM store of the process
+    MemoryAccount account;
 
  public:
     /// Initialize a new cartridge
     Cartridge() :
         name_table_mirroring(0),
         mapper_number(0),
-        has_extended_ram(false) { }
+        has_extended_ram(false),
+        account(ROM_STORE) { }
     
     /// Return the ROM data.
     const inline std::vector<NES_Byte>& getROM() { return prg_rom; }
@@ -53,6 +57,11 @@ class Cartridge : public Serializable {
     /// Load a ROM file into the cartridge and build the corresponding mapper.
     void loadFromFile(std::string path);
 
+    /// Return the bytes of the PRG and CHR ROM.
+    inline std::size_t get_memory_size() const {
+        return vector_bytes(prg_rom) + vector_bytes(chr_rom);
+    }
+
 
     /// Serializable
     void serialize(std::vector<uint8_t>& buffer) override;
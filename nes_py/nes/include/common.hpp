@@ -14,6 +14,7 @@
 #include <vector>
 #include <span>
 #include <cstdint>
+#include <stdexcept>
 #include <type_traits>
 
 namespace NES {
@@ -25,6 +26,12 @@ typedef uint16_t NES_Address;
 /// A shortcut for a single pixel in memory
 typedef uint32_t NES_Pixel;
 
+/// An error raised while deserializing a state that is truncated or does not
+/// fit the emulator it is loaded into
+struct StateError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
 class Serializable {
 public:
     virtual void serialize(std::vector<uint8_t>& buffer) = 0;
@@ -32,6 +39,9 @@ public:
 protected:
     static void serialize_vector(const std::vector<uint8_t>& value, std::vector<uint8_t>& buffer);
     static std::span<uint8_t> deserialize_vector(std::span<uint8_t> buffer, std::vector<uint8_t>& value);
+    /// Read a vector written by serialize_vector into storage of a fixed
+    /// size, raising a StateError if the serialized size differs.
+    static std::span<uint8_t> deserialize_bytes(std::span<uint8_t> buffer, uint8_t* data, std::size_t size);
     static void serialize_bool(bool value, std::vector<uint8_t>& buffer); 
     static void deserialize_bool(std::span<uint8_t>& buffer, bool& value);
 };
@@ -50,6 +60,8 @@ template<typename T>
 inline void deserialize_int(std::span<uint8_t>& buffer, T& value) {
     static_assert(std::is_integral<T>::value, "T must be an integral type");
     using UnsignedT = std::make_unsigned_t<T>;
+    if (buffer.size() < sizeof(UnsignedT))
+        throw StateError("the state is truncated");
     UnsignedT unsigned_value = 0;
     for (size_t i = 0; i < sizeof(UnsignedT); i++) {
         unsigned_value |= static_cast<UnsignedT>(buffer[0]) << (i * 8);
@@ -0,0 +1,71 @@
+//  Program:      nes-py
+//  File:         counter_rng.hpp
+//  Description:  A seedable counter-based random number generator
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef COUNTER_RNG_HPP
+#define COUNTER_RNG_HPP
+
+#include <cstdint>
+
+namespace NES {
+
+/// A counter-based random number generator. The n-th number of a stream is
+/// a hash of the key of the stream and n, so streams of different seeds
+/// (or of different emulators with the same seed) are independent and the
+/// generator is just two words of state.
+class CounterRNG {
+ private:
+    /// the golden ratio increment of splitmix64
+    static const uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ull;
+    /// the key of the stream, a hash of the seed and the stream index
+    uint64_t key;
+    /// the number of numbers drawn from the stream
+    uint64_t counter;
+
+    /// Return the splitmix64 finalizer of a word.
+    ///
+    /// @param x the word to mix
+    /// @return a hash of the word
+    ///
+    static inline uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+ public:
+    /// Initialize a new generator with the first stream of seed 0.
+    CounterRNG() { seed(0); }
+
+    /// Restart the generator at the beginning of a stream.
+    ///
+    /// @param seed the seed of the stream
+    /// @param stream the index of the stream, e.g., of an emulator in a batch
+    ///
+    inline void seed(uint64_t seed, uint64_t stream = 0) {
+        key = mix(mix(seed) + stream * GOLDEN_GAMMA);
+        counter = 0;
+    }
+
+    /// Return the next 64 random bits of the stream.
+    inline uint64_t next() { return mix(key + ++counter * GOLDEN_GAMMA); }
+
+    /// Return the next random number of the stream in [0, 1).
+    inline double uniform() { return (next() >> 11) * 0x1.0p-53; }
+
+    /// Return the next random integer of the stream in [0, bound].
+    ///
+    /// @param bound the maximal integer to return
+    /// @return a random integer in [0, bound]
+    ///
+    inline uint64_t up_to(uint64_t bound) {
+        return static_cast<uint64_t>(uniform() * (bound + 1));
+    }
+};
+
+}  // namespace NES
+
+#endif  // COUNTER_RNG_HPP
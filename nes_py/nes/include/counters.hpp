@@ -0,0 +1,152 @@
+//  Program:      nes-py
+//  File:         counters.hpp
+//  Description:  Optional counters of the traffic on the hot paths
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef COUNTERS_HPP
+#define COUNTERS_HPP
+
+#include "common.hpp"
+
+namespace NES {
+
+// The counters are compiled out unless the library is built with
+// NES_COUNTERS defined (`scons counters=1` or NES_PY_COUNTERS=1 for
+// setup.py), so the default build pays nothing for them.
+#ifdef NES_COUNTERS
+/// Run a statement that updates the hot-path counters
+#define NES_COUNT(statement) do { statement; } while (0)
+#else
+/// Discard a statement that updates the hot-path counters
+#define NES_COUNT(statement) do { } while (0)
+#endif
+
+/// Return true if the library counts the traffic on the hot paths.
+inline constexpr bool counters_enabled() {
+#ifdef NES_COUNTERS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// The regions of the address space of the main bus
+enum BusRegion {
+    /// the 2KB of RAM and its mirrors ($0000-$1FFF)
+    BUS_RAM,
+    /// the PPU registers and their mirrors ($2000-$3FFF)
+    BUS_PPU_REGISTERS,
+    /// the APU and IO registers other than the joypads ($4000-$401F)
+    BUS_APU_IO,
+    /// the joypad registers ($4016-$4017)
+    BUS_JOYPAD,
+    /// the expansion ROM ($4020-$5FFF)
+    BUS_EXPANSION,
+    /// the PRG-RAM of the cartridge ($6000-$7FFF)
+    BUS_PRG_RAM,
+    /// the PRG-ROM of the cartridge and the mapper registers ($8000-$FFFF)
+    BUS_PRG_ROM,
+    NUM_BUS_REGIONS,
+};
+
+/// The regions of the address space of the picture bus
+enum PictureRegion {
+    /// the pattern tables in the CHR of the cartridge ($0000-$1FFF)
+    PICTURE_PATTERN_TABLES,
+    /// the name and attribute tables in VRAM ($2000-$3EFF)
+    PICTURE_NAME_TABLES,
+    /// the palette RAM ($3F00-$3FFF, and the reads of the renderer)
+    PICTURE_PALETTE,
+    NUM_PICTURE_REGIONS,
+};
+
+/// The number of IO registers with callbacks, the 8 PPU registers then
+/// OAMDMA ($4014), $4015, JOY1 ($4016), and JOY2 ($4017)
+const int NUM_IO_REGISTERS = 12;
+
+/// Return the region of the main bus of an address.
+///
+/// @param address the address on the main bus
+/// @return the region the address belongs to
+///
+inline BusRegion bus_region(NES_Address address) {
+    if (address < 0x2000) return BUS_RAM;
+    if (address < 0x4000) return BUS_PPU_REGISTERS;
+    if (address == 0x4016 || address == 0x4017) return BUS_JOYPAD;
+    if (address < 0x4020) return BUS_APU_IO;
+    if (address < 0x6000) return BUS_EXPANSION;
+    if (address < 0x8000) return BUS_PRG_RAM;
+    return BUS_PRG_ROM;
+}
+
+/// Return the region of the picture bus of an address.
+///
+/// @param address the address on the picture bus
+/// @return the region the address belongs to
+///
+inline PictureRegion picture_region(NES_Address address) {
+    if (address < 0x2000) return PICTURE_PATTERN_TABLES;
+    if (address < 0x3f00) return PICTURE_NAME_TABLES;
+    return PICTURE_PALETTE;
+}
+
+/// Return the index of the counters of an IO register.
+///
+/// @param address the address of the register (after mirroring)
+/// @return the index of the register in [0, NUM_IO_REGISTERS)
+///
+inline int io_register_index(NES_Address address) {
+    return address < 0x4000 ? address & 0x7 : 8 + ((address - 0x4014) & 0x3);
+}
+
+/// Counters of the traffic on the hot paths of an emulator
+struct HotPathCounters {
+    /// the reads of the main bus by region
+    uint64_t bus_reads[NUM_BUS_REGIONS];
+    /// the writes of the main bus by region
+    uint64_t bus_writes[NUM_BUS_REGIONS];
+    /// the reads of the picture bus by region
+    uint64_t picture_reads[NUM_PICTURE_REGIONS];
+    /// the writes of the picture bus by region
+    uint64_t picture_writes[NUM_PICTURE_REGIONS];
+    /// the invocations of the read callback of each IO register
+    uint64_t register_reads[NUM_IO_REGISTERS];
+    /// the invocations of the write callback of each IO register
+    uint64_t register_writes[NUM_IO_REGISTERS];
+    /// the OAM DMA transfers
+    uint64_t oam_dmas;
+    /// the non-maskable interrupts from the PPU
+    uint64_t nmis;
+    /// the writes to the registers of the mapper
+    uint64_t mapper_writes;
+
+    /// Add other counters to these.
+    ///
+    /// @param other the counters to add
+    /// @return a reference to these counters
+    ///
+    inline HotPathCounters& operator+=(const HotPathCounters& other) {
+        for (int i = 0; i < NUM_BUS_REGIONS; i++) {
+            bus_reads[i] += other.bus_reads[i];
+            bus_writes[i] += other.bus_writes[i];
+        }
+        for (int i = 0; i < NUM_PICTURE_REGIONS; i++) {
+            picture_reads[i] += other.picture_reads[i];
+            picture_writes[i] += other.picture_writes[i];
+        }
+        for (int i = 0; i < NUM_IO_REGISTERS; i++) {
+            register_reads[i] += other.register_reads[i];
+            register_writes[i] += other.register_writes[i];
+        }
+        oam_dmas += other.oam_dmas;
+        nmis += other.nmis;
+        mapper_writes += other.mapper_writes;
+        return *this;
+    }
+};
+
+}  // namespace NES
+
+#endif  // COUNTERS_HPP
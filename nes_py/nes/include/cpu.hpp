@@ -10,7 +10,9 @@
 
 #include "common.hpp"
 #include "cpu_opcodes.hpp"
+#include "cpu_trace.hpp"
 #include "main_bus.hpp"
+#include "profiler.hpp"
 
 namespace NES {
 
@@ -33,6 +35,18 @@ class CPU : public Serializable {
     int skip_cycles;
     /// The number of cycles the CPU has run
     int cycles;
+    /// The profiler to report instructions and interrupts to (if any)
+    Profiler* profiler = nullptr;
+    /// The trace to record instructions to (if any)
+    CpuTrace* trace = nullptr;
+
+    /// Record an instruction to the trace before it executes.
+    ///
+    /// @param bus the bus to read the operand bytes from
+    /// @param address the address of the instruction
+    /// @param opcode the opcode of the instruction
+    ///
+    void trace_instruction(MainBus &bus, NES_Address address, NES_Byte opcode);
 
     /// Set the zero and negative flags based on the given value.
     ///
@@ -159,6 +173,18 @@ class CPU : public Serializable {
     ///
     void cycle(MainBus &bus);
 
+    /// Set the profiler to report the instructions and interrupts to.
+    ///
+    /// @param profiler the profiler, or nullptr to stop profiling
+    ///
+    inline void set_profiler(Profiler* profiler) { this->profiler = profiler; }
+
+    /// Set the trace to record the instructions to.
+    ///
+    /// @param trace the trace, or nullptr to stop tracing
+    ///
+    inline void set_trace(CpuTrace* trace) { this->trace = trace; }
+
     /// Skip DMA cycles.
     ///
     /// 513 = 256 read + 256 write + 1 dummy read
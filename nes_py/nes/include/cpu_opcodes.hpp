@@ -154,6 +154,93 @@ const NES_Byte OPERATION_CYCLES[0x100] = {
     2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
 };
 
+/// a mapping of opcodes to their assembly mnemonics. "???" implies an unused
+/// opcode.
+const char* const OPERATION_MNEMONICS[0x100] = {
+    "BRK", "ORA", "???", "???", "???", "ORA", "ASL", "???", "PHP", "ORA", "ASL", "???", "???", "ORA", "ASL", "???",
+    "BPL", "ORA", "???", "???", "???", "ORA", "ASL", "???", "CLC", "ORA", "???", "???", "???", "ORA", "ASL", "???",
+    "JSR", "AND", "???", "???", "BIT", "AND", "ROL", "???", "PLP", "AND", "ROL", "???", "BIT", "AND", "ROL", "???",
+    "BMI", "AND", "???", "???", "???", "AND", "ROL", "???", "SEC", "AND", "???", "???", "???", "AND", "ROL", "???",
+    "RTI", "EOR", "???", "???", "???", "EOR", "LSR", "???", "PHA", "EOR", "LSR", "???", "JMP", "EOR", "LSR", "???",
+    "BVC", "EOR", "???", "???", "???", "EOR", "LSR", "???", "CLI", "EOR", "???", "???", "???", "EOR", "LSR", "???",
+    "RTS", "ADC", "???", "???", "???", "ADC", "ROR", "???", "PLA", "ADC", "ROR", "???", "JMP", "ADC", "ROR", "???",
+    "BVS", "ADC", "???", "???", "???", "ADC", "ROR", "???", "SEI", "ADC", "???", "???", "???", "ADC", "ROR", "???",
+    "???", "STA", "???", "???", "STY", "STA", "STX", "???", "DEY", "???", "TXA", "???", "STY", "STA", "STX", "???",
+    "BCC", "STA", "???", "???", "STY", "STA", "STX", "???", "TYA", "STA", "TXS", "???", "???", "STA", "???", "???",
+    "LDY", "LDA", "LDX", "???", "LDY", "LDA", "LDX", "???", "TAY", "LDA", "TAX", "???", "LDY", "LDA", "LDX", "???",
+    "BCS", "LDA", "???", "???", "LDY", "LDA", "LDX", "???", "CLV", "LDA", "TSX", "???", "LDY", "LDA", "LDX", "???",
+    "CPY", "CMP", "???", "???", "CPY", "CMP", "DEC", "???", "INY", "CMP", "DEX", "???", "CPY", "CMP", "DEC", "???",
+    "BNE", "CMP", "???", "???", "???", "CMP", "DEC", "???", "CLD", "CMP", "???", "???", "???", "CMP", "DEC", "???",
+    "CPX", "SBC", "???", "???", "CPX", "SBC", "INC", "???", "INX", "SBC", "NOP", "SBC", "CPX", "SBC", "INC", "???",
+    "BEQ", "SBC", "???", "???", "???", "SBC", "INC", "???", "SED", "SBC", "???", "???", "???", "SBC", "INC", "???",
+};
+
+/// The addressing modes of the opcodes, which give the number of operand
+/// bytes of an instruction and the syntax of its operand
+enum AddressingMode : NES_Byte {
+    /// implied, no operand
+    MODE_IMP,
+    /// the accumulator, e.g., `ASL A`
+    MODE_ACC,
+    /// an immediate byte, e.g., `LDA #$01`
+    MODE_IMM,
+    /// a zero page address, e.g., `LDA $10`
+    MODE_ZP,
+    /// a zero page address indexed by X, e.g., `LDA $10,X`
+    MODE_ZPX,
+    /// a zero page address indexed by Y, e.g., `LDX $10,Y`
+    MODE_ZPY,
+    /// an absolute address, e.g., `LDA $0200`
+    MODE_ABS,
+    /// an absolute address indexed by X, e.g., `LDA $0200,X`
+    MODE_ABX,
+    /// an absolute address indexed by Y, e.g., `LDA $0200,Y`
+    MODE_ABY,
+    /// an indirect address, e.g., `JMP ($0200)`
+    MODE_IND,
+    /// a zero page pointer indexed by X, e.g., `LDA ($10,X)`
+    MODE_IZX,
+    /// a zero page pointer indexed by Y after it is read, e.g., `LDA ($10),Y`
+    MODE_IZY,
+    /// a signed offset from the next instruction, e.g., `BNE $C010`
+    MODE_REL,
+};
+
+/// a mapping of opcodes to their addressing modes. Unused opcodes are
+/// implied.
+const AddressingMode OPERATION_MODES[0x100] = {
+    MODE_IMP, MODE_IZX, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZP,  MODE_ZP,  MODE_IMP, MODE_IMP, MODE_IMM, MODE_ACC, MODE_IMP, MODE_IMP, MODE_ABS, MODE_ABS, MODE_IMP,
+    MODE_REL, MODE_IZY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZPX, MODE_ZPX, MODE_IMP, MODE_IMP, MODE_ABY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ABX, MODE_ABX, MODE_IMP,
+    MODE_ABS, MODE_IZX, MODE_IMP, MODE_IMP, MODE_ZP,  MODE_ZP,  MODE_ZP,  MODE_IMP, MODE_IMP, MODE_IMM, MODE_ACC, MODE_IMP, MODE_ABS, MODE_ABS, MODE_ABS, MODE_IMP,
+    MODE_REL, MODE_IZY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZPX, MODE_ZPX, MODE_IMP, MODE_IMP, MODE_ABY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ABX, MODE_ABX, MODE_IMP,
+    MODE_IMP, MODE_IZX, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZP,  MODE_ZP,  MODE_IMP, MODE_IMP, MODE_IMM, MODE_ACC, MODE_IMP, MODE_ABS, MODE_ABS, MODE_ABS, MODE_IMP,
+    MODE_REL, MODE_IZY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZPX, MODE_ZPX, MODE_IMP, MODE_IMP, MODE_ABY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ABX, MODE_ABX, MODE_IMP,
+    MODE_IMP, MODE_IZX, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZP,  MODE_ZP,  MODE_IMP, MODE_IMP, MODE_IMM, MODE_ACC, MODE_IMP, MODE_IND, MODE_ABS, MODE_ABS, MODE_IMP,
+    MODE_REL, MODE_IZY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZPX, MODE_ZPX, MODE_IMP, MODE_IMP, MODE_ABY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ABX, MODE_ABX, MODE_IMP,
+    MODE_IMP, MODE_IZX, MODE_IMP, MODE_IMP, MODE_ZP,  MODE_ZP,  MODE_ZP,  MODE_IMP, MODE_IMP, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ABS, MODE_ABS, MODE_ABS, MODE_IMP,
+    MODE_REL, MODE_IZY, MODE_IMP, MODE_IMP, MODE_ZPX, MODE_ZPX, MODE_ZPY, MODE_IMP, MODE_IMP, MODE_ABY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ABX, MODE_IMP, MODE_IMP,
+    MODE_IMM, MODE_IZX, MODE_IMM, MODE_IMP, MODE_ZP,  MODE_ZP,  MODE_ZP,  MODE_IMP, MODE_IMP, MODE_IMM, MODE_IMP, MODE_IMP, MODE_ABS, MODE_ABS, MODE_ABS, MODE_IMP,
+    MODE_REL, MODE_IZY, MODE_IMP, MODE_IMP, MODE_ZPX, MODE_ZPX, MODE_ZPY, MODE_IMP, MODE_IMP, MODE_ABY, MODE_IMP, MODE_IMP, MODE_ABX, MODE_ABX, MODE_ABY, MODE_IMP,
+    MODE_IMM, MODE_IZX, MODE_IMP, MODE_IMP, MODE_ZP,  MODE_ZP,  MODE_ZP,  MODE_IMP, MODE_IMP, MODE_IMM, MODE_IMP, MODE_IMP, MODE_ABS, MODE_ABS, MODE_ABS, MODE_IMP,
+    MODE_REL, MODE_IZY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZPX, MODE_ZPX, MODE_IMP, MODE_IMP, MODE_ABY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ABX, MODE_ABX, MODE_IMP,
+    MODE_IMM, MODE_IZX, MODE_IMP, MODE_IMP, MODE_ZP,  MODE_ZP,  MODE_ZP,  MODE_IMP, MODE_IMP, MODE_IMM, MODE_IMP, MODE_IMM, MODE_ABS, MODE_ABS, MODE_ABS, MODE_IMP,
+    MODE_REL, MODE_IZY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ZPX, MODE_ZPX, MODE_IMP, MODE_IMP, MODE_ABY, MODE_IMP, MODE_IMP, MODE_IMP, MODE_ABX, MODE_ABX, MODE_IMP,
+};
+
+/// Return the number of bytes of an instruction, i.e., its opcode and its
+/// operand.
+///
+/// @param opcode the opcode of the instruction
+/// @return the number of bytes of the instruction, from 1 to 3
+///
+inline int operation_length(NES_Byte opcode) {
+    switch (OPERATION_MODES[opcode]) {
+        case MODE_IMP: case MODE_ACC: return 1;
+        case MODE_ABS: case MODE_ABX: case MODE_ABY: case MODE_IND: return 3;
+        default: return 2;
+    }
+}
+
 }  // namespace NES
 
 #endif  // CPU_OPCODES_HPP
@@ -0,0 +1,151 @@
+//  Program:      nes-py
+//  File:         cpu_trace.hpp
+//  Description:  A binary trace of the instructions the CPU executes
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef CPU_TRACE_HPP
+#define CPU_TRACE_HPP
+
+#include <string>
+#include <vector>
+#include "common.hpp"
+#include "footprint.hpp"
+#include "ppu.hpp"
+
+namespace NES {
+
+/// An instruction of the trace with the registers before it executed
+struct CpuTraceRecord {
+    /// the CPU cycles since the last reset before the instruction
+    uint32_t cycle;
+    /// the address of the instruction
+    uint16_t pc;
+    /// the dot of the scanline the PPU was on
+    uint16_t dot;
+    /// the scanline the PPU was on (261 for the pre-render scanline)
+    uint16_t scanline;
+    /// the opcode of the instruction
+    NES_Byte opcode;
+    /// the operand bytes of the instruction (0 past its length)
+    NES_Byte operand[2];
+    /// the A register
+    NES_Byte a;
+    /// the X register
+    NES_Byte x;
+    /// the Y register
+    NES_Byte y;
+    /// the flags register
+    NES_Byte p;
+    /// the stack pointer register
+    NES_Byte sp;
+    /// the number of bytes of the instruction, from 1 to 3
+    NES_Byte length;
+    /// unused, keeps the record at a fixed size without padding
+    NES_Byte reserved;
+};
+
+static_assert(sizeof(CpuTraceRecord) == 20, "trace records have a fixed size");
+
+/// A ring of the last instructions the CPU executed, written with fixed-size
+/// records and dumped to a binary file that format_cpu_trace turns into a
+/// nestest-style log offline.
+class CpuTrace {
+ private:
+    /// the last records, the ring has a power of two of them
+    std::vector<CpuTraceRecord> records;
+    /// the number of records ever written
+    uint64_t head;
+    /// the PPU whose position is recorded with the instructions (if any)
+    const PPU* ppu;
+
+ public:
+    /// The number of records of a ring by default (1.25MB)
+    static constexpr std::size_t DEFAULT_CAPACITY = 1 << 16;
+
+    /// Initialize a new empty trace.
+    ///
+    /// @param capacity the number of records of the ring, rounded up to a
+    ///        power of two
+    ///
+    explicit CpuTrace(std::size_t capacity = DEFAULT_CAPACITY);
+
+    /// Set the PPU whose position is recorded with the instructions.
+    ///
+    /// @param ppu the PPU of the emulator, or nullptr to record 0
+    ///
+    inline void set_ppu(const PPU* ppu) { this->ppu = ppu; }
+
+    /// Write a record, overwriting the oldest one if the ring is full.
+    ///
+    /// @param record the record of the instruction, the position of the PPU
+    ///        is filled in
+    ///
+    inline void record(CpuTraceRecord record) {
+        if (ppu) {
+            record.dot = ppu->get_dot();
+            record.scanline = ppu->get_scanline();
+        }
+        records[head++ & (records.size() - 1)] = record;
+    }
+
+    /// Remove every record.
+    inline void clear() { head = 0; }
+
+    /// Return the number of records of the ring.
+    inline std::size_t get_capacity() const { return records.size(); }
+
+    /// Return the number of records held, at most the capacity.
+    inline std::size_t size() const {
+        return head < records.size() ? head : records.size();
+    }
+
+    /// Return the number of records ever written, including overwritten ones.
+    inline uint64_t get_written() const { return head; }
+
+    /// Return the bytes of the ring.
+    inline std::size_t get_memory_size() const { return vector_bytes(records); }
+
+    /// Copy the records from the oldest to the latest.
+    ///
+    /// @param output the buffer to copy the records to
+    /// @param max the number of records the buffer holds, the latest ones are
+    ///        copied if it holds fewer than size()
+    /// @return the number of records copied
+    ///
+    std::size_t copy(CpuTraceRecord* output, std::size_t max) const;
+
+    /// Write the records from the oldest to the latest to a binary file, a
+    /// header of the magic "NESCPUTR", the version, and the size of a record
+    /// (both uint32) followed by the records.
+    ///
+    /// @param path the path of the file to write
+    /// @param error the string to write a description of an error to
+    /// @return true if the file was written, false otherwise
+    ///
+    bool dump(const std::string& path, std::string& error) const;
+};
+
+/// Format a record as a line of a nestest log, i.e., the address, the
+/// bytes, and the disassembly of the instruction, the registers, the
+/// scanline and dot of the PPU, and the CPU cycle. The values of memory
+/// operands (`= 00`) are not part of the trace, so they are left out.
+///
+/// @param record the record to format
+/// @return the line without a newline
+///
+std::string format_cpu_record(const CpuTraceRecord& record);
+
+/// Format a binary trace file as a nestest-style log.
+///
+/// @param trace_path the path of the trace written by CpuTrace::dump
+/// @param log_path the path of the log to write
+/// @param error the string to write a description of an error to
+/// @return true if the log was written, false otherwise
+///
+bool format_cpu_trace(const std::string& trace_path, const std::string& log_path, std::string& error);
+
+}  // namespace NES
+
+#endif  // CPU_TRACE_HPP
@@ -8,14 +8,25 @@
 #ifndef EMULATOR_HPP
 #define EMULATOR_HPP
 
+#include <chrono>
+#include <memory>
 #include <string>
 #include "common.hpp"
 #include "cartridge.hpp"
 #include "controller.hpp"
+#include "counters.hpp"
+#include "counter_rng.hpp"
 #include "cpu.hpp"
+#include "cpu_trace.hpp"
+#include "footprint.hpp"
+#include "frame_stack.hpp"
+#include "latency.hpp"
 #include "ppu.hpp"
+#include "profiler.hpp"
 #include "main_bus.hpp"
 #include "picture_bus.hpp"
+#include "ram_watch.hpp"
+#include "trace.hpp"
 
 namespace NES {
 
@@ -24,19 +35,52 @@ struct SavedState {
     PictureBus picture_bus;
     CPU cpu;
     PPU ppu;
+    /// the share of the state in the snapshot pool of the process
+    MemoryAccount account{SNAPSHOT_POOL};
+
+    /// Return the bytes of the state, including its copy of the screen.
+    inline std::size_t get_memory_size() const {
+        return sizeof(SavedState) + bus.get_memory_size() + picture_bus.get_memory_size()
+            + ppu.get_memory_size() + ppu.get_screen_memory_size();
+    }
+};
+
+/// The statistics of an episode, accumulated by the emulator after each
+/// step from the results of its RAM watch
+struct EpisodeStats {
+    /// the sum of the rewards of the steps of the episode
+    double episode_return;
+    /// the maximum of the `progress` entry of the RAM watch over the
+    /// episode (0 without such an entry)
+    double max_progress;
+    /// the wall-clock seconds from the start of the episode to its last step
+    double seconds;
+    /// the number of steps of the episode
+    uint64_t length;
+    /// the number of frames of the steps of the episode
+    uint64_t frames;
 };
 
 /// An NES Emulator and OpenAI Gym interface
 class Emulator : public Serializable{
  private:
-    /// The number of cycles in 1 frame
-    static const int CYCLES_PER_FRAME = 29781;
     /// the virtual cartridge with ROM and mapper data
     Cartridge cartridge;
     /// the mapper
     Mapper* mapper;
     /// the 2 controllers on the emulator
     Controller controllers[2];
+    /// the joypad bytes of both controllers for each discrete action
+    std::vector<NES_Byte> action_table;
+    /// the probability of repeating the buttons of the last frame instead
+    /// of pressing the buttons of the current action
+    double sticky_probability;
+    /// the joypad bytes of both controllers pressed in the last frame
+    NES_Byte sticky_buttons[2];
+    /// the maximal number of frames without input after a reset
+    int max_noops;
+    /// the generator of the sticky actions and no-op starts
+    CounterRNG rng;
 
     /// the main data bus of the emulator
     MainBus bus;
@@ -49,10 +93,62 @@ class Emulator : public Serializable{
 
     SavedState savedState;
 
+    /// the expressions over RAM evaluated after each frame
+    RamWatch watch;
+    /// the last frames of the screen, pushed at the end of each step
+    FrameStack frame_stack;
+    /// the index of the `progress` entry of the RAM watch (-1 for none)
+    int progress_index;
+    /// the statistics of the current episode
+    EpisodeStats episode;
+    /// the statistics of the last episode that a reset or restore ended
+    EpisodeStats final_episode;
+    /// the time the current episode started
+    std::chrono::steady_clock::time_point episode_start;
+    /// the hot-path counters of the frame that is running
+    HotPathCounters counters;
+    /// the hot-path counters of the last frame that ran
+    HotPathCounters frame_counters;
+    /// the hot-path counters of all the frames since the last reset of them
+    HotPathCounters total_counters;
+    /// the profiler of the emulated code (created when first enabled)
+    std::unique_ptr<Profiler> profiler;
+    /// whether the CPU reports to the profiler
+    bool profiling;
+    /// the trace of the instructions of the CPU (created when first enabled)
+    std::unique_ptr<CpuTrace> cpu_trace;
+    /// whether the CPU records to the trace
+    bool cpu_tracing;
+
     /// @brief setup the callbacks for the internal
     void setup_callbacks();
 
+    /// Copy the state of the emulator into a saved state and account it in
+    /// the snapshot pool.
+    ///
+    /// @param state the saved state to copy to
+    ///
+    void save_state(SavedState& state);
+
+    /// Run the CPU and PPU for a single frame.
+    void run_frame();
+
+    /// Run frames with the buttons on the controllers, applying sticky
+    /// actions and the RAM watch, only rendering the frames that make up
+    /// the screen after the last one.
+    ///
+    /// @param frames the number of frames to run
+    ///
+    void run_frames(int frames);
+
+    /// Start an episode after a reset or restore, releasing the buttons and
+    /// running a random number of frames without input. The statistics of
+    /// the episode that ends are kept as the final ones if it had a step.
+    void start_episode();
+
  public:
+    /// The number of cycles in 1 frame
+    static const int CYCLES_PER_FRAME = 29781;
     /// The width of the NES screen in pixels
     static const int WIDTH = SCANLINE_VISIBLE_DOTS;
     /// The height of the NES screen in pixels
@@ -65,20 +161,105 @@ class Emulator : public Serializable{
     explicit Emulator(std::string rom_path, bool headless = false);
     virtual ~Emulator() { delete mapper; delete ppu; }
 
-    /// Return a 32-bit pointer to the screen buffer's first address.
+    /// Return a 8-bit pointer to the screen buffer's first address.
+    ///
+    /// @return a 8-bit pointer to the screen buffer's first address, laid
+    /// out in the emulator's pixel format
+    ///
+    inline NES_Byte* get_screen_buffer() {
+        return ppu->get_screen_buffer();
+    }
+
+    /// Render the screen to a caller-owned buffer, e.g., a slot of a batch
+    /// tensor, instead of the PPU's internal screen.
+    ///
+    /// @param data the buffer to render to, or nullptr for the internal one
+    /// @param stride the number of bytes between rows of the buffer, or 0
+    ///        for rows that are packed back to back
+    ///
+    inline void set_screen_buffer(NES_Byte* data, std::size_t stride) {
+        ppu->set_screen_buffer(data, stride);
+    }
+
+    /// Enable or disable double buffering of the screen.
     ///
-    /// @return a 32-bit pointer to the screen buffer's first address
+    /// @param enabled whether to render to a back buffer that is swapped
+    ///        in at the end of each frame
     ///
-    inline NES_Pixel* get_screen_buffer() { 
-        return ppu->get_screen_buffer(); 
+    inline void set_double_buffered(bool enabled) {
+        ppu->set_double_buffered(enabled);
     }
 
+    /// Return the number of frames the PPU has rendered in full.
+    inline uint64_t get_frame_sequence() { return ppu->get_frame_sequence(); }
+
+    /// Return the screen buffer of a frame when double buffering.
+    ///
+    /// @param sequence the frame sequence number of the frame
+    /// @return a pointer to the screen buffer that holds the frame
+    ///
+    inline NES_Byte* get_sequence_buffer(uint64_t sequence) {
+        return ppu->get_sequence_buffer(sequence);
+    }
+
+    /// Return true if the emulator renders frames to the screen.
+    inline bool get_rendering() { return ppu->get_rendering(); }
+
+    /// Enable or disable rendering of frames to the screen. Frames that are
+    /// not observed can skip the pixel work without changing the emulation.
+    ///
+    /// @param enabled whether to render frames to the screen
+    ///
+    inline void set_rendering(bool enabled) { ppu->set_rendering(enabled); }
+
+    /// Return a view of the screen buffer with the latest frame.
+    inline const ScreenView& get_screen_view() { return ppu->get_screen_view(); }
+
+    /// Return the format the screen buffer is stored in.
+    inline PixelFormat get_pixel_format() { return ppu->get_pixel_format(); }
+
+    /// Set the format the screen buffer is stored in.
+    ///
+    /// @param format the pixel format for the PPU to render in
+    /// @return true if the PPU can render in the format, false otherwise
+    ///
+    bool set_pixel_format(PixelFormat format);
+
+    /// Convert the screen buffer to another pixel format. The screen must be
+    /// stored as palette indexes.
+    ///
+    /// @param output the buffer to write screen_size(format) bytes to
+    /// @param format the pixel format to convert the screen to
+    /// @return true if the screen was converted, false otherwise
+    ///
+    bool convert_screen(NES_Byte* output, PixelFormat format);
+
     /// Return a 8-bit pointer to the RAM buffer's first address.
     ///
     /// @return a 8-bit pointer to the RAM buffer's first address
     ///
     inline NES_Byte* get_memory_buffer() { return bus.get_memory_buffer(); }
 
+    /// Store the RAM in a caller-owned buffer, e.g., a row of a batch-wide
+    /// block (see MainBus::set_memory_buffer).
+    ///
+    /// @param data the buffer of 2KB to store the RAM in, or nullptr for the
+    ///        internal storage
+    ///
+    inline void set_memory_buffer(NES_Byte* data) { bus.set_memory_buffer(data); }
+
+    /// Return the CPU of the emulator, e.g., to benchmark it in isolation.
+    inline CPU& get_cpu() { return cpu; }
+
+    /// Return the PPU of the emulator.
+    inline PPU& get_ppu() { return *ppu; }
+
+    /// Return the main bus of the emulator.
+    inline MainBus& get_bus() { return bus; }
+
+    /// Return the picture bus of the emulator.
+    inline PictureBus& get_picture_bus() { return picture_bus; }
+
     /// Return a pointer to a controller port
     ///
     /// @param port the port of the controller to return the pointer to
@@ -88,28 +269,191 @@ class Emulator : public Serializable{
         return controllers[port].get_joypad_buffer();
     }
 
+    /// Set the table of discrete actions.
+    ///
+    /// @param table the joypad bytes of the first and second controller for
+    ///        each action, one action after another
+    /// @param actions the number of actions in the table (0 to remove it)
+    ///
+    inline void set_action_table(const NES_Byte* table, int actions) {
+        action_table.assign(table, table + 2 * actions);
+    }
+
+    /// Return the number of discrete actions in the table.
+    inline int get_action_count() const { return action_table.size() / 2; }
+
+    /// Press the buttons of an action on the controllers. Without an action
+    /// table, the action is the joypad byte of the first controller. Indexes
+    /// outside of the table press no buttons.
+    ///
+    /// @param action the index of the action in the table
+    ///
+    inline void set_action(int32_t action) {
+        if (action_table.empty()) {
+            controllers[0].write_buttons(action);
+        } else if (action < 0 || action >= get_action_count()) {
+            controllers[0].write_buttons(0);
+            controllers[1].write_buttons(0);
+        } else {
+            controllers[0].write_buttons(action_table[2 * action]);
+            controllers[1].write_buttons(action_table[2 * action + 1]);
+        }
+    }
+
+    /// Set the probability of sticky actions, i.e., of repeating the buttons
+    /// of the last frame instead of the buttons of the current action. It is
+    /// drawn for every frame, including the frames of a multi-frame step.
+    ///
+    /// @param probability the probability in [0, 1] (0 to disable)
+    ///
+    inline void set_sticky_actions(double probability) { sticky_probability = probability; }
+
+    /// Set the maximal number of frames without input run after a reset or
+    /// restore. The number is drawn uniformly from [0, frames].
+    ///
+    /// @param frames the maximal number of no-op frames (0 to disable)
+    ///
+    inline void set_max_noops(int frames) { max_noops = frames; }
+
+    /// Seed the generator of the sticky actions and no-op starts. The
+    /// generator is not part of saved states, so restoring a state does not
+    /// replay its draws.
+    ///
+    /// @param seed the seed of the generator
+    /// @param stream the index of the stream, e.g., of an emulator in a batch
+    ///
+    inline void seed(uint64_t seed, uint64_t stream = 0) { rng.seed(seed, stream); }
+
     /// Load the ROM into the NES.
-    inline void reset() { cpu.reset(bus); ppu->reset(); }
+    void reset();
 
     /// Perform a step on the emulator, i.e., a single frame.
-    void step();
+    inline void step() { step(1); }
+
+    /// Perform a number of steps on the emulator, only rendering the steps
+    /// that make up the screen after the last one (the last step, and the
+    /// one before it when double buffering). Frames are not rendered at all
+    /// if rendering is disabled. The RAM watch sums the reward of all the
+    /// steps.
+    ///
+    /// @param steps the number of steps to perform
+    ///
+    void step(int steps);
 
     /// Create a backup state on the emulator.
     inline void backup() {
-        savedState = *save_state();
+        LatencyTimer timer(LATENCY_SNAPSHOT);
+        TraceZone zone("backup");
+        save_state(savedState);
+    }
+
+    /// Restore the backup state on the emulator and start an episode.
+    void restore();
+
+    /// Compile a RAM watch spec that is evaluated after each frame (see
+    /// RamWatch), replacing the current one.
+    ///
+    /// @param spec the text of the watch spec (empty to remove the watch)
+    /// @param error the string to write a description of an error to
+    /// @return true if the spec compiled, false otherwise
+    ///
+    inline bool set_watch(const std::string& spec, std::string& error) {
+        if (!watch.compile(spec, error))
+            return false;
+        watch.prime(get_memory_buffer());
+        progress_index = watch.find("progress");
+        return true;
+    }
+
+    /// Return the RAM watch of the emulator.
+    inline RamWatch& get_watch() { return watch; }
+
+    /// Return the statistics of the current episode.
+    inline const EpisodeStats& get_episode() const { return episode; }
+
+    /// Return the statistics of the last episode that a reset or restore
+    /// ended (zero before the first one).
+    inline const EpisodeStats& get_final_episode() const { return final_episode; }
+
+    /// Keep a stack of the last frames of the screen as luma (see
+    /// FrameStack). A frame is pushed at the end of each step and the stack
+    /// is filled with the screen at the start of each episode, so the
+    /// frames are only current if rendering is enabled.
+    ///
+    /// @param depth the number of frames in the stack (0 to disable it)
+    /// @param downsample the factor to downsample the frames by
+    /// @return true if the shape of the stack is valid, false otherwise
+    ///
+    inline bool set_frame_stack(int depth, int downsample) {
+        frame_stack.set_buffer(nullptr);
+        if (!frame_stack.configure(depth, downsample))
+            return false;
+        frame_stack.fill(get_screen_view());
+        return true;
     }
 
-    /// Restore the backup state on the emulator.
-    inline void restore() {
-        load_state(&savedState);
+    /// Return the frame stack of the emulator.
+    inline FrameStack& get_frame_stack() { return frame_stack; }
+
+    /// Return the hot-path counters of the last frame that ran (zero unless
+    /// the library is built with NES_COUNTERS).
+    inline const HotPathCounters& get_frame_counters() const { return frame_counters; }
+
+    /// Return the hot-path counters of all the frames since the last reset
+    /// of them (zero unless the library is built with NES_COUNTERS).
+    inline const HotPathCounters& get_total_counters() const { return total_counters; }
+
+    /// Zero the hot-path counters.
+    inline void reset_counters() {
+        counters = frame_counters = total_counters = HotPathCounters{};
     }
 
+    /// Enable or disable the profiler of the emulated code (see Profiler).
+    /// The profile is kept when it is disabled, so it can be exported.
+    ///
+    /// @param enabled whether the CPU reports its instructions to it
+    ///
+    void set_profiling(bool enabled);
+
+    /// Return the profiler of the emulated code, or nullptr if it was never
+    /// enabled.
+    inline Profiler* get_profiler() { return profiler.get(); }
+
+    /// Enable or disable the trace of the instructions of the CPU (see
+    /// CpuTrace). The records are kept when it is disabled, so they can be
+    /// dumped.
+    ///
+    /// @param enabled whether the CPU records its instructions to it
+    /// @param capacity the number of records of the ring, which is
+    ///        created anew if it changes (0 to keep the current one)
+    ///
+    void set_cpu_tracing(bool enabled, std::size_t capacity = 0);
+
+    /// Return the trace of the instructions of the CPU, or nullptr if it was
+    /// never enabled.
+    inline CpuTrace* get_cpu_trace() { return cpu_trace.get(); }
+
+    /// Return the bytes of memory the emulator uses by component. Buffers
+    /// owned by the caller, e.g., the slots of a batch, are not included.
+    MemoryFootprint get_memory_footprint() const;
+
     SavedState* save_state();
     void load_state(SavedState* state);
 
     void serialize(std::vector<uint8_t>& buffer) override;
+    /// Load a serialized state, raising a StateError if it is truncated or
+    /// does not fit the emulator, which is left partially loaded.
     std::span<uint8_t> deserialize(std::span<uint8_t> buffer) override;
 
+    /// Load a serialized state, e.g., one from an untrusted source.
+    ///
+    /// @param buffer the state that serialize wrote
+    /// @param error the string to write a description of an error to
+    /// @return true if the state was loaded, false if it is truncated or
+    ///         does not fit the emulator, which keeps its current state
+    ///
+    bool deserialize(std::span<uint8_t> buffer, std::string& error);
+
 
 };
 
@@ -0,0 +1,120 @@
+//  Program:      nes-py
+//  File:         footprint.hpp
+//  Description:  Accounting of the memory the emulators use
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef FOOTPRINT_HPP
+#define FOOTPRINT_HPP
+
+#include <atomic>
+#include <vector>
+#include "common.hpp"
+
+namespace NES {
+
+/// The pools of memory that are totaled over the process
+enum MemoryPool {
+    /// the PRG and CHR ROM of every loaded cartridge
+    ROM_STORE,
+    /// the saved states, i.e., the backups of emulators and the states
+    /// returned by save_state
+    SNAPSHOT_POOL,
+    NUM_MEMORY_POOLS,
+};
+
+/// The bytes of live objects in each pool of the process
+inline std::atomic<int64_t> memory_pool_bytes[NUM_MEMORY_POOLS];
+/// The number of live objects in each pool of the process
+inline std::atomic<int64_t> memory_pool_count[NUM_MEMORY_POOLS];
+
+/// Return the bytes a vector holds, i.e., its capacity.
+///
+/// @param vector the vector to return the bytes of
+/// @return the bytes of the storage of the vector
+///
+template<typename T>
+inline std::size_t vector_bytes(const std::vector<T>& vector) {
+    return vector.capacity() * sizeof(T);
+}
+
+/// The share of an object in a pool, which it leaves when it is destroyed.
+/// Copies of the object start outside of the pool until they are accounted.
+class MemoryAccount {
+ private:
+    /// the pool of the object
+    MemoryPool pool;
+    /// the bytes the object has in the pool (0 for none)
+    int64_t bytes;
+
+ public:
+    /// Initialize the share of an object that is not in the pool yet.
+    ///
+    /// @param pool the pool of the object
+    ///
+    explicit MemoryAccount(MemoryPool pool) : pool(pool), bytes(0) { }
+
+    MemoryAccount(const MemoryAccount& other) : pool(other.pool), bytes(0) { }
+
+    /// Keep the share of this object, its new contents are accounted anew.
+    MemoryAccount& operator=(const MemoryAccount&) { return *this; }
+
+    ~MemoryAccount() { set(0); }
+
+    /// Set the bytes of the object in the pool.
+    ///
+    /// @param size the bytes of the object (0 to leave the pool)
+    ///
+    inline void set(std::size_t size) {
+        int64_t next = size;
+        if (next == bytes)
+            return;
+        memory_pool_bytes[pool].fetch_add(next - bytes, std::memory_order_relaxed);
+        if (bytes == 0 || next == 0)
+            memory_pool_count[pool].fetch_add(next ? 1 : -1, std::memory_order_relaxed);
+        bytes = next;
+    }
+
+    /// Return the bytes of the object in the pool.
+    inline std::size_t get() const { return bytes; }
+};
+
+/// The bytes of memory an emulator (or a batch of them) uses by component
+struct MemoryFootprint {
+    /// the PRG and CHR ROM of the cartridge
+    uint64_t rom;
+    /// the internal screens of the PPU (and the screens of a batch)
+    uint64_t framebuffer;
+    /// the saved states, i.e., the backup
+    uint64_t snapshots;
+    /// the frame stack, the profiler, the CPU trace, the RAM watch, and the
+    /// action table
+    uint64_t caches;
+    /// the RAM, VRAM, palette, OAM, and CHR RAM of the buses and mapper
+    uint64_t bus;
+    /// the objects themselves, i.e., the emulator, PPU, and mapper
+    uint64_t objects;
+    /// the sum of the components
+    uint64_t total;
+
+    /// Add the bytes of another footprint to this one.
+    ///
+    /// @param other the footprint to add
+    /// @return a reference to this footprint
+    ///
+    inline MemoryFootprint& operator+=(const MemoryFootprint& other) {
+        rom += other.rom;
+        framebuffer += other.framebuffer;
+        snapshots += other.snapshots;
+        caches += other.caches;
+        bus += other.bus;
+        objects += other.objects;
+        total += other.total;
+        return *this;
+    }
+};
+
+}  // namespace NES
+
+#endif  // FOOTPRINT_HPP
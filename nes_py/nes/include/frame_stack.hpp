@@ -0,0 +1,120 @@
+//  Program:      nes-py
+//  File:         frame_stack.hpp
+//  Description:  A ring buffer of the last frames of an emulator as luma
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef FRAME_STACK_HPP
+#define FRAME_STACK_HPP
+
+#include <vector>
+#include "common.hpp"
+#include "footprint.hpp"
+#include "pixel_format.hpp"
+
+namespace NES {
+
+/// A ring buffer of the last frames of a screen, preprocessed to luma and
+/// optionally downsampled by averaging square blocks of pixels. The ring
+/// has twice as many slots as the depth of the stack and each frame is
+/// written to two slots, one depth apart, so the last frames are always a
+/// contiguous [depth, height, width] array at a moving offset into the
+/// ring. A stacked observation is a view of the ring without any copy.
+class FrameStack {
+ private:
+    /// the number of frames in the stack (0 when disabled)
+    int depth;
+    /// the factor the frames are downsampled by in both dimensions
+    int downsample;
+    /// the slot of the oldest frame of the stack
+    int offset;
+    /// the internal slots of the ring
+    std::vector<NES_Byte> frames;
+    /// the caller-owned slots of the ring (nullptr to use the internal ones)
+    NES_Byte* buffer;
+    /// the luma of a row of the screen at full resolution
+    std::vector<NES_Byte> row_luma;
+    /// the sums of the luma of the blocks of a row of the frame
+    std::vector<uint32_t> block_sums;
+
+    /// Preprocess a screen into a frame.
+    ///
+    /// @param view the screen to preprocess
+    /// @param frame the frame of get_frame_size() bytes to write to
+    ///
+    void preprocess(const ScreenView& view, NES_Byte* frame);
+
+ public:
+    /// Initialize a new disabled frame stack.
+    FrameStack() : depth(0), downsample(1), offset(0), buffer(nullptr) { }
+
+    /// Set the shape of the stack and clear it.
+    ///
+    /// @param depth the number of frames in the stack (0 to disable it)
+    /// @param downsample the factor to downsample the frames by, which must
+    ///        divide the width and height of the screen
+    /// @return true if the shape is valid, false otherwise
+    ///
+    bool configure(int depth, int downsample);
+
+    /// Store the ring in a caller-owned buffer, e.g., a slot of a batch
+    /// tensor, instead of the internal one. The stack is cleared.
+    ///
+    /// @param data the buffer of get_ring_size() bytes to store the ring
+    ///        in, or nullptr for the internal one
+    ///
+    void set_buffer(NES_Byte* data);
+
+    /// Return true if the stack is disabled.
+    inline bool empty() const { return depth == 0; }
+
+    /// Return the number of frames in the stack.
+    inline int get_depth() const { return depth; }
+
+    /// Return the factor the frames are downsampled by.
+    inline int get_downsample() const { return downsample; }
+
+    /// Return the height of a frame in pixels.
+    inline int get_height() const { return SCREEN_HEIGHT / downsample; }
+
+    /// Return the width of a frame in pixels.
+    inline int get_width() const { return SCREEN_WIDTH / downsample; }
+
+    /// Return the number of bytes of a frame.
+    inline std::size_t get_frame_size() const { return get_height() * get_width(); }
+
+    /// Return the number of bytes of the ring, i.e., of 2 * depth frames.
+    inline std::size_t get_ring_size() const { return 2 * depth * get_frame_size(); }
+
+    /// Return a pointer to the first slot of the ring.
+    inline NES_Byte* get_buffer() { return buffer ? buffer : frames.data(); }
+
+    /// Return the slot of the oldest frame of the stack, the stack being the
+    /// depth slots that start at it.
+    inline int get_offset() const { return offset; }
+
+    /// Return a pointer to the stack, from the oldest to the latest frame.
+    inline NES_Byte* get_frames() { return get_buffer() + offset * get_frame_size(); }
+
+    /// Return the bytes of the internal ring and the scratch rows.
+    inline std::size_t get_memory_size() const {
+        return vector_bytes(frames) + vector_bytes(row_luma) + vector_bytes(block_sums);
+    }
+
+    /// Push the latest frame of a screen onto the stack, dropping the oldest.
+    ///
+    /// @param view the screen to push
+    ///
+    void push(const ScreenView& view);
+
+    /// Fill every frame of the stack with a screen, e.g., after a reset.
+    ///
+    /// @param view the screen to fill the stack with
+    ///
+    void fill(const ScreenView& view);
+};
+
+}  // namespace NES
+
+#endif  // FRAME_STACK_HPP
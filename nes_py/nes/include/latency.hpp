@@ -0,0 +1,192 @@
+//  Program:      nes-py
+//  File:         latency.hpp
+//  Description:  Lock-free histograms of the latencies of the core
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <atomic>
+#include <chrono>
+#include "common.hpp"
+
+namespace NES {
+
+/// The sections of the core that are timed
+enum LatencySection {
+    /// a whole Emulator::step
+    LATENCY_STEP,
+    /// the frames of a step, the CPU and PPU run interleaved cycle by cycle,
+    /// so their time is measured together
+    LATENCY_EMULATION,
+    /// the preprocessing of observations, i.e., pushing to the frame stack
+    /// and converting the screen
+    LATENCY_PREPROCESS,
+    /// the backups, restores, serializations, and deserializations of states
+    LATENCY_SNAPSHOT,
+    /// a whole Batch::step of every emulator of a batch
+    LATENCY_BATCH_STEP,
+    NUM_LATENCY_SECTIONS,
+};
+
+/// The summary of the latencies of a section in nanoseconds
+struct LatencySummary {
+    /// the number of latencies recorded
+    uint64_t count;
+    /// the mean latency
+    double mean;
+    /// the median latency
+    double p50;
+    /// the 90th percentile latency
+    double p90;
+    /// the 99th percentile latency
+    double p99;
+    /// the maximal latency
+    double max;
+};
+
+/// A log-linear histogram of latencies in nanoseconds that threads record
+/// to without locks. Latencies below 32ns have a bucket each, the others
+/// have 16 buckets per power of 2, so a percentile is within 1/32 of the
+/// true value. The core records to a histogram per thread (see
+/// thread_latency_histogram), so the threads of a batch do not contend on
+/// its cache lines, and merges them when it is read.
+class LatencyHistogram {
+ public:
+    /// The number of bits of the mantissa of a bucket
+    static constexpr int MANTISSA_BITS = 4;
+    /// The number of latencies with a bucket each
+    static constexpr int LINEAR_BUCKETS = 2 << MANTISSA_BITS;
+    /// The number of buckets, enough for any 64-bit latency
+    static constexpr int BUCKETS = LINEAR_BUCKETS + (64 - MANTISSA_BITS - 1) * (1 << MANTISSA_BITS);
+
+ private:
+    /// the number of latencies in each bucket
+    std::atomic<uint64_t> counts[BUCKETS];
+    /// the number of latencies
+    std::atomic<uint64_t> count;
+    /// the sum of the latencies
+    std::atomic<uint64_t> sum;
+    /// the maximal latency
+    std::atomic<uint64_t> max;
+
+ public:
+    /// Initialize a new histogram without latencies.
+    LatencyHistogram() { reset(); }
+
+    /// Return the bucket of a latency.
+    ///
+    /// @param nanoseconds the latency
+    /// @return the index of the bucket of the latency
+    ///
+    static inline int bucket(uint64_t nanoseconds) {
+        if (nanoseconds < LINEAR_BUCKETS)
+            return nanoseconds;
+        int shift = 63 - __builtin_clzll(nanoseconds) - MANTISSA_BITS;
+        int mantissa = (nanoseconds >> shift) - (1 << MANTISSA_BITS);
+        return LINEAR_BUCKETS + (shift - 1) * (1 << MANTISSA_BITS) + mantissa;
+    }
+
+    /// Return the middle of the range of latencies of a bucket.
+    ///
+    /// @param index the index of the bucket
+    /// @return the latency in the middle of the bucket
+    ///
+    static double bucket_value(int index);
+
+    /// Record a latency.
+    ///
+    /// @param nanoseconds the latency to record
+    ///
+    inline void record(uint64_t nanoseconds) {
+        counts[bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+        uint64_t current = max.load(std::memory_order_relaxed);
+        while (nanoseconds > current && !max.compare_exchange_weak(current, nanoseconds, std::memory_order_relaxed)) { }
+    }
+
+    /// Remove the latencies, e.g., to start a new window. Latencies that are
+    /// recorded at the same time can be kept in part.
+    void reset();
+
+    /// Add the latencies of another histogram to this one.
+    ///
+    /// @param other the histogram to add the latencies of
+    ///
+    void merge(const LatencyHistogram& other);
+
+    /// Return a percentile of the latencies.
+    ///
+    /// @param fraction the fraction of latencies at or below the percentile
+    /// @return the latency at the percentile (0 without latencies)
+    ///
+    double percentile(double fraction) const;
+
+    /// Return the summary of the latencies.
+    LatencySummary summary() const;
+};
+
+/// Return the histogram of a section of the core that the calling thread
+/// records to. The histograms of threads that exit are kept and reused by
+/// later threads.
+///
+/// @param section the section to return the histogram of
+/// @return the histogram of the section of the calling thread
+///
+LatencyHistogram& thread_latency_histogram(LatencySection section);
+
+/// Return the summary of the latencies of a section over every thread of
+/// the process.
+///
+/// @param section the section to return the summary of
+/// @return the summary of the merged histograms of the threads
+///
+LatencySummary latency_summary(LatencySection section);
+
+/// Remove the latencies of a section of every thread of the process.
+///
+/// @param section the section to remove the latencies of
+///
+void reset_latency(LatencySection section);
+
+/// Return the name of a section of the core.
+///
+/// @param section the section to return the name of
+/// @return the name in snake case
+///
+const char* latency_section_name(LatencySection section);
+
+/// Records the time from its creation to its destruction to the histogram
+/// of a section.
+class LatencyTimer {
+ private:
+    /// the histogram to record the latency to
+    LatencyHistogram& histogram;
+    /// the time the timer started
+    std::chrono::steady_clock::time_point start;
+
+ public:
+    /// Start timing a section.
+    ///
+    /// @param section the section to record the latency to
+    ///
+    explicit LatencyTimer(LatencySection section) :
+        histogram(thread_latency_histogram(section)),
+        start(std::chrono::steady_clock::now()) { }
+
+    /// Record the latency of the section.
+    ~LatencyTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    LatencyTimer(const LatencyTimer&) = delete;
+    LatencyTimer& operator=(const LatencyTimer&) = delete;
+};
+
+}  // namespace NES
+
+#endif  // LATENCY_HPP
@@ -12,12 +12,14 @@
 
 namespace NES {
 
-
+/// A PPU that starts with rendering disabled, i.e., it only does the work
+/// needed to keep the emulation exact until rendering is enabled
 class LightPPU : public PPU {
 public:
-    void cycle(PictureBus& bus) override;
+    /// Initialize a new PPU without rendering.
+    LightPPU() : PPU() { set_rendering(false); }
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
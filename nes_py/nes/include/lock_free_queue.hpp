@@ -0,0 +1,164 @@
+//  Program:      nes-py
+//  File:         lock_free_queue.hpp
+//  Description:  Bounded lock-free queues to hand work between threads
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef LOCK_FREE_QUEUE_HPP
+#define LOCK_FREE_QUEUE_HPP
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+
+namespace NES {
+
+/// A bounded lock-free queue with a single producer and a single consumer.
+/// The consumer can sleep until the queue is not empty.
+template<typename T>
+class SPSCQueue {
+ private:
+    /// the slots of the queue, indexed by position modulo the capacity
+    std::unique_ptr<T[]> slots;
+    /// the number of slots minus one (the capacity is a power of two)
+    uint32_t mask;
+    /// the number of values pushed by the producer
+    alignas(64) std::atomic<uint32_t> head;
+    /// the number of values popped by the consumer
+    alignas(64) std::atomic<uint32_t> tail;
+
+ public:
+    /// Initialize a new queue.
+    ///
+    /// @param capacity the number of values the queue holds at least
+    ///
+    explicit SPSCQueue(uint32_t capacity) :
+        slots(new T[std::bit_ceil(capacity)]),
+        mask(std::bit_ceil(capacity) - 1),
+        head(0),
+        tail(0) { }
+
+    /// Push a value to the queue (producer only).
+    ///
+    /// @param value the value to push
+    /// @return true if the value was pushed, false if the queue is full
+    ///
+    inline bool push(const T& value) {
+        uint32_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) > mask)
+            return false;
+        slots[position & mask] = value;
+        head.store(position + 1, std::memory_order_release);
+        head.notify_one();
+        return true;
+    }
+
+    /// Pop a value from the queue (consumer only).
+    ///
+    /// @param value the value to pop to
+    /// @return true if a value was popped, false if the queue is empty
+    ///
+    inline bool pop(T& value) {
+        uint32_t position = tail.load(std::memory_order_relaxed);
+        if (position == head.load(std::memory_order_acquire))
+            return false;
+        value = slots[position & mask];
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Sleep until the queue is not empty and pop a value (consumer only).
+    ///
+    /// @param value the value to pop to
+    ///
+    inline void wait_pop(T& value) {
+        while (!pop(value))
+            head.wait(tail.load(std::memory_order_relaxed), std::memory_order_acquire);
+    }
+};
+
+/// A bounded lock-free queue with multiple producers and a single consumer
+/// (Vyukov's bounded queue with a sequence number per cell).
+template<typename T>
+class MPSCQueue {
+ private:
+    /// a slot of the queue with the position it is ready for
+    struct Cell {
+        /// the position the cell can be pushed to (equal) or popped from
+        /// (one more)
+        std::atomic<uint32_t> sequence;
+        /// the value of the cell
+        T value;
+    };
+
+    /// the cells of the queue, indexed by position modulo the capacity
+    std::unique_ptr<Cell[]> cells;
+    /// the number of cells minus one (the capacity is a power of two)
+    uint32_t mask;
+    /// the position of the next push
+    alignas(64) std::atomic<uint32_t> enqueue_position;
+    /// the position of the next pop
+    alignas(64) uint32_t dequeue_position;
+
+ public:
+    /// Initialize a new queue.
+    ///
+    /// @param capacity the number of values the queue holds at least
+    ///
+    explicit MPSCQueue(uint32_t capacity) :
+        cells(new Cell[std::bit_ceil(capacity)]),
+        mask(std::bit_ceil(capacity) - 1),
+        enqueue_position(0),
+        dequeue_position(0) {
+        for (uint32_t i = 0; i <= mask; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /// Push a value to the queue (any producer).
+    ///
+    /// @param value the value to push
+    /// @return true if the value was pushed, false if the queue is full
+    ///
+    inline bool push(const T& value) {
+        uint32_t position = enqueue_position.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[position & mask];
+            auto sequence = cell->sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<int32_t>(sequence - position);
+            if (difference == 0) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Pop a value from the queue (consumer only).
+    ///
+    /// @param value the value to pop to
+    /// @return true if a value was popped, false if the queue is empty
+    ///
+    inline bool pop(T& value) {
+        Cell* cell = &cells[dequeue_position & mask];
+        auto sequence = cell->sequence.load(std::memory_order_acquire);
+        if (static_cast<int32_t>(sequence - (dequeue_position + 1)) < 0)
+            return false;
+        value = cell->value;
+        cell->sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+        dequeue_position++;
+        return true;
+    }
+};
+
+}  // namespace NES
+
+#endif  // LOCK_FREE_QUEUE_HPP
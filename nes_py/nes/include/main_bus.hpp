@@ -11,6 +11,8 @@
 #include <vector>
 #include <unordered_map>
 #include "common.hpp"
+#include "counters.hpp"
+#include "footprint.hpp"
 #include "mapper.hpp"
 
 namespace NES {
@@ -49,8 +51,12 @@ typedef std::unordered_map<IORegisters, ReadCallback, EnumClassHash> IORegisterT
 /// The main bus for data to travel along the NES hardware
 class MainBus : public Serializable{
  private:
-    /// The RAM on the main bus
+    /// The internal storage of the RAM on the main bus (empty while a
+    /// caller-owned buffer is set)
     std::vector<NES_Byte> ram;
+    /// The RAM on the main bus, i.e., the internal storage or a
+    /// caller-owned buffer
+    NES_Byte* memory;
     /// The extended RAM (if the mapper has extended RAM)
     std::vector<NES_Byte> extended_ram;
     /// a pointer to the mapper on the cartridge
@@ -59,14 +65,19 @@ class MainBus : public Serializable{
     IORegisterToWriteCallbackMap write_callbacks;
     /// a map of IO registers to callback methods for reads
     IORegisterToReadCallbackMap read_callbacks;
+    /// the counters of the accesses (only updated with NES_COUNTERS)
+    HotPathCounters* counters = nullptr;
 
  public:
+    /// The number of bytes of RAM on the main bus
+    static constexpr std::size_t RAM_SIZE = 0x800;
+
     /// Initialize a new main bus.
-    MainBus() : ram(0x800, 0), mapper(nullptr) { }
+    MainBus() : ram(RAM_SIZE, 0), memory(ram.data()), mapper(nullptr) { }
 
     ~MainBus();
     MainBus(const MainBus& other);
-    MainBus(MainBus&& other) noexcept;
+    MainBus(MainBus&& other);
     MainBus& operator=(const MainBus& other);
     MainBus& operator=(MainBus&& other) noexcept;
 
@@ -75,7 +86,22 @@ class MainBus : public Serializable{
     ///
     /// @return a 8-bit pointer to the RAM buffer's first address
     ///
-    inline NES_Byte* get_memory_buffer() { return &ram.front(); }
+    inline NES_Byte* get_memory_buffer() { return memory; }
+
+    /// Store the RAM in a caller-owned buffer, e.g., a row of a batch-wide
+    /// block, instead of the internal storage. The contents move over, the
+    /// internal storage is freed while the buffer is set, and copies of the
+    /// bus copy the contents, not the buffer.
+    ///
+    /// @param data the buffer of RAM_SIZE bytes to store the RAM in, or
+    ///        nullptr for the internal storage
+    ///
+    void set_memory_buffer(NES_Byte* data);
+
+    /// Return the bytes of the internal RAM and the extended RAM.
+    inline std::size_t get_memory_size() const {
+        return vector_bytes(ram) + vector_bytes(extended_ram);
+    }
 
     /// Read a byte from an address on the RAM.
     ///
@@ -85,6 +111,15 @@ class MainBus : public Serializable{
     ///
     NES_Byte read(NES_Address address);
 
+    /// Read a byte from an address without the side effects of reading IO
+    /// registers, e.g., to trace the operands of instructions.
+    ///
+    /// @param address the 16-bit address of the byte to read
+    /// @return the byte at the address in RAM, PRG RAM, or PRG ROM, and 0
+    ///         for the IO registers and expansion ROM
+    ///
+    NES_Byte peek(NES_Address address);
+
     /// Write a byte to an address in the RAM.
     ///
     /// @param address the 16-bit address to write the byte to in RAM
@@ -108,6 +143,13 @@ class MainBus : public Serializable{
         read_callbacks.insert({reg, callback});
     }
 
+    /// Set the counters that the accesses are counted in. Copies of the bus
+    /// do not share them.
+    ///
+    /// @param counters the counters to update, or nullptr to count nothing
+    ///
+    inline void set_counters(HotPathCounters* counters) { this->counters = counters; }
+
     /// Return a pointer to the page in memory.
     const NES_Byte* get_page_pointer(NES_Byte page);
 
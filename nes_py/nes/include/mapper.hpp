@@ -74,6 +74,9 @@ class Mapper : public Serializable {
     ///
     virtual void writeCHR(NES_Address address, NES_Byte value) = 0;
 
+    /// Return the bytes of the memory of the mapper, e.g., its CHR RAM.
+    inline virtual std::size_t get_memory_size() const { return 0; }
+
 };
 
 }  // namespace NES
@@ -10,6 +10,7 @@
 
 #include <vector>
 #include "common.hpp"
+#include "footprint.hpp"
 #include "mapper.hpp"
 
 namespace NES {
@@ -98,6 +99,11 @@ class MapperSxROM : public Mapper {
     ///
     void writeCHR(NES_Address address, NES_Byte value) override;
 
+    /// Return the bytes of the CHR RAM.
+    inline std::size_t get_memory_size() const override {
+        return vector_bytes(character_ram);
+    }
+
     /// Return the name table mirroring mode of this mapper.
     inline NameTableMirroring getNameTableMirroring() override { return mirroring; }
 
@@ -10,6 +10,7 @@
 
 #include <vector>
 #include "common.hpp"
+#include "footprint.hpp"
 #include "mapper.hpp"
 
 namespace NES {
@@ -62,6 +63,11 @@ class MapperUxROM : public Mapper {
     ///
     void writeCHR(NES_Address address, NES_Byte value) override;
 
+    /// Return the bytes of the CHR RAM.
+    inline std::size_t get_memory_size() const override {
+        return vector_bytes(character_ram);
+    }
+
     /// Serializable
     void serialize(std::vector<uint8_t>& buffer) override;
     std::span<uint8_t> deserialize(std::span<uint8_t> buffer) override;
@@ -11,6 +11,8 @@
 #include <vector>
 #include <cstdlib>
 #include "common.hpp"
+#include "counters.hpp"
+#include "footprint.hpp"
 #include "mapper.hpp"
 
 namespace NES {
@@ -26,6 +28,8 @@ class PictureBus : public Serializable {
     std::vector<NES_Byte> palette;
     /// a pointer to the mapper on the cartridge
     Mapper* mapper;
+    /// the counters of the accesses (only updated with NES_COUNTERS)
+    HotPathCounters* counters = nullptr;
 
  public:
     /// Initialize a new picture bus.
@@ -67,9 +71,28 @@ class PictureBus : public Serializable {
     /// @return the index of the RGB tuple in the color array
     ///
     inline NES_Byte read_palette(NES_Byte address) {
+        NES_COUNT(if (counters) counters->picture_reads[PICTURE_PALETTE]++);
         return palette[address];
     }
 
+    /// Set the counters that the accesses are counted in. Copies of the bus
+    /// do not share them.
+    ///
+    /// @param counters the counters to update, or nullptr to count nothing
+    ///
+    inline void set_counters(HotPathCounters* counters) { this->counters = counters; }
+
+    /// Return the 2KB of VRAM that back the name tables.
+    inline const std::vector<NES_Byte>& get_vram() const { return ram; }
+
+    /// Return the 32 bytes of palette RAM.
+    inline const std::vector<NES_Byte>& get_palette() const { return palette; }
+
+    /// Return the bytes of the VRAM and the palette RAM.
+    inline std::size_t get_memory_size() const {
+        return vector_bytes(ram) + vector_bytes(palette);
+    }
+
     /// Update the mirroring and name table from the mapper.
     void update_mirroring();
 
@@ -0,0 +1,214 @@
+//  Program:      nes-py
+//  File:         pixel_format.hpp
+//  Description:  Pixel formats for the screen buffer and their conversions
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef PIXEL_FORMAT_HPP
+#define PIXEL_FORMAT_HPP
+
+#include <cstddef>
+#include <cstring>
+#include "common.hpp"
+
+namespace NES {
+
+/// The layouts the screen buffer can be stored in
+enum PixelFormat {
+    /// 32-bit xRGB words (native endian), the legacy layout
+    XRGB32 = 0,
+    /// 8-bit indexes into the 64-color NES palette
+    PALETTE_INDEX,
+    /// packed 8-bit R, G, B bytes
+    RGB24,
+    /// packed 8-bit B, G, R bytes
+    BGR24,
+    /// packed 8-bit R, G, B, A bytes (A is always 255)
+    RGBA32,
+    /// planar 8-bit R, G, B channels (channels-first)
+    CHW_UINT8,
+    /// packed 8-bit B, G, R, A bytes (A is always 255)
+    BGRA32,
+    /// planar IEEE half-precision R, G, B channels normalized to [0, 1]
+    CHW_FLOAT16,
+};
+
+/// The number of pixel formats
+const int NUM_PIXEL_FORMATS = CHW_FLOAT16 + 1;
+
+/// The height of the screen in pixels
+const int SCREEN_HEIGHT = 240;
+/// The width of the screen in pixels
+const int SCREEN_WIDTH = 256;
+/// The number of pixels on the screen
+const std::size_t SCREEN_PIXELS = SCREEN_HEIGHT * SCREEN_WIDTH;
+
+/// The number of colors in the NES palette
+const int PALETTE_COLORS = 64;
+
+/// Lookup tables from palette indexes to the bytes of each pixel format.
+/// Rendering and conversion are a single table lookup per channel so the
+/// 64-entry tables stay resident in L1.
+struct PaletteTables {
+    /// the red channel of each color
+    NES_Byte red[PALETTE_COLORS];
+    /// the green channel of each color
+    NES_Byte green[PALETTE_COLORS];
+    /// the blue channel of each color
+    NES_Byte blue[PALETTE_COLORS];
+    /// each color as RGBA bytes in memory order
+    uint32_t rgba[PALETTE_COLORS];
+    /// each color as BGRA bytes in memory order
+    uint32_t bgra[PALETTE_COLORS];
+    /// the red channel of each color as a normalized half-precision float
+    uint16_t red_half[PALETTE_COLORS];
+    /// the green channel of each color as a normalized half-precision float
+    uint16_t green_half[PALETTE_COLORS];
+    /// the blue channel of each color as a normalized half-precision float
+    uint16_t blue_half[PALETTE_COLORS];
+    /// the luma of each color (see rgb_luma)
+    NES_Byte luma[PALETTE_COLORS];
+
+    /// Initialize the tables from the NES palette.
+    PaletteTables();
+};
+
+/// Return the luma of a color with the integer BT.601 weights.
+///
+/// @param red the red channel of the color
+/// @param green the green channel of the color
+/// @param blue the blue channel of the color
+/// @return the luma of the color in [0, 255]
+///
+inline NES_Byte rgb_luma(int red, int green, int blue) {
+    return (77 * red + 150 * green + 29 * blue + 128) >> 8;
+}
+
+/// The lookup tables shared by all renderers and conversions
+extern const PaletteTables PALETTE_TABLES;
+
+/// Return the number of bytes a full screen occupies in a pixel format.
+///
+/// @param format the pixel format to return the screen size of
+/// @return the size of the screen in bytes
+///
+std::size_t screen_size(PixelFormat format);
+
+/// Return the number of planes a pixel format is stored in.
+///
+/// @param format the pixel format to return the number of planes of
+/// @return 3 for planar (channels-first) formats, 1 otherwise
+///
+inline int screen_planes(PixelFormat format) {
+    return (format == CHW_UINT8 || format == CHW_FLOAT16) ? 3 : 1;
+}
+
+/// Return the number of bytes in a row of a single plane of the screen.
+///
+/// @param format the pixel format to return the row size of
+/// @return the size of a row of the screen in bytes
+///
+inline std::size_t row_size(PixelFormat format) {
+    return screen_size(format) / (screen_planes(format) * SCREEN_HEIGHT);
+}
+
+/// A screen buffer in a pixel format with an arbitrary stride between rows.
+/// Planar formats store the planes one after another, i.e., row y of plane
+/// p is located at data + (p * SCREEN_HEIGHT + y) * stride.
+struct ScreenView {
+    /// the first byte of the screen
+    NES_Byte* data;
+    /// the number of bytes between the starts of consecutive rows
+    std::size_t stride;
+    /// the pixel format the screen is stored in
+    PixelFormat format;
+
+    /// Return a pointer to the start of a row of the screen.
+    ///
+    /// @param y the row of the screen
+    /// @param plane the plane of the row (for planar formats)
+    /// @return a pointer to the first byte of the row
+    ///
+    inline NES_Byte* row(int y, int plane = 0) const {
+        return data + (plane * SCREEN_HEIGHT + y) * stride;
+    }
+};
+
+/// Copy a screen between two views in the same pixel format.
+///
+/// @param source the screen to copy from
+/// @param destination the screen to copy to
+///
+void copy_screen(const ScreenView& source, const ScreenView& destination);
+
+/// Write a single pixel to a screen in a pixel format.
+///
+/// @param row the row of the screen (of the first plane) to write to
+/// @param plane_stride the number of bytes between planes of the screen
+/// @param x the horizontal position of the pixel in the row
+/// @param color the index of the color in the NES palette (6 bits)
+/// @param format the pixel format of the screen buffer
+///
+inline void write_pixel(
+    NES_Byte* row,
+    std::size_t plane_stride,
+    std::size_t x,
+    NES_Byte color,
+    PixelFormat format
+) {
+    const PaletteTables& tables = PALETTE_TABLES;
+    switch (format) {
+        case XRGB32: {
+            uint32_t xrgb = tables.red[color] << 16 | tables.green[color] << 8 | tables.blue[color];
+            std::memcpy(row + 4 * x, &xrgb, 4);
+            break;
+        }
+        case PALETTE_INDEX:
+            row[x] = color;
+            break;
+        case RGB24:
+            row[3 * x + 0] = tables.red[color];
+            row[3 * x + 1] = tables.green[color];
+            row[3 * x + 2] = tables.blue[color];
+            break;
+        case BGR24:
+            row[3 * x + 0] = tables.blue[color];
+            row[3 * x + 1] = tables.green[color];
+            row[3 * x + 2] = tables.red[color];
+            break;
+        case RGBA32:
+            std::memcpy(row + 4 * x, &tables.rgba[color], 4);
+            break;
+        case BGRA32:
+            std::memcpy(row + 4 * x, &tables.bgra[color], 4);
+            break;
+        case CHW_UINT8:
+            row[x] = tables.red[color];
+            row[plane_stride + x] = tables.green[color];
+            row[2 * plane_stride + x] = tables.blue[color];
+            break;
+        case CHW_FLOAT16:
+            std::memcpy(row + 2 * x, &tables.red_half[color], 2);
+            std::memcpy(row + plane_stride + 2 * x, &tables.green_half[color], 2);
+            std::memcpy(row + 2 * plane_stride + 2 * x, &tables.blue_half[color], 2);
+            break;
+    }
+}
+
+/// Convert a screen of palette indexes to another pixel format.
+///
+/// @param indexes the screen of palette indexes to convert
+/// @param output the buffer to write the converted screen to (must hold
+///        screen_size(format) bytes)
+/// @param format the pixel format to convert to
+///
+void convert_palette_indexes(
+    const NES_Byte* indexes,
+    NES_Byte* output,
+    PixelFormat format
+);
+
+}  // namespace NES
+
+#endif  // PIXEL_FORMAT_HPP
@@ -8,8 +8,11 @@
 #ifndef PPU_HPP
 #define PPU_HPP
 
+#include <atomic>
 #include "common.hpp"
+#include "footprint.hpp"
 #include "picture_bus.hpp"
+#include "pixel_format.hpp"
 
 namespace NES {
 
@@ -98,14 +101,75 @@ class PPU : Serializable{
     /// The value to increment the data address by
     NES_Address data_address_increment;
 
+    /// whether pixels are rendered to the screen. Without rendering only
+    /// the work needed to keep the emulation exact (e.g., sprite 0 hits) is
+    /// done and the screen holds the last rendered pixels
+    bool is_rendering;
+    /// whether every pixel of the frame in progress has been rendered
+    bool is_frame_rendered;
+    /// The format pixels are written to the screen in
+    PixelFormat pixel_format;
     /// The internal screen data structure as a vector representation of a
     /// matrix of height matching the visible scans lines and width matching
-    /// the number of visible scan line dots
-    NES_Pixel screen[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS];
+    /// the number of visible scan line dots, laid out in the pixel format
+    std::vector<NES_Byte> screen;
+    /// The second internal screen, used as the back buffer when double
+    /// buffering (frame N renders to screen N % 2 of the pair)
+    std::vector<NES_Byte> second_screen;
+    /// whether frames render to a back buffer that is swapped in when done
+    bool is_double_buffered;
+    /// The number of frames the PPU has rendered and published
+    std::atomic<uint64_t> frame_sequence;
+    /// The screen pixels are rendered to, either the internal screen, the
+    /// back buffer, or a caller-owned buffer
+    ScreenView output;
+    /// The screen holding the last completed frame when double buffering,
+    /// the same as the output otherwise
+    ScreenView front;
+
+    /// Return a view of one of the internal screens.
+    ///
+    /// @param sequence the frame sequence number whose parity selects the
+    ///        screen of the double buffered pair
+    /// @return a packed view of the internal screen
+    ///
+    inline ScreenView internal_view(uint64_t sequence = 0) {
+        auto& buffer = (is_double_buffered && (sequence & 1)) ? second_screen : screen;
+        return {buffer.data(), row_size(pixel_format), pixel_format};
+    }
+
+    /// Take the pixel format and rendered screen of another PPU. The output
+    /// buffer of this PPU is kept if the pixel formats match.
+    ///
+    /// @param other the PPU to copy the screen from
+    ///
+    void assign_screen(const PPU& other);
+
+    /// Finish the visible part of a frame, swapping the screens if double
+    /// buffering, and publish the new frame sequence number. Frames that
+    /// were not rendered in full are dropped.
+    void end_frame();
+
+    /// Write a pixel to the screen in the current pixel format.
+    ///
+    /// @param x the horizontal position of the pixel
+    /// @param y the vertical position of the pixel
+    /// @param color the index of the color in the NES palette
+    ///
+    void put_pixel(int x, int y, NES_Byte color);
 
  public:
     /// Initialize a new PPU.
-    PPU() : sprite_memory(64 * 4) { }
+    PPU() :
+        sprite_memory(64 * 4),
+        is_rendering(true),
+        is_frame_rendered(false),
+        pixel_format(XRGB32),
+        screen(screen_size(XRGB32)),
+        is_double_buffered(false),
+        frame_sequence(0),
+        output{screen.data(), row_size(XRGB32), XRGB32},
+        front(output) { }
 
     virtual ~PPU(){}
     PPU(const PPU& other);
@@ -186,8 +250,94 @@ class PPU : Serializable{
         sprite_memory[sprite_data_address++] = value;
     }
 
-    /// Return a pointer to the screen buffer.
-    inline NES_Pixel* get_screen_buffer() { return *screen; }
+    /// Return a pointer to the screen buffer with the latest frame.
+    inline NES_Byte* get_screen_buffer() { return front.data; }
+
+    /// Return a view of the screen buffer with the latest frame.
+    inline const ScreenView& get_screen_view() const { return front; }
+
+    /// Return the number of frames the PPU has rendered in full. The value
+    /// is published after the frame's screen, so it is safe to read from
+    /// another thread.
+    inline uint64_t get_frame_sequence() const {
+        return frame_sequence.load(std::memory_order_acquire);
+    }
+
+    /// Return the screen buffer that holds a frame when double buffering.
+    /// The buffer of frame N is not drawn over until frame N + 2 starts
+    /// rendering, so readers on other threads can consume it without
+    /// copying while the next frame is emulated.
+    ///
+    /// @param sequence the frame sequence number of the frame
+    /// @return a pointer to the screen buffer of the frame
+    ///
+    inline NES_Byte* get_sequence_buffer(uint64_t sequence) {
+        return is_double_buffered ? internal_view(sequence).data : front.data;
+    }
+
+    /// Return true if the PPU is double buffering, false otherwise.
+    inline bool get_double_buffered() { return is_double_buffered; }
+
+    /// Enable or disable double buffering. Enabling releases any
+    /// caller-owned buffer; the latest frame is kept in either case.
+    ///
+    /// @param enabled whether to render to a back buffer that is swapped
+    ///        in at the end of each frame
+    ///
+    void set_double_buffered(bool enabled);
+
+    /// Render to a caller-owned buffer instead of the internal screen. The
+    /// current screen is copied to the new buffer. The buffer is released
+    /// (and copied back to the internal screen) when the pixel format
+    /// changes or when called with a null pointer. Setting a buffer disables
+    /// double buffering.
+    ///
+    /// @param data the buffer to render to, or nullptr for the internal one
+    /// @param stride the number of bytes between rows of the buffer, or 0
+    ///        for rows that are packed back to back
+    ///
+    void set_screen_buffer(NES_Byte* data, std::size_t stride = 0);
+
+    /// Return true if the PPU renders pixels to the screen, false otherwise.
+    inline bool get_rendering() { return is_rendering; }
+
+    /// Enable or disable rendering of pixels to the screen. The emulation
+    /// is identical either way; a frame has to render from its first
+    /// scanline to be published.
+    ///
+    /// @param enabled whether to render pixels to the screen
+    ///
+    void set_rendering(bool enabled);
+
+    /// Return the format pixels are written to the screen in.
+    inline PixelFormat get_pixel_format() { return pixel_format; }
+
+    /// Return the scanline the PPU is on, 261 for the pre-render scanline.
+    inline int get_scanline() const {
+        return pipeline_state == PRE_RENDER ? FRAME_END_SCANLINE : scanline;
+    }
+
+    /// Return the dot of the scanline the PPU runs next.
+    inline int get_dot() const { return cycles; }
+
+    /// Return the bytes of the OAM and the sprites of the next scanline.
+    inline std::size_t get_memory_size() const {
+        return vector_bytes(sprite_memory) + vector_bytes(scanline_sprites);
+    }
+
+    /// Return the bytes of the internal screens, which are kept when
+    /// rendering to a caller-owned buffer.
+    inline std::size_t get_screen_memory_size() const {
+        return vector_bytes(screen) + vector_bytes(second_screen);
+    }
+
+    /// Set the format pixels are written to the screen in. The screen is
+    /// cleared and any caller-owned buffer is released when the format
+    /// changes.
+    ///
+    /// @param format the new pixel format
+    ///
+    void set_pixel_format(PixelFormat format);
 
     /// Serializable
     void serialize(std::vector<uint8_t>& buffer) override;
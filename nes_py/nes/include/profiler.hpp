@@ -0,0 +1,196 @@
+//  Program:      nes-py
+//  File:         profiler.hpp
+//  Description:  A profiler of the 6502 code that the emulator executes
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common.hpp"
+#include "footprint.hpp"
+
+namespace NES {
+
+/// A profiler of the emulated 6502 code. The CPU reports each instruction
+/// with the cycles it took, including page crossings, taken branches, and
+/// OAM DMA, and each interrupt it takes. The profiler keeps the hits and
+/// cycles of each opcode and of each address of the program counter, and
+/// the cycles of each call stack that JSR/RTS and interrupts/RTI form.
+///
+/// The addresses are those of the CPU, so code in switched PRG banks shares
+/// the addresses of the banks.
+class Profiler {
+ public:
+    /// The number of opcodes
+    static constexpr int OPCODES = 0x100;
+    /// The number of addresses of the program counter
+    static constexpr int ADDRESSES = 0x10000;
+    /// The deepest call stack that is tracked, deeper calls are attributed
+    /// to the deepest tracked frame
+    static constexpr int MAX_DEPTH = 64;
+
+ private:
+    /// A node of the tree of call stacks
+    struct Frame {
+        /// the index of the node of the caller (-1 for the root)
+        int parent;
+        /// the entry address of the routine, with the kind of interrupt in
+        /// the bits above 16 for interrupt handlers
+        uint32_t address;
+        /// the cycles spent in the routine itself
+        uint64_t cycles;
+    };
+
+    /// An active call on the stack
+    struct Call {
+        /// the index of the node of the call in the tree
+        int node;
+        /// the stack pointer before the call, which the return restores
+        NES_Byte stack_pointer;
+    };
+
+    /// the number of times each opcode executed
+    std::vector<uint64_t> opcode_hits;
+    /// the cycles of each opcode
+    std::vector<uint64_t> opcode_cycles;
+    /// the number of times an instruction at each address executed
+    std::vector<uint64_t> address_hits;
+    /// the cycles of the instructions at each address
+    std::vector<uint64_t> address_cycles;
+    /// the cycles the CPU spent entering interrupts
+    uint64_t interrupt_cycles;
+    /// the tree of call stacks, the root is the code entered from reset
+    std::vector<Frame> frames;
+    /// the children of the nodes of the tree keyed by node and address
+    std::unordered_map<uint64_t, int> children;
+    /// the active calls from the outermost to the innermost
+    std::vector<Call> calls;
+    /// the node of the innermost active call
+    int current;
+    /// the text of the last export
+    std::string report;
+
+    /// Enter a routine from the current node.
+    ///
+    /// @param address the entry address of the routine
+    /// @param stack_pointer the stack pointer before the call
+    ///
+    void enter(uint32_t address, NES_Byte stack_pointer);
+
+    /// Leave the routines that a return to a stack pointer ends.
+    ///
+    /// @param stack_pointer the stack pointer after the return
+    ///
+    void leave(NES_Byte stack_pointer);
+
+    /// Return the name of a node of the tree of call stacks.
+    ///
+    /// @param node the index of the node
+    /// @return the entry address in hex, with the kind of interrupt
+    ///
+    std::string frame_name(int node) const;
+
+ public:
+    /// The kinds of frames of interrupt handlers in the tree
+    enum FrameKind : uint32_t {
+        ROUTINE_FRAME = 0,
+        NMI_FRAME = 1 << 16,
+        IRQ_FRAME = 2 << 16,
+    };
+
+    /// Initialize a new profiler with zero counts.
+    Profiler() { clear(); }
+
+    /// Zero the counts and forget the call stacks.
+    void clear();
+
+    /// Record an instruction that the CPU executed.
+    ///
+    /// @param address the address of the opcode
+    /// @param opcode the opcode of the instruction
+    /// @param cycles the cycles the instruction took
+    /// @param stack_pointer the stack pointer after the instruction
+    /// @param target the program counter after the instruction
+    ///
+    inline void instruction(
+        NES_Address address,
+        NES_Byte opcode,
+        int cycles,
+        NES_Byte stack_pointer,
+        NES_Address target
+    ) {
+        opcode_hits[opcode]++;
+        opcode_cycles[opcode] += cycles;
+        address_hits[address]++;
+        address_cycles[address] += cycles;
+        frames[current].cycles += cycles;
+        if (opcode == 0x20)  // JSR pushed 2 bytes
+            enter(target, stack_pointer + 2);
+        else if (opcode == 0x60 || opcode == 0x40)  // RTS and RTI
+            leave(stack_pointer);
+    }
+
+    /// Record an interrupt that the CPU took.
+    ///
+    /// @param kind the kind of frame of the interrupt handler
+    /// @param handler the address of the interrupt handler
+    /// @param cycles the cycles of entering the interrupt (0 if they are
+    ///        part of an instruction, i.e., of BRK)
+    /// @param stack_pointer the stack pointer after the interrupt
+    ///
+    inline void interrupt(FrameKind kind, NES_Address handler, int cycles, NES_Byte stack_pointer) {
+        interrupt_cycles += cycles;
+        enter(kind | handler, stack_pointer + 3);
+        frames[current].cycles += cycles;
+    }
+
+    /// Forget the active calls, e.g., after a reset or restore, keeping the
+    /// counts.
+    inline void reset_calls() { calls.clear(); current = 0; }
+
+    /// Return the number of times each opcode executed.
+    inline const uint64_t* get_opcode_hits() const { return opcode_hits.data(); }
+
+    /// Return the cycles of each opcode.
+    inline const uint64_t* get_opcode_cycles() const { return opcode_cycles.data(); }
+
+    /// Return the number of times an instruction at each address executed.
+    inline const uint64_t* get_address_hits() const { return address_hits.data(); }
+
+    /// Return the cycles of the instructions at each address.
+    inline const uint64_t* get_address_cycles() const { return address_cycles.data(); }
+
+    /// Return the cycles the CPU spent entering interrupts.
+    inline uint64_t get_interrupt_cycles() const { return interrupt_cycles; }
+
+    /// Return the bytes of the counts, the tree of call stacks, and the
+    /// last export.
+    std::size_t get_memory_size() const;
+
+    /// Export a flat profile, a table of the opcodes then a table of the
+    /// addresses by descending cycles.
+    ///
+    /// @param top the number of rows of each table (0 for all of them)
+    /// @return the text of the profile, valid until the next export
+    ///
+    const std::string& flat_profile(int top);
+
+    /// Export the cycles of each call stack in the folded format of flame
+    /// graphs, a line of `frame;frame;... cycles` per stack, from the
+    /// outermost frame. Frames are named by the entry address in hex, the
+    /// root is `reset`, and interrupt handlers are prefixed by `nmi:` or
+    /// `irq:`.
+    ///
+    /// @return the text of the stacks, valid until the next export
+    ///
+    const std::string& folded_stacks();
+};
+
+}  // namespace NES
+
+#endif  // PROFILER_HPP
@@ -0,0 +1,187 @@
+//  Program:      nes-py
+//  File:         ram_watch.hpp
+//  Description:  Compiled expressions over RAM evaluated after each frame
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef RAM_WATCH_HPP
+#define RAM_WATCH_HPP
+
+#include <string>
+#include <vector>
+#include "common.hpp"
+#include "footprint.hpp"
+
+namespace NES {
+
+/// The operations of the stack machine that evaluates watch expressions
+enum WatchOp : uint8_t {
+    /// push a constant
+    WATCH_CONSTANT,
+    /// pop an address and push the RAM byte at it
+    WATCH_RAM,
+    /// push the value of an earlier watch in this frame
+    WATCH_VALUE,
+    /// pop a value and push its change since the last frame
+    WATCH_DELTA,
+    /// pop a packed BCD byte and push its decimal value
+    WATCH_BCD,
+    /// pop operand decimal digits and push the number they form
+    WATCH_DIGITS,
+    /// pop a value and push its absolute value
+    WATCH_ABS,
+    /// pop a value and push its negation
+    WATCH_NEGATE,
+    /// pop a value and push 1 if it is zero, 0 otherwise
+    WATCH_NOT,
+    /// pop a value and push its bitwise complement
+    WATCH_COMPLEMENT,
+    // binary operations pop the right then the left operand
+    WATCH_ADD,
+    WATCH_SUBTRACT,
+    WATCH_MULTIPLY,
+    WATCH_DIVIDE,
+    WATCH_MODULO,
+    WATCH_SHIFT_LEFT,
+    WATCH_SHIFT_RIGHT,
+    WATCH_BIT_AND,
+    WATCH_BIT_OR,
+    WATCH_BIT_XOR,
+    WATCH_EQUAL,
+    WATCH_NOT_EQUAL,
+    WATCH_LESS,
+    WATCH_LESS_EQUAL,
+    WATCH_GREATER,
+    WATCH_GREATER_EQUAL,
+    WATCH_AND,
+    WATCH_OR,
+    WATCH_MIN,
+    WATCH_MAX,
+    /// pop the else, then, and condition values and push the selected one
+    WATCH_SELECT,
+    /// pop a value and store it as the watch with the operand index
+    WATCH_STORE,
+};
+
+/// A single instruction of a compiled watch program
+struct WatchInstruction {
+    /// the operation to perform
+    WatchOp op;
+    /// the index of a watch, delta slot, or digit count
+    int32_t operand;
+    /// the value of a constant
+    double constant;
+};
+
+/// Named expressions over RAM compiled to a stack machine program and
+/// evaluated after every frame. A spec is a list of `name = expression`
+/// entries separated by newlines or semicolons (`#` starts a comment).
+/// Expressions support numbers (decimal, `0x` or `$` hex), `ram[address]`,
+/// earlier names, the C operators (arithmetic, bitwise, comparisons,
+/// logical, and `?:`), and the functions `bcd(x)`, `digits(d, ...)`,
+/// `frame_delta(x)`, `abs(x)`, `min(a, b)`, and `max(a, b)`. Every
+/// expression is evaluated in full each frame, so `frame_delta` is the
+/// change since the last frame, not since the last step. Parentheses, unary
+/// operators, and conditionals nest at most 256 deep.
+///
+/// The entries named `reward` and `done` are special: the results hold the
+/// reward summed over and the done flag of any frame of the last step. An
+/// entry named `progress` is tracked by the episode statistics of the
+/// emulator (see EpisodeStats).
+class RamWatch {
+ private:
+    /// the compiled program of all the entries in order
+    std::vector<WatchInstruction> program;
+    /// the names of the entries in the order of the results
+    std::vector<std::string> names;
+    /// the index of the result of each entry
+    std::vector<int> result_indexes;
+    /// the values of the entries in the current frame
+    std::vector<double> values;
+    /// the values of the delta expressions in the last frame
+    std::vector<double> previous;
+    /// the evaluation stack
+    std::vector<double> stack;
+    /// the reward, done flag, and the other entries after the last step
+    std::vector<double> results;
+
+    /// Run the program on the RAM of the current frame.
+    ///
+    /// @param ram the 2KB of RAM to evaluate the program on
+    /// @param is_priming whether to report no change for deltas
+    ///
+    void run(const NES_Byte* ram, bool is_priming);
+
+ public:
+    /// The index of the summed reward in the results
+    static constexpr int REWARD = 0;
+    /// The index of the done flag in the results
+    static constexpr int DONE = 1;
+
+    /// Compile a spec, replacing the current program.
+    ///
+    /// @param spec the text of the watch spec
+    /// @param error the string to write a description of an error to
+    /// @return true if the spec compiled, false otherwise (the current
+    ///         program is kept)
+    ///
+    bool compile(const std::string& spec, std::string& error);
+
+    /// Return true if no program is compiled, false otherwise.
+    inline bool empty() const { return program.empty(); }
+
+    /// Evaluate the program without reporting any change or reward, e.g.,
+    /// after a reset or after restoring a state.
+    ///
+    /// @param ram the 2KB of RAM to evaluate the program on
+    ///
+    void prime(const NES_Byte* ram);
+
+    /// Clear the reward and done flag before the frames of a step.
+    inline void begin_step() {
+        if (empty()) return;
+        results[REWARD] = 0;
+        results[DONE] = 0;
+    }
+
+    /// Evaluate the program after a frame, adding to the reward and done
+    /// flag of the step.
+    ///
+    /// @param ram the 2KB of RAM to evaluate the program on
+    ///
+    void update(const NES_Byte* ram);
+
+    /// Return the number of results, i.e., the reward, done flag, and the
+    /// other entries in the order of the spec.
+    inline int size() const { return results.size(); }
+
+    /// Return the name of a result.
+    ///
+    /// @param index the index of the result
+    /// @return the name of the result
+    ///
+    inline const std::string& get_name(int index) const { return names[index]; }
+
+    /// Return the index of the result of an entry.
+    ///
+    /// @param name the name of the entry
+    /// @return the index of the result, or -1 if there is no such entry
+    ///
+    inline int find(const std::string& name) const {
+        for (std::size_t i = 0; i < names.size(); i++)
+            if (names[i] == name)
+                return i;
+        return -1;
+    }
+
+    /// Return a pointer to the results.
+    inline double* get_results() { return results.data(); }
+
+    /// Return the bytes of the program and its values.
+    std::size_t get_memory_size() const;
+};
+
+}  // namespace NES
+
+#endif  // RAM_WATCH_HPP
@@ -0,0 +1,299 @@
+//  Program:      nes-py
+//  File:         shared_batch.hpp
+//  Description:  A batch of emulators in worker processes sharing memory
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef SHARED_BATCH_HPP
+#define SHARED_BATCH_HPP
+
+// POSIX shared memory and futexes are only used on Linux
+#ifdef __linux__
+
+#include <atomic>
+#include <string>
+#include "common.hpp"
+#include "emulator.hpp"
+#include "pixel_format.hpp"
+#include "ram_watch.hpp"
+
+namespace NES {
+
+/// The commands the parent process posts to the workers
+enum SharedCommandType : uint32_t {
+    /// step the emulators with the actions in the shared region
+    SHARED_STEP,
+    /// reset the emulators to their start state
+    SHARED_RESET,
+    /// save the current state of the emulators as their start state
+    SHARED_BACKUP,
+    /// seed the generators of the emulators
+    SHARED_SEED,
+    /// set the probability of sticky actions
+    SHARED_STICKY_ACTIONS,
+    /// set the maximal number of no-op frames after a reset
+    SHARED_MAX_NOOPS,
+    /// set the number of steps after which episodes are truncated
+    SHARED_MAX_EPISODE_STEPS,
+    /// set the action table in the shared region as that of the emulators
+    SHARED_ACTION_TABLE,
+    /// leave the command loop of the workers
+    SHARED_CLOSE,
+};
+
+/// A command from the parent process to a worker
+struct SharedCommand {
+    /// the type of the command
+    SharedCommandType type;
+    /// the integer argument, i.e., the frames, seed, number of steps, or
+    /// number of actions
+    uint64_t value;
+    /// the real argument, i.e., the probability of sticky actions
+    double real;
+};
+
+/// A lock-free single producer (the parent) single consumer (a worker)
+/// ring of commands in shared memory
+struct SharedCommandRing {
+    /// the number of commands the ring holds
+    static const uint32_t CAPACITY = 64;
+    /// the number of commands posted by the parent (the futex of the worker)
+    alignas(64) std::atomic<uint32_t> head;
+    /// the number of processes sleeping on the futex of the head
+    std::atomic<uint32_t> head_waiters;
+    /// the number of commands finished by the worker
+    alignas(64) std::atomic<uint32_t> tail;
+    /// the commands, indexed by their number modulo the capacity
+    SharedCommand commands[CAPACITY];
+};
+
+/// The header at the start of the shared region that describes its layout
+struct SharedHeader;
+
+/// A batch of emulators of the same ROM that are owned by worker processes
+/// and stepped through shared memory. The parent creates a named POSIX
+/// shared memory region that holds the actions, action table, screens,
+/// frame stacks, RAM, RAM watch results, episode flags, and episode
+/// statistics of all the emulators as [N, ...] arrays. Each
+/// worker attaches to the region by name and runs a Batch of a contiguous
+/// slice of the emulators that renders straight into the shared screens.
+/// The parent posts commands to a lock-free ring per worker and waits on a
+/// futex for the workers to finish them, so a step costs a few context
+/// switches regardless of the size of the observations.
+class SharedBatch {
+ private:
+    /// the name of the shared memory object
+    std::string name;
+    /// the mapping of the shared region
+    SharedHeader* header;
+    /// the number of bytes of the mapping
+    std::size_t mapping_size;
+    /// whether this is the parent that created (and unlinks) the region
+    bool is_owner;
+    /// whether the name of the region is still linked (parent only)
+    bool is_linked;
+    /// the number of finished commands the parent waits for
+    uint32_t expected;
+    /// the RAM watch that describes the results (parent only)
+    RamWatch watch;
+
+    /// Create a handle on a mapping of the shared region.
+    ///
+    /// @param name the name of the shared memory object
+    /// @param header the mapping of the shared region
+    /// @param mapping_size the number of bytes of the mapping
+    /// @param is_owner whether this is the parent that created the region
+    ///
+    SharedBatch(
+        const std::string& name,
+        SharedHeader* header,
+        std::size_t mapping_size,
+        bool is_owner
+    );
+
+    /// Return a pointer into the shared region.
+    ///
+    /// @param offset the offset of the pointer from the start of the region
+    /// @return a pointer at the offset into the region
+    ///
+    template<typename T>
+    inline T* at(uint64_t offset) const {
+        return reinterpret_cast<T*>(reinterpret_cast<NES_Byte*>(header) + offset);
+    }
+
+    /// Return the command ring of a worker.
+    ///
+    /// @param index the index of the worker
+    /// @return a pointer to the command ring of the worker
+    ///
+    SharedCommandRing* get_ring(int index) const;
+
+    /// Post a command to every worker.
+    ///
+    /// @param command the command to post
+    ///
+    void post(const SharedCommand& command);
+
+ public:
+    /// The number of actions the action table of the shared region holds
+    static const int MAX_ACTIONS = 256;
+
+    /// Create a new shared region and return a handle of the parent on it.
+    ///
+    /// @param name the name of the shared memory object, e.g., "/nes_py_1"
+    /// @param rom_path the path to the ROM of the emulators
+    /// @param size the number of emulators in the batch
+    /// @param workers the number of worker processes to split them between
+    /// @param headless whether to disable rendering of the emulators
+    /// @param format the format the screens are rendered in
+    /// @param spec the text of the RAM watch spec of the emulators
+    /// @param stack_depth the number of frames in the frame stack of each
+    ///        emulator (0 for none)
+    /// @param stack_downsample the factor to downsample the stacked frames by
+    /// @param error the string to write a description of an error to
+    /// @return the handle of the parent, or nullptr on error
+    ///
+    static SharedBatch* create(
+        const std::string& name,
+        const std::string& rom_path,
+        int size,
+        int workers,
+        bool headless,
+        PixelFormat format,
+        const std::string& spec,
+        int stack_depth,
+        int stack_downsample,
+        std::string& error
+    );
+
+    /// Attach to an existing shared region and run the command loop of a
+    /// worker until the parent closes the batch.
+    ///
+    /// @param name the name of the shared memory object
+    /// @param index the index of the worker
+    /// @param error the string to write a description of an error to
+    /// @return true if the batch was closed, false on error
+    ///
+    static bool run_worker(const std::string& name, int index, std::string& error);
+
+    /// Unmap the shared region. The parent also tells the workers to close
+    /// and unlinks the shared memory object if it is still linked.
+    ~SharedBatch();
+
+    SharedBatch(const SharedBatch&) = delete;
+    SharedBatch& operator=(const SharedBatch&) = delete;
+
+    /// Wait for the workers to finish the posted commands (and to start
+    /// after the batch is created).
+    ///
+    /// @param timeout_ms the number of milliseconds to wait at most
+    /// @return true if the commands finished, false if the wait timed out
+    ///
+    bool wait(int timeout_ms);
+
+    /// Unlink the name of the shared memory object once every worker has
+    /// attached to it (see `wait`), so the region is freed with the last
+    /// mapping even if the parent dies without closing the batch.
+    void unlink();
+
+    /// Post a step of every emulator with an action. The actions are copied
+    /// to the shared region, so the previous step must have finished (see
+    /// `wait`) before the next one is posted.
+    ///
+    /// @param actions the action of each emulator, i.e., an index in its
+    ///        action table or the joypad byte of the first controller
+    /// @param frames the number of frames to hold the actions for
+    ///
+    void step(const int32_t* actions, int frames = 1);
+
+    /// Post a reset of every emulator to its start state.
+    inline void reset() { post({SHARED_RESET, 0, 0}); }
+
+    /// Post a backup of the current state of every emulator.
+    inline void backup() { post({SHARED_BACKUP, 0, 0}); }
+
+    /// Post a seed of the generators of the emulators (see Batch::seed).
+    inline void seed(uint64_t seed) { post({SHARED_SEED, seed, 0}); }
+
+    /// Post the probability of sticky actions of every emulator.
+    inline void set_sticky_actions(double probability) {
+        post({SHARED_STICKY_ACTIONS, 0, probability});
+    }
+
+    /// Post the maximal number of no-op frames after a reset.
+    inline void set_max_noops(int frames) {
+        post({SHARED_MAX_NOOPS, static_cast<uint64_t>(frames), 0});
+    }
+
+    /// Post the number of steps after which episodes are truncated.
+    inline void set_max_episode_steps(uint64_t steps) {
+        post({SHARED_MAX_EPISODE_STEPS, steps, 0});
+    }
+
+    /// Post the table of discrete actions of every emulator. The table is
+    /// copied to the shared region, so the previous command must have
+    /// finished (see `wait`) before it is posted.
+    ///
+    /// @param table the joypad bytes of the first and second controller for
+    ///        each action, one action after another
+    /// @param actions the number of actions in the table (0 to remove it)
+    /// @return true if the table was posted, false if it has more than
+    ///         MAX_ACTIONS actions
+    ///
+    bool set_action_table(const NES_Byte* table, int actions);
+
+    /// Return the number of emulators in the batch.
+    int size() const;
+
+    /// Return the number of bytes of the screen of an emulator.
+    std::size_t get_screen_size() const;
+
+    /// Return the RAM watch that describes the results.
+    inline const RamWatch& get_watch() const { return watch; }
+
+    /// Return a pointer to the shared screens of the emulators.
+    NES_Byte* get_screens() const;
+
+    /// Return a pointer to the shared final screens of the episodes that
+    /// ended in the last step.
+    NES_Byte* get_final_screens() const;
+
+    /// Return a pointer to the shared RAM of the emulators.
+    NES_Byte* get_ram() const;
+
+    /// Return a pointer to the shared RAM watch results of the emulators.
+    double* get_results() const;
+
+    /// Return a pointer to the shared terminated flags of the emulators.
+    NES_Byte* get_terminated() const;
+
+    /// Return a pointer to the shared truncated flags of the emulators.
+    NES_Byte* get_truncated() const;
+
+    /// Return the number of bytes of the frame stack ring of an emulator
+    /// (0 without frame stacks).
+    std::size_t get_frame_stack_size() const;
+
+    /// Return a pointer to the shared frame stack rings of the emulators
+    /// (see Batch::set_frame_stack).
+    NES_Byte* get_frame_stacks() const;
+
+    /// Return a pointer to the shared slots of the oldest frame of the
+    /// stack of each emulator.
+    int32_t* get_frame_stack_offsets() const;
+
+    /// Return a pointer to the shared statistics of the current episode of
+    /// each emulator.
+    EpisodeStats* get_episodes() const;
+
+    /// Return a pointer to the shared statistics of the last episode that
+    /// ended for each emulator.
+    EpisodeStats* get_final_episodes() const;
+};
+
+}  // namespace NES
+
+#endif  // __linux__
+
+#endif  // SHARED_BATCH_HPP
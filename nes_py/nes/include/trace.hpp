@@ -0,0 +1,105 @@
+//  Program:      nes-py
+//  File:         trace.hpp
+//  Description:  Scoped trace zones exported as Chrome trace-event JSON
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "common.hpp"
+
+namespace NES {
+
+/// Whether the trace zones record events, off unless enabled at runtime
+inline std::atomic<bool> tracing_enabled{false};
+
+/// A zone of a thread's timeline
+struct TraceEvent {
+    /// the name of the zone, a string literal
+    const char* name;
+    /// the start of the zone in nanoseconds since the trace epoch
+    uint64_t start;
+    /// the duration of the zone in nanoseconds
+    uint64_t duration;
+    /// the argument of the zone, e.g., the index of an emulator (-1 for none)
+    int32_t argument;
+    /// the id of the thread in the trace
+    uint32_t thread;
+};
+
+/// Return the nanoseconds since the trace epoch, i.e., the first call.
+uint64_t trace_now();
+
+/// Record a zone to the ring of the calling thread. The ring of each thread
+/// has a single writer, so recording takes no locks, and it keeps the last
+/// events when it is full.
+///
+/// @param event the zone to record, its thread is filled in
+///
+void trace_record(TraceEvent event);
+
+/// Name the calling thread in the trace, e.g., "batch worker 2".
+///
+/// @param name the name of the thread
+///
+void trace_thread_name(const std::string& name);
+
+/// Enable or disable the recording of zones.
+///
+/// @param enabled whether the zones record events
+///
+inline void set_tracing(bool enabled) { tracing_enabled.store(enabled, std::memory_order_relaxed); }
+
+/// Remove the events of every thread.
+void trace_clear();
+
+/// Write the events of every thread as Chrome trace-event JSON, e.g., to
+/// view in Perfetto or chrome://tracing. Zones still being recorded while
+/// the events are written can be torn, so tracing is best disabled first.
+///
+/// @param path the path of the file to write
+/// @param error the string to write a description of an error to
+/// @return true if the file was written, false otherwise
+///
+bool trace_dump(const std::string& path, std::string& error);
+
+/// Records the time from its creation to its destruction as a zone of the
+/// calling thread if tracing is enabled, else costs a load and a branch.
+class TraceZone {
+ private:
+    /// the name of the zone, a string literal
+    const char* name;
+    /// the argument of the zone
+    int32_t argument;
+    /// the start of the zone, or UINT64_MAX if tracing was disabled
+    uint64_t start;
+
+ public:
+    /// Start a zone.
+    ///
+    /// @param name the name of the zone, a string literal
+    /// @param argument the argument of the zone (-1 for none)
+    ///
+    explicit TraceZone(const char* name, int32_t argument = -1) :
+        name(name),
+        argument(argument),
+        start(tracing_enabled.load(std::memory_order_relaxed) ? trace_now() : UINT64_MAX) { }
+
+    /// Record the zone.
+    ~TraceZone() {
+        if (start != UINT64_MAX)
+            trace_record({name, start, trace_now() - start, argument, 0});
+    }
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+};
+
+}  // namespace NES
+
+#endif  // TRACE_HPP
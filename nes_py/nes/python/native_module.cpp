@@ -0,0 +1,248 @@
+//  Program:      nes-py
+//  File:         native_module.cpp
+//  Description:  A CPython extension module stepping the NES emulator
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <cstdint>
+
+namespace {
+
+/// The emulator of lib_nes_env, only ever handled through its address
+struct Emulator;
+
+/// The entry points of lib_nes_env the module calls. The emulator is not
+/// compiled into the module, so the emulators, tracing, and latency
+/// histograms are the ones of the library that NESEnv loaded.
+struct Library {
+    /// SetAction(emu, action), press the buttons of an action of the table
+    void (*set_action)(Emulator*, int32_t) = nullptr;
+    /// StepN(emu, steps), run frames with the GIL released
+    void (*step_n)(Emulator*, int) = nullptr;
+};
+
+/// The entry points bound by bind()
+Library library;
+
+/// The stepping of an emulator of lib_nes_env with its action and results
+struct StepperObject {
+    PyObject_HEAD
+    /// the emulator to step
+    Emulator* emulator;
+    /// the joypad byte of the first controller of the emulator
+    uint8_t* controller;
+    /// the number of actions of the action table (0 for joypad bytes)
+    long actions;
+    /// the RAM watch results (reward, done, and info), or nullptr for none
+    const double* results;
+    /// the names of the info entries of the RAM watch (a tuple)
+    PyObject* names;
+    /// whether a thread is stepping the emulator without holding the GIL
+    bool is_stepping;
+};
+
+/// Return an address passed from Python as a pointer.
+///
+/// @param value the address as a Python integer
+/// @param pointer the pointer to set
+/// @return true if the value is a non-null address, false with an error
+///
+template<typename T>
+bool parse_address(PyObject* value, T*& pointer) {
+    void* address = PyLong_AsVoidPtr(value);
+    if (address == nullptr) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_ValueError, "the address must not be null");
+        return false;
+    }
+    pointer = reinterpret_cast<T*>(address);
+    return true;
+}
+
+// MARK: Module
+
+PyObject* native_bind(PyObject*, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"set_action", "step_n", nullptr};
+    PyObject* set_action;
+    PyObject* step_n;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", const_cast<char**>(keywords), &set_action, &step_n))
+        return nullptr;
+    void* set_action_address;
+    void* step_n_address;
+    if (!parse_address(set_action, set_action_address) || !parse_address(step_n, step_n_address))
+        return nullptr;
+    library.set_action = reinterpret_cast<void(*)(Emulator*, int32_t)>(set_action_address);
+    library.step_n = reinterpret_cast<void(*)(Emulator*, int)>(step_n_address);
+    Py_RETURN_NONE;
+}
+
+PyMethodDef native_methods[] = {
+    {"bind", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(native_bind)), METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR(
+            "bind(set_action, step_n)\n\n"
+            "Bind the addresses of the SetAction and StepN functions of the "
+            "loaded lib_nes_env, which steppers call.")},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+// MARK: Stepper
+
+int stepper_init(StepperObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"emulator", "controller", "actions", "results", "names", nullptr};
+    PyObject* emulator;
+    PyObject* controller;
+    long actions = 0;
+    PyObject* results = Py_None;
+    PyObject* names = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|lOO!", const_cast<char**>(keywords),
+        &emulator, &controller, &actions, &results, &PyTuple_Type, &names))
+        return -1;
+    if (library.step_n == nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "lib_nes_env is not bound, call bind first");
+        return -1;
+    }
+    if (actions < 0) {
+        PyErr_SetString(PyExc_ValueError, "actions must not be negative");
+        return -1;
+    }
+    if (!parse_address(emulator, self->emulator) || !parse_address(controller, self->controller))
+        return -1;
+    self->results = nullptr;
+    if (results != Py_None && !parse_address(results, self->results))
+        return -1;
+    if (names == nullptr)
+        names = PyTuple_New(0);
+    else
+        Py_INCREF(names);
+    if (names == nullptr)
+        return -1;
+    Py_XSETREF(self->names, names);
+    self->actions = actions;
+    self->is_stepping = false;
+    return 0;
+}
+
+void stepper_dealloc(StepperObject* self) {
+    Py_XDECREF(self->names);
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+PyObject* stepper_step(StepperObject* self, PyObject* const* args, Py_ssize_t nargs) {
+    if (nargs < 1 || nargs > 2) {
+        PyErr_SetString(PyExc_TypeError, "step() takes an action and optionally the frames");
+        return nullptr;
+    }
+    if (self->emulator == nullptr) {
+        PyErr_SetString(PyExc_ValueError, "the stepper is not initialized");
+        return nullptr;
+    }
+    if (self->is_stepping) {
+        PyErr_SetString(PyExc_RuntimeError, "the emulator is stepping in another thread");
+        return nullptr;
+    }
+    long action = PyLong_AsLong(args[0]);
+    if (action == -1 && PyErr_Occurred())
+        return nullptr;
+    long frames = 1;
+    if (nargs == 2) {
+        frames = PyLong_AsLong(args[1]);
+        if (frames == -1 && PyErr_Occurred())
+            return nullptr;
+    }
+    if (frames < 1 || frames > INT32_MAX) {
+        PyErr_Format(PyExc_ValueError, "frames must be positive, got %ld", frames);
+        return nullptr;
+    }
+    if (self->actions > 0) {
+        if (action < 0 || action >= self->actions) {
+            PyErr_Format(PyExc_ValueError, "actions must be indexes in the action table of %ld actions", self->actions);
+            return nullptr;
+        }
+        library.set_action(self->emulator, static_cast<int32_t>(action));
+    } else {
+        if (action < 0 || action > 0xff) {
+            // the same error as assigning the byte to the NumPy controller
+            PyErr_Format(PyExc_OverflowError, "Python integer %ld out of bounds for uint8", action);
+            return nullptr;
+        }
+        *self->controller = static_cast<uint8_t>(action);
+    }
+    // the emulator is only touched by this thread until the step finishes
+    auto emulator = self->emulator;
+    auto step_n = library.step_n;
+    self->is_stepping = true;
+    Py_BEGIN_ALLOW_THREADS
+    step_n(emulator, static_cast<int>(frames));
+    Py_END_ALLOW_THREADS
+    self->is_stepping = false;
+    // the reward, the done flag, and the info from the RAM watch results
+    if (self->results == nullptr)
+        return Py_BuildValue("(dO{})", 0.0, Py_False);
+    PyObject* info = PyDict_New();
+    if (info == nullptr)
+        return nullptr;
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(self->names); i++) {
+        PyObject* value = PyFloat_FromDouble(self->results[i + 2]);
+        if (value == nullptr || PyDict_SetItem(info, PyTuple_GET_ITEM(self->names, i), value) < 0) {
+            Py_XDECREF(value);
+            Py_DECREF(info);
+            return nullptr;
+        }
+        Py_DECREF(value);
+    }
+    return Py_BuildValue("(dNN)", self->results[0], PyBool_FromLong(self->results[1] != 0), info);
+}
+
+PyMethodDef stepper_methods[] = {
+    {"step", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(stepper_step)), METH_FASTCALL,
+        PyDoc_STR(
+            "step(action, frames=1) -> (reward, done, info)\n\n"
+            "Press an action and run frames of the emulator with the GIL "
+            "released. Return the reward, the done flag, and the info dict "
+            "of the RAM watch, or (0.0, False, {}) without a watch.")},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+PyTypeObject StepperType = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "nes_py._native.Stepper",
+    .tp_basicsize = sizeof(StepperObject),
+    .tp_dealloc = reinterpret_cast<destructor>(stepper_dealloc),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+        "Stepper(emulator, controller, actions=0, results=None, names=())\n\n"
+        "Steps an emulator of lib_nes_env in a single call. The addresses "
+        "are those of the emulator, its first controller, and its RAM watch "
+        "results; actions is the size of its action table (0 for joypad "
+        "bytes) and names are the names of the info entries of the watch. "
+        "The stepper must not outlive the emulator or its watch."
+    ),
+    .tp_methods = stepper_methods,
+    .tp_init = reinterpret_cast<initproc>(stepper_init),
+    .tp_new = PyType_GenericNew,
+};
+
+PyModuleDef native_module = {
+    .m_base = PyModuleDef_HEAD_INIT,
+    .m_name = "nes_py._native",
+    .m_doc = PyDoc_STR("A native interface to step the emulators of lib_nes_env."),
+    .m_size = -1,
+    .m_methods = native_methods,
+};
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit__native(void) {
+    if (PyType_Ready(&StepperType) < 0)
+        return nullptr;
+    PyObject* module = PyModule_Create(&native_module);
+    if (module == nullptr) return nullptr;
+    if (PyModule_AddObjectRef(module, "Stepper", reinterpret_cast<PyObject*>(&StepperType)) < 0) {
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
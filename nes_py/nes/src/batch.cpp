@@ -0,0 +1,335 @@
+//  Program:      nes-py
+//  File:         batch.cpp
+//  Description:  A batch of emulators stepped together with auto-reset
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "batch.hpp"
+
+namespace NES {
+
+namespace {
+
+/// Allocate the 64-byte aligned RAM block of the emulators of a batch.
+///
+/// @param size the number of emulators in the batch
+/// @return the block of [size, 2048] bytes to free with std::free
+///
+NES_Byte* allocate_ram(int size) {
+    auto data = std::aligned_alloc(64, size * MainBus::RAM_SIZE);
+    if (data == nullptr)
+        throw std::bad_alloc();
+    return static_cast<NES_Byte*>(data);
+}
+
+}  // namespace
+
+Batch::Batch(const std::string& rom_path, int size, bool headless) :
+    pixel_format(XRGB32),
+    screen_buffer(nullptr),
+    final_screen_buffer(nullptr),
+    ram(allocate_ram(size)),
+    ram_buffer(nullptr),
+    frame_stack_buffer(nullptr),
+    frame_stack_offsets(size, 0),
+    watch_size(2),
+    results(2 * size, 0),
+    terminated(size, 0),
+    truncated(size, 0),
+    episode_steps(size, 0),
+    episodes(size, EpisodeStats{}),
+    final_episodes(size, EpisodeStats{}),
+    max_episode_steps(0),
+    has_backup(false),
+    finished(size),
+    finished_count(0),
+    is_in_flight(size, 0),
+    in_flight(0),
+    step_ready(size) {
+    for (int i = 0; i < size; i++) {
+        emulators.push_back(new Emulator(rom_path, headless));
+        emulators.back()->set_memory_buffer(ram.get() + i * MainBus::RAM_SIZE);
+    }
+    set_pixel_format(XRGB32);
+    seed(0);
+}
+
+Batch::~Batch() {
+    stop_workers();
+    for (auto emulator : emulators)
+        delete emulator;
+}
+
+void Batch::bind_screen(int index) {
+    auto slot = get_screens() + index * get_screen_size();
+    // restoring a state with another pixel format releases the slot
+    if (emulators[index]->get_pixel_format() != pixel_format)
+        emulators[index]->set_pixel_format(pixel_format);
+    if (emulators[index]->get_screen_buffer() != slot)
+        emulators[index]->set_screen_buffer(slot, 0);
+}
+
+void Batch::reset_emulator(int index) {
+    TraceZone zone("reset_emulator", index);
+    if (has_backup)
+        emulators[index]->restore();
+    else
+        emulators[index]->reset();
+    bind_screen(index);
+    episode_steps[index] = 0;
+    episodes[index] = emulators[index]->get_episode();
+    final_episodes[index] = emulators[index]->get_final_episode();
+}
+
+bool Batch::set_pixel_format(PixelFormat format) {
+    if (format < 0 || format >= NUM_PIXEL_FORMATS)
+        return false;
+    pixel_format = format;
+    if (!screen_buffer)
+        screens.assign(size() * get_screen_size(), 0);
+    if (!final_screen_buffer)
+        final_screens.assign(size() * get_screen_size(), 0);
+    for (int i = 0; i < size(); i++)
+        bind_screen(i);
+    return true;
+}
+
+void Batch::set_screen_buffers(NES_Byte* buffer, NES_Byte* final_buffer) {
+    screen_buffer = buffer;
+    final_screen_buffer = final_buffer;
+    // release the internal buffers that are replaced
+    screens.assign(screen_buffer ? 0 : size() * get_screen_size(), 0);
+    final_screens.assign(final_screen_buffer ? 0 : size() * get_screen_size(), 0);
+    for (int i = 0; i < size(); i++)
+        bind_screen(i);
+}
+
+void Batch::set_ram_buffer(NES_Byte* data) {
+    ram_buffer = data;
+    for (int i = 0; i < size(); i++)
+        emulators[i]->set_memory_buffer(get_ram() + i * MainBus::RAM_SIZE);
+}
+
+bool Batch::set_frame_stack(int depth, int downsample, NES_Byte* buffer) {
+    FrameStack shape;
+    if (!shape.configure(depth, downsample))
+        return false;
+    // the internal block is released while a caller buffer holds the rings
+    frame_stack_buffer = buffer;
+    frame_stacks.assign(buffer ? 0 : size() * shape.get_ring_size(), 0);
+    for (int i = 0; i < size(); i++) {
+        auto emulator = emulators[i];
+        emulator->set_frame_stack(depth, downsample);
+        auto& stack = emulator->get_frame_stack();
+        stack.set_buffer(get_frame_stacks() + i * shape.get_ring_size());
+        stack.fill(emulator->get_screen_view());
+        frame_stack_offsets[i] = stack.get_offset();
+    }
+    return true;
+}
+
+bool Batch::set_watch(const std::string& spec, std::string& error) {
+    for (auto emulator : emulators)
+        if (!emulator->set_watch(spec, error))
+            return false;
+    // the reward and done columns are kept without a watch
+    watch_size = std::max(2, emulators.empty() ? 0 : emulators[0]->get_watch().size());
+    results.assign(size() * watch_size, 0);
+    return true;
+}
+
+void Batch::set_action_table(const NES_Byte* table, int actions) {
+    for (auto emulator : emulators)
+        emulator->set_action_table(table, actions);
+}
+
+void Batch::set_sticky_actions(double probability) {
+    for (auto emulator : emulators)
+        emulator->set_sticky_actions(probability);
+}
+
+void Batch::set_max_noops(int frames) {
+    for (auto emulator : emulators)
+        emulator->set_max_noops(frames);
+}
+
+void Batch::seed(uint64_t seed, uint64_t first_stream) {
+    for (int i = 0; i < size(); i++)
+        emulators[i]->seed(seed, first_stream + i);
+}
+
+void Batch::backup() {
+    for (auto emulator : emulators)
+        emulator->backup();
+    has_backup = true;
+}
+
+MemoryFootprint Batch::get_memory_footprint() const {
+    MemoryFootprint footprint{};
+    for (auto emulator : emulators)
+        footprint += emulator->get_memory_footprint();
+    MemoryFootprint own{};
+    own.framebuffer = vector_bytes(screens) + vector_bytes(final_screens);
+    own.bus = size() * MainBus::RAM_SIZE;
+    own.caches = vector_bytes(frame_stacks);
+    own.objects = sizeof(Batch) + vector_bytes(emulators) + vector_bytes(results)
+        + vector_bytes(episodes) + vector_bytes(final_episodes);
+    own.total = own.framebuffer + own.bus + own.caches + own.objects;
+    footprint += own;
+    return footprint;
+}
+
+void Batch::reset() {
+    for (int i = 0; i < size(); i++) {
+        reset_emulator(i);
+        terminated[i] = truncated[i] = 0;
+    }
+    std::fill(results.begin(), results.end(), 0);
+}
+
+void Batch::step_emulator(int index, int32_t action, int frames) {
+    TraceZone zone("step_emulator", index);
+    auto emulator = emulators[index];
+    emulator->set_action(action);
+    emulator->step(frames);
+    episode_steps[index]++;
+    episodes[index] = emulator->get_episode();
+    // a reset fills the stack in place, so the offset is final here
+    frame_stack_offsets[index] = emulator->get_frame_stack().get_offset();
+    // copy the results out before a reset primes the watch again
+    auto& watch = emulator->get_watch();
+    auto row = results.data() + index * watch_size;
+    if (watch.empty()) {
+        std::fill(row, row + watch_size, 0);
+    } else {
+        std::copy(watch.get_results(), watch.get_results() + watch_size, row);
+    }
+    terminated[index] = row[RamWatch::DONE] != 0;
+    truncated[index] = max_episode_steps > 0 && episode_steps[index] >= max_episode_steps;
+    if (terminated[index] || truncated[index]) {
+        auto size_ = get_screen_size();
+        std::memcpy(get_final_screens() + index * size_, get_screens() + index * size_, size_);
+        reset_emulator(index);
+    }
+}
+
+bool Batch::step(const int32_t* actions, int frames) {
+    // waiting for the steps would collect the completions of the caller
+    if (in_flight != 0)
+        return false;
+    LatencyTimer timer(LATENCY_BATCH_STEP);
+    TraceZone zone("batch_step");
+    if (workers.empty()) {
+        for (int i = 0; i < size(); i++)
+            step_emulator(i, actions[i], frames);
+        return true;
+    }
+    step_async(actions, nullptr, size(), frames);
+    wait_all(step_ready.data(), size());
+    return true;
+}
+
+void Batch::run_worker(int worker) {
+    auto& queue = *tasks[worker];
+    trace_thread_name("batch worker " + std::to_string(worker));
+    for (;;) {
+        BatchTask task;
+        {
+            // the time a worker is starved of steps
+            TraceZone zone("wait_task");
+            queue.wait_pop(task);
+        }
+        if (task.index < 0)
+            return;
+        step_emulator(task.index, task.action, task.frames);
+        // the queue holds every emulator, so it never fills up
+        finished.push(task.index);
+        finished_count.fetch_add(1, std::memory_order_release);
+        finished_count.notify_one();
+    }
+}
+
+void Batch::stop_workers() {
+    for (auto& queue : tasks)
+        queue->push({-1, 0, 0});
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+    tasks.clear();
+}
+
+void Batch::set_threads(int threads) {
+    stop_workers();
+    threads = std::min(threads, size());
+    for (int i = 0; i < threads; i++) {
+        // a worker has at most one step in flight per emulator and a stop
+        tasks.emplace_back(new SPSCQueue<BatchTask>((size() + threads - 1) / threads + 1));
+    }
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(&Batch::run_worker, this, i);
+}
+
+bool Batch::step_async(const int32_t* actions, const int32_t* indexes, int count, int frames) {
+    // check every index before starting any step
+    for (int i = 0; i < count; i++) {
+        int index = indexes ? indexes[i] : i;
+        if (index < 0 || index >= size() || is_in_flight[index]) {
+            for (int j = 0; j < i; j++)
+                is_in_flight[indexes ? indexes[j] : j] = 0;
+            return false;
+        }
+        // mark the emulators to catch duplicate indexes
+        is_in_flight[index] = 2;
+    }
+    TraceZone zone("enqueue_steps", count);
+    for (int i = 0; i < count; i++) {
+        int index = indexes ? indexes[i] : i;
+        is_in_flight[index] = 1;
+        in_flight++;
+        if (workers.empty()) {
+            step_emulator(index, actions[i], frames);
+            finished.push(index);
+        } else {
+            tasks[index % workers.size()]->push({index, actions[i], frames});
+        }
+    }
+    return true;
+}
+
+int Batch::poll(int32_t* ready, int max) {
+    int count = 0;
+    int32_t index;
+    while (count < max && finished.pop(index)) {
+        is_in_flight[index] = 0;
+        in_flight--;
+        ready[count++] = index;
+    }
+    return count;
+}
+
+int Batch::wait_any(int32_t* ready, int max) {
+    for (;;) {
+        // read the count first so that a step finishing after the poll
+        // wakes the wait
+        uint32_t count = finished_count.load(std::memory_order_acquire);
+        int polled = poll(ready, max);
+        if (polled > 0 || in_flight == 0 || max <= 0)
+            return polled;
+        TraceZone zone("wait_steps");
+        finished_count.wait(count, std::memory_order_acquire);
+    }
+}
+
+int Batch::wait_all(int32_t* ready, int max) {
+    int count = 0;
+    while (in_flight > 0 && count < max)
+        count += wait_any(ready + count, max - count);
+    return count;
+}
+
+}  // namespace NES
@@ -28,10 +28,11 @@ void Cartridge::loadFromFile(std::string path) {
     romFile.read(reinterpret_cast<char*>(&prg_rom[0]), 0x4000 * banks);
     // read CHR-ROM 8KB banks
     NES_Byte vbanks = header[5];
-    if (!vbanks)
-        return;
-    chr_rom.resize(0x2000 * vbanks);
-    romFile.read(reinterpret_cast<char*>(&chr_rom[0]), 0x2000 * vbanks);
+    if (vbanks) {
+        chr_rom.resize(0x2000 * vbanks);
+        romFile.read(reinterpret_cast<char*>(&chr_rom[0]), 0x2000 * vbanks);
+    }
+    account.set(get_memory_size());
 }
 
 void Cartridge::serialize(std::vector<uint8_t>& buffer) {
@@ -47,6 +48,7 @@ std::span<uint8_t> Cartridge::deserialize(std::span<uint8_t> buffer) {
     buffer = deserialize_vector(buffer, chr_rom);
     deserialize_int(buffer, name_table_mirroring);
     deserialize_bool(buffer, has_extended_ram);
+    account.set(get_memory_size());
     return buffer;
 }
 
@@ -539,6 +539,29 @@ void CPU::interrupt(MainBus &bus, InterruptType type) {
     }
     // add the number of cycles to handle the interrupt
     skip_cycles += 7;
+    // the cycles of BRK are those of its instruction
+    if (profiler) {
+        auto kind = type == NMI_INTERRUPT ? Profiler::NMI_FRAME : Profiler::IRQ_FRAME;
+        profiler->interrupt(kind, register_PC, type == BRK_INTERRUPT ? 0 : 7, register_SP);
+    }
+}
+
+void CPU::trace_instruction(MainBus &bus, NES_Address address, NES_Byte opcode) {
+    int length = operation_length(opcode);
+    // the flags in the layout of the P register, the bit-field of the union
+    // is laid out by the compiler
+    NES_Byte p = flags.bits.N << 7 | flags.bits.V << 6 | flags.bits.ONE << 5 | flags.bits.B << 4
+        | flags.bits.D << 3 | flags.bits.I << 2 | flags.bits.Z << 1 | flags.bits.C;
+    trace->record({
+        // the cycle of the fetch is already counted
+        static_cast<uint32_t>(cycles - 1), address, 0, 0, opcode,
+        {
+            length > 1 ? bus.peek(address + 1) : NES_Byte(0),
+            length > 2 ? bus.peek(address + 2) : NES_Byte(0),
+        },
+        register_A, register_X, register_Y, p, register_SP,
+        static_cast<NES_Byte>(length), 0,
+    });
 }
 
 void CPU::cycle(MainBus &bus) {
@@ -550,7 +573,10 @@ void CPU::cycle(MainBus &bus) {
     // reset the number of skip cycles to 0
     skip_cycles = 0;
     // read the opcode from the bus and lookup the number of cycles
+    NES_Address address = register_PC;
     NES_Byte op = bus.read(register_PC++);
+    if (trace)
+        trace_instruction(bus, address, op);
     // Using short-circuit evaluation, call the other function only if the
     // first failed. ExecuteImplied must be called first and ExecuteBranch
     // must be before ExecuteType0
@@ -558,6 +584,9 @@ void CPU::cycle(MainBus &bus) {
         skip_cycles += OPERATION_CYCLES[op];
     else
         std::cout << "failed to execute opcode: " << std::hex << +op << std::endl;
+    // the skip cycles are the cycles of the whole instruction
+    if (profiler)
+        profiler->instruction(address, op, skip_cycles, register_SP, register_PC);
 }
 
 /// Serializable
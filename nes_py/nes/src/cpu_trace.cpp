@@ -0,0 +1,148 @@
+//  Program:      nes-py
+//  File:         cpu_trace.cpp
+//  Description:  A binary trace of the instructions the CPU executes
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include "cpu_trace.hpp"
+#include "cpu_opcodes.hpp"
+
+namespace NES {
+
+namespace {
+
+/// The magic bytes at the start of a trace file
+const char TRACE_MAGIC[8] = {'N', 'E', 'S', 'C', 'P', 'U', 'T', 'R'};
+/// The version of the layout of the records of a trace file
+const uint32_t TRACE_VERSION = 1;
+
+/// The header of a trace file
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+/// Format the operand of an instruction in assembly syntax.
+std::string format_operand(const CpuTraceRecord& record) {
+    char text[16] = "";
+    unsigned byte = record.operand[0];
+    unsigned word = record.operand[0] | record.operand[1] << 8;
+    switch (OPERATION_MODES[record.opcode]) {
+        case MODE_IMP: break;
+        case MODE_ACC: std::snprintf(text, sizeof(text), "A"); break;
+        case MODE_IMM: std::snprintf(text, sizeof(text), "#$%02X", byte); break;
+        case MODE_ZP: std::snprintf(text, sizeof(text), "$%02X", byte); break;
+        case MODE_ZPX: std::snprintf(text, sizeof(text), "$%02X,X", byte); break;
+        case MODE_ZPY: std::snprintf(text, sizeof(text), "$%02X,Y", byte); break;
+        case MODE_ABS: std::snprintf(text, sizeof(text), "$%04X", word); break;
+        case MODE_ABX: std::snprintf(text, sizeof(text), "$%04X,X", word); break;
+        case MODE_ABY: std::snprintf(text, sizeof(text), "$%04X,Y", word); break;
+        case MODE_IND: std::snprintf(text, sizeof(text), "($%04X)", word); break;
+        case MODE_IZX: std::snprintf(text, sizeof(text), "($%02X,X)", byte); break;
+        case MODE_IZY: std::snprintf(text, sizeof(text), "($%02X),Y", byte); break;
+        case MODE_REL: {
+            // branches are relative to the next instruction
+            unsigned target = (record.pc + 2 + static_cast<int8_t>(byte)) & 0xffff;
+            std::snprintf(text, sizeof(text), "$%04X", target);
+            break;
+        }
+    }
+    return text;
+}
+
+}  // namespace
+
+CpuTrace::CpuTrace(std::size_t capacity) :
+    records(std::bit_ceil(std::max<std::size_t>(capacity, 1))),
+    head(0),
+    ppu(nullptr) { }
+
+std::size_t CpuTrace::copy(CpuTraceRecord* output, std::size_t max) const {
+    std::size_t count = std::min(size(), max);
+    for (uint64_t i = head - count; i < head; i++)
+        *output++ = records[i & (records.size() - 1)];
+    return count;
+}
+
+bool CpuTrace::dump(const std::string& path, std::string& error) const {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    TraceHeader header;
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(CpuTraceRecord);
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::vector<CpuTraceRecord> ordered(size());
+    copy(ordered.data(), ordered.size());
+    std::fwrite(ordered.data(), sizeof(CpuTraceRecord), ordered.size(), file);
+    if (std::fclose(file) != 0) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+std::string format_cpu_record(const CpuTraceRecord& record) {
+    // the columns of nestest.log: the bytes at 6, the disassembly at 16 (an
+    // unofficial opcode is marked at 15), and the registers at 48
+    char bytes[16];
+    int length = std::clamp<int>(record.length, 1, 3);
+    int written = std::snprintf(bytes, sizeof(bytes), "%02X", record.opcode);
+    for (int i = 1; i < length; i++)
+        written += std::snprintf(bytes + written, sizeof(bytes) - written, " %02X", record.operand[i - 1]);
+    bool is_unofficial = OPERATION_CYCLES[record.opcode] == 0 || record.opcode == 0xeb;
+    std::string assembly = OPERATION_MNEMONICS[record.opcode];
+    std::string operand = format_operand(record);
+    if (!operand.empty())
+        assembly += " " + operand;
+    char line[128];
+    std::snprintf(line, sizeof(line),
+        "%04X  %-8s %c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3u,%3u CYC:%u",
+        record.pc, bytes, is_unofficial ? '*' : ' ', assembly.c_str(),
+        record.a, record.x, record.y, record.p, record.sp,
+        record.scanline, record.dot, record.cycle);
+    return line;
+}
+
+bool format_cpu_trace(const std::string& trace_path, const std::string& log_path, std::string& error) {
+    std::FILE* input = std::fopen(trace_path.c_str(), "rb");
+    if (!input) {
+        error = "cannot open " + trace_path;
+        return false;
+    }
+    TraceHeader header;
+    if (std::fread(&header, sizeof(header), 1, input) != 1
+        || std::memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0
+        || header.version != TRACE_VERSION
+        || header.record_size != sizeof(CpuTraceRecord)) {
+        std::fclose(input);
+        error = trace_path + " is not a CPU trace of this version";
+        return false;
+    }
+    std::FILE* output = std::fopen(log_path.c_str(), "w");
+    if (!output) {
+        std::fclose(input);
+        error = "cannot open " + log_path;
+        return false;
+    }
+    CpuTraceRecord record;
+    while (std::fread(&record, sizeof(record), 1, input) == 1)
+        std::fprintf(output, "%s\n", format_cpu_record(record).c_str());
+    std::fclose(input);
+    if (std::fclose(output) != 0) {
+        error = "cannot write " + log_path;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace NES
@@ -5,6 +5,8 @@
 //  Copyright (c) 2019 Christian Kauten. All rights reserved.
 //
 
+#include <algorithm>
+#include <bit>
 #include "emulator.hpp"
 #include "light_ppu.hpp"
 #include "mapper_factory.hpp"
@@ -12,7 +14,19 @@
 
 namespace NES {
 
-Emulator::Emulator(std::string rom_path, bool headless) {
+Emulator::Emulator(std::string rom_path, bool headless) :
+    sticky_probability(0),
+    sticky_buttons{0, 0},
+    max_noops(0),
+    progress_index(-1),
+    episode{},
+    final_episode{},
+    episode_start(std::chrono::steady_clock::now()),
+    counters{},
+    frame_counters{},
+    total_counters{},
+    profiling(false),
+    cpu_tracing(false) {
     // load the ROM from disk, expect that the Python code has validated it
     cartridge.loadFromFile(rom_path);
 
@@ -34,6 +48,13 @@ void Emulator::setup_callbacks() {
     // give the IO buses a pointer to the mapper
     bus.set_mapper(mapper);
     picture_bus.set_mapper(mapper);
+    // count the accesses of the buses of this emulator
+    bus.set_counters(&counters);
+    picture_bus.set_counters(&counters);
+    // copies of the CPU in saved states carry the profiler they were
+    // saved with
+    cpu.set_profiler(profiling ? profiler.get() : nullptr);
+    cpu.set_trace(cpu_tracing ? cpu_trace.get() : nullptr);
     bus.clear_callbacks();
     bus.set_read_callback(PPUSTATUS, [&](void) { return ppu->get_status();          });
     bus.set_read_callback(PPUDATA,   [&](void) { return ppu->get_data(picture_bus); });
@@ -47,14 +68,14 @@ void Emulator::setup_callbacks() {
     bus.set_write_callback(PPUADDR,  [&](NES_Byte b) { ppu->set_data_address(b);                                    });
     bus.set_write_callback(PPUSCROL, [&](NES_Byte b) { ppu->set_scroll(b);                                          });
     bus.set_write_callback(PPUDATA,  [&](NES_Byte b) { ppu->set_data(picture_bus, b);                               });
-    bus.set_write_callback(OAMDMA,   [&](NES_Byte b) { cpu.skip_DMA_cycles(); ppu->do_DMA(bus.get_page_pointer(b)); });
+    bus.set_write_callback(OAMDMA,   [&](NES_Byte b) { NES_COUNT(counters.oam_dmas++); cpu.skip_DMA_cycles(); ppu->do_DMA(bus.get_page_pointer(b)); });
     bus.set_write_callback(JOY1,     [&](NES_Byte b) { controllers[0].strobe(b); controllers[1].strobe(b);         });
     bus.set_write_callback(OAMDATA,  [&](NES_Byte b) { ppu->set_OAM_data(b);                                        });
     // set the interrupt callback for the PPU
-    ppu->set_interrupt_callback([&]() { cpu.interrupt(bus, CPU::NMI_INTERRUPT); });
+    ppu->set_interrupt_callback([&]() { NES_COUNT(counters.nmis++); cpu.interrupt(bus, CPU::NMI_INTERRUPT); });
 }
 
-void Emulator::step() {
+void Emulator::run_frame() {
     // render a single frame on the emulator
     for (int i = 0; i < CYCLES_PER_FRAME; i++) {
         // 3 PPU steps per CPU step
@@ -63,29 +84,197 @@ void Emulator::step() {
         ppu->cycle(picture_bus);
         cpu.cycle(bus);
     }
+#ifdef NES_COUNTERS
+    // publish the counters of the frame and start counting the next one
+    total_counters += counters;
+    frame_counters = counters;
+    counters = HotPathCounters{};
+#endif
+}
+
+void Emulator::run_frames(int frames) {
+    bool is_rendering = ppu->get_rendering();
+    // a double buffered frame is published if it renders from its start,
+    // which can lie in the frame before the last one
+    int rendered_frames = ppu->get_double_buffered() ? 2 : 1;
+    // the buttons of the action, the controllers hold the pressed ones
+    NES_Byte buttons[2] = {*get_controller(0), *get_controller(1)};
+    for (int i = 0; i < frames; i++) {
+        ppu->set_rendering(is_rendering && i >= frames - rendered_frames);
+        if (sticky_probability > 0) {
+            if (rng.uniform() >= sticky_probability) {
+                sticky_buttons[0] = buttons[0];
+                sticky_buttons[1] = buttons[1];
+            }
+            controllers[0].write_buttons(sticky_buttons[0]);
+            controllers[1].write_buttons(sticky_buttons[1]);
+        }
+        {
+            TraceZone zone(ppu->get_rendering() ? "render_frame" : "frame");
+            run_frame();
+        }
+        watch.update(get_memory_buffer());
+    }
+    ppu->set_rendering(is_rendering);
+    if (sticky_probability <= 0) {
+        sticky_buttons[0] = buttons[0];
+        sticky_buttons[1] = buttons[1];
+    }
+}
+
+void Emulator::set_profiling(bool enabled) {
+    if (enabled && !profiler)
+        profiler = std::make_unique<Profiler>();
+    profiling = enabled;
+    cpu.set_profiler(profiling ? profiler.get() : nullptr);
+}
+
+void Emulator::set_cpu_tracing(bool enabled, std::size_t capacity) {
+    if (enabled && !cpu_trace)
+        cpu_trace = std::make_unique<CpuTrace>(capacity ? capacity : CpuTrace::DEFAULT_CAPACITY);
+    else if (cpu_trace && capacity && std::bit_ceil(capacity) != cpu_trace->get_capacity())
+        cpu_trace = std::make_unique<CpuTrace>(capacity);
+    if (cpu_trace)
+        cpu_trace->set_ppu(ppu);
+    cpu_tracing = enabled;
+    cpu.set_trace(cpu_tracing ? cpu_trace.get() : nullptr);
+}
+
+void Emulator::start_episode() {
+    if (episode.length > 0)
+        final_episode = episode;
+    episode = EpisodeStats{};
+    controllers[0].write_buttons(0);
+    controllers[1].write_buttons(0);
+    sticky_buttons[0] = sticky_buttons[1] = 0;
+    if (max_noops > 0) {
+        int noops = rng.up_to(max_noops);
+        if (noops > 0)
+            run_frames(noops);
+    }
+    watch.prime(get_memory_buffer());
+    frame_stack.fill(get_screen_view());
+    if (progress_index >= 0)
+        episode.max_progress = watch.get_results()[progress_index];
+    episode_start = std::chrono::steady_clock::now();
+}
+
+void Emulator::reset() {
+    if (profiler)
+        profiler->reset_calls();
+    cpu.reset(bus);
+    ppu->reset();
+    start_episode();
+}
+
+void Emulator::restore() {
+    {
+        LatencyTimer timer(LATENCY_SNAPSHOT);
+        TraceZone zone("restore");
+        load_state(&savedState);
+    }
+    start_episode();
+}
+
+void Emulator::step(int steps) {
+    LatencyTimer timer(LATENCY_STEP);
+    TraceZone zone("step");
+    // the watch sums the reward of all the frames
+    watch.begin_step();
+    {
+        LatencyTimer emulation_timer(LATENCY_EMULATION);
+        run_frames(steps);
+    }
+    if (!frame_stack.empty()) {
+        LatencyTimer preprocess_timer(LATENCY_PREPROCESS);
+        TraceZone preprocess_zone("frame_stack");
+        frame_stack.push(get_screen_view());
+    }
+    // accumulate the statistics of the episode
+    episode.length++;
+    episode.frames += steps;
+    if (!watch.empty()) {
+        const double* results = watch.get_results();
+        episode.episode_return += results[RamWatch::REWARD];
+        if (progress_index >= 0)
+            episode.max_progress = std::max(episode.max_progress, results[progress_index]);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - episode_start;
+    episode.seconds = std::chrono::duration<double>(elapsed).count();
+}
+
+bool Emulator::set_pixel_format(PixelFormat format) {
+    if (format < 0 || format >= NUM_PIXEL_FORMATS)
+        return false;
+    ppu->set_pixel_format(format);
+    return true;
+}
+
+bool Emulator::convert_screen(NES_Byte* output, PixelFormat format) {
+    if (get_pixel_format() != PALETTE_INDEX || format < 0 || format >= NUM_PIXEL_FORMATS)
+        return false;
+    LatencyTimer timer(LATENCY_PREPROCESS);
+    TraceZone zone("convert_screen");
+    const ScreenView& view = ppu->get_screen_view();
+    if (view.stride == row_size(PALETTE_INDEX)) {
+        convert_palette_indexes(view.data, output, format);
+    } else {  // gather a caller-owned buffer with padded rows first
+        std::vector<NES_Byte> indexes(SCREEN_PIXELS);
+        copy_screen(view, {indexes.data(), row_size(PALETTE_INDEX), PALETTE_INDEX});
+        convert_palette_indexes(indexes.data(), output, format);
+    }
+    return true;
+}
+
+void Emulator::save_state(SavedState& state) {
+    state.bus = bus;
+    state.picture_bus = picture_bus;
+    state.cpu = cpu;
+    state.ppu = *ppu;
+    state.account.set(state.get_memory_size());
 }
 
 SavedState* Emulator::save_state() {
     SavedState* state = new SavedState();
-    state->bus = bus;
-    state->picture_bus = picture_bus;
-    state->cpu = cpu;
-    state->ppu = *ppu;
-
+    save_state(*state);
     return state;
 }
 
+MemoryFootprint Emulator::get_memory_footprint() const {
+    MemoryFootprint footprint{};
+    footprint.rom = cartridge.get_memory_size();
+    footprint.framebuffer = ppu->get_screen_memory_size();
+    // the backup is resident whether or not it holds a state
+    footprint.snapshots = savedState.get_memory_size() - sizeof(SavedState);
+    footprint.caches = vector_bytes(action_table) + watch.get_memory_size()
+        + frame_stack.get_memory_size() + (profiler ? profiler->get_memory_size() : 0)
+        + (cpu_trace ? cpu_trace->get_memory_size() : 0);
+    footprint.bus = bus.get_memory_size() + picture_bus.get_memory_size()
+        + ppu->get_memory_size() + mapper->get_memory_size();
+    footprint.objects = sizeof(Emulator) + sizeof(PPU) + (profiler ? sizeof(Profiler) : 0)
+        + (cpu_trace ? sizeof(CpuTrace) : 0);
+    footprint.total = footprint.rom + footprint.framebuffer + footprint.snapshots
+        + footprint.caches + footprint.bus + footprint.objects;
+    return footprint;
+}
+
 void Emulator::load_state(SavedState* state) {
     bus = state->bus;
     picture_bus = state->picture_bus;
     cpu = state->cpu;
     *ppu = state->ppu;
     setup_callbacks();
+    // the stack of the state has other calls on it
+    if (profiler)
+        profiler->reset_calls();
+    watch.prime(get_memory_buffer());
 }
 
 // Serializable 
 
 void Emulator::serialize(std::vector<uint8_t>& buffer) {
+    LatencyTimer timer(LATENCY_SNAPSHOT);
+    TraceZone zone("serialize");
     bus.serialize(buffer);
     picture_bus.serialize(buffer);
     cpu.serialize(buffer);
@@ -93,12 +282,31 @@ void Emulator::serialize(std::vector<uint8_t>& buffer) {
 }
 
 std::span<uint8_t> Emulator::deserialize(std::span<uint8_t> buffer) {
+    LatencyTimer timer(LATENCY_SNAPSHOT);
+    TraceZone zone("deserialize");
     buffer = bus.deserialize(buffer);
     buffer = picture_bus.deserialize(buffer);
     buffer = cpu.deserialize(buffer);
     buffer = ppu->deserialize(buffer);
     setup_callbacks();
+    if (profiler)
+        profiler->reset_calls();
+    watch.prime(get_memory_buffer());
     return buffer;
 }
 
+bool Emulator::deserialize(std::span<uint8_t> buffer, std::string& error) {
+    // a state that fails part way through is rolled back
+    SavedState previous;
+    save_state(previous);
+    try {
+        deserialize(buffer);
+    } catch (const StateError& state_error) {
+        load_state(&previous);
+        error = state_error.what();
+        return false;
+    }
+    return true;
+}
+
 }  // namespace NES
@@ -0,0 +1,152 @@
+//  Program:      nes-py
+//  File:         frame_stack.cpp
+//  Description:  A ring buffer of the last frames of an emulator as luma
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "frame_stack.hpp"
+
+namespace NES {
+
+/// Return an 8-bit channel value from the bits of a normalized half.
+///
+/// @param bits the bits of the half-precision float in [0, 1]
+/// @return the channel value rounded to [0, 255]
+///
+static int half_channel(uint16_t bits) {
+    int exponent = (bits >> 10) & 0x1f;
+    int mantissa = bits & 0x3ff;
+    float value = exponent == 0 ?
+        std::ldexp(static_cast<float>(mantissa), -24) :
+        std::ldexp(static_cast<float>(mantissa + 0x400), exponent - 25);
+    return std::clamp(static_cast<int>(value * 255.0f + 0.5f), 0, 255);
+}
+
+/// Compute the luma of each pixel of a row of a screen.
+///
+/// @param view the screen to read the row from
+/// @param y the row of the screen
+/// @param luma the SCREEN_WIDTH bytes to write the luma of the row to
+///
+static void luma_row(const ScreenView& view, int y, NES_Byte* luma) {
+    const NES_Byte* row = view.row(y);
+    switch (view.format) {
+        case XRGB32:
+            for (int x = 0; x < SCREEN_WIDTH; x++) {
+                uint32_t xrgb;
+                std::memcpy(&xrgb, row + 4 * x, 4);
+                luma[x] = rgb_luma((xrgb >> 16) & 0xff, (xrgb >> 8) & 0xff, xrgb & 0xff);
+            }
+            break;
+        case PALETTE_INDEX:
+            for (int x = 0; x < SCREEN_WIDTH; x++)
+                luma[x] = PALETTE_TABLES.luma[row[x] & 0x3f];
+            break;
+        case RGB24:
+            for (int x = 0; x < SCREEN_WIDTH; x++)
+                luma[x] = rgb_luma(row[3 * x], row[3 * x + 1], row[3 * x + 2]);
+            break;
+        case BGR24:
+            for (int x = 0; x < SCREEN_WIDTH; x++)
+                luma[x] = rgb_luma(row[3 * x + 2], row[3 * x + 1], row[3 * x]);
+            break;
+        case RGBA32:
+            for (int x = 0; x < SCREEN_WIDTH; x++)
+                luma[x] = rgb_luma(row[4 * x], row[4 * x + 1], row[4 * x + 2]);
+            break;
+        case BGRA32:
+            for (int x = 0; x < SCREEN_WIDTH; x++)
+                luma[x] = rgb_luma(row[4 * x + 2], row[4 * x + 1], row[4 * x]);
+            break;
+        case CHW_UINT8: {
+            const NES_Byte* green = view.row(y, 1);
+            const NES_Byte* blue = view.row(y, 2);
+            for (int x = 0; x < SCREEN_WIDTH; x++)
+                luma[x] = rgb_luma(row[x], green[x], blue[x]);
+            break;
+        }
+        case CHW_FLOAT16: {
+            const NES_Byte* planes[3] = {row, view.row(y, 1), view.row(y, 2)};
+            for (int x = 0; x < SCREEN_WIDTH; x++) {
+                int channels[3];
+                for (int plane = 0; plane < 3; plane++) {
+                    uint16_t bits;
+                    std::memcpy(&bits, planes[plane] + 2 * x, 2);
+                    channels[plane] = half_channel(bits);
+                }
+                luma[x] = rgb_luma(channels[0], channels[1], channels[2]);
+            }
+            break;
+        }
+    }
+}
+
+bool FrameStack::configure(int depth_, int downsample_) {
+    if (depth_ < 0 || downsample_ < 1 ||
+        SCREEN_WIDTH % downsample_ != 0 || SCREEN_HEIGHT % downsample_ != 0)
+        return false;
+    depth = depth_;
+    downsample = downsample_;
+    // the stack starts at the upper half, the next push writes slot 0
+    offset = depth;
+    frames.assign(buffer ? 0 : get_ring_size(), 0);
+    row_luma.assign(SCREEN_WIDTH, 0);
+    block_sums.assign(get_width(), 0);
+    return true;
+}
+
+void FrameStack::set_buffer(NES_Byte* data) {
+    buffer = data;
+    frames.assign(buffer ? 0 : get_ring_size(), 0);
+    std::fill(get_buffer(), get_buffer() + get_ring_size(), 0);
+    offset = depth;
+}
+
+void FrameStack::preprocess(const ScreenView& view, NES_Byte* frame) {
+    if (downsample == 1) {
+        for (int y = 0; y < SCREEN_HEIGHT; y++)
+            luma_row(view, y, frame + y * SCREEN_WIDTH);
+        return;
+    }
+    const int width = get_width();
+    const uint32_t area = downsample * downsample;
+    for (int y = 0; y < get_height(); y++) {
+        std::fill(block_sums.begin(), block_sums.end(), 0);
+        for (int dy = 0; dy < downsample; dy++) {
+            luma_row(view, y * downsample + dy, row_luma.data());
+            for (int x = 0; x < SCREEN_WIDTH; x++)
+                block_sums[x / downsample] += row_luma[x];
+        }
+        // round the mean of each block to nearest
+        for (int x = 0; x < width; x++)
+            frame[y * width + x] = (block_sums[x] + area / 2) / area;
+    }
+}
+
+void FrameStack::push(const ScreenView& view) {
+    if (empty())
+        return;
+    // the oldest frame lies in slot (offset % depth) and its copy
+    int slot = offset % depth;
+    auto size = get_frame_size();
+    auto frame = get_buffer() + slot * size;
+    preprocess(view, frame);
+    std::memcpy(frame + depth * size, frame, size);
+    offset = slot + 1;
+}
+
+void FrameStack::fill(const ScreenView& view) {
+    if (empty())
+        return;
+    // the offset is kept, so stacks that step together stay aligned
+    auto size = get_frame_size();
+    preprocess(view, get_buffer());
+    for (int slot = 1; slot < 2 * depth; slot++)
+        std::memcpy(get_buffer() + slot * size, get_buffer(), size);
+}
+
+}  // namespace NES
@@ -0,0 +1,157 @@
+//  Program:      nes-py
+//  File:         latency.cpp
+//  Description:  Lock-free histograms of the latencies of the core
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "latency.hpp"
+
+namespace NES {
+
+namespace {
+
+/// The histograms of the sections of a thread, on cache lines of their own
+struct alignas(64) LatencyShard {
+    LatencyHistogram sections[NUM_LATENCY_SECTIONS];
+};
+
+/// The histograms of every thread that recorded latencies
+struct LatencyShards {
+    /// the lock of the shards, taken when a thread starts or exits recording
+    /// and when the histograms are read, never while recording
+    std::mutex mutex;
+    /// every shard, in use or not
+    std::vector<std::unique_ptr<LatencyShard>> shards;
+    /// the shards of threads that exited
+    std::vector<LatencyShard*> unused;
+};
+
+/// Return the shards of the process, which are never destroyed so threads
+/// that exit during static destruction can still return theirs.
+LatencyShards& latency_shards() {
+    static LatencyShards* shards = new LatencyShards();
+    return *shards;
+}
+
+/// The shard of a thread, taken when it first records a latency and
+/// returned when it exits
+struct ThreadShard {
+    LatencyShard* shard;
+
+    ThreadShard() {
+        auto& shards = latency_shards();
+        std::lock_guard<std::mutex> lock(shards.mutex);
+        if (shards.unused.empty()) {
+            shards.shards.emplace_back(new LatencyShard());
+            shard = shards.shards.back().get();
+        } else {
+            shard = shards.unused.back();
+            shards.unused.pop_back();
+        }
+    }
+
+    ~ThreadShard() {
+        auto& shards = latency_shards();
+        std::lock_guard<std::mutex> lock(shards.mutex);
+        shards.unused.push_back(shard);
+    }
+};
+
+}  // namespace
+
+double LatencyHistogram::bucket_value(int index) {
+    if (index < LINEAR_BUCKETS)
+        return index;
+    int shift = (index - LINEAR_BUCKETS) / (1 << MANTISSA_BITS) + 1;
+    uint64_t mantissa = (index - LINEAR_BUCKETS) % (1 << MANTISSA_BITS) + (1 << MANTISSA_BITS);
+    uint64_t lower = mantissa << shift;
+    return lower + ((uint64_t(1) << shift) - 1) / 2.0;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket_count : counts)
+        bucket_count.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < BUCKETS; i++)
+        counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    count.fetch_add(other.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    uint64_t other_max = other.max.load(std::memory_order_relaxed);
+    if (other_max > max.load(std::memory_order_relaxed))
+        max.store(other_max, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile(double fraction) const {
+    // the buckets are read one at a time, so take the total from them
+    uint64_t snapshot[BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS; i++)
+        total += snapshot[i] = counts[i].load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+    // the rank of the latency at the percentile, from 1
+    auto rank = std::max<uint64_t>(1, std::ceil(fraction * total));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += snapshot[i];
+        if (seen >= rank)
+            return std::min(bucket_value(i), static_cast<double>(max.load(std::memory_order_relaxed)));
+    }
+    return max.load(std::memory_order_relaxed);
+}
+
+LatencySummary LatencyHistogram::summary() const {
+    LatencySummary result;
+    result.count = count.load(std::memory_order_relaxed);
+    result.mean = result.count ? static_cast<double>(sum.load(std::memory_order_relaxed)) / result.count : 0;
+    result.p50 = percentile(0.50);
+    result.p90 = percentile(0.90);
+    result.p99 = percentile(0.99);
+    result.max = max.load(std::memory_order_relaxed);
+    return result;
+}
+
+LatencyHistogram& thread_latency_histogram(LatencySection section) {
+    thread_local ThreadShard thread_shard;
+    return thread_shard.shard->sections[section];
+}
+
+LatencySummary latency_summary(LatencySection section) {
+    LatencyHistogram total;
+    auto& shards = latency_shards();
+    std::lock_guard<std::mutex> lock(shards.mutex);
+    for (auto& shard : shards.shards)
+        total.merge(shard->sections[section]);
+    return total.summary();
+}
+
+void reset_latency(LatencySection section) {
+    auto& shards = latency_shards();
+    std::lock_guard<std::mutex> lock(shards.mutex);
+    for (auto& shard : shards.shards)
+        shard->sections[section].reset();
+}
+
+const char* latency_section_name(LatencySection section) {
+    switch (section) {
+        case LATENCY_STEP: return "step";
+        case LATENCY_EMULATION: return "emulation";
+        case LATENCY_PREPROCESS: return "preprocess";
+        case LATENCY_SNAPSHOT: return "snapshot";
+        case LATENCY_BATCH_STEP: return "batch_step";
+        default: return "";
+    }
+}
+
+}  // namespace NES
@@ -8,6 +8,8 @@
 #include <string>
 #include "common.hpp"
 #include "emulator.hpp"
+#include "batch.hpp"
+#include "shared_batch.hpp"
 
 // Windows-base systems
 #if defined(_WIN32) || defined(WIN32) || defined(__CYGWIN__) || defined(__MINGW32__) || defined(__BORLANDC__)
@@ -33,6 +35,98 @@ extern "C" {
         return NES::Emulator::HEIGHT;
     }
 
+    /// Return the number of bytes of the statistics of an episode.
+    EXP size_t EpisodeStatsSize() {
+        return sizeof(NES::EpisodeStats);
+    }
+
+    /// Return true if the library is built with the hot-path counters.
+    EXP bool CountersEnabled() {
+        return NES::counters_enabled();
+    }
+
+    /// Return the number of bytes of the hot-path counters.
+    EXP size_t HotPathCountersSize() {
+        return sizeof(NES::HotPathCounters);
+    }
+
+    /// Return the number of timed sections of the core.
+    EXP int LatencySections() {
+        return NES::NUM_LATENCY_SECTIONS;
+    }
+
+    /// Return the name of a timed section of the core.
+    EXP const char* LatencySectionName(int section) {
+        return NES::latency_section_name(static_cast<NES::LatencySection>(section));
+    }
+
+    /// Return the number of bytes of a summary of latencies.
+    EXP size_t LatencySummarySize() {
+        return sizeof(NES::LatencySummary);
+    }
+
+    /// Write the count, mean, p50, p90, p99, and max latency of a section in ns
+    EXP void LatencyStats(int section, NES::LatencySummary* summary) {
+        *summary = NES::latency_summary(static_cast<NES::LatencySection>(section));
+    }
+
+    /// Remove the latencies of a section to start a new window (-1 for all)
+    EXP void ResetLatency(int section) {
+        for (int i = 0; i < NES::NUM_LATENCY_SECTIONS; i++)
+            if (section < 0 || section == i)
+                NES::reset_latency(static_cast<NES::LatencySection>(i));
+    }
+
+    /// Return the number of bytes of a memory footprint.
+    EXP size_t MemoryFootprintSize() {
+        return sizeof(NES::MemoryFootprint);
+    }
+
+    /// Return the bytes of the live objects of a pool of the process
+    EXP int64_t MemoryPoolBytes(int pool) {
+        return NES::memory_pool_bytes[pool].load(std::memory_order_relaxed);
+    }
+
+    /// Return the number of live objects of a pool of the process
+    EXP int64_t MemoryPoolCount(int pool) {
+        return NES::memory_pool_count[pool].load(std::memory_order_relaxed);
+    }
+
+    /// Enable or disable the recording of trace zones
+    EXP void SetTracing(bool enabled) {
+        NES::set_tracing(enabled);
+    }
+
+    /// Remove the recorded trace zones of every thread
+    EXP void ClearTrace() {
+        NES::trace_clear();
+    }
+
+    /// Write the recorded trace zones as Chrome trace-event JSON to a file
+    EXP bool DumpTrace(const char* path, char* error, size_t error_size) {
+        std::string message;
+        if (NES::trace_dump(path, message))
+            return true;
+        if (error_size > 0)
+            error[message.copy(error, error_size - 1)] = '\0';
+        return false;
+    }
+
+    /// Return the number of bytes of a record of the CPU trace.
+    EXP size_t CpuTraceRecordSize() {
+        return sizeof(NES::CpuTraceRecord);
+    }
+
+    /// Format a binary CPU trace file as a nestest-style log file
+    EXP bool FormatCpuTrace(const char* trace_path, const char* log_path, char* error, size_t error_size) {
+        std::string message;
+        if (NES::format_cpu_trace(trace_path, log_path, message))
+            return true;
+        if (error_size > 0)
+            error[message.copy(error, error_size - 1)] = '\0';
+        return false;
+    }
+
     /// Initialize a new emulator and return a pointer to it
     EXP NES::Emulator* Initialize(wchar_t* path, bool headless = false) {
         // convert the c string to a c++ std string data structure
@@ -48,15 +142,91 @@ extern "C" {
     }
 
     /// Return the pointer to the screen buffer
-    EXP NES::NES_Pixel* Screen(NES::Emulator* emu) {
+    EXP NES::NES_Byte* Screen(NES::Emulator* emu) {
         return emu->get_screen_buffer();
     }
 
+    /// Render the screen to a caller-owned buffer (nullptr to release it)
+    EXP void SetScreenBuffer(NES::Emulator* emu, NES::NES_Byte* data, size_t stride) {
+        emu->set_screen_buffer(data, stride);
+    }
+
+    /// Enable or disable double buffering of the screen buffer
+    EXP void SetDoubleBuffered(NES::Emulator* emu, bool enabled) {
+        emu->set_double_buffered(enabled);
+    }
+
+    /// Return the number of frames the emulator has completed
+    EXP uint64_t FrameSequence(NES::Emulator* emu) {
+        return emu->get_frame_sequence();
+    }
+
+    /// Return the screen buffer that holds a frame when double buffering
+    EXP NES::NES_Byte* SequenceScreen(NES::Emulator* emu, uint64_t sequence) {
+        return emu->get_sequence_buffer(sequence);
+    }
+
+    /// Return the latest completed frame and its sequence number
+    EXP NES::NES_Byte* FrontScreen(NES::Emulator* emu, uint64_t* sequence) {
+        *sequence = emu->get_frame_sequence();
+        return emu->get_sequence_buffer(*sequence);
+    }
+
+    /// Set the pixel format of the screen buffer
+    EXP bool SetPixelFormat(NES::Emulator* emu, int format) {
+        return emu->set_pixel_format(static_cast<NES::PixelFormat>(format));
+    }
+
+    /// Convert the palette-index screen buffer to another pixel format
+    EXP bool ConvertScreen(NES::Emulator* emu, NES::NES_Byte* output, int format) {
+        return emu->convert_screen(output, static_cast<NES::PixelFormat>(format));
+    }
+
     /// Return the pointer to the memory buffer
     EXP NES::NES_Byte* Memory(NES::Emulator* emu) {
         return emu->get_memory_buffer();
     }
 
+    /// Set the table of discrete actions (joypad bytes of both controllers)
+    EXP void SetActionTable(NES::Emulator* emu, NES::NES_Byte* table, int actions) {
+        emu->set_action_table(table, actions);
+    }
+
+    /// Press the buttons of a discrete action on the controllers
+    EXP void SetAction(NES::Emulator* emu, int32_t action) {
+        emu->set_action(action);
+    }
+
+    /// Set the probability of repeating the buttons of the last frame
+    EXP void SetStickyActions(NES::Emulator* emu, double probability) {
+        emu->set_sticky_actions(probability);
+    }
+
+    /// Set the maximal number of random no-op frames after a reset
+    EXP void SetMaxNoops(NES::Emulator* emu, int frames) {
+        emu->set_max_noops(frames);
+    }
+
+    /// Seed the generator of sticky actions and no-op starts
+    EXP void Seed(NES::Emulator* emu, uint64_t seed) {
+        emu->seed(seed);
+    }
+
+    /// Keep a stack of the last frames as luma (false if the shape is invalid)
+    EXP bool SetFrameStack(NES::Emulator* emu, int depth, int downsample) {
+        return emu->set_frame_stack(depth, downsample);
+    }
+
+    /// Return the pointer to the ring of the frame stack ([2 * depth, H, W])
+    EXP NES::NES_Byte* FrameStackBuffer(NES::Emulator* emu) {
+        return emu->get_frame_stack().get_buffer();
+    }
+
+    /// Return the slot of the oldest frame of the frame stack in its ring
+    EXP int FrameStackOffset(NES::Emulator* emu) {
+        return emu->get_frame_stack().get_offset();
+    }
+
     /// Reset the emulator
     EXP void Reset(NES::Emulator* emu) {
         emu->reset();
@@ -67,6 +237,153 @@ extern "C" {
         emu->step();
     }
 
+    /// Perform a number of steps, only rendering the ones that are observed
+    EXP void StepN(NES::Emulator* emu, int steps) {
+        emu->step(steps);
+    }
+
+    /// Enable or disable rendering frames to the screen buffer
+    EXP void SetRendering(NES::Emulator* emu, bool enabled) {
+        emu->set_rendering(enabled);
+    }
+
+    /// Return true if the emulator renders frames to the screen buffer
+    EXP bool Rendering(NES::Emulator* emu) {
+        return emu->get_rendering();
+    }
+
+    /// Compile a RAM watch spec evaluated after each frame (false on error)
+    EXP bool SetWatch(NES::Emulator* emu, const char* spec, char* error, size_t error_size) {
+        std::string message;
+        if (emu->set_watch(spec, message))
+            return true;
+        if (error_size > 0)
+            error[message.copy(error, error_size - 1)] = '\0';
+        return false;
+    }
+
+    /// Return the number of RAM watch results (reward, done, and others)
+    EXP int WatchSize(NES::Emulator* emu) {
+        return emu->get_watch().size();
+    }
+
+    /// Return the name of a RAM watch result
+    EXP const char* WatchName(NES::Emulator* emu, int index) {
+        return emu->get_watch().get_name(index).c_str();
+    }
+
+    /// Return the pointer to the RAM watch results of the last step
+    EXP double* WatchResults(NES::Emulator* emu) {
+        return emu->get_watch().get_results();
+    }
+
+    /// Return the pointer to the statistics of the current episode
+    EXP const NES::EpisodeStats* EpisodeStats(NES::Emulator* emu) {
+        return &emu->get_episode();
+    }
+
+    /// Return the pointer to the statistics of the last episode that ended
+    EXP const NES::EpisodeStats* FinalEpisodeStats(NES::Emulator* emu) {
+        return &emu->get_final_episode();
+    }
+
+    /// Return the pointer to the hot-path counters of the last frame
+    EXP const NES::HotPathCounters* FrameCounters(NES::Emulator* emu) {
+        return &emu->get_frame_counters();
+    }
+
+    /// Return the pointer to the hot-path counters of all the frames
+    EXP const NES::HotPathCounters* TotalCounters(NES::Emulator* emu) {
+        return &emu->get_total_counters();
+    }
+
+    /// Zero the hot-path counters of the emulator
+    EXP void ResetCounters(NES::Emulator* emu) {
+        emu->reset_counters();
+    }
+
+    /// Write the bytes of memory the emulator uses by component
+    EXP void MemoryFootprint(NES::Emulator* emu, NES::MemoryFootprint* footprint) {
+        *footprint = emu->get_memory_footprint();
+    }
+
+    /// Enable or disable the profiler of the emulated code
+    EXP void SetProfiling(NES::Emulator* emu, bool enabled) {
+        emu->set_profiling(enabled);
+    }
+
+    /// Zero the profile of the emulated code
+    EXP void ClearProfile(NES::Emulator* emu) {
+        if (emu->get_profiler())
+            emu->get_profiler()->clear();
+    }
+
+    /// Return the pointer to the hits of each opcode (null before profiling)
+    EXP const uint64_t* ProfileOpcodeHits(NES::Emulator* emu) {
+        return emu->get_profiler() ? emu->get_profiler()->get_opcode_hits() : nullptr;
+    }
+
+    /// Return the pointer to the cycles of each opcode (null before profiling)
+    EXP const uint64_t* ProfileOpcodeCycles(NES::Emulator* emu) {
+        return emu->get_profiler() ? emu->get_profiler()->get_opcode_cycles() : nullptr;
+    }
+
+    /// Return the pointer to the hits of each address (null before profiling)
+    EXP const uint64_t* ProfileAddressHits(NES::Emulator* emu) {
+        return emu->get_profiler() ? emu->get_profiler()->get_address_hits() : nullptr;
+    }
+
+    /// Return the pointer to the cycles of each address (null before profiling)
+    EXP const uint64_t* ProfileAddressCycles(NES::Emulator* emu) {
+        return emu->get_profiler() ? emu->get_profiler()->get_address_cycles() : nullptr;
+    }
+
+    /// Return the cycles the CPU spent entering interrupts while profiling
+    EXP uint64_t ProfileInterruptCycles(NES::Emulator* emu) {
+        return emu->get_profiler() ? emu->get_profiler()->get_interrupt_cycles() : 0;
+    }
+
+    /// Return the flat profile of the top opcodes and addresses as text
+    EXP const char* FlatProfile(NES::Emulator* emu, int top) {
+        return emu->get_profiler() ? emu->get_profiler()->flat_profile(top).c_str() : "";
+    }
+
+    /// Return the cycles of each call stack in the folded format as text
+    EXP const char* FoldedStacks(NES::Emulator* emu) {
+        return emu->get_profiler() ? emu->get_profiler()->folded_stacks().c_str() : "";
+    }
+
+    /// Enable or disable the trace of the instructions of the CPU
+    EXP void SetCpuTracing(NES::Emulator* emu, bool enabled, size_t capacity) {
+        emu->set_cpu_tracing(enabled, capacity);
+    }
+
+    /// Remove the records of the CPU trace
+    EXP void ClearCpuTrace(NES::Emulator* emu) {
+        if (emu->get_cpu_trace())
+            emu->get_cpu_trace()->clear();
+    }
+
+    /// Return the number of records the CPU trace holds
+    EXP size_t CpuTraceSize(NES::Emulator* emu) {
+        return emu->get_cpu_trace() ? emu->get_cpu_trace()->size() : 0;
+    }
+
+    /// Copy the latest records of the CPU trace from the oldest on, return the number copied
+    EXP size_t CpuTraceRecords(NES::Emulator* emu, NES::CpuTraceRecord* records, size_t max) {
+        return emu->get_cpu_trace() ? emu->get_cpu_trace()->copy(records, max) : 0;
+    }
+
+    /// Write the records of the CPU trace to a binary file
+    EXP bool DumpCpuTrace(NES::Emulator* emu, const char* path, char* error, size_t error_size) {
+        std::string message = "the CPU trace was never enabled";
+        if (emu->get_cpu_trace() && emu->get_cpu_trace()->dump(path, message))
+            return true;
+        if (error_size > 0)
+            error[message.copy(error, error_size - 1)] = '\0';
+        return false;
+    }
+
     /// Create a deep copy (i.e., a clone) of the given emulator
     EXP void Backup(NES::Emulator* emu) {
         emu->backup();
@@ -92,6 +409,11 @@ extern "C" {
         emu->load_state(state);
     }
 
+    /// Free a saved state, returning its memory to the snapshot pool
+    EXP void FreeState(NES::SavedState* state) {
+        delete state;
+    }
+
     // Serialization
     EXP uint8_t* serialize(NES::Emulator* emu, size_t* size_out) {
         std::vector<uint8_t> data;
@@ -109,11 +431,341 @@ extern "C" {
         delete[] buffer;
     }
 
-    EXP void deserialize(NES::Emulator* emu, uint8_t* buffer, size_t size) {
-        std::vector<uint8_t> data(buffer, buffer + size);
-        emu->deserialize(data);
+    /// Load a serialized state (false if it does not fit the emulator)
+    EXP bool deserialize(NES::Emulator* emu, uint8_t* buffer, size_t size, char* error, size_t error_size) {
+        std::string message;
+        if (emu->deserialize(std::span<uint8_t>(buffer, size), message))
+            return true;
+        if (error_size > 0)
+            error[message.copy(error, error_size - 1)] = '\0';
+        return false;
+    }
+
+    // Batches
+
+    /// Initialize a new batch of emulators and return a pointer to it
+    EXP NES::Batch* InitializeBatch(wchar_t* path, int size, bool headless) {
+        std::wstring ws_rom_path(path);
+        std::string rom_path(ws_rom_path.begin(), ws_rom_path.end());
+        return new NES::Batch(rom_path, size, headless);
+    }
+
+    /// Close the batch, i.e., purge it and its emulators from memory
+    EXP void CloseBatch(NES::Batch* batch) {
+        delete batch;
+    }
+
+    /// Return an emulator of the batch
+    EXP NES::Emulator* BatchEmulator(NES::Batch* batch, int index) {
+        return batch->get_emulator(index);
+    }
+
+    /// Set the pixel format of the screens of the batch
+    EXP bool BatchSetPixelFormat(NES::Batch* batch, int format) {
+        return batch->set_pixel_format(static_cast<NES::PixelFormat>(format));
+    }
+
+    /// Compile a RAM watch spec for every emulator (false on error)
+    EXP bool BatchSetWatch(NES::Batch* batch, const char* spec, char* error, size_t error_size) {
+        std::string message;
+        if (batch->set_watch(spec, message))
+            return true;
+        if (error_size > 0)
+            error[message.copy(error, error_size - 1)] = '\0';
+        return false;
+    }
+
+    /// Set the number of steps after which episodes are truncated
+    EXP void BatchSetMaxEpisodeSteps(NES::Batch* batch, uint64_t steps) {
+        batch->set_max_episode_steps(steps);
+    }
+
+    /// Set the table of discrete actions of every emulator of the batch
+    EXP void BatchSetActionTable(NES::Batch* batch, NES::NES_Byte* table, int actions) {
+        batch->set_action_table(table, actions);
+    }
+
+    /// Set the probability of sticky actions of every emulator of the batch
+    EXP void BatchSetStickyActions(NES::Batch* batch, double probability) {
+        batch->set_sticky_actions(probability);
+    }
+
+    /// Set the maximal number of no-op frames after a reset of the batch
+    EXP void BatchSetMaxNoops(NES::Batch* batch, int frames) {
+        batch->set_max_noops(frames);
+    }
+
+    /// Seed the generators of the emulators of the batch
+    EXP void BatchSeed(NES::Batch* batch, uint64_t seed) {
+        batch->seed(seed);
+    }
+
+    /// Save the current state of every emulator as its start state
+    EXP void BatchBackup(NES::Batch* batch) {
+        batch->backup();
+    }
+
+    /// Reset every emulator of the batch to its start state
+    EXP void BatchReset(NES::Batch* batch) {
+        batch->reset();
+    }
+
+    /// Step every emulator of the batch, resetting the ones that finish
+    EXP bool StepBatch(NES::Batch* batch, int32_t* actions, int frames) {
+        return batch->step(actions, frames);
+    }
+
+    /// Set the number of worker threads that step the emulators of the batch
+    EXP void BatchSetThreads(NES::Batch* batch, int threads) {
+        batch->set_threads(threads);
+    }
+
+    /// Start steps of some emulators of the batch without waiting for them
+    EXP bool StepBatchAsync(NES::Batch* batch, int32_t* actions, int32_t* indexes, int count, int frames) {
+        return batch->step_async(actions, indexes, count, frames);
+    }
+
+    /// Collect the emulators whose steps finished without waiting
+    EXP int BatchPoll(NES::Batch* batch, int32_t* ready, int max) {
+        return batch->poll(ready, max);
+    }
+
+    /// Wait for a step to finish and collect the emulators that finished
+    EXP int BatchWaitAny(NES::Batch* batch, int32_t* ready, int max) {
+        return batch->wait_any(ready, max);
+    }
+
+    /// Wait for every step to finish and collect the emulators
+    EXP int BatchWaitAll(NES::Batch* batch, int32_t* ready, int max) {
+        return batch->wait_all(ready, max);
+    }
+
+    /// Return the number of steps of the batch in flight
+    EXP int BatchInFlight(NES::Batch* batch) {
+        return batch->get_in_flight();
+    }
+
+    /// Keep a stack of the last frames of every emulator of the batch
+    EXP bool BatchSetFrameStack(NES::Batch* batch, int depth, int downsample) {
+        return batch->set_frame_stack(depth, downsample);
+    }
+
+    /// Return the pointer to the frame stack rings ([N, 2 * depth, H, W])
+    EXP NES::NES_Byte* BatchFrameStacks(NES::Batch* batch) {
+        return batch->get_frame_stacks();
+    }
+
+    /// Return the pointer to the slot of the oldest frame of each stack
+    EXP int32_t* BatchFrameStackOffsets(NES::Batch* batch) {
+        return batch->get_frame_stack_offsets();
+    }
+
+    /// Return the pointer to the statistics of the current episodes ([N])
+    EXP NES::EpisodeStats* BatchEpisodeStats(NES::Batch* batch) {
+        return batch->get_episodes();
+    }
+
+    /// Return the pointer to the statistics of the last episode that ended
+    /// for each emulator ([N])
+    EXP NES::EpisodeStats* BatchFinalEpisodeStats(NES::Batch* batch) {
+        return batch->get_final_episodes();
+    }
+
+    /// Return the pointer to the RAM of the batch ([N, 2048], 64-byte aligned)
+    EXP NES::NES_Byte* BatchRAM(NES::Batch* batch) {
+        return batch->get_ram();
+    }
+
+    /// Return the pointer to the screens of the batch
+    EXP NES::NES_Byte* BatchScreens(NES::Batch* batch) {
+        return batch->get_screens();
+    }
+
+    /// Return the pointer to the final screens of the episodes that ended
+    EXP NES::NES_Byte* BatchFinalScreens(NES::Batch* batch) {
+        return batch->get_final_screens();
+    }
+
+    /// Return the number of RAM watch results per emulator
+    EXP int BatchWatchSize(NES::Batch* batch) {
+        return batch->get_watch_size();
+    }
+
+    /// Return the pointer to the RAM watch results of the batch
+    EXP double* BatchResults(NES::Batch* batch) {
+        return batch->get_results();
+    }
+
+    /// Return the pointer to the terminated flags of the batch
+    EXP NES::NES_Byte* BatchTerminated(NES::Batch* batch) {
+        return batch->get_terminated();
+    }
+
+    /// Return the pointer to the truncated flags of the batch
+    EXP NES::NES_Byte* BatchTruncated(NES::Batch* batch) {
+        return batch->get_truncated();
+    }
+
+    /// Write the bytes of memory the batch uses by component
+    EXP void BatchMemoryFootprint(NES::Batch* batch, NES::MemoryFootprint* footprint) {
+        *footprint = batch->get_memory_footprint();
+    }
+
+
+// shared memory batches are only available on Linux
+#ifdef __linux__
+
+    /// Create a batch in shared memory for worker processes (nullptr on error)
+    EXP NES::SharedBatch* CreateSharedBatch(
+        const char* name,
+        wchar_t* path,
+        int size,
+        int workers,
+        bool headless,
+        int format,
+        const char* spec,
+        int stack_depth,
+        int stack_downsample,
+        char* error,
+        size_t error_size
+    ) {
+        std::wstring ws_rom_path(path);
+        std::string rom_path(ws_rom_path.begin(), ws_rom_path.end());
+        std::string message;
+        auto batch = NES::SharedBatch::create(name, rom_path, size, workers,
+            headless, static_cast<NES::PixelFormat>(format), spec,
+            stack_depth, stack_downsample, message);
+        if (!batch && error_size > 0)
+            error[message.copy(error, error_size - 1)] = '\0';
+        return batch;
+    }
+
+    /// Run a worker of a shared batch until it is closed (false on error)
+    EXP bool RunSharedWorker(const char* name, int index, char* error, size_t error_size) {
+        std::string message;
+        if (NES::SharedBatch::run_worker(name, index, message))
+            return true;
+        if (error_size > 0)
+            error[message.copy(error, error_size - 1)] = '\0';
+        return false;
+    }
+
+    /// Close the workers of a shared batch and unlink its shared memory
+    EXP void CloseSharedBatch(NES::SharedBatch* batch) {
+        delete batch;
+    }
+
+    /// Wait for the workers to finish the posted commands (false on timeout)
+    EXP bool SharedBatchWait(NES::SharedBatch* batch, int timeout_ms) {
+        return batch->wait(timeout_ms);
+    }
+
+    /// Unlink the name of the shared memory of a batch its workers attached to
+    EXP void SharedBatchUnlink(NES::SharedBatch* batch) {
+        batch->unlink();
+    }
+
+    /// Post the probability of sticky actions of the shared batch
+    EXP void SharedBatchSetStickyActions(NES::SharedBatch* batch, double probability) {
+        batch->set_sticky_actions(probability);
+    }
+
+    /// Post the maximal number of no-op frames after a reset
+    EXP void SharedBatchSetMaxNoops(NES::SharedBatch* batch, int frames) {
+        batch->set_max_noops(frames);
+    }
+
+    /// Post the number of steps after which episodes are truncated
+    EXP void SharedBatchSetMaxEpisodeSteps(NES::SharedBatch* batch, uint64_t steps) {
+        batch->set_max_episode_steps(steps);
+    }
+
+    /// Post a seed of the generators of the shared batch
+    EXP void SharedBatchSeed(NES::SharedBatch* batch, uint64_t seed) {
+        batch->seed(seed);
+    }
+
+    /// Post a backup of the current state of every emulator
+    EXP void SharedBatchBackup(NES::SharedBatch* batch) {
+        batch->backup();
+    }
+
+    /// Post a reset of every emulator to its start state
+    EXP void SharedBatchReset(NES::SharedBatch* batch) {
+        batch->reset();
+    }
+
+    /// Post the action table of the shared batch (false if it is too large)
+    EXP bool SharedBatchSetActionTable(NES::SharedBatch* batch, NES::NES_Byte* table, int actions) {
+        return batch->set_action_table(table, actions);
+    }
+
+    /// Post a step of every emulator of the shared batch
+    EXP void StepSharedBatch(NES::SharedBatch* batch, int32_t* actions, int frames) {
+        batch->step(actions, frames);
+    }
+
+    /// Return the number of RAM watch results of the emulators
+    EXP int SharedBatchWatchSize(NES::SharedBatch* batch) {
+        return batch->get_watch().size();
+    }
+
+    /// Return the name of a RAM watch result
+    EXP const char* SharedBatchWatchName(NES::SharedBatch* batch, int index) {
+        return batch->get_watch().get_name(index).c_str();
+    }
+
+    /// Return a pointer to the shared screens of the emulators
+    EXP NES::NES_Byte* SharedBatchScreens(NES::SharedBatch* batch) {
+        return batch->get_screens();
+    }
+
+    /// Return a pointer to the shared final screens of the emulators
+    EXP NES::NES_Byte* SharedBatchFinalScreens(NES::SharedBatch* batch) {
+        return batch->get_final_screens();
+    }
+
+    /// Return a pointer to the shared RAM of the emulators
+    EXP NES::NES_Byte* SharedBatchRAM(NES::SharedBatch* batch) {
+        return batch->get_ram();
+    }
+
+    /// Return a pointer to the shared RAM watch results of the emulators
+    EXP double* SharedBatchResults(NES::SharedBatch* batch) {
+        return batch->get_results();
+    }
+
+    /// Return a pointer to the shared terminated flags of the emulators
+    EXP NES::NES_Byte* SharedBatchTerminated(NES::SharedBatch* batch) {
+        return batch->get_terminated();
+    }
+
+    /// Return a pointer to the shared truncated flags of the emulators
+    EXP NES::NES_Byte* SharedBatchTruncated(NES::SharedBatch* batch) {
+        return batch->get_truncated();
+    }
+
+    /// Return a pointer to the shared frame stack rings of the emulators
+    EXP NES::NES_Byte* SharedBatchFrameStacks(NES::SharedBatch* batch) {
+        return batch->get_frame_stacks();
+    }
+
+    /// Return a pointer to the shared slots of the oldest stacked frames
+    EXP int32_t* SharedBatchFrameStackOffsets(NES::SharedBatch* batch) {
+        return batch->get_frame_stack_offsets();
+    }
+
+    /// Return a pointer to the shared statistics of the current episodes
+    EXP NES::EpisodeStats* SharedBatchEpisodeStats(NES::SharedBatch* batch) {
+        return batch->get_episodes();
+    }
+
+    /// Return a pointer to the shared statistics of the last episodes
+    EXP NES::EpisodeStats* SharedBatchFinalEpisodeStats(NES::SharedBatch* batch) {
+        return batch->get_final_episodes();
     }
 
+#endif  // __linux__
 }
 
 // un-define the macro
@@ -5,25 +5,32 @@
 //  Copyright (c) 2019 Christian Kauten. All rights reserved.
 //
 
+#include <algorithm>
+#include <cstring>
 #include "main_bus.hpp"
 #include "log.hpp"
 
 namespace NES {
 
 NES_Byte MainBus::read(NES_Address address) {
+    NES_COUNT(if (counters) counters->bus_reads[bus_region(address)]++);
     if (address < 0x2000) {
-        return ram[address & 0x7ff];
+        return memory[address & 0x7ff];
     } else if (address < 0x4020) {
         if (address < 0x4000) {  // PPU registers, mirrored
             auto reg = static_cast<IORegisters>(address & 0x2007);
-            if (read_callbacks.count(reg))
+            if (read_callbacks.count(reg)) {
+                NES_COUNT(if (counters) counters->register_reads[io_register_index(reg)]++);
                 return read_callbacks.at(reg)();
+            }
             else
                 LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +address << std::endl;
         } else if (address < 0x4018 && address >= 0x4014) {  // only *some* IO registers
             auto reg = static_cast<IORegisters>(address);
-            if (read_callbacks.count(reg))
+            if (read_callbacks.count(reg)) {
+                NES_COUNT(if (counters) counters->register_reads[io_register_index(reg)]++);
                 return read_callbacks.at(reg)();
+            }
             else
                 LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +address << std::endl;
         }
@@ -41,20 +48,35 @@ NES_Byte MainBus::read(NES_Address address) {
     return 0;
 }
 
+NES_Byte MainBus::peek(NES_Address address) {
+    if (address < 0x2000)
+        return memory[address & 0x7ff];
+    if (address < 0x6000)
+        return 0;
+    if (address < 0x8000)
+        return mapper->hasExtendedRAM() ? extended_ram[address - 0x6000] : 0;
+    return mapper->readPRG(address);
+}
+
 void MainBus::write(NES_Address address, NES_Byte value) {
+    NES_COUNT(if (counters) counters->bus_writes[bus_region(address)]++);
     if (address < 0x2000) {
-        ram[address & 0x7ff] = value;
+        memory[address & 0x7ff] = value;
     } else if (address < 0x4020) {
         if (address < 0x4000) {  // PPU registers, mirrored
             auto reg = static_cast<IORegisters>(address & 0x2007);
-            if (write_callbacks.count(reg))
+            if (write_callbacks.count(reg)) {
+                NES_COUNT(if (counters) counters->register_writes[io_register_index(reg)]++);
                 return write_callbacks.at(reg)(value);
+            }
             else
                 LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +address << std::endl;
         } else if (address < 0x4017 && address >= 0x4014) {  // only some registers
             auto reg = static_cast<IORegisters>(address);
-            if (write_callbacks.count(reg))
+            if (write_callbacks.count(reg)) {
+                NES_COUNT(if (counters) counters->register_writes[io_register_index(reg)]++);
                 return write_callbacks.at(reg)(value);
+            }
             else
                 LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +address << std::endl;
         } else {
@@ -66,6 +88,7 @@ void MainBus::write(NES_Address address, NES_Byte value) {
         if (mapper->hasExtendedRAM())
             extended_ram[address - 0x6000] = value;
     } else {
+        NES_COUNT(if (counters) counters->mapper_writes++);
         mapper->writePRG(address, value);
     }
 }
@@ -73,7 +96,7 @@ void MainBus::write(NES_Address address, NES_Byte value) {
 const NES_Byte* MainBus::get_page_pointer(NES_Byte page) {
     NES_Address address = page << 8;
     if (address < 0x2000)
-        return &ram[address & 0x7ff];
+        return &memory[address & 0x7ff];
     else if (address < 0x4020)
         LOG(Error) << "Register address memory pointer access attempt" << std::endl;
     else if (address < 0x6000)
@@ -85,6 +108,21 @@ const NES_Byte* MainBus::get_page_pointer(NES_Byte page) {
     return nullptr;
 }
 
+void MainBus::set_memory_buffer(NES_Byte* data) {
+    if (data == memory)
+        return;
+    if (data == nullptr) {
+        // back to the internal storage, which is only allocated while no
+        // caller buffer is set
+        ram.resize(RAM_SIZE);
+        data = ram.data();
+    }
+    std::memcpy(data, memory, RAM_SIZE);
+    memory = data;
+    if (memory != ram.data())
+        std::vector<NES_Byte>().swap(ram);
+}
+
 void MainBus::set_mapper(Mapper* mapper) {
     this->mapper = mapper;
     if (mapper->hasExtendedRAM())
@@ -97,14 +135,19 @@ MainBus::~MainBus() {
     read_callbacks.clear();
 }
 
-MainBus::MainBus(const MainBus& other) {
-    ram = other.ram;
+MainBus::MainBus(const MainBus& other) : ram(RAM_SIZE) {
+    // a copy keeps the contents in its internal storage
+    memory = ram.data();
+    std::memcpy(memory, other.memory, RAM_SIZE);
     extended_ram = other.extended_ram;
     mapper = other.mapper;
 }
 
-MainBus::MainBus(MainBus&& other) noexcept{
-    ram = std::move(other.ram);
+MainBus::MainBus(MainBus&& other) : ram(RAM_SIZE) {
+    // the caller-owned buffer of the other bus stays with it, so the new bus
+    // needs internal storage
+    memory = ram.data();
+    std::memcpy(memory, other.memory, RAM_SIZE);
     extended_ram = std::move(other.extended_ram);
     mapper = other.mapper;
     other.mapper = nullptr;
@@ -115,7 +158,8 @@ MainBus::MainBus(MainBus&& other) noexcept{
 MainBus& MainBus::operator=(const MainBus& other) {
     if (this == &other)
         return *this;
-    ram = other.ram;
+    // keep the storage of this bus, e.g., the row of a batch-wide block
+    std::memcpy(memory, other.memory, RAM_SIZE);
     extended_ram = other.extended_ram;
     mapper = other.mapper;
     return *this;
@@ -124,7 +168,7 @@ MainBus& MainBus::operator=(const MainBus& other) {
 MainBus& MainBus::operator=(MainBus&& other) noexcept{
     if (this == &other)
         return *this;
-    ram = std::move(other.ram);
+    std::memcpy(memory, other.memory, RAM_SIZE);
     extended_ram = std::move(other.extended_ram);
     mapper = other.mapper;
     other.mapper = nullptr;
@@ -136,15 +180,15 @@ MainBus& MainBus::operator=(MainBus&& other) noexcept{
 /// Serializable
 
 void MainBus::serialize(std::vector<uint8_t>& buffer) {
-    serialize_vector(ram, buffer);
+    serialize_vector(std::vector<uint8_t>(memory, memory + RAM_SIZE), buffer);
     serialize_vector(extended_ram, buffer);
 }
 
 std::span<uint8_t> MainBus::deserialize(std::span<uint8_t> buffer) {
-    // read the RAM
-    buffer = deserialize_vector(buffer, ram);
-    // read the extended RAM
-    buffer = deserialize_vector(buffer, extended_ram);
+    // read the RAM into its storage
+    buffer = deserialize_bytes(buffer, memory, RAM_SIZE);
+    // read the extended RAM, which the cartridge has or not
+    buffer = deserialize_bytes(buffer, extended_ram.data(), extended_ram.size());
 
     return buffer;
 }
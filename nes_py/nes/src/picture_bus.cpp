@@ -13,6 +13,7 @@
 namespace NES {
 
 NES_Byte PictureBus::read(NES_Address address) {
+    NES_COUNT(if (counters) counters->picture_reads[picture_region(address)]++);
     if (address < 0x2000) {
         return mapper->readCHR(address);
     } else if (address < 0x3eff) {  // Name tables up to 0x3000, then mirrored up to 0x3ff
@@ -31,6 +32,7 @@ NES_Byte PictureBus::read(NES_Address address) {
 }
 
 void PictureBus::write(NES_Address address, NES_Byte value) {
+    NES_COUNT(if (counters) counters->picture_writes[picture_region(address)]++);
     if (address < 0x2000) {
         mapper->writeCHR(address, value);
     } else if (address < 0x3eff) {  // Name tables up to 0x3000, then mirrored up to 0x3ff
@@ -128,10 +130,13 @@ void PictureBus::serialize(std::vector<uint8_t>& buffer) {
 }
 
 std::span<uint8_t> PictureBus::deserialize(std::span<uint8_t> buffer) {
-    buffer = deserialize_vector(buffer, ram);
-    buffer = deserialize_vector(buffer, palette);
+    buffer = deserialize_bytes(buffer, ram.data(), ram.size());
+    buffer = deserialize_bytes(buffer, palette.data(), palette.size());
     for (int i = 0; i < 4; i++) {
         deserialize_int(buffer, name_tables[i]);
+        // the name tables are offsets of 1KB pages of the VRAM
+        if (name_tables[i] > ram.size() - 0x400)
+            throw StateError("the state has a name table outside of the VRAM");
     }
     return buffer;
 }
@@ -0,0 +1,134 @@
+//  Program:      nes-py
+//  File:         pixel_format.cpp
+//  Description:  Pixel formats for the screen buffer and their conversions
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <cstring>
+#include "pixel_format.hpp"
+#include "palette.hpp"
+
+namespace NES {
+
+/// Return the IEEE half-precision bits of a channel value normalized to
+/// [0, 1]. Only the range of an 8-bit channel needs to be handled.
+///
+/// @param channel the 8-bit channel value to normalize
+/// @return the bits of the half-precision float channel / 255
+///
+static uint16_t normalized_half(NES_Byte channel) {
+    if (channel == 0) return 0;
+    float value = channel / 255.0f;
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    // re-bias the exponent from 127 to 15 (value is normal and in (0, 1])
+    uint32_t exponent = ((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    // round the mantissa to nearest, letting a carry bump the exponent
+    uint32_t half = (exponent << 10) + (mantissa >> 13);
+    if ((mantissa & 0x1fff) > 0x1000 || ((mantissa & 0x1fff) == 0x1000 && (half & 1)))
+        half++;
+    return static_cast<uint16_t>(half);
+}
+
+PaletteTables::PaletteTables() {
+    for (int i = 0; i < PALETTE_COLORS; i++) {
+        red[i] = (PALETTE[i] >> 16) & 0xff;
+        green[i] = (PALETTE[i] >> 8) & 0xff;
+        blue[i] = PALETTE[i] & 0xff;
+        NES_Byte rgba_bytes[4] = {red[i], green[i], blue[i], 0xff};
+        std::memcpy(&rgba[i], rgba_bytes, sizeof(rgba_bytes));
+        NES_Byte bgra_bytes[4] = {blue[i], green[i], red[i], 0xff};
+        std::memcpy(&bgra[i], bgra_bytes, sizeof(bgra_bytes));
+        red_half[i] = normalized_half(red[i]);
+        green_half[i] = normalized_half(green[i]);
+        blue_half[i] = normalized_half(blue[i]);
+        luma[i] = rgb_luma(red[i], green[i], blue[i]);
+    }
+}
+
+const PaletteTables PALETTE_TABLES;
+
+std::size_t screen_size(PixelFormat format) {
+    switch (format) {
+        case XRGB32:
+        case RGBA32:
+        case BGRA32:
+            return 4 * SCREEN_PIXELS;
+        case PALETTE_INDEX:
+            return SCREEN_PIXELS;
+        case RGB24:
+        case BGR24:
+        case CHW_UINT8:
+            return 3 * SCREEN_PIXELS;
+        case CHW_FLOAT16:
+            return 6 * SCREEN_PIXELS;
+    }
+    return 0;
+}
+
+void copy_screen(const ScreenView& source, const ScreenView& destination) {
+    std::size_t size = row_size(source.format);
+    // contiguous screens are copied in one block
+    if (source.stride == size && destination.stride == size) {
+        std::memcpy(destination.data, source.data, screen_size(source.format));
+        return;
+    }
+    for (int plane = 0; plane < screen_planes(source.format); plane++)
+        for (int y = 0; y < SCREEN_HEIGHT; y++)
+            std::memcpy(destination.row(y, plane), source.row(y, plane), size);
+}
+
+void convert_palette_indexes(
+    const NES_Byte* indexes,
+    NES_Byte* output,
+    PixelFormat format
+) {
+    const PaletteTables& tables = PALETTE_TABLES;
+    switch (format) {
+        case PALETTE_INDEX: {
+            std::memcpy(output, indexes, SCREEN_PIXELS);
+            break;
+        }
+        case RGBA32: {
+            auto pixels = reinterpret_cast<uint32_t*>(output);
+            for (std::size_t i = 0; i < SCREEN_PIXELS; i++)
+                pixels[i] = tables.rgba[indexes[i] & 0x3f];
+            break;
+        }
+        case BGRA32: {
+            auto pixels = reinterpret_cast<uint32_t*>(output);
+            for (std::size_t i = 0; i < SCREEN_PIXELS; i++)
+                pixels[i] = tables.bgra[indexes[i] & 0x3f];
+            break;
+        }
+        case CHW_UINT8: {
+            // one pass per plane keeps each loop a pure gather
+            NES_Byte* red = output;
+            NES_Byte* green = output + SCREEN_PIXELS;
+            NES_Byte* blue = output + 2 * SCREEN_PIXELS;
+            for (std::size_t i = 0; i < SCREEN_PIXELS; i++)
+                red[i] = tables.red[indexes[i] & 0x3f];
+            for (std::size_t i = 0; i < SCREEN_PIXELS; i++)
+                green[i] = tables.green[indexes[i] & 0x3f];
+            for (std::size_t i = 0; i < SCREEN_PIXELS; i++)
+                blue[i] = tables.blue[indexes[i] & 0x3f];
+            break;
+        }
+        default: {
+            // the remaining formats share the per-pixel writer with the PPU
+            std::size_t stride = row_size(format);
+            std::size_t plane_stride = stride * SCREEN_HEIGHT;
+            for (int y = 0; y < SCREEN_HEIGHT; y++) {
+                auto row = output + y * stride;
+                auto row_indexes = indexes + y * SCREEN_WIDTH;
+                for (int x = 0; x < SCREEN_WIDTH; x++)
+                    write_pixel(row, plane_stride, x, row_indexes[x] & 0x3f, format);
+            }
+            break;
+        }
+    }
+}
+
+}  // namespace NES
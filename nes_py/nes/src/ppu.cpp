@@ -7,7 +7,6 @@
 
 #include <cstring>
 #include "ppu.hpp"
-#include "palette.hpp"
 #include "log.hpp"
 
 namespace NES {
@@ -55,6 +54,8 @@ void PPU::cycle(PictureBus& bus) {
             if (cycles >= SCANLINE_END_CYCLE - (!is_even_frame && is_showing_background && is_showing_sprites)) {
                 pipeline_state = RENDER;
                 cycles = scanline = 0;
+                // a frame is only published if it renders from the start
+                is_frame_rendered = is_rendering;
             }
             break;
         }
@@ -66,10 +67,17 @@ void PPU::cycle(PictureBus& bus) {
 
                 int x = cycles - 1;
                 int y = scanline;
+                // without rendering, the pixel only matters if it may set the
+                // sprite 0 hit flag, which sprite 0 can only do as the first
+                // sprite on the scanline
+                bool is_pixel_needed = is_rendering || (
+                    !is_sprite_zero_hit && is_showing_background && is_showing_sprites &&
+                    !scanline_sprites.empty() && scanline_sprites.front() == 0
+                );
 
                 if (is_showing_background) {
                     auto x_fine = (fine_x_scroll + x) % 8;
-                    if (!is_hiding_edge_background || x >= 8) {
+                    if (is_pixel_needed && (!is_hiding_edge_background || x >= 8)) {
                         // fetch tile
                         // mask off fine y
                         auto address = 0x2000 | (data_address & 0x0FFF);
@@ -114,7 +122,7 @@ void PPU::cycle(PictureBus& bus) {
                     }
                 }
 
-                if (is_showing_sprites && (!is_hiding_edge_sprites || x >= 8)) {
+                if (is_pixel_needed && is_showing_sprites && (!is_hiding_edge_sprites || x >= 8)) {
                     for (auto i : scanline_sprites) {
                         NES_Byte spr_x =     sprite_memory[i * 4 + 3];
 
@@ -168,14 +176,16 @@ void PPU::cycle(PictureBus& bus) {
                         break; //Exit the loop now since we've found the highest priority sprite
                     }
                 }
-                // get the address of the color in the palette
-                NES_Byte paletteAddr = bgColor;
-                if ( (!bgOpaque && sprOpaque) || (bgOpaque && sprOpaque && spriteForeground) )
-                    paletteAddr = sprColor;
-                else if (!bgOpaque && !sprOpaque)
-                    paletteAddr = 0;
-                // lookup the pixel in the palette and write it to the screen
-                screen[y][x] = PALETTE[bus.read_palette(paletteAddr)];
+                if (is_rendering) {
+                    // get the address of the color in the palette
+                    NES_Byte paletteAddr = bgColor;
+                    if ( (!bgOpaque && sprOpaque) || (bgOpaque && sprOpaque && spriteForeground) )
+                        paletteAddr = sprColor;
+                    else if (!bgOpaque && !sprOpaque)
+                        paletteAddr = 0;
+                    // lookup the pixel in the palette and write it to the screen
+                    put_pixel(x, y, bus.read_palette(paletteAddr));
+                }
             }
             else if (cycles == SCANLINE_VISIBLE_DOTS + 1 && is_showing_background) {
                 //Shamelessly copied from nesdev wiki
@@ -237,8 +247,10 @@ void PPU::cycle(PictureBus& bus) {
                 cycles = 0;
             }
 
-            if (scanline >= VISIBLE_SCANLINES)
+            if (scanline >= VISIBLE_SCANLINES) {
+                end_frame();
                 pipeline_state = POST_RENDER;
+            }
 
             break;
         }
@@ -276,6 +288,84 @@ void PPU::cycle(PictureBus& bus) {
     ++cycles;
 }
 
+void PPU::set_rendering(bool enabled) {
+    is_rendering = enabled;
+    // the frame in progress is missing pixels once rendering stops
+    if (!enabled) is_frame_rendered = false;
+}
+
+void PPU::put_pixel(int x, int y, NES_Byte color) {
+    // the PPU only has 6 bits of color per palette entry
+    write_pixel(output.row(y), output.stride * VISIBLE_SCANLINES, x, color & 0x3f, pixel_format);
+}
+
+void PPU::set_pixel_format(PixelFormat format) {
+    if (format == pixel_format) return;
+    pixel_format = format;
+    screen.assign(screen_size(format), 0);
+    if (is_double_buffered)
+        second_screen.assign(screen_size(format), 0);
+    auto sequence = frame_sequence.load(std::memory_order_relaxed);
+    front = internal_view(sequence);
+    output = internal_view(sequence + 1);
+}
+
+void PPU::set_screen_buffer(NES_Byte* data, std::size_t stride) {
+    if (data != nullptr && is_double_buffered)
+        set_double_buffered(false);
+    ScreenView next = internal_view();
+    if (data != nullptr)
+        next = {data, stride ? stride : row_size(pixel_format), pixel_format};
+    if (next.data != output.data)
+        copy_screen(output, next);
+    output = front = next;
+}
+
+void PPU::set_double_buffered(bool enabled) {
+    if (enabled == is_double_buffered) return;
+    if (enabled) {
+        // bring the latest frame back to the internal screen
+        set_screen_buffer(nullptr);
+        // both screens start with the latest frame
+        second_screen = screen;
+        is_double_buffered = true;
+    } else {
+        if (front.data != screen.data())
+            copy_screen(front, internal_view());
+        is_double_buffered = false;
+        second_screen.clear();
+        second_screen.shrink_to_fit();
+    }
+    auto sequence = frame_sequence.load(std::memory_order_relaxed);
+    front = internal_view(sequence);
+    output = internal_view(sequence + 1);
+}
+
+void PPU::end_frame() {
+    // frames that were not rendered in full are never published
+    if (!is_frame_rendered) return;
+    auto sequence = frame_sequence.load(std::memory_order_relaxed) + 1;
+    if (is_double_buffered) {
+        // the back buffer becomes the front, the old front is drawn over
+        front = output;
+        output = internal_view(sequence + 1);
+    }
+    frame_sequence.store(sequence, std::memory_order_release);
+}
+
+void PPU::assign_screen(const PPU& other) {
+    if (pixel_format != other.pixel_format) {
+        // a caller-owned buffer cannot hold a different pixel format
+        set_screen_buffer(nullptr);
+        set_pixel_format(other.pixel_format);
+    }
+    if (other.front.data != front.data)
+        copy_screen(other.front, front);
+    // the back buffer resumes from the frame in progress
+    if (is_double_buffered && other.output.data != output.data)
+        copy_screen(other.output, output);
+}
+
 void PPU::do_DMA(const NES_Byte* page_ptr) {
     std::memcpy(
         sprite_memory.data() + sprite_data_address,
@@ -399,14 +489,17 @@ PPU::PPU(const PPU& other) :
     background_page(other.background_page),
     sprite_page(other.sprite_page),
 
-    data_address_increment(other.data_address_increment){
-    
-    for (int i = 0; i < VISIBLE_SCANLINES; i++) {
-        for (int j = 0; j < SCANLINE_VISIBLE_DOTS; j++) {
-            screen[i][j] = other.screen[i][j];
-        }
-    }
-    
+    data_address_increment(other.data_address_increment),
+
+    is_rendering(true),
+    is_frame_rendered(false),
+    pixel_format(XRGB32),
+    screen(screen_size(XRGB32)),
+    is_double_buffered(false),
+    frame_sequence(0),
+    output{screen.data(), row_size(XRGB32), XRGB32},
+    front(output) {
+    assign_screen(other);
 }
 
 PPU::PPU(PPU&& other) noexcept:
@@ -441,13 +534,17 @@ PPU::PPU(PPU&& other) noexcept:
     background_page(other.background_page),
     sprite_page(other.sprite_page),
 
-    data_address_increment(other.data_address_increment){
-    
-    for (int i = 0; i < VISIBLE_SCANLINES; i++) {
-        for (int j = 0; j < SCANLINE_VISIBLE_DOTS; j++) {
-            screen[i][j] = other.screen[i][j];
-        }
-    }
+    data_address_increment(other.data_address_increment),
+
+    is_rendering(true),
+    is_frame_rendered(false),
+    pixel_format(XRGB32),
+    screen(screen_size(XRGB32)),
+    is_double_buffered(false),
+    frame_sequence(0),
+    output{screen.data(), row_size(XRGB32), XRGB32},
+    front(output) {
+    assign_screen(other);
 
     other.vblank_callback = nullptr;
     other.sprite_memory.clear();
@@ -490,11 +587,7 @@ PPU& PPU::operator=(const PPU& other) {
 
     data_address_increment = other.data_address_increment;
 
-    for (int i = 0; i < VISIBLE_SCANLINES; i++) {
-        for (int j = 0; j < SCANLINE_VISIBLE_DOTS; j++) {
-            screen[i][j] = other.screen[i][j];
-        }
-    }
+    assign_screen(other);
 
     return *this;
 }
@@ -535,11 +628,7 @@ PPU& PPU::operator=(PPU&& other) noexcept{
 
     data_address_increment = other.data_address_increment;
 
-    for (int i = 0; i < VISIBLE_SCANLINES; i++) {
-        for (int j = 0; j < SCANLINE_VISIBLE_DOTS; j++) {
-            screen[i][j] = other.screen[i][j];
-        }
-    }
+    assign_screen(other);
 
     other.vblank_callback = nullptr;
     other.sprite_memory.clear();
@@ -581,16 +670,24 @@ void PPU::serialize(std::vector<uint8_t>& buffer) {
 
     serialize_int(data_address_increment, buffer);
 
-    for (int i = 0; i < VISIBLE_SCANLINES; i++) {
-        for (int j = 0; j < SCANLINE_VISIBLE_DOTS; j++) {
-            serialize_int(screen[i][j], buffer);
-        }
-    }
+    // the screen is stored in the raw bytes of its pixel format, after the
+    // format and the number of bytes so a state loads into any emulator
+    serialize_enum(pixel_format, buffer);
+    serialize_int(screen.size(), buffer);
+    auto offset = buffer.size();
+    buffer.resize(offset + screen.size());
+    copy_screen(front, {buffer.data() + offset, row_size(pixel_format), pixel_format});
 }
 
 std::span<uint8_t> PPU::deserialize(std::span<uint8_t> buffer) {
-    buffer = deserialize_vector(buffer, sprite_memory);
+    buffer = deserialize_bytes(buffer, sprite_memory.data(), sprite_memory.size());
     buffer = deserialize_vector(buffer, scanline_sprites);
+    // a scanline has at most 8 of the 64 sprites
+    if (scanline_sprites.size() > 8)
+        throw StateError("the state has too many sprites on the scanline");
+    for (auto sprite : scanline_sprites)
+        if (sprite >= 64)
+            throw StateError("the state has a sprite outside of the OAM");
 
     deserialize_enum(buffer, pipeline_state);
 
@@ -621,11 +718,29 @@ std::span<uint8_t> PPU::deserialize(std::span<uint8_t> buffer) {
 
     deserialize_int(buffer, data_address_increment);
 
-    for (int i = 0; i < VISIBLE_SCANLINES; i++) {
-        for (int j = 0; j < SCANLINE_VISIBLE_DOTS; j++) {
-            deserialize_int(buffer, screen[i][j]);
-        }
+    PixelFormat format;
+    std::size_t size = 0;
+    deserialize_enum(buffer, format);
+    deserialize_int(buffer, size);
+    if (format < 0 || format >= NUM_PIXEL_FORMATS || size != screen_size(format))
+        throw StateError("the state has a screen of an unknown pixel format");
+    if (buffer.size() < size)
+        throw StateError("the state is truncated");
+    // palette indexes convert to any format, the other formats only load
+    // into an emulator that renders them
+    std::vector<NES_Byte> converted;
+    ScreenView serialized = {buffer.data(), row_size(format), format};
+    if (format != pixel_format) {
+        if (format != PALETTE_INDEX)
+            throw StateError("the state has a screen in a different pixel format");
+        converted.resize(screen.size());
+        convert_palette_indexes(buffer.data(), converted.data(), pixel_format);
+        serialized = {converted.data(), row_size(pixel_format), pixel_format};
     }
+    copy_screen(serialized, front);
+    if (output.data != front.data)
+        copy_screen(serialized, output);
+    buffer = buffer.subspan(size);
 
     return buffer;
 }
@@ -0,0 +1,135 @@
+//  Program:      nes-py
+//  File:         profiler.cpp
+//  Description:  A profiler of the 6502 code that the emulator executes
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include "profiler.hpp"
+#include "cpu_opcodes.hpp"
+
+namespace NES {
+
+void Profiler::clear() {
+    opcode_hits.assign(OPCODES, 0);
+    opcode_cycles.assign(OPCODES, 0);
+    address_hits.assign(ADDRESSES, 0);
+    address_cycles.assign(ADDRESSES, 0);
+    interrupt_cycles = 0;
+    frames.assign(1, Frame{-1, ROUTINE_FRAME, 0});
+    children.clear();
+    calls.clear();
+    current = 0;
+}
+
+void Profiler::enter(uint32_t address, NES_Byte stack_pointer) {
+    // deeper calls, e.g., of code that never returns, stay in the deepest
+    // tracked frame
+    if (calls.size() >= MAX_DEPTH)
+        return;
+    uint64_t key = static_cast<uint64_t>(current) << 20 | address;
+    auto child = children.find(key);
+    if (child == children.end()) {
+        frames.push_back(Frame{current, address, 0});
+        child = children.emplace(key, frames.size() - 1).first;
+    }
+    calls.push_back(Call{child->second, stack_pointer});
+    current = child->second;
+}
+
+void Profiler::leave(NES_Byte stack_pointer) {
+    // a return ends the calls it unwinds the stack past, so calls that
+    // drop their return address (e.g., jump tables) end with their caller
+    while (!calls.empty() && calls.back().stack_pointer <= stack_pointer)
+        calls.pop_back();
+    current = calls.empty() ? 0 : calls.back().node;
+}
+
+std::string Profiler::frame_name(int node) const {
+    if (node == 0)
+        return "reset";
+    uint32_t address = frames[node].address;
+    char name[16];
+    const char* prefix = "";
+    if ((address & ~0xffff) == NMI_FRAME) prefix = "nmi:";
+    else if ((address & ~0xffff) == IRQ_FRAME) prefix = "irq:";
+    std::snprintf(name, sizeof(name), "%s$%04X", prefix, address & 0xffff);
+    return name;
+}
+
+/// Return the indexes of counts by descending value, without the zeros.
+///
+/// @param counts the counts to sort the indexes of
+/// @param top the number of indexes to return (0 for all of them)
+/// @return the indexes of the largest counts
+///
+static std::vector<int> top_indexes(const std::vector<uint64_t>& counts, int top) {
+    std::vector<int> indexes;
+    for (std::size_t i = 0; i < counts.size(); i++)
+        if (counts[i] > 0)
+            indexes.push_back(i);
+    std::stable_sort(indexes.begin(), indexes.end(), [&](int a, int b) {
+        return counts[a] > counts[b];
+    });
+    if (top > 0 && indexes.size() > static_cast<std::size_t>(top))
+        indexes.resize(top);
+    return indexes;
+}
+
+const std::string& Profiler::flat_profile(int top) {
+    uint64_t total = std::accumulate(address_cycles.begin(), address_cycles.end(), uint64_t(0));
+    total += interrupt_cycles;
+    double scale = total ? 100.0 / total : 0;
+    char line[96];
+    report.clear();
+    std::snprintf(line, sizeof(line), "total cycles: %llu (interrupt entry: %llu)\n",
+        static_cast<unsigned long long>(total), static_cast<unsigned long long>(interrupt_cycles));
+    report += line;
+    report += "\nopcode  mnemonic          hits        cycles  percent\n";
+    for (int opcode : top_indexes(opcode_cycles, top)) {
+        std::snprintf(line, sizeof(line), "$%02X     %-8s  %12llu  %12llu  %6.2f%%\n",
+            opcode, OPERATION_MNEMONICS[opcode],
+            static_cast<unsigned long long>(opcode_hits[opcode]),
+            static_cast<unsigned long long>(opcode_cycles[opcode]),
+            opcode_cycles[opcode] * scale);
+        report += line;
+    }
+    report += "\naddress                   hits        cycles  percent\n";
+    for (int address : top_indexes(address_cycles, top)) {
+        std::snprintf(line, sizeof(line), "$%04X             %12llu  %12llu  %6.2f%%\n",
+            address,
+            static_cast<unsigned long long>(address_hits[address]),
+            static_cast<unsigned long long>(address_cycles[address]),
+            address_cycles[address] * scale);
+        report += line;
+    }
+    return report;
+}
+
+const std::string& Profiler::folded_stacks() {
+    report.clear();
+    // the stack of a node is the stack of its parent and its own name, and
+    // parents are created before their children
+    std::vector<std::string> stacks(frames.size());
+    for (std::size_t node = 0; node < frames.size(); node++) {
+        int parent = frames[node].parent;
+        stacks[node] = parent < 0 ? frame_name(node) : stacks[parent] + ";" + frame_name(node);
+        if (frames[node].cycles > 0)
+            report += stacks[node] + " " + std::to_string(frames[node].cycles) + "\n";
+    }
+    return report;
+}
+
+std::size_t Profiler::get_memory_size() const {
+    // a node of the map is its entry and the link to the next node
+    std::size_t map_size = children.size() * (sizeof(std::pair<const uint64_t, int>) + sizeof(void*))
+        + children.bucket_count() * sizeof(void*);
+    return vector_bytes(opcode_hits) + vector_bytes(opcode_cycles) + vector_bytes(address_hits)
+        + vector_bytes(address_cycles) + vector_bytes(frames) + vector_bytes(calls) + map_size
+        + report.capacity();
+}
+
+}  // namespace NES
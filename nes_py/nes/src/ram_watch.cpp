@@ -0,0 +1,481 @@
+//  Program:      nes-py
+//  File:         ram_watch.cpp
+//  Description:  Compiled expressions over RAM evaluated after each frame
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include "ram_watch.hpp"
+
+namespace NES {
+
+namespace {
+
+/// An error raised while compiling a spec
+struct CompileError {
+    /// the offset of the error in the spec
+    std::size_t position;
+    /// a description of the error
+    std::string message;
+};
+
+/// The functions of the expression language and their operations
+const struct { const char* name; WatchOp op; int arguments; } FUNCTIONS[] = {
+    {"bcd", WATCH_BCD, 1},
+    {"frame_delta", WATCH_DELTA, 1},
+    {"abs", WATCH_ABS, 1},
+    {"min", WATCH_MIN, 2},
+    {"max", WATCH_MAX, 2},
+    // digits takes any number of arguments
+    {"digits", WATCH_DIGITS, -1},
+};
+
+/// The binary operators of each precedence level, from lowest to highest
+const struct { const char* token; WatchOp op; } BINARY_OPERATORS[][4] = {
+    {{"||", WATCH_OR}},
+    {{"&&", WATCH_AND}},
+    {{"|", WATCH_BIT_OR}},
+    {{"^", WATCH_BIT_XOR}},
+    {{"&", WATCH_BIT_AND}},
+    {{"==", WATCH_EQUAL}, {"!=", WATCH_NOT_EQUAL}},
+    {{"<=", WATCH_LESS_EQUAL}, {">=", WATCH_GREATER_EQUAL}, {"<", WATCH_LESS}, {">", WATCH_GREATER}},
+    {{"<<", WATCH_SHIFT_LEFT}, {">>", WATCH_SHIFT_RIGHT}},
+    {{"+", WATCH_ADD}, {"-", WATCH_SUBTRACT}},
+    {{"*", WATCH_MULTIPLY}, {"/", WATCH_DIVIDE}, {"%", WATCH_MODULO}},
+};
+
+/// The number of precedence levels of binary operators
+const int BINARY_LEVELS = sizeof(BINARY_OPERATORS) / sizeof(BINARY_OPERATORS[0]);
+
+/// The maximal nesting of parentheses, unary operators, and conditionals,
+/// which bounds the recursion of the compiler
+const int MAX_NESTING = 256;
+
+/// A recursive descent compiler from a spec to a stack machine program
+class WatchCompiler {
+ private:
+    /// the text of the spec
+    const std::string& spec;
+    /// the offset of the next character to read
+    std::size_t position = 0;
+    /// the number of expressions being compiled within each other
+    int nesting = 0;
+
+    /// Skip spaces, tabs, and comments (but not newlines).
+    void skip_space() {
+        while (position < spec.size()) {
+            char c = spec[position];
+            if (c == '#') {
+                while (position < spec.size() && spec[position] != '\n')
+                    position++;
+            } else if (c == ' ' || c == '\t' || c == '\r') {
+                position++;
+            } else {
+                break;
+            }
+        }
+    }
+
+    /// Consume a token if it is next in the spec.
+    bool accept(const char* token) {
+        skip_space();
+        std::size_t length = std::char_traits<char>::length(token);
+        if (spec.compare(position, length, token) != 0)
+            return false;
+        // don't split a longer operator, e.g., "|" from "||" or "<" from "<="
+        if (length == 1 && position + 1 < spec.size()) {
+            char next = spec[position + 1];
+            if ((token[0] == '|' || token[0] == '&') && next == token[0])
+                return false;
+            if ((token[0] == '<' || token[0] == '>') && (next == token[0] || next == '='))
+                return false;
+            if ((token[0] == '=' || token[0] == '!') && next == '=')
+                return false;
+        }
+        position += length;
+        return true;
+    }
+
+    /// Consume a token that has to be next in the spec.
+    void expect(const char* token) {
+        if (!accept(token))
+            fail(std::string("expected '") + token + "'");
+    }
+
+    /// Raise an error at the current position.
+    [[noreturn]] void fail(const std::string& message) {
+        throw CompileError{position, message};
+    }
+
+    /// Read an identifier, or return an empty string if there is none.
+    std::string identifier() {
+        skip_space();
+        std::size_t start = position;
+        while (position < spec.size() && (std::isalnum(static_cast<unsigned char>(spec[position])) || spec[position] == '_')) {
+            if (position == start && std::isdigit(static_cast<unsigned char>(spec[position])))
+                break;
+            position++;
+        }
+        return spec.substr(start, position - start);
+    }
+
+    /// Append an instruction to the program, tracking the stack depth.
+    void emit(WatchOp op, int pops, int pushes, int32_t operand = 0, double constant = 0) {
+        program.push_back({op, operand, constant});
+        depth += pushes - pops;
+        max_depth = std::max(max_depth, depth);
+    }
+
+    /// Compile a number literal.
+    void number() {
+        skip_space();
+        const char* start = spec.c_str() + position;
+        char* end;
+        double value;
+        if (*start == '$') {
+            value = std::strtoll(start + 1, &end, 16);
+            if (end == start + 1) fail("expected a hex number");
+        } else if (start[0] == '0' && (start[1] == 'x' || start[1] == 'X')) {
+            value = std::strtoll(start + 2, &end, 16);
+            if (end == start + 2) fail("expected a hex number");
+        } else {
+            value = std::strtod(start, &end);
+            if (end == start) fail("expected a number");
+        }
+        position += end - start;
+        emit(WATCH_CONSTANT, 0, 1, 0, value);
+    }
+
+    /// Compile a function call after its name and opening parenthesis.
+    void call(const std::string& name) {
+        for (const auto& function : FUNCTIONS) {
+            if (name != function.name) continue;
+            int arguments = 0;
+            if (!accept(")")) {
+                do {
+                    expression();
+                    arguments++;
+                } while (accept(","));
+                expect(")");
+            }
+            if (function.arguments >= 0 && arguments != function.arguments)
+                fail(name + " takes " + std::to_string(function.arguments) + " argument(s)");
+            if (function.op == WATCH_DIGITS) {
+                if (arguments == 0) fail("digits takes at least 1 argument");
+                emit(WATCH_DIGITS, arguments, 1, arguments);
+            } else if (function.op == WATCH_DELTA) {
+                emit(WATCH_DELTA, 1, 1, deltas++);
+            } else {
+                emit(function.op, arguments, 1);
+            }
+            return;
+        }
+        fail("unknown function '" + name + "'");
+    }
+
+    /// Compile a primary expression.
+    void primary() {
+        skip_space();
+        if (position >= spec.size())
+            fail("expected an expression");
+        char c = spec[position];
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '$' || c == '.') {
+            number();
+        } else if (accept("(")) {
+            expression();
+            expect(")");
+        } else {
+            auto name = identifier();
+            if (name.empty())
+                fail("expected an expression");
+            if (name == "ram") {
+                expect("[");
+                expression();
+                expect("]");
+                emit(WATCH_RAM, 1, 1);
+            } else if (accept("(")) {
+                call(name);
+            } else {
+                auto entry = std::find(entries.begin(), entries.end(), name);
+                if (entry == entries.end())
+                    fail("unknown name '" + name + "'");
+                emit(WATCH_VALUE, 0, 1, entry - entries.begin());
+            }
+        }
+    }
+
+    /// Count a nested expression while it is compiled, failing if the
+    /// expressions are nested too deeply.
+    class Nesting {
+     private:
+        /// the compiler of the expression
+        WatchCompiler& compiler;
+
+     public:
+        explicit Nesting(WatchCompiler& compiler_) : compiler(compiler_) {
+            if (++compiler.nesting > MAX_NESTING)
+                compiler.fail("expressions are nested more than " + std::to_string(MAX_NESTING) + " deep");
+        }
+
+        ~Nesting() { compiler.nesting--; }
+    };
+
+    /// Compile a unary expression.
+    void unary() {
+        if (accept("-")) {
+            Nesting nesting_(*this);
+            unary();
+            emit(WATCH_NEGATE, 1, 1);
+        } else if (accept("!")) {
+            Nesting nesting_(*this);
+            unary();
+            emit(WATCH_NOT, 1, 1);
+        } else if (accept("~")) {
+            Nesting nesting_(*this);
+            unary();
+            emit(WATCH_COMPLEMENT, 1, 1);
+        } else {
+            accept("+");
+            primary();
+        }
+    }
+
+    /// Compile a left-associative chain of binary operators.
+    ///
+    /// @param level the precedence level of the operators
+    ///
+    void binary(int level) {
+        if (level == BINARY_LEVELS) {
+            unary();
+            return;
+        }
+        binary(level + 1);
+        for (bool found = true; found; ) {
+            found = false;
+            for (const auto& binary_operator : BINARY_OPERATORS[level]) {
+                if (binary_operator.token == nullptr || !accept(binary_operator.token))
+                    continue;
+                binary(level + 1);
+                emit(binary_operator.op, 2, 1);
+                found = true;
+                break;
+            }
+        }
+    }
+
+    /// Compile a (conditional) expression.
+    void expression() {
+        Nesting nesting_(*this);
+        binary(0);
+        if (accept("?")) {
+            expression();
+            expect(":");
+            expression();
+            emit(WATCH_SELECT, 3, 1);
+        }
+    }
+
+    /// Skip any separators between entries, returning true if one was found.
+    bool separators() {
+        bool found = false;
+        while (true) {
+            skip_space();
+            if (position < spec.size() && (spec[position] == '\n' || spec[position] == ';')) {
+                position++;
+                found = true;
+            } else {
+                return found;
+            }
+        }
+    }
+
+ public:
+    /// the compiled program
+    std::vector<WatchInstruction> program;
+    /// the names of the entries in the order of the spec
+    std::vector<std::string> entries;
+    /// the number of delta slots
+    int deltas = 0;
+    /// the current and maximal depth of the evaluation stack
+    int depth = 0, max_depth = 0;
+
+    explicit WatchCompiler(const std::string& spec_) : spec(spec_) { }
+
+    /// Compile the entries of the spec.
+    void compile() {
+        separators();
+        while (position < spec.size()) {
+            auto name = identifier();
+            if (name.empty())
+                fail("expected a name");
+            if (name == "ram" || std::any_of(std::begin(FUNCTIONS), std::end(FUNCTIONS),
+                    [&](const auto& function) { return name == function.name; }))
+                fail("'" + name + "' is reserved");
+            if (std::find(entries.begin(), entries.end(), name) != entries.end())
+                fail("'" + name + "' is defined twice");
+            expect("=");
+            expression();
+            emit(WATCH_STORE, 1, 0, entries.size());
+            entries.push_back(name);
+            if (!separators() && position < spec.size())
+                fail("expected the end of the entry");
+        }
+    }
+};
+
+/// Return an operand as an integer for bitwise operations, NaN is 0 and
+/// values out of range saturate (converting them directly is undefined).
+inline int64_t integer(double value) {
+    // 2^63, the first double past the range of an int64
+    constexpr double LIMIT = 9223372036854775808.0;
+    if (std::isnan(value))
+        return 0;
+    if (value >= LIMIT)
+        return std::numeric_limits<int64_t>::max();
+    if (value < -LIMIT)
+        return std::numeric_limits<int64_t>::min();
+    return static_cast<int64_t>(value);
+}
+
+}  // namespace
+
+bool RamWatch::compile(const std::string& spec, std::string& error) {
+    WatchCompiler compiler(spec);
+    try {
+        compiler.compile();
+    } catch (const CompileError& compile_error) {
+        // locate the error by line and column
+        auto before = spec.substr(0, std::min(compile_error.position, spec.size()));
+        auto line = std::count(before.begin(), before.end(), '\n') + 1;
+        auto column = before.size() - (before.rfind('\n') + 1) + 1;
+        error = std::to_string(line) + ":" + std::to_string(column) + ": " + compile_error.message;
+        return false;
+    }
+    program = std::move(compiler.program);
+    // the reward and done flag lead the results, the rest follow in order
+    names = {"reward", "done"};
+    result_indexes.clear();
+    for (const auto& name : compiler.entries) {
+        if (name == "reward") {
+            result_indexes.push_back(REWARD);
+        } else if (name == "done") {
+            result_indexes.push_back(DONE);
+        } else {
+            result_indexes.push_back(names.size());
+            names.push_back(name);
+        }
+    }
+    values.assign(compiler.entries.size(), 0);
+    previous.assign(compiler.deltas, 0);
+    // the bottom slot of the stack is never used
+    stack.assign(compiler.max_depth + 1, 0);
+    results.assign(names.size(), 0);
+    return true;
+}
+
+void RamWatch::run(const NES_Byte* ram, bool is_priming) {
+    double* top = stack.data();
+    for (const auto& instruction : program) {
+        switch (instruction.op) {
+            case WATCH_CONSTANT: *++top = instruction.constant; break;
+            case WATCH_RAM: *top = ram[integer(*top) & 0x7ff]; break;
+            case WATCH_VALUE: *++top = values[instruction.operand]; break;
+            case WATCH_DELTA: {
+                double value = *top;
+                *top = is_priming ? 0 : value - previous[instruction.operand];
+                previous[instruction.operand] = value;
+                break;
+            }
+            case WATCH_BCD: {
+                auto value = integer(*top) & 0xff;
+                *top = (value >> 4) * 10 + (value & 0xf);
+                break;
+            }
+            case WATCH_DIGITS: {
+                top -= instruction.operand - 1;
+                double number = 0;
+                for (int i = 0; i < instruction.operand; i++)
+                    number = number * 10 + top[i];
+                *top = number;
+                break;
+            }
+            case WATCH_ABS: *top = std::fabs(*top); break;
+            case WATCH_NEGATE: *top = -*top; break;
+            case WATCH_NOT: *top = *top == 0; break;
+            case WATCH_COMPLEMENT: *top = ~integer(*top); break;
+            case WATCH_SELECT: top -= 2; *top = top[0] != 0 ? top[1] : top[2]; break;
+            case WATCH_STORE: values[instruction.operand] = *top--; break;
+            default: {
+                // binary operations replace the left operand with the result
+                double right = *top--;
+                double& left = *top;
+                switch (instruction.op) {
+                    case WATCH_ADD: left += right; break;
+                    case WATCH_SUBTRACT: left -= right; break;
+                    case WATCH_MULTIPLY: left *= right; break;
+                    // dividing by zero results in zero to keep rewards finite
+                    case WATCH_DIVIDE: left = right == 0 ? 0 : left / right; break;
+                    case WATCH_MODULO: left = right == 0 ? 0 : std::fmod(left, right); break;
+                    case WATCH_SHIFT_LEFT: left = integer(left) << (integer(right) & 63); break;
+                    case WATCH_SHIFT_RIGHT: left = integer(left) >> (integer(right) & 63); break;
+                    case WATCH_BIT_AND: left = integer(left) & integer(right); break;
+                    case WATCH_BIT_OR: left = integer(left) | integer(right); break;
+                    case WATCH_BIT_XOR: left = integer(left) ^ integer(right); break;
+                    case WATCH_EQUAL: left = left == right; break;
+                    case WATCH_NOT_EQUAL: left = left != right; break;
+                    case WATCH_LESS: left = left < right; break;
+                    case WATCH_LESS_EQUAL: left = left <= right; break;
+                    case WATCH_GREATER: left = left > right; break;
+                    case WATCH_GREATER_EQUAL: left = left >= right; break;
+                    case WATCH_AND: left = left != 0 && right != 0; break;
+                    case WATCH_OR: left = left != 0 || right != 0; break;
+                    case WATCH_MIN: left = std::min(left, right); break;
+                    case WATCH_MAX: left = std::max(left, right); break;
+                    default: break;
+                }
+                break;
+            }
+        }
+    }
+}
+
+void RamWatch::prime(const NES_Byte* ram) {
+    if (empty()) return;
+    run(ram, true);
+    results[REWARD] = 0;
+    results[DONE] = 0;
+    for (std::size_t i = 0; i < values.size(); i++) {
+        if (result_indexes[i] == DONE)
+            results[DONE] = values[i] != 0;
+        else if (result_indexes[i] != REWARD)
+            results[result_indexes[i]] = values[i];
+    }
+}
+
+void RamWatch::update(const NES_Byte* ram) {
+    if (empty()) return;
+    run(ram, false);
+    for (std::size_t i = 0; i < values.size(); i++) {
+        if (result_indexes[i] == REWARD)
+            results[REWARD] += values[i];
+        else if (result_indexes[i] == DONE)
+            results[DONE] = results[DONE] != 0 || values[i] != 0;
+        else
+            results[result_indexes[i]] = values[i];
+    }
+}
+
+std::size_t RamWatch::get_memory_size() const {
+    std::size_t size = vector_bytes(program) + vector_bytes(names) + vector_bytes(result_indexes)
+        + vector_bytes(values) + vector_bytes(previous) + vector_bytes(stack) + vector_bytes(results);
+    for (const auto& name : names)
+        size += name.capacity();
+    return size;
+}
+
+}  // namespace NES
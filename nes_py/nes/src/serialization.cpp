@@ -5,6 +5,7 @@
 //  Copyright (c) 2024 Zhao Liang. All rights reserved.
 //
 
+#include <cstring>
 #include "common.hpp"
 
 namespace NES {
@@ -18,12 +19,25 @@ std::span<uint8_t> Serializable::deserialize_vector(std::span<uint8_t> buffer, s
     // read the length
     size_t size = 0;
     deserialize_int(buffer, size);
+    if (buffer.size() < size)
+        throw StateError("the state is truncated");
     // read the data
     value.clear();
     value.insert(value.end(), buffer.begin(), buffer.begin() + size);
     return buffer.subspan(size);
 }
 
+std::span<uint8_t> Serializable::deserialize_bytes(std::span<uint8_t> buffer, uint8_t* data, std::size_t size) {
+    size_t serialized_size = 0;
+    deserialize_int(buffer, serialized_size);
+    if (serialized_size != size)
+        throw StateError("the state is from a different cartridge or version");
+    if (buffer.size() < size)
+        throw StateError("the state is truncated");
+    std::memcpy(data, buffer.data(), size);
+    return buffer.subspan(size);
+}
+
 // Specialization for bool serialization
 void Serializable::serialize_bool(bool value, std::vector<uint8_t>& buffer) {
     buffer.push_back(value ? 1 : 0);
@@ -31,10 +45,10 @@ void Serializable::serialize_bool(bool value, std::vector<uint8_t>& buffer) {
 
 // Specialization for bool deserialization
 void Serializable::deserialize_bool(std::span<uint8_t>& buffer, bool& value) {
-    if (!buffer.empty()) {
-        value = buffer[0] != 0;
-        buffer = buffer.subspan(1); // Move the span forward
-    }
+    if (buffer.empty())
+        throw StateError("the state is truncated");
+    value = buffer[0] != 0;
+    buffer = buffer.subspan(1); // Move the span forward
 }
 
 }
\ No newline at end of file
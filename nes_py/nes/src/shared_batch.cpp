@@ -0,0 +1,485 @@
+//  Program:      nes-py
+//  File:         shared_batch.cpp
+//  Description:  A batch of emulators in worker processes sharing memory
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "shared_batch.hpp"
+#include "batch.hpp"
+
+namespace NES {
+
+/// The header at the start of the shared region that describes its layout.
+/// Offsets are in bytes from the start of the region.
+struct SharedHeader {
+    /// the magic number of a shared batch region
+    uint64_t magic;
+    /// the number of emulators in the batch
+    int32_t size;
+    /// the number of worker processes
+    int32_t workers;
+    /// the number of RAM watch results per emulator
+    int32_t watch_size;
+    /// the format the screens are rendered in
+    int32_t pixel_format;
+    /// whether rendering of the emulators is disabled
+    bool headless;
+    /// the number of frames in the frame stack of each emulator (0 for none)
+    int32_t stack_depth;
+    /// the factor the stacked frames are downsampled by
+    int32_t stack_downsample;
+    /// the number of bytes of the frame stack ring of an emulator
+    uint64_t stack_size;
+    /// the number of bytes of the screen of an emulator
+    uint64_t screen_size;
+    /// the offset of the NUL-terminated path to the ROM
+    uint64_t rom_path;
+    /// the offset of the NUL-terminated RAM watch spec
+    uint64_t spec;
+    /// the offset of the command rings of the workers
+    uint64_t rings;
+    /// the offset of the int32 actions [N]
+    uint64_t actions;
+    /// the offset of the action table [MAX_ACTIONS, 2]
+    uint64_t action_table;
+    /// the offset of the screens [N, screen_size]
+    uint64_t screens;
+    /// the offset of the final screens [N, screen_size]
+    uint64_t final_screens;
+    /// the offset of the frame stack rings [N, stack_size]
+    uint64_t frame_stacks;
+    /// the offset of the int32 slots of the oldest stacked frames [N]
+    uint64_t frame_stack_offsets;
+    /// the offset of the RAM [N, 2048]
+    uint64_t ram;
+    /// the offset of the RAM watch results [N, watch_size]
+    uint64_t results;
+    /// the offset of the terminated flags [N]
+    uint64_t terminated;
+    /// the offset of the truncated flags [N]
+    uint64_t truncated;
+    /// the offset of the statistics of the current episodes [N]
+    uint64_t episodes;
+    /// the offset of the statistics of the last episodes that ended [N]
+    uint64_t final_episodes;
+    /// the number of commands finished by all the workers (the futex of the
+    /// parent)
+    alignas(64) std::atomic<uint32_t> completed;
+    /// the number of processes sleeping on the futex of completed
+    std::atomic<uint32_t> completed_waiters;
+};
+
+namespace {
+
+/// the magic number of a shared batch region ("NESBATCH")
+const uint64_t MAGIC = 0x4843544142534e45ull;
+/// the number of polls of a word before sleeping on its futex
+const int SPIN_COUNT = 4096;
+/// the number of milliseconds the parent waits for the workers to close
+const int CLOSE_TIMEOUT_MS = 1000;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+    "futexes in shared memory need lock-free 32-bit atomics");
+
+/// Round an offset up to the next cache line.
+inline uint64_t align(uint64_t offset) { return (offset + 63) & ~uint64_t(63); }
+
+// The futexes are shared between processes, so they can not use
+// FUTEX_WAIT_PRIVATE and FUTEX_WAKE_PRIVATE, which key a futex by the
+// address space of the process.
+
+/// Sleep on a futex in shared memory while it holds a value.
+///
+/// @param word the futex to sleep on
+/// @param waiters the number of processes sleeping on the futex
+/// @param value the value to sleep while the futex holds
+/// @param timeout the relative time to sleep at most, or nullptr
+///
+inline void futex_wait(
+    std::atomic<uint32_t>* word,
+    std::atomic<uint32_t>* waiters,
+    uint32_t value,
+    const timespec* timeout
+) {
+    waiters->fetch_add(1, std::memory_order_relaxed);
+    // pairs with the fence of futex_wake: either the waker sees this sleeper
+    // or this sleeper sees the new value
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (word->load(std::memory_order_relaxed) == value)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, value, timeout, nullptr, 0);
+    waiters->fetch_sub(1, std::memory_order_relaxed);
+}
+
+/// Wake every process sleeping on a futex in shared memory after changing
+/// its value, skipping the system call if none is sleeping.
+///
+/// @param word the futex to wake the sleepers of
+/// @param waiters the number of processes sleeping on the futex
+///
+inline void futex_wake(std::atomic<uint32_t>* word, std::atomic<uint32_t>* waiters) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters->load(std::memory_order_relaxed) != 0)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+/// Wait for a futex in shared memory to change, spinning briefly first
+/// because steps tend to arrive back to back.
+///
+/// @param word the futex to wait on
+/// @param waiters the number of processes sleeping on the futex
+/// @param value the value to wait for the futex to change from
+///
+void wait_for_change(std::atomic<uint32_t>* word, std::atomic<uint32_t>* waiters, uint32_t value) {
+    for (int i = 0; i < SPIN_COUNT; i++)
+        if (word->load(std::memory_order_acquire) != value)
+            return;
+    while (word->load(std::memory_order_acquire) == value)
+        futex_wait(word, waiters, value, nullptr);
+}
+
+}  // namespace
+
+SharedBatch::SharedBatch(
+    const std::string& name_,
+    SharedHeader* header_,
+    std::size_t mapping_size_,
+    bool is_owner_
+) :
+    name(name_),
+    header(header_),
+    mapping_size(mapping_size_),
+    is_owner(is_owner_),
+    is_linked(is_owner_),
+    expected(0) { }
+
+SharedBatch* SharedBatch::create(
+    const std::string& name,
+    const std::string& rom_path,
+    int size,
+    int workers,
+    bool headless,
+    PixelFormat format,
+    const std::string& spec,
+    int stack_depth,
+    int stack_downsample,
+    std::string& error
+) {
+    if (size < 1) {
+        error = "size must be positive";
+        return nullptr;
+    }
+    if (workers < 1 || workers > size) {
+        error = "workers must be between 1 and the size of the batch";
+        return nullptr;
+    }
+    if (format < 0 || format >= NUM_PIXEL_FORMATS) {
+        error = "invalid pixel format";
+        return nullptr;
+    }
+    FrameStack stack;
+    if (!stack.configure(stack_depth, stack_downsample)) {
+        error = "invalid frame stack shape";
+        return nullptr;
+    }
+    RamWatch watch;
+    if (!watch.compile(spec, error))
+        return nullptr;
+    // the reward and done columns are kept without a watch (see Batch)
+    int watch_size = std::max(2, watch.size());
+    // lay the arrays out one after another on separate cache lines
+    uint64_t offset = align(sizeof(SharedHeader));
+    auto allocate = [&offset](uint64_t bytes) {
+        auto start = offset;
+        offset = align(offset + bytes);
+        return start;
+    };
+    auto screen_size_ = screen_size(format);
+    auto rom_path_offset = allocate(rom_path.size() + 1);
+    auto spec_offset = allocate(spec.size() + 1);
+    auto rings = allocate(workers * sizeof(SharedCommandRing));
+    auto actions = allocate(size * sizeof(int32_t));
+    auto action_table = allocate(MAX_ACTIONS * 2);
+    auto screens = allocate(size * screen_size_);
+    auto final_screens = allocate(size * screen_size_);
+    auto frame_stacks = allocate(size * stack.get_ring_size());
+    auto frame_stack_offsets = allocate(size * sizeof(int32_t));
+    auto ram = allocate(size * MainBus::RAM_SIZE);
+    auto results = allocate(size * watch_size * sizeof(double));
+    auto terminated = allocate(size);
+    auto truncated = allocate(size);
+    auto episodes = allocate(size * sizeof(EpisodeStats));
+    auto final_episodes = allocate(size * sizeof(EpisodeStats));
+    // create the zero-filled shared memory object and map it
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        error = name + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, offset) == 0)
+        mapping = mmap(nullptr, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        error = name + ": " + std::strerror(errno);
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    close(fd);
+    auto header = new (mapping) SharedHeader();
+    header->size = size;
+    header->workers = workers;
+    header->watch_size = watch_size;
+    header->pixel_format = format;
+    header->headless = headless;
+    header->stack_depth = stack_depth;
+    header->stack_downsample = stack_downsample;
+    header->stack_size = stack.get_ring_size();
+    header->screen_size = screen_size_;
+    header->rom_path = rom_path_offset;
+    header->spec = spec_offset;
+    header->rings = rings;
+    header->actions = actions;
+    header->action_table = action_table;
+    header->screens = screens;
+    header->final_screens = final_screens;
+    header->frame_stacks = frame_stacks;
+    header->frame_stack_offsets = frame_stack_offsets;
+    header->ram = ram;
+    header->results = results;
+    header->terminated = terminated;
+    header->truncated = truncated;
+    header->episodes = episodes;
+    header->final_episodes = final_episodes;
+    auto batch = new SharedBatch(name, header, offset, true);
+    std::memcpy(batch->at<char>(rom_path_offset), rom_path.c_str(), rom_path.size() + 1);
+    std::memcpy(batch->at<char>(spec_offset), spec.c_str(), spec.size() + 1);
+    for (int i = 0; i < workers; i++)
+        new (batch->get_ring(i)) SharedCommandRing();
+    header->magic = MAGIC;
+    batch->watch = std::move(watch);
+    // every worker finishes starting up before the first command
+    batch->expected = workers;
+    return batch;
+}
+
+bool SharedBatch::run_worker(const std::string& name, int index, std::string& error) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        error = name + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && status.st_size >= static_cast<off_t>(sizeof(SharedHeader)))
+        mapping = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = name + ": not a shared batch";
+        return false;
+    }
+    // the handle unmaps the region when the worker returns
+    SharedBatch shared(name, static_cast<SharedHeader*>(mapping), status.st_size, false);
+    auto header = shared.header;
+    if (header->magic != MAGIC) {
+        error = name + ": not a shared batch";
+        return false;
+    }
+    if (index < 0 || index >= header->workers) {
+        error = "invalid worker index " + std::to_string(index);
+        return false;
+    }
+    // the worker runs a batch of a contiguous slice of the emulators
+    int first = index * header->size / header->workers;
+    int count = (index + 1) * header->size / header->workers - first;
+    Batch batch(shared.at<char>(header->rom_path), count, header->headless);
+    batch.set_pixel_format(static_cast<PixelFormat>(header->pixel_format));
+    if (!batch.set_watch(shared.at<char>(header->spec), error))
+        return false;
+    auto screen_size = header->screen_size;
+    batch.set_screen_buffers(
+        shared.get_screens() + first * screen_size,
+        shared.get_final_screens() + first * screen_size
+    );
+    batch.set_ram_buffer(shared.get_ram() + first * MainBus::RAM_SIZE);
+    if (header->stack_depth > 0)
+        batch.set_frame_stack(header->stack_depth, header->stack_downsample,
+            shared.get_frame_stacks() + first * header->stack_size);
+    batch.seed(0, first);
+    auto actions = shared.at<int32_t>(header->actions) + first;
+    // copy what the batch does not store in the shared region
+    auto publish = [&]() {
+        auto watch_size = header->watch_size;
+        std::copy(batch.get_results(), batch.get_results() + count * watch_size,
+            shared.get_results() + first * watch_size);
+        std::memcpy(shared.get_terminated() + first, batch.get_terminated(), count);
+        std::memcpy(shared.get_truncated() + first, batch.get_truncated(), count);
+        std::copy(batch.get_frame_stack_offsets(), batch.get_frame_stack_offsets() + count,
+            shared.get_frame_stack_offsets() + first);
+        std::copy(batch.get_episodes(), batch.get_episodes() + count, shared.get_episodes() + first);
+        std::copy(batch.get_final_episodes(), batch.get_final_episodes() + count,
+            shared.get_final_episodes() + first);
+    };
+    auto complete = [&]() {
+        header->completed.fetch_add(1, std::memory_order_release);
+        futex_wake(&header->completed, &header->completed_waiters);
+    };
+    publish();
+    complete();
+    auto ring = shared.get_ring(index);
+    for (bool is_open = true; is_open;) {
+        uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+        wait_for_change(&ring->head, &ring->head_waiters, tail);
+        const auto& command = ring->commands[tail % SharedCommandRing::CAPACITY];
+        switch (command.type) {
+            case SHARED_STEP:
+                batch.step(actions, command.value);
+                publish();
+                break;
+            case SHARED_RESET:
+                batch.reset();
+                publish();
+                break;
+            case SHARED_BACKUP: batch.backup(); break;
+            case SHARED_SEED: batch.seed(command.value, first); break;
+            case SHARED_STICKY_ACTIONS: batch.set_sticky_actions(command.real); break;
+            case SHARED_MAX_NOOPS: batch.set_max_noops(command.value); break;
+            case SHARED_MAX_EPISODE_STEPS: batch.set_max_episode_steps(command.value); break;
+            case SHARED_ACTION_TABLE:
+                batch.set_action_table(shared.at<NES_Byte>(header->action_table), command.value);
+                break;
+            case SHARED_CLOSE: is_open = false; break;
+        }
+        ring->tail.store(tail + 1, std::memory_order_release);
+        complete();
+    }
+    return true;
+}
+
+SharedBatch::~SharedBatch() {
+    if (is_owner) {
+        // tell the workers to leave their command loop unless a dead worker
+        // left its ring full
+        bool is_full = false;
+        for (int i = 0; i < header->workers; i++) {
+            auto ring = get_ring(i);
+            is_full |= ring->head.load() - ring->tail.load() >= SharedCommandRing::CAPACITY;
+        }
+        if (!is_full) {
+            post({SHARED_CLOSE, 0, 0});
+            wait(CLOSE_TIMEOUT_MS);
+        }
+        unlink();
+    }
+    munmap(header, mapping_size);
+}
+
+void SharedBatch::unlink() {
+    if (!is_linked) return;
+    shm_unlink(name.c_str());
+    is_linked = false;
+}
+
+SharedCommandRing* SharedBatch::get_ring(int index) const {
+    return at<SharedCommandRing>(header->rings) + index;
+}
+
+void SharedBatch::post(const SharedCommand& command) {
+    TraceZone zone("post_command");
+    for (int i = 0; i < header->workers; i++) {
+        auto ring = get_ring(i);
+        uint32_t head = ring->head.load(std::memory_order_relaxed);
+        // wait for the worker to free a slot of a full ring
+        while (head - ring->tail.load(std::memory_order_acquire) >= SharedCommandRing::CAPACITY) {
+            uint32_t completed = header->completed.load(std::memory_order_acquire);
+            if (head - ring->tail.load(std::memory_order_acquire) < SharedCommandRing::CAPACITY)
+                break;
+            timespec timeout = {0, 1000000};
+            futex_wait(&header->completed, &header->completed_waiters, completed, &timeout);
+        }
+        ring->commands[head % SharedCommandRing::CAPACITY] = command;
+        ring->head.store(head + 1, std::memory_order_release);
+        futex_wake(&ring->head, &ring->head_waiters);
+    }
+    expected += header->workers;
+}
+
+bool SharedBatch::wait(int timeout_ms) {
+    TraceZone zone("wait_workers");
+    using namespace std::chrono;
+    auto deadline = steady_clock::now() + milliseconds(timeout_ms);
+    for (;;) {
+        uint32_t completed = header->completed.load(std::memory_order_acquire);
+        // the counters wrap around, so compare their difference
+        if (static_cast<int32_t>(completed - expected) >= 0)
+            return true;
+        auto remaining = duration_cast<nanoseconds>(deadline - steady_clock::now()).count();
+        if (remaining <= 0)
+            return false;
+        timespec timeout = {
+            static_cast<time_t>(remaining / 1000000000),
+            static_cast<long>(remaining % 1000000000)
+        };
+        futex_wait(&header->completed, &header->completed_waiters, completed, &timeout);
+    }
+}
+
+void SharedBatch::step(const int32_t* actions, int frames) {
+    std::memcpy(at<int32_t>(header->actions), actions, size() * sizeof(int32_t));
+    post({SHARED_STEP, static_cast<uint64_t>(frames), 0});
+}
+
+bool SharedBatch::set_action_table(const NES_Byte* table, int actions) {
+    if (actions < 0 || actions > MAX_ACTIONS)
+        return false;
+    std::memcpy(at<NES_Byte>(header->action_table), table, actions * 2);
+    post({SHARED_ACTION_TABLE, static_cast<uint64_t>(actions), 0});
+    return true;
+}
+
+int SharedBatch::size() const { return header->size; }
+
+std::size_t SharedBatch::get_screen_size() const { return header->screen_size; }
+
+NES_Byte* SharedBatch::get_screens() const { return at<NES_Byte>(header->screens); }
+
+NES_Byte* SharedBatch::get_final_screens() const { return at<NES_Byte>(header->final_screens); }
+
+NES_Byte* SharedBatch::get_ram() const { return at<NES_Byte>(header->ram); }
+
+double* SharedBatch::get_results() const { return at<double>(header->results); }
+
+NES_Byte* SharedBatch::get_terminated() const { return at<NES_Byte>(header->terminated); }
+
+NES_Byte* SharedBatch::get_truncated() const { return at<NES_Byte>(header->truncated); }
+
+std::size_t SharedBatch::get_frame_stack_size() const { return header->stack_size; }
+
+NES_Byte* SharedBatch::get_frame_stacks() const { return at<NES_Byte>(header->frame_stacks); }
+
+int32_t* SharedBatch::get_frame_stack_offsets() const {
+    return at<int32_t>(header->frame_stack_offsets);
+}
+
+EpisodeStats* SharedBatch::get_episodes() const { return at<EpisodeStats>(header->episodes); }
+
+EpisodeStats* SharedBatch::get_final_episodes() const {
+    return at<EpisodeStats>(header->final_episodes);
+}
+
+}  // namespace NES
+
+#endif  // __linux__
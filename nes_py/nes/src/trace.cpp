@@ -0,0 +1,164 @@
+//  Program:      nes-py
+//  File:         trace.cpp
+//  Description:  Scoped trace zones exported as Chrome trace-event JSON
+//
+//  Copyright (c) 2024 Zhao Liang. All rights reserved.
+//
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include "trace.hpp"
+
+namespace NES {
+
+namespace {
+
+/// The number of events in the ring of a thread
+const uint64_t RING_SIZE = 1 << 14;
+
+/// The events of a thread, written by the thread and read by dumps
+struct TraceRing {
+    /// the last RING_SIZE events
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(RING_SIZE);
+    /// the number of events ever written
+    std::atomic<uint64_t> head{0};
+    /// the number of events before the last clear
+    std::atomic<uint64_t> tail{0};
+    /// the id of the thread that writes the ring
+    uint32_t thread = 0;
+    /// whether a thread writes the ring, rings of threads that exited are
+    /// given to new threads
+    std::atomic<bool> owned{false};
+};
+
+/// the lock of the rings and thread names, only taken when a thread writes
+/// its first event, names itself, and by clears and dumps
+std::mutex registry_mutex;
+/// the rings of every thread that recorded an event
+std::vector<std::unique_ptr<TraceRing>> rings;
+/// the names of the threads by id
+std::map<uint32_t, std::string> thread_names;
+/// the id of the next thread
+uint32_t next_thread = 1;
+
+/// The ring of a thread, released to other threads when it exits
+struct RingHandle {
+    TraceRing* ring = nullptr;
+    ~RingHandle() { if (ring) ring->owned.store(false, std::memory_order_release); }
+};
+
+thread_local RingHandle handle;
+/// the name of the calling thread until it takes a ring
+thread_local std::string pending_name;
+
+/// Return the ring of the calling thread, taking one on its first event.
+TraceRing* thread_ring() {
+    if (handle.ring)
+        return handle.ring;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    TraceRing* ring = nullptr;
+    for (auto& candidate : rings)
+        if (!candidate->owned.load(std::memory_order_acquire))
+            ring = candidate.get();
+    if (!ring) {
+        rings.emplace_back(new TraceRing());
+        ring = rings.back().get();
+    }
+    ring->owned.store(true, std::memory_order_relaxed);
+    ring->thread = next_thread++;
+    if (!pending_name.empty())
+        thread_names[ring->thread] = pending_name;
+    handle.ring = ring;
+    return ring;
+}
+
+/// Return a string as a JSON string literal.
+std::string json_quote(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+}  // namespace
+
+uint64_t trace_now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - epoch;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void trace_record(TraceEvent event) {
+    TraceRing* ring = thread_ring();
+    event.thread = ring->thread;
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    ring->events[head % RING_SIZE] = event;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const std::string& name) {
+    // threads that never record take no ring
+    if (!handle.ring) {
+        pending_name = name;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    thread_names[handle.ring->thread] = name;
+}
+
+void trace_clear() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& ring : rings)
+        ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+bool trace_dump(const std::string& path, std::string& error) {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    int pid = getpid();
+    std::fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    std::fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": 0, "
+        "\"args\": {\"name\": \"nes-py\"}}", pid);
+    for (const auto& [thread, name] : thread_names) {
+        std::fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %u, "
+            "\"args\": {\"name\": %s}}", pid, thread, json_quote(name).c_str());
+    }
+    for (const auto& ring : rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = ring->tail.load(std::memory_order_relaxed);
+        // the ring keeps the last events
+        if (head > RING_SIZE && first < head - RING_SIZE)
+            first = head - RING_SIZE;
+        for (uint64_t i = first; i < head; i++) {
+            const TraceEvent& event = ring->events[i % RING_SIZE];
+            // complete events with the times in microseconds
+            std::fprintf(file, ",\n{\"name\": %s, \"cat\": \"nes\", \"ph\": \"X\", \"ts\": %.3f, "
+                "\"dur\": %.3f, \"pid\": %d, \"tid\": %u",
+                json_quote(event.name).c_str(), event.start / 1e3, event.duration / 1e3,
+                pid, event.thread);
+            if (event.argument >= 0)
+                std::fprintf(file, ", \"args\": {\"index\": %d}", event.argument);
+            std::fprintf(file, "}");
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    if (std::fclose(file) != 0) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace NES
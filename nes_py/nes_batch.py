@@ -0,0 +1,327 @@
+"""A batch of NES emulators stepped together by the C++ code."""
+import ctypes
+import numpy as np
+from .nes_env import _LIB
+from .nes_env import _action_table
+from .nes_env import _array
+from .nes_env import _check_actions
+from .nes_env import _check_frames
+from .nes_env import _check_pixel_format
+from .nes_env import _check_rom
+from .nes_env import _check_stochasticity
+from .nes_env import _frame_stack_shape
+from .nes_env import _observation_space
+from .nes_env import _stacked_frames
+from .nes_env import _watch_spec
+from .nes_env import EPISODE_STATS_DTYPE
+from .nes_env import MEMORY_FOOTPRINT_DTYPE
+from .nes_env import PIXEL_FORMATS
+
+
+class NESBatch(object):
+    """A batch of NES emulators with auto-reset of finished episodes."""
+
+    def __init__(self, rom_path, num_envs, headless=False, pixel_format='rgb',
+        ram_watch=None, max_episode_steps=0, sticky_actions=0.0, max_noops=0,
+        num_threads=0
+    ):
+        """
+        Create a new batch of NES emulators.
+
+        Episodes end when the 'done' entry of the RAM watch is non-zero
+        (terminated) or after a number of steps (truncated). Emulators whose
+        episodes end are reset to their start state within the same step
+        (see `backup`) and the last screen of the episode is kept in
+        `final_observations`. The emulators accumulate the return, length,
+        maximal 'progress' entry of the RAM watch, and time of their
+        episodes in `episode_stats`, and keep those of the episodes that
+        ended in `final_episode_stats`.
+
+        Args:
+            rom_path (str): the path to the ROM for the emulators
+            num_envs (int): the number of emulators in the batch
+            headless (bool): whether to skip rendering the screens
+            pixel_format (str): the format the screens are rendered in (see
+                NESEnv)
+            ram_watch (dict, str): the RAM watch evaluated by each emulator
+                after each frame (see NESEnv.set_ram_watch)
+            max_episode_steps (int): the number of steps after which episodes
+                are truncated, 0 for no limit
+            sticky_actions (float): the probability of repeating the buttons
+                of the last frame instead of the action in each frame
+            max_noops (int): the maximal number of frames without input after
+                each reset (see NESEnv.set_stochasticity)
+            num_threads (int): the number of worker threads that step the
+                emulators in parallel, 0 to step them on the calling thread
+
+        Returns:
+            None
+
+        """
+        _check_rom(rom_path)
+        pixel_format = _check_pixel_format(pixel_format)
+        _check_stochasticity(sticky_actions, max_noops)
+        if num_envs < 1:
+            raise ValueError('num_envs must be positive')
+        self.num_envs = num_envs
+        self.single_observation_space = _observation_space(pixel_format)
+        self._batch = _LIB.InitializeBatch(rom_path, num_envs, headless)
+        _LIB.BatchSetPixelFormat(self._batch, PIXEL_FORMATS[pixel_format][0])
+        _LIB.BatchSetMaxEpisodeSteps(self._batch, max_episode_steps)
+        _LIB.BatchSetStickyActions(self._batch, sticky_actions)
+        _LIB.BatchSetMaxNoops(self._batch, max_noops)
+        _LIB.BatchSetThreads(self._batch, num_threads)
+        # setup the buffer of the indexes of emulators whose steps finished
+        self._ready = np.zeros(num_envs, dtype=np.int32)
+        # setup views of the batch buffers
+        space = self.single_observation_space
+        shape = (num_envs, ) + space.shape
+        self.observations = _array(_LIB.BatchScreens(self._batch), shape, space.dtype)
+        self.final_observations = _array(_LIB.BatchFinalScreens(self._batch), shape, space.dtype)
+        self.ram = _array(_LIB.BatchRAM(self._batch), (num_envs, 0x800), np.uint8)
+        self.terminated = _array(_LIB.BatchTerminated(self._batch), (num_envs, ), np.bool_)
+        self.truncated = _array(_LIB.BatchTruncated(self._batch), (num_envs, ), np.bool_)
+        self.episode_stats = _array(_LIB.BatchEpisodeStats(self._batch), (num_envs, ), EPISODE_STATS_DTYPE)
+        self.final_episode_stats = _array(_LIB.BatchFinalEpisodeStats(self._batch), (num_envs, ), EPISODE_STATS_DTYPE)
+        # setup a placeholder for the rings of the frame stacks
+        self._frame_rings = None
+        # the number of actions in the action table, None without a table
+        self._num_actions = None
+        self.set_ram_watch(ram_watch)
+
+    def set_ram_watch(self, watch):
+        """
+        Evaluate expressions over RAM in each emulator after each frame.
+
+        Args:
+            watch (dict, str, None): the RAM watch (see NESEnv.set_ram_watch)
+
+        Returns:
+            None
+
+        """
+        error = ctypes.create_string_buffer(256)
+        spec = _watch_spec(watch).encode('utf-8')
+        if not _LIB.BatchSetWatch(self._batch, spec, error, len(error)):
+            raise ValueError('invalid RAM watch: {}'.format(error.value.decode('utf-8')))
+        # view the results as a struct per emulator with a field per name
+        emulator = _LIB.BatchEmulator(self._batch, 0)
+        size = _LIB.WatchSize(emulator)
+        names = [_LIB.WatchName(emulator, index).decode('utf-8') for index in range(size)]
+        dtype = np.dtype([(name, np.float64) for name in names])
+        self.results = _array(_LIB.BatchResults(self._batch), (self.num_envs, ), dtype)
+
+    def set_action_table(self, table=None):
+        """
+        Map discrete actions to joypad bytes in each emulator.
+
+        Args:
+            table (array-like, None): the action table (see
+                NESEnv.set_action_table), or None to step with joypad bytes
+
+        Returns:
+            None
+
+        """
+        if table is None:
+            _LIB.BatchSetActionTable(self._batch, None, 0)
+            self._num_actions = None
+            return
+        table = _action_table(table)
+        _LIB.BatchSetActionTable(self._batch, table.ctypes.data, len(table))
+        self._num_actions = len(table)
+
+    def set_frame_stack(self, depth, downsample=1):
+        """
+        Keep a stack of the last frames of each emulator (see
+        NESEnv.set_frame_stack).
+
+        Args:
+            depth (int): the number of frames in each stack, None to disable
+                them
+            downsample (int): the factor to downsample the frames by
+
+        Returns:
+            None
+
+        """
+        if depth is None:
+            _LIB.BatchSetFrameStack(self._batch, 0, 1)
+            self._frame_rings = None
+            return
+        height, width = _frame_stack_shape(depth, downsample)
+        _LIB.BatchSetFrameStack(self._batch, depth, downsample)
+        shape = (self.num_envs, 2 * depth, height, width)
+        self._frame_rings = _array(_LIB.BatchFrameStacks(self._batch), shape, np.uint8)
+        address = _LIB.BatchFrameStackOffsets(self._batch)
+        self._frame_offsets = _array(address, (self.num_envs, ), np.int32)
+
+    @property
+    def stacked_observations(self):
+        """
+        Return the last frames of each emulator from the oldest to the latest.
+
+        Returns:
+            a [N, depth, height, width] array of the frame stacks, or None
+            without frame stacks. While the emulators step together it is a
+            strided view of the rings that the next step overwrites in part,
+            after asynchronous steps of some emulators it is a copy
+
+        """
+        if self._frame_rings is None:
+            return None
+        return _stacked_frames(self._frame_rings, self._frame_offsets)
+
+    @property
+    def rewards(self):
+        """Return the rewards of the last step."""
+        return self.results['reward']
+
+    def backup(self):
+        """Save the current state of each emulator as its start state."""
+        _LIB.BatchBackup(self._batch)
+
+    def memory_footprint(self):
+        """
+        Return the memory the batch uses by component.
+
+        Returns:
+            a structured NumPy scalar of the bytes of the components (see
+            NESEnv.memory_footprint) summed over the emulators, including
+            the screens, RAM, and frame stacks of the batch
+
+        """
+        footprint = np.zeros((), dtype=MEMORY_FOOTPRINT_DTYPE)
+        _LIB.BatchMemoryFootprint(self._batch, footprint.ctypes.data)
+        return footprint
+
+    def reset(self, seed=None):
+        """
+        Reset each emulator to its start state.
+
+        Args:
+            seed (int): an optional seed of the sticky actions and no-op
+                starts, each emulator draws from its own stream of the seed
+
+        Returns:
+            the observations of the emulators
+
+        """
+        if seed is not None:
+            _LIB.BatchSeed(self._batch, seed)
+        _LIB.BatchReset(self._batch)
+        return self.observations
+
+    def step(self, actions, frames=1):
+        """
+        Step each emulator with an action.
+
+        The returned arrays are views of buffers that are updated in place by
+        the next step.
+
+        Args:
+            actions (np.ndarray): the action of each emulator, an index in the
+                action table or the joypad byte of the first controller
+            frames (int): the number of frames to hold the actions for, only
+                the last of which is rendered
+
+        Returns:
+            a tuple of:
+            - observations (np.ndarray): the screens after the step (after
+              the reset for emulators whose episodes ended)
+            - rewards (np.ndarray): the rewards of the step
+            - terminated (np.ndarray): whether each episode was terminated
+            - truncated (np.ndarray): whether each episode was truncated
+            - info (dict): the RAM watch 'results', and the
+              'final_observations' and 'final_episode_stats' of the episodes
+              that ended
+
+        """
+        actions = np.ascontiguousarray(actions, dtype=np.int32)
+        if actions.shape != (self.num_envs, ):
+            raise ValueError('expected {} actions'.format(self.num_envs))
+        _check_actions(actions, self._num_actions)
+        _check_frames(frames)
+        if not _LIB.StepBatch(self._batch, actions.ctypes.data, frames):
+            raise RuntimeError('cannot step while steps of step_async are in flight, call wait_all first')
+        info = {
+            'results': self.results,
+            'final_observations': self.final_observations,
+            'final_episode_stats': self.final_episode_stats,
+        }
+        return self.observations, self.rewards, self.terminated, self.truncated, info
+
+    def step_async(self, actions, env_ids=None, frames=1):
+        """
+        Start steps of some emulators and return without waiting for them.
+
+        The observations, results, and flags of an emulator must not be read
+        until its step finishes (see `poll`, `wait_any`, and `wait_all`), and
+        the other methods of the batch must not be called while steps are in
+        flight.
+
+        Args:
+            actions (np.ndarray): the action of each emulator to step
+            env_ids (np.ndarray): the indexes of the emulators to step, None
+                for all of them
+            frames (int): the number of frames to hold the actions for
+
+        Returns:
+            None
+
+        """
+        actions = np.ascontiguousarray(actions, dtype=np.int32)
+        if env_ids is None:
+            env_ids = np.arange(self.num_envs, dtype=np.int32)
+        env_ids = np.ascontiguousarray(env_ids, dtype=np.int32)
+        if actions.shape != env_ids.shape or actions.ndim != 1:
+            raise ValueError('expected an action for each of the env_ids')
+        _check_actions(actions, self._num_actions)
+        _check_frames(frames)
+        if not _LIB.StepBatchAsync(self._batch, actions.ctypes.data, env_ids.ctypes.data, len(env_ids), frames):
+            raise ValueError('env_ids must be unique emulators without a step in flight')
+
+    def poll(self):
+        """Return the indexes of the emulators whose steps finished."""
+        count = _LIB.BatchPoll(self._batch, self._ready.ctypes.data, self.num_envs)
+        return self._ready[:count].copy()
+
+    def wait_any(self):
+        """
+        Wait for a step to finish.
+
+        Returns:
+            the indexes of the emulators whose steps finished, empty if no
+            step is in flight
+
+        """
+        count = _LIB.BatchWaitAny(self._batch, self._ready.ctypes.data, self.num_envs)
+        return self._ready[:count].copy()
+
+    def wait_all(self):
+        """
+        Wait for every step in flight to finish.
+
+        Returns:
+            the indexes of the emulators whose steps finished
+
+        """
+        count = _LIB.BatchWaitAll(self._batch, self._ready.ctypes.data, self.num_envs)
+        return self._ready[:count].copy()
+
+    @property
+    def in_flight(self):
+        """Return the number of steps in flight."""
+        return _LIB.BatchInFlight(self._batch)
+
+    def close(self):
+        """Close the batch."""
+        # make sure the batch is not already closed
+        if self._batch is None:
+            raise ValueError('batch has already been closed.')
+        _LIB.CloseBatch(self._batch)
+        self._batch = None
+
+
+# explicitly define the outward facing API of this module
+__all__ = [NESBatch.__name__]
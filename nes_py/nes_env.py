@@ -3,7 +3,6 @@ import ctypes
 import glob
 import itertools
 import os
-import sys
 
 import gymnasium as gym
 from gymnasium.core import ObsType, RenderFrame
@@ -53,15 +52,368 @@ _LIB.Controller.restype = ctypes.c_void_p
 # setup the argument and return types for Screen
 _LIB.Screen.argtypes = [ctypes.c_void_p]
 _LIB.Screen.restype = ctypes.c_void_p
+# setup the argument and return types for SetScreenBuffer
+_LIB.SetScreenBuffer.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+_LIB.SetScreenBuffer.restype = None
+# setup the argument and return types for SetDoubleBuffered
+_LIB.SetDoubleBuffered.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+_LIB.SetDoubleBuffered.restype = None
+# setup the argument and return types for FrameSequence
+_LIB.FrameSequence.argtypes = [ctypes.c_void_p]
+_LIB.FrameSequence.restype = ctypes.c_uint64
+# setup the argument and return types for SequenceScreen
+_LIB.SequenceScreen.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+_LIB.SequenceScreen.restype = ctypes.c_void_p
+# setup the argument and return types for FrontScreen
+_LIB.FrontScreen.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint64)]
+_LIB.FrontScreen.restype = ctypes.c_void_p
+# setup the argument and return types for SetPixelFormat
+_LIB.SetPixelFormat.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.SetPixelFormat.restype = ctypes.c_bool
+# setup the argument and return types for ConvertScreen
+_LIB.ConvertScreen.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+_LIB.ConvertScreen.restype = ctypes.c_bool
 # setup the argument and return types for GetMemoryBuffer
 _LIB.Memory.argtypes = [ctypes.c_void_p]
 _LIB.Memory.restype = ctypes.c_void_p
+# setup the argument and return types for SetActionTable
+_LIB.SetActionTable.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+_LIB.SetActionTable.restype = None
+# setup the argument and return types for SetAction
+_LIB.SetAction.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+_LIB.SetAction.restype = None
+# setup the argument and return types for SetStickyActions
+_LIB.SetStickyActions.argtypes = [ctypes.c_void_p, ctypes.c_double]
+_LIB.SetStickyActions.restype = None
+# setup the argument and return types for SetMaxNoops
+_LIB.SetMaxNoops.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.SetMaxNoops.restype = None
+# setup the argument and return types for Seed
+_LIB.Seed.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+_LIB.Seed.restype = None
+# setup the argument and return types for SetFrameStack
+_LIB.SetFrameStack.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+_LIB.SetFrameStack.restype = ctypes.c_bool
+# setup the argument and return types for FrameStackBuffer
+_LIB.FrameStackBuffer.argtypes = [ctypes.c_void_p]
+_LIB.FrameStackBuffer.restype = ctypes.c_void_p
+# setup the argument and return types for FrameStackOffset
+_LIB.FrameStackOffset.argtypes = [ctypes.c_void_p]
+_LIB.FrameStackOffset.restype = ctypes.c_int
+# setup the argument and return types for EpisodeStatsSize
+_LIB.EpisodeStatsSize.argtypes = None
+_LIB.EpisodeStatsSize.restype = ctypes.c_size_t
+# setup the argument and return types for EpisodeStats
+_LIB.EpisodeStats.argtypes = [ctypes.c_void_p]
+_LIB.EpisodeStats.restype = ctypes.c_void_p
+# setup the argument and return types for FinalEpisodeStats
+_LIB.FinalEpisodeStats.argtypes = [ctypes.c_void_p]
+_LIB.FinalEpisodeStats.restype = ctypes.c_void_p
+# setup the argument and return types for CountersEnabled
+_LIB.CountersEnabled.argtypes = None
+_LIB.CountersEnabled.restype = ctypes.c_bool
+# setup the argument and return types for HotPathCountersSize
+_LIB.HotPathCountersSize.argtypes = None
+_LIB.HotPathCountersSize.restype = ctypes.c_size_t
+# setup the argument and return types for FrameCounters
+_LIB.FrameCounters.argtypes = [ctypes.c_void_p]
+_LIB.FrameCounters.restype = ctypes.c_void_p
+# setup the argument and return types for TotalCounters
+_LIB.TotalCounters.argtypes = [ctypes.c_void_p]
+_LIB.TotalCounters.restype = ctypes.c_void_p
+# setup the argument and return types for ResetCounters
+_LIB.ResetCounters.argtypes = [ctypes.c_void_p]
+_LIB.ResetCounters.restype = None
+# setup the argument and return types for MemoryFootprintSize
+_LIB.MemoryFootprintSize.argtypes = None
+_LIB.MemoryFootprintSize.restype = ctypes.c_size_t
+# setup the argument and return types for MemoryFootprint
+_LIB.MemoryFootprint.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+_LIB.MemoryFootprint.restype = None
+# setup the argument and return types for MemoryPoolBytes
+_LIB.MemoryPoolBytes.argtypes = [ctypes.c_int]
+_LIB.MemoryPoolBytes.restype = ctypes.c_int64
+# setup the argument and return types for MemoryPoolCount
+_LIB.MemoryPoolCount.argtypes = [ctypes.c_int]
+_LIB.MemoryPoolCount.restype = ctypes.c_int64
+# setup the argument and return types for LatencySections
+_LIB.LatencySections.argtypes = None
+_LIB.LatencySections.restype = ctypes.c_int
+# setup the argument and return types for LatencySectionName
+_LIB.LatencySectionName.argtypes = [ctypes.c_int]
+_LIB.LatencySectionName.restype = ctypes.c_char_p
+# setup the argument and return types for LatencySummarySize
+_LIB.LatencySummarySize.argtypes = None
+_LIB.LatencySummarySize.restype = ctypes.c_size_t
+# setup the argument and return types for LatencyStats
+_LIB.LatencyStats.argtypes = [ctypes.c_int, ctypes.c_void_p]
+_LIB.LatencyStats.restype = None
+# setup the argument and return types for ResetLatency
+_LIB.ResetLatency.argtypes = [ctypes.c_int]
+_LIB.ResetLatency.restype = None
+# setup the argument and return types for SetTracing
+_LIB.SetTracing.argtypes = [ctypes.c_bool]
+_LIB.SetTracing.restype = None
+# setup the argument and return types for ClearTrace
+_LIB.ClearTrace.argtypes = None
+_LIB.ClearTrace.restype = None
+# setup the argument and return types for DumpTrace
+_LIB.DumpTrace.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+_LIB.DumpTrace.restype = ctypes.c_bool
+# setup the argument and return types for CpuTraceRecordSize
+_LIB.CpuTraceRecordSize.argtypes = None
+_LIB.CpuTraceRecordSize.restype = ctypes.c_size_t
+# setup the argument and return types for FormatCpuTrace
+_LIB.FormatCpuTrace.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+_LIB.FormatCpuTrace.restype = ctypes.c_bool
+# setup the argument and return types for SetCpuTracing
+_LIB.SetCpuTracing.argtypes = [ctypes.c_void_p, ctypes.c_bool, ctypes.c_size_t]
+_LIB.SetCpuTracing.restype = None
+# setup the argument and return types for ClearCpuTrace
+_LIB.ClearCpuTrace.argtypes = [ctypes.c_void_p]
+_LIB.ClearCpuTrace.restype = None
+# setup the argument and return types for CpuTraceSize
+_LIB.CpuTraceSize.argtypes = [ctypes.c_void_p]
+_LIB.CpuTraceSize.restype = ctypes.c_size_t
+# setup the argument and return types for CpuTraceRecords
+_LIB.CpuTraceRecords.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+_LIB.CpuTraceRecords.restype = ctypes.c_size_t
+# setup the argument and return types for DumpCpuTrace
+_LIB.DumpCpuTrace.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+_LIB.DumpCpuTrace.restype = ctypes.c_bool
+# setup the argument and return types for SetProfiling
+_LIB.SetProfiling.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+_LIB.SetProfiling.restype = None
+# setup the argument and return types for ClearProfile
+_LIB.ClearProfile.argtypes = [ctypes.c_void_p]
+_LIB.ClearProfile.restype = None
+# setup the argument and return types for ProfileOpcodeHits
+_LIB.ProfileOpcodeHits.argtypes = [ctypes.c_void_p]
+_LIB.ProfileOpcodeHits.restype = ctypes.c_void_p
+# setup the argument and return types for ProfileOpcodeCycles
+_LIB.ProfileOpcodeCycles.argtypes = [ctypes.c_void_p]
+_LIB.ProfileOpcodeCycles.restype = ctypes.c_void_p
+# setup the argument and return types for ProfileAddressHits
+_LIB.ProfileAddressHits.argtypes = [ctypes.c_void_p]
+_LIB.ProfileAddressHits.restype = ctypes.c_void_p
+# setup the argument and return types for ProfileAddressCycles
+_LIB.ProfileAddressCycles.argtypes = [ctypes.c_void_p]
+_LIB.ProfileAddressCycles.restype = ctypes.c_void_p
+# setup the argument and return types for ProfileInterruptCycles
+_LIB.ProfileInterruptCycles.argtypes = [ctypes.c_void_p]
+_LIB.ProfileInterruptCycles.restype = ctypes.c_uint64
+# setup the argument and return types for FlatProfile
+_LIB.FlatProfile.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.FlatProfile.restype = ctypes.c_char_p
+# setup the argument and return types for FoldedStacks
+_LIB.FoldedStacks.argtypes = [ctypes.c_void_p]
+_LIB.FoldedStacks.restype = ctypes.c_char_p
 # setup the argument and return types for Reset
 _LIB.Reset.argtypes = [ctypes.c_void_p]
 _LIB.Reset.restype = None
 # setup the argument and return types for Step
 _LIB.Step.argtypes = [ctypes.c_void_p]
 _LIB.Step.restype = None
+# setup the argument and return types for StepN
+_LIB.StepN.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.StepN.restype = None
+# setup the argument and return types for SetRendering
+_LIB.SetRendering.argtypes = [ctypes.c_void_p, ctypes.c_bool]
+_LIB.SetRendering.restype = None
+# setup the argument and return types for Rendering
+_LIB.Rendering.argtypes = [ctypes.c_void_p]
+_LIB.Rendering.restype = ctypes.c_bool
+# setup the argument and return types for SetWatch
+_LIB.SetWatch.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+_LIB.SetWatch.restype = ctypes.c_bool
+# setup the argument and return types for WatchSize
+_LIB.WatchSize.argtypes = [ctypes.c_void_p]
+_LIB.WatchSize.restype = ctypes.c_int
+# setup the argument and return types for WatchName
+_LIB.WatchName.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.WatchName.restype = ctypes.c_char_p
+# setup the argument and return types for WatchResults
+_LIB.WatchResults.argtypes = [ctypes.c_void_p]
+_LIB.WatchResults.restype = ctypes.c_void_p
+# setup the argument and return types for InitializeBatch
+_LIB.InitializeBatch.argtypes = [ctypes.c_wchar_p, ctypes.c_int, ctypes.c_bool]
+_LIB.InitializeBatch.restype = ctypes.c_void_p
+# setup the argument and return types for CloseBatch
+_LIB.CloseBatch.argtypes = [ctypes.c_void_p]
+_LIB.CloseBatch.restype = None
+# setup the argument and return types for BatchEmulator
+_LIB.BatchEmulator.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.BatchEmulator.restype = ctypes.c_void_p
+# setup the argument and return types for BatchSetPixelFormat
+_LIB.BatchSetPixelFormat.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.BatchSetPixelFormat.restype = ctypes.c_bool
+# setup the argument and return types for BatchSetWatch
+_LIB.BatchSetWatch.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+_LIB.BatchSetWatch.restype = ctypes.c_bool
+# setup the argument and return types for BatchSetMaxEpisodeSteps
+_LIB.BatchSetMaxEpisodeSteps.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+_LIB.BatchSetMaxEpisodeSteps.restype = None
+# setup the argument and return types for BatchSetActionTable
+_LIB.BatchSetActionTable.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+_LIB.BatchSetActionTable.restype = None
+# setup the argument and return types for BatchSetStickyActions
+_LIB.BatchSetStickyActions.argtypes = [ctypes.c_void_p, ctypes.c_double]
+_LIB.BatchSetStickyActions.restype = None
+# setup the argument and return types for BatchSetMaxNoops
+_LIB.BatchSetMaxNoops.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.BatchSetMaxNoops.restype = None
+# setup the argument and return types for BatchSeed
+_LIB.BatchSeed.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+_LIB.BatchSeed.restype = None
+# setup the argument and return types for BatchBackup
+_LIB.BatchBackup.argtypes = [ctypes.c_void_p]
+_LIB.BatchBackup.restype = None
+# setup the argument and return types for BatchReset
+_LIB.BatchReset.argtypes = [ctypes.c_void_p]
+_LIB.BatchReset.restype = None
+# setup the argument and return types for StepBatch
+_LIB.StepBatch.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+_LIB.StepBatch.restype = ctypes.c_bool
+# setup the argument and return types for BatchSetThreads
+_LIB.BatchSetThreads.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_LIB.BatchSetThreads.restype = None
+# setup the argument and return types for StepBatchAsync
+_LIB.StepBatchAsync.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+_LIB.StepBatchAsync.restype = ctypes.c_bool
+# setup the argument and return types for BatchPoll
+_LIB.BatchPoll.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+_LIB.BatchPoll.restype = ctypes.c_int
+# setup the argument and return types for BatchWaitAny
+_LIB.BatchWaitAny.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+_LIB.BatchWaitAny.restype = ctypes.c_int
+# setup the argument and return types for BatchWaitAll
+_LIB.BatchWaitAll.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+_LIB.BatchWaitAll.restype = ctypes.c_int
+# setup the argument and return types for BatchInFlight
+_LIB.BatchInFlight.argtypes = [ctypes.c_void_p]
+_LIB.BatchInFlight.restype = ctypes.c_int
+# setup the argument and return types for BatchSetFrameStack
+_LIB.BatchSetFrameStack.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+_LIB.BatchSetFrameStack.restype = ctypes.c_bool
+# setup the argument and return types for BatchFrameStacks
+_LIB.BatchFrameStacks.argtypes = [ctypes.c_void_p]
+_LIB.BatchFrameStacks.restype = ctypes.c_void_p
+# setup the argument and return types for BatchFrameStackOffsets
+_LIB.BatchFrameStackOffsets.argtypes = [ctypes.c_void_p]
+_LIB.BatchFrameStackOffsets.restype = ctypes.c_void_p
+# setup the argument and return types for BatchEpisodeStats
+_LIB.BatchEpisodeStats.argtypes = [ctypes.c_void_p]
+_LIB.BatchEpisodeStats.restype = ctypes.c_void_p
+# setup the argument and return types for BatchFinalEpisodeStats
+_LIB.BatchFinalEpisodeStats.argtypes = [ctypes.c_void_p]
+_LIB.BatchFinalEpisodeStats.restype = ctypes.c_void_p
+# setup the argument and return types for BatchRAM
+_LIB.BatchRAM.argtypes = [ctypes.c_void_p]
+_LIB.BatchRAM.restype = ctypes.c_void_p
+# setup the argument and return types for BatchScreens
+_LIB.BatchScreens.argtypes = [ctypes.c_void_p]
+_LIB.BatchScreens.restype = ctypes.c_void_p
+# setup the argument and return types for BatchFinalScreens
+_LIB.BatchFinalScreens.argtypes = [ctypes.c_void_p]
+_LIB.BatchFinalScreens.restype = ctypes.c_void_p
+# setup the argument and return types for BatchWatchSize
+_LIB.BatchWatchSize.argtypes = [ctypes.c_void_p]
+_LIB.BatchWatchSize.restype = ctypes.c_int
+# setup the argument and return types for BatchResults
+_LIB.BatchResults.argtypes = [ctypes.c_void_p]
+_LIB.BatchResults.restype = ctypes.c_void_p
+# setup the argument and return types for BatchTerminated
+_LIB.BatchTerminated.argtypes = [ctypes.c_void_p]
+_LIB.BatchTerminated.restype = ctypes.c_void_p
+# setup the argument and return types for BatchTruncated
+_LIB.BatchTruncated.argtypes = [ctypes.c_void_p]
+_LIB.BatchTruncated.restype = ctypes.c_void_p
+# setup the argument and return types for BatchMemoryFootprint
+_LIB.BatchMemoryFootprint.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+_LIB.BatchMemoryFootprint.restype = None
+
+# setup the argument and return types of the shared memory batch (Linux)
+if hasattr(_LIB, 'CreateSharedBatch'):
+    # setup the argument and return types for CreateSharedBatch
+    _LIB.CreateSharedBatch.argtypes = [
+        ctypes.c_char_p, ctypes.c_wchar_p, ctypes.c_int, ctypes.c_int,
+        ctypes.c_bool, ctypes.c_int, ctypes.c_char_p, ctypes.c_int,
+        ctypes.c_int, ctypes.c_char_p, ctypes.c_size_t
+    ]
+    _LIB.CreateSharedBatch.restype = ctypes.c_void_p
+    # setup the argument and return types for RunSharedWorker
+    _LIB.RunSharedWorker.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_size_t]
+    _LIB.RunSharedWorker.restype = ctypes.c_bool
+    # setup the argument and return types for CloseSharedBatch
+    _LIB.CloseSharedBatch.argtypes = [ctypes.c_void_p]
+    _LIB.CloseSharedBatch.restype = None
+    # setup the argument and return types for SharedBatchWait
+    _LIB.SharedBatchWait.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    _LIB.SharedBatchWait.restype = ctypes.c_bool
+    # setup the argument and return types for SharedBatchUnlink
+    _LIB.SharedBatchUnlink.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchUnlink.restype = None
+    # setup the argument and return types for SharedBatchSetStickyActions
+    _LIB.SharedBatchSetStickyActions.argtypes = [ctypes.c_void_p, ctypes.c_double]
+    _LIB.SharedBatchSetStickyActions.restype = None
+    # setup the argument and return types for SharedBatchSetMaxNoops
+    _LIB.SharedBatchSetMaxNoops.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    _LIB.SharedBatchSetMaxNoops.restype = None
+    # setup the argument and return types for SharedBatchSetMaxEpisodeSteps
+    _LIB.SharedBatchSetMaxEpisodeSteps.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    _LIB.SharedBatchSetMaxEpisodeSteps.restype = None
+    # setup the argument and return types for SharedBatchSeed
+    _LIB.SharedBatchSeed.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    _LIB.SharedBatchSeed.restype = None
+    # setup the argument and return types for SharedBatchBackup
+    _LIB.SharedBatchBackup.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchBackup.restype = None
+    # setup the argument and return types for SharedBatchReset
+    _LIB.SharedBatchReset.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchReset.restype = None
+    # setup the argument and return types for SharedBatchSetActionTable
+    _LIB.SharedBatchSetActionTable.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+    _LIB.SharedBatchSetActionTable.restype = ctypes.c_bool
+    # setup the argument and return types for StepSharedBatch
+    _LIB.StepSharedBatch.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int]
+    _LIB.StepSharedBatch.restype = None
+    # setup the argument and return types for SharedBatchWatchSize
+    _LIB.SharedBatchWatchSize.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchWatchSize.restype = ctypes.c_int
+    # setup the argument and return types for SharedBatchWatchName
+    _LIB.SharedBatchWatchName.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    _LIB.SharedBatchWatchName.restype = ctypes.c_char_p
+    # setup the argument and return types for SharedBatchScreens
+    _LIB.SharedBatchScreens.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchScreens.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchFinalScreens
+    _LIB.SharedBatchFinalScreens.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchFinalScreens.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchRAM
+    _LIB.SharedBatchRAM.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchRAM.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchResults
+    _LIB.SharedBatchResults.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchResults.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchTerminated
+    _LIB.SharedBatchTerminated.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchTerminated.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchTruncated
+    _LIB.SharedBatchTruncated.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchTruncated.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchFrameStacks
+    _LIB.SharedBatchFrameStacks.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchFrameStacks.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchFrameStackOffsets
+    _LIB.SharedBatchFrameStackOffsets.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchFrameStackOffsets.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchEpisodeStats
+    _LIB.SharedBatchEpisodeStats.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchEpisodeStats.restype = ctypes.c_void_p
+    # setup the argument and return types for SharedBatchFinalEpisodeStats
+    _LIB.SharedBatchFinalEpisodeStats.argtypes = [ctypes.c_void_p]
+    _LIB.SharedBatchFinalEpisodeStats.restype = ctypes.c_void_p
+
 # setup the argument and return types for Backup
 _LIB.Backup.argtypes = [ctypes.c_void_p]
 _LIB.Backup.restype = None
@@ -77,13 +429,30 @@ _LIB.SaveState.restype = ctypes.c_void_p
 # setup the argument and return types for LoadState
 _LIB.LoadState.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
 _LIB.LoadState.restype = None
+# setup the argument and return types for FreeState
+_LIB.FreeState.argtypes = [ctypes.c_void_p]
+_LIB.FreeState.restype = None
 # setup serialization and deserialization functions
 _LIB.serialize.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_size_t)]
 _LIB.serialize.restype = ctypes.POINTER(ctypes.c_uint8)
 _LIB.free_buffer.argtypes = [ctypes.POINTER(ctypes.c_uint8)]
 _LIB.free_buffer.restype = None
-_LIB.deserialize.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint8), ctypes.c_size_t]
-_LIB.deserialize.restype = None
+_LIB.deserialize.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint8), ctypes.c_size_t, ctypes.c_char_p, ctypes.c_size_t]
+_LIB.deserialize.restype = ctypes.c_bool
+
+# load the native extension that steps an emulator in a single call with the
+# GIL released, it is only built by setup.py, so NESEnv falls back to ctypes
+# without it
+try:
+    from . import _native
+except ImportError:
+    _native = None
+else:
+    # the extension calls into this library, so both use the same emulators
+    _native.bind(
+        set_action=ctypes.cast(_LIB.SetAction, ctypes.c_void_p).value,
+        step_n=ctypes.cast(_LIB.StepN, ctypes.c_void_p).value,
+    )
 
 
 # height in pixels of the NES screen
@@ -94,8 +463,107 @@ SCREEN_WIDTH = _LIB.Width()
 SCREEN_SHAPE_24_BIT = SCREEN_HEIGHT, SCREEN_WIDTH, 3
 # shape of the screen as 32-bit RGB (C++ memory arrangement)
 SCREEN_SHAPE_32_BIT = SCREEN_HEIGHT, SCREEN_WIDTH, 4
-# create a type for the screen tensor matrix from C++
-SCREEN_TENSOR = ctypes.c_byte * int(np.prod(SCREEN_SHAPE_32_BIT))
+# the pixel formats of the C++ screen buffer mapped to their enumeration
+# value in pixel_format.hpp, and the shape and type of the screen in it
+PIXEL_FORMATS = {
+    'xrgb': (0, SCREEN_SHAPE_32_BIT, np.uint8),
+    'palette': (1, (SCREEN_HEIGHT, SCREEN_WIDTH), np.uint8),
+    'rgb24': (2, SCREEN_SHAPE_24_BIT, np.uint8),
+    'bgr24': (3, SCREEN_SHAPE_24_BIT, np.uint8),
+    'rgba': (4, SCREEN_SHAPE_32_BIT, np.uint8),
+    'chw': (5, (3, SCREEN_HEIGHT, SCREEN_WIDTH), np.uint8),
+    'bgra': (6, SCREEN_SHAPE_32_BIT, np.uint8),
+    'chw_float16': (7, (3, SCREEN_HEIGHT, SCREEN_WIDTH), np.float16),
+}
+# the pixel formats the screen can be rendered in for observations
+OBSERVATION_PIXEL_FORMATS = set(PIXEL_FORMATS) - {'xrgb'}
+
+# the statistics of an episode in the layout of EpisodeStats in emulator.hpp
+EPISODE_STATS_DTYPE = np.dtype([
+    ('return', np.float64),
+    ('max_progress', np.float64),
+    ('seconds', np.float64),
+    ('length', np.uint64),
+    ('frames', np.uint64),
+])
+assert EPISODE_STATS_DTYPE.itemsize == _LIB.EpisodeStatsSize()
+
+# the regions of the main bus in the order of BusRegion in counters.hpp
+BUS_REGIONS = ('ram', 'ppu_registers', 'apu_io', 'joypad', 'expansion', 'prg_ram', 'prg_rom')
+# the regions of the picture bus in the order of PictureRegion
+PICTURE_REGIONS = ('pattern_tables', 'name_tables', 'palette')
+# the IO registers with callbacks in the order of their counters
+IO_REGISTERS = (
+    'PPUCTRL', 'PPUMASK', 'PPUSTATUS', 'OAMADDR', 'OAMDATA', 'PPUSCROLL',
+    'PPUADDR', 'PPUDATA', 'OAMDMA', 'SND_CHN', 'JOY1', 'JOY2',
+)
+# whether the library counts the traffic on its hot paths, which takes a
+# build with NES_COUNTERS defined
+COUNTERS_ENABLED = _LIB.CountersEnabled()
+# the hot-path counters in the layout of HotPathCounters in counters.hpp
+HOT_PATH_COUNTERS_DTYPE = np.dtype([
+    ('bus_reads', np.uint64, len(BUS_REGIONS)),
+    ('bus_writes', np.uint64, len(BUS_REGIONS)),
+    ('picture_reads', np.uint64, len(PICTURE_REGIONS)),
+    ('picture_writes', np.uint64, len(PICTURE_REGIONS)),
+    ('register_reads', np.uint64, len(IO_REGISTERS)),
+    ('register_writes', np.uint64, len(IO_REGISTERS)),
+    ('oam_dmas', np.uint64),
+    ('nmis', np.uint64),
+    ('mapper_writes', np.uint64),
+])
+assert HOT_PATH_COUNTERS_DTYPE.itemsize == _LIB.HotPathCountersSize()
+
+# the summary of the latencies of a section in nanoseconds in the layout of
+# LatencySummary in latency.hpp
+LATENCY_SUMMARY_DTYPE = np.dtype([
+    ('count', np.uint64),
+    ('mean', np.float64),
+    ('p50', np.float64),
+    ('p90', np.float64),
+    ('p99', np.float64),
+    ('max', np.float64),
+])
+assert LATENCY_SUMMARY_DTYPE.itemsize == _LIB.LatencySummarySize()
+# the names of the timed sections of the core in the order of LatencySection
+LATENCY_SECTIONS = tuple(
+    _LIB.LatencySectionName(section).decode('utf-8')
+    for section in range(_LIB.LatencySections())
+)
+
+# the bytes of memory of an emulator or a batch by component in the layout
+# of MemoryFootprint in footprint.hpp
+MEMORY_FOOTPRINT_DTYPE = np.dtype([
+    ('rom', np.uint64),
+    ('framebuffer', np.uint64),
+    ('snapshots', np.uint64),
+    ('caches', np.uint64),
+    ('bus', np.uint64),
+    ('objects', np.uint64),
+    ('total', np.uint64),
+])
+assert MEMORY_FOOTPRINT_DTYPE.itemsize == _LIB.MemoryFootprintSize()
+# the pools of memory of the process in the order of MemoryPool
+MEMORY_POOLS = ('rom_store', 'snapshot_pool')
+
+# an instruction of the CPU trace in the layout of CpuTraceRecord in
+# cpu_trace.hpp
+CPU_TRACE_RECORD_DTYPE = np.dtype([
+    ('cycle', np.uint32),
+    ('pc', np.uint16),
+    ('dot', np.uint16),
+    ('scanline', np.uint16),
+    ('opcode', np.uint8),
+    ('operand', np.uint8, 2),
+    ('a', np.uint8),
+    ('x', np.uint8),
+    ('y', np.uint8),
+    ('p', np.uint8),
+    ('sp', np.uint8),
+    ('length', np.uint8),
+    ('reserved', np.uint8),
+])
+assert CPU_TRACE_RECORD_DTYPE.itemsize == _LIB.CpuTraceRecordSize()
 
 # create a type for the RAM vector from C++
 RAM_VECTOR = ctypes.c_byte * 0x800
@@ -104,6 +572,357 @@ RAM_VECTOR = ctypes.c_byte * 0x800
 CONTROLLER_VECTOR = ctypes.c_byte * 1
 
 
+def latency_stats():
+    """
+    Return the latencies of the timed sections of the core.
+
+    The core records the latency of every emulator step, of the frames of
+    each step, of preprocessing (frame stacks and screen conversions), of
+    snapshots (backups, restores, serialization), and of every batch step
+    in log-linear histograms shared by the process.
+
+    Returns:
+        a dict of the name of each section to a structured NumPy scalar of
+        the count, mean, p50, p90, p99, and max latency in nanoseconds
+
+    """
+    stats = {}
+    for section, name in enumerate(LATENCY_SECTIONS):
+        summary = np.zeros((), dtype=LATENCY_SUMMARY_DTYPE)
+        _LIB.LatencyStats(section, summary.ctypes.data)
+        stats[name] = summary
+    return stats
+
+
+def reset_latency(section=None):
+    """
+    Remove the recorded latencies to start a new window.
+
+    Args:
+        section (str, None): the name of the section to reset, or None to
+            reset every section
+
+    Returns:
+        None
+
+    """
+    _LIB.ResetLatency(-1 if section is None else LATENCY_SECTIONS.index(section))
+
+
+def memory_totals():
+    """
+    Return the memory of the pools that are shared by the process.
+
+    The ROM store holds the PRG and CHR ROM of every live emulator, and the
+    snapshot pool holds the backups of the emulators and the states that
+    `save_state` returned and that were not freed yet.
+
+    Returns:
+        a dict of the name of each pool to a dict of its live bytes and its
+        number of live objects
+
+    """
+    return {
+        name: {
+            'bytes': _LIB.MemoryPoolBytes(pool),
+            'count': _LIB.MemoryPoolCount(pool),
+        }
+        for pool, name in enumerate(MEMORY_POOLS)
+    }
+
+
+def set_tracing(enabled=True):
+    """
+    Enable or disable the trace zones of the core.
+
+    The zones time the steps and frames of every emulator, preprocessing,
+    snapshots, and the steps, queues, and waits of batches, on each thread.
+    They cost a load and a branch while disabled.
+
+    Args:
+        enabled (bool): whether the zones record events
+
+    Returns:
+        None
+
+    """
+    _LIB.SetTracing(enabled)
+
+
+def clear_trace():
+    """Remove the recorded trace zones of every thread."""
+    _LIB.ClearTrace()
+
+
+def dump_trace(path):
+    """
+    Write the recorded trace zones as Chrome trace-event JSON.
+
+    The file opens in Perfetto (ui.perfetto.dev) or chrome://tracing. Each
+    thread keeps its last 16384 zones.
+
+    Args:
+        path (str): the path of the file to write
+
+    Returns:
+        None
+
+    """
+    error = ctypes.create_string_buffer(256)
+    if not _LIB.DumpTrace(os.fspath(path).encode('utf-8'), error, len(error)):
+        raise OSError(error.value.decode('utf-8'))
+
+
+def format_cpu_trace(trace_path, log_path):
+    """
+    Format a binary CPU trace as a nestest-style log.
+
+    A line of the log has the address, bytes, and disassembly of an
+    instruction, the registers before it executed, the scanline and dot of
+    the PPU, and the CPU cycle. The values of memory operands are not part
+    of the trace, so they are left out.
+
+    Args:
+        trace_path (str): the path of a trace written by `dump_cpu_trace`
+        log_path (str): the path of the log to write
+
+    Returns:
+        None
+
+    """
+    error = ctypes.create_string_buffer(256)
+    trace_path = os.fspath(trace_path).encode('utf-8')
+    if not _LIB.FormatCpuTrace(trace_path, os.fspath(log_path).encode('utf-8'), error, len(error)):
+        raise OSError(error.value.decode('utf-8'))
+
+
+def _check_rom(rom_path):
+    """
+    Check that a ROM can be run by the emulator.
+
+    Args:
+        rom_path (str): the path to the ROM to check
+
+    Returns:
+        None
+
+    """
+    # create a ROM file from the ROM path
+    rom = ROM(rom_path)
+    # check that there is PRG ROM
+    if rom.prg_rom_size == 0:
+        raise ValueError('ROM has no PRG-ROM banks.')
+    # ensure that there is no trainer
+    if rom.has_trainer:
+        raise ValueError('ROM has trainer. trainer is not supported.')
+    # try to read the PRG ROM and raise a value error if it fails
+    _ = rom.prg_rom
+    # try to read the CHR ROM and raise a value error if it fails
+    _ = rom.chr_rom
+    # check the TV system
+    if rom.is_pal:
+        raise ValueError('ROM is PAL. PAL is not supported.')
+    # check that the mapper is implemented
+    elif rom.mapper not in {0, 1, 2, 3}:
+        msg = 'ROM has an unsupported mapper number {}. please see https://github.com/Kautenja/nes-py/issues/28 for more information.'
+        raise ValueError(msg.format(rom.mapper))
+
+
+def _check_pixel_format(pixel_format):
+    """
+    Check that a pixel format is supported for observations.
+
+    Args:
+        pixel_format (str): the name of the pixel format to check
+
+    Returns:
+        the name of the pixel format with aliases resolved
+
+    """
+    if pixel_format == 'rgb':
+        pixel_format = 'rgb24'
+    if pixel_format not in OBSERVATION_PIXEL_FORMATS:
+        raise ValueError('invalid pixel format: {}'.format(repr(pixel_format)))
+    return pixel_format
+
+
+def _observation_space(pixel_format):
+    """
+    Return the space of screens in a pixel format.
+
+    Args:
+        pixel_format (str): the name of the pixel format of the screens
+
+    Returns:
+        a Box space of the screens
+
+    """
+    _, shape, dtype = PIXEL_FORMATS[pixel_format]
+    if pixel_format == 'palette':
+        high = 63
+    elif pixel_format == 'chw_float16':
+        high = 1
+    else:
+        high = 255
+    return Box(low=0, high=high, shape=shape, dtype=dtype)
+
+
+def _watch_spec(watch):
+    """
+    Return the text of a RAM watch spec.
+
+    Args:
+        watch (dict, str, None): an ordered dict of names to expressions, a
+            spec of `name = expression` lines, or None for no watch
+
+    Returns:
+        the text of the spec
+
+    """
+    if watch is None:
+        return ''
+    if isinstance(watch, dict):
+        return '\n'.join('{} = {}'.format(*entry) for entry in watch.items())
+    return watch
+
+
+def _action_table(table):
+    """
+    Return a table of discrete actions in the layout of the C++ code.
+
+    Args:
+        table (array-like): the joypad byte of the first controller of each
+            action, or the joypad bytes of both controllers of each action
+
+    Returns:
+        a contiguous [N, 2] array of joypad bytes
+
+    """
+    table = np.asarray(table)
+    if table.ndim == 1:
+        table = np.stack([table, np.zeros_like(table)], axis=1)
+    if table.ndim != 2 or table.shape[1] != 2 or len(table) == 0:
+        raise ValueError('action table must be shaped [N] or [N, 2]')
+    if table.min() < 0 or table.max() > 0xff:
+        raise ValueError('action table must hold joypad bytes')
+    return np.ascontiguousarray(table, dtype=np.uint8)
+
+
+def _check_actions(actions, num_actions):
+    """
+    Check that actions are indexes in an action table.
+
+    Args:
+        actions (int, np.ndarray): the action or actions to check
+        num_actions (int): the number of actions in the table, None without
+            a table
+
+    Returns:
+        None
+
+    """
+    if num_actions is None:
+        return
+    actions = np.asarray(actions)
+    if actions.size and (actions.min() < 0 or actions.max() >= num_actions):
+        raise ValueError('actions must be indexes in the action table of {} actions'.format(num_actions))
+
+
+def _check_frames(frames):
+    """
+    Check the number of frames a step holds its actions for.
+
+    Args:
+        frames (int): the number of frames to check
+
+    Returns:
+        None
+
+    """
+    if frames < 1:
+        raise ValueError('frames must be at least 1, got {}'.format(frames))
+
+
+def _check_stochasticity(sticky_actions, max_noops):
+    """
+    Check the options of sticky actions and no-op starts.
+
+    Args:
+        sticky_actions (float): the probability of repeating the buttons of
+            the last frame
+        max_noops (int): the maximal number of no-op frames after a reset
+
+    Returns:
+        None
+
+    """
+    if not 0 <= sticky_actions <= 1:
+        raise ValueError('sticky_actions must be a probability in [0, 1]')
+    if not isinstance(max_noops, int) or max_noops < 0:
+        raise ValueError('max_noops must be a non-negative integer')
+
+
+def _frame_stack_shape(depth, downsample):
+    """
+    Check the shape of a frame stack and return the shape of its frames.
+
+    Args:
+        depth (int): the number of frames in the stack
+        downsample (int): the factor the frames are downsampled by
+
+    Returns:
+        the (height, width) of a frame of the stack
+
+    """
+    if not isinstance(depth, int) or depth < 1:
+        raise ValueError('depth must be a positive integer')
+    if not isinstance(downsample, int) or downsample < 1 or \
+            SCREEN_HEIGHT % downsample or SCREEN_WIDTH % downsample:
+        raise ValueError('downsample must divide the screen height and width')
+    return SCREEN_HEIGHT // downsample, SCREEN_WIDTH // downsample
+
+
+def _stacked_frames(rings, offsets):
+    """
+    Return the frame stacks of a batch from the oldest to the latest frame.
+
+    Args:
+        rings (np.ndarray): the [N, 2 * depth, height, width] frame rings
+        offsets (np.ndarray): the slot of the oldest frame of each ring
+
+    Returns:
+        a [N, depth, height, width] strided view of the rings if every
+        stack starts at the same slot, a copy otherwise
+
+    """
+    depth = rings.shape[1] // 2
+    offset = offsets[0]
+    if (offsets == offset).all():
+        return rings[:, offset:offset + depth]
+    # gather the stacks that start at different slots
+    slots = offsets[:, None] + np.arange(depth)
+    return rings[np.arange(len(rings))[:, None], slots]
+
+
+def _array(address, shape, dtype):
+    """
+    Return a NumPy array over memory owned by the C++ code.
+
+    Args:
+        address (int): the address of the first byte of the array
+        shape (tuple): the shape of the array
+        dtype (np.dtype): the data type of the items of the array
+
+    Returns:
+        a NumPy array that views the memory without copying it
+
+    """
+    dtype = np.dtype(dtype)
+    size = int(np.prod(shape)) * dtype.itemsize
+    buffer_ = ctypes.cast(address, ctypes.POINTER(ctypes.c_byte * size)).contents
+    return np.frombuffer(buffer_, dtype=dtype).reshape(shape)
+
+
 class NESEnv(gym.Env):
     """An NES environment based on the LaiNES emulator."""
 
@@ -129,42 +948,42 @@ class NESEnv(gym.Env):
     # action space is a bitmap of button press values for the 8 NES buttons
     action_space = Discrete(256)
 
-    def __init__(self, rom_path, render_mode='human', headless: bool=False):
+    # the RAM watch evaluated by the emulator after each frame as a dict of
+    # names to expressions (see `set_ram_watch`), or None to compute the
+    # reward, done flag, and info in Python
+    ram_watch = None
+
+    def __init__(self, rom_path, render_mode='human', headless: bool=False,
+        pixel_format: str='rgb'
+    ):
         """
         Create a new NES environment.
 
         Args:
             rom_path (str): the path to the ROM for the environment
+            render_mode (str): the mode to render with ('human', 'rgb_array')
+            headless (bool): whether to skip rendering the screen entirely
+            pixel_format (str): the format the screen is rendered in, one
+                of 'rgb' (alias of 'rgb24'), 'rgb24', 'bgr24', 'rgba',
+                'bgra', 'chw', 'chw_float16' (normalized to [0, 1]), or
+                'palette' for 6-bit NES palette indexes
 
         Returns:
             None
 
         """
-        # create a ROM file from the ROM path
-        rom = ROM(rom_path)
-        # check that there is PRG ROM
-        if rom.prg_rom_size == 0:
-            raise ValueError('ROM has no PRG-ROM banks.')
-        # ensure that there is no trainer
-        if rom.has_trainer:
-            raise ValueError('ROM has trainer. trainer is not supported.')
-        # try to read the PRG ROM and raise a value error if it fails
-        _ = rom.prg_rom
-        # try to read the CHR ROM and raise a value error if it fails
-        _ = rom.chr_rom
-        # check the TV system
-        if rom.is_pal:
-            raise ValueError('ROM is PAL. PAL is not supported.')
-        # check that the mapper is implemented
-        elif rom.mapper not in {0, 1, 2, 3}:
-            msg = 'ROM has an unsupported mapper number {}. please see https://github.com/Kautenja/nes-py/issues/28 for more information.'
-            raise ValueError(msg.format(rom.mapper))
+        _check_rom(rom_path)
+        pixel_format = _check_pixel_format(pixel_format)
         # create a dedicated random number generator for the environment
         self.np_random = np.random.RandomState()
         # store the ROM path
         self._rom_path = rom_path
         # initialize the C++ object for running the environment
         self._env = _LIB.Initialize(self._rom_path, headless)
+        # render the screen directly in the pixel format of observations
+        self._pixel_format = pixel_format
+        _LIB.SetPixelFormat(self._env, PIXEL_FORMATS[pixel_format][0])
+        self.observation_space = _observation_space(pixel_format)
         # setup a placeholder for a 'human' render mode viewer
         self.viewer = None
         # setup a placeholder for a pointer to a backup state
@@ -173,28 +992,203 @@ class NESEnv(gym.Env):
         self.done = True
         # truncated
         self.truncated = False
+        # setup a placeholder for the double buffered pair of screens
+        self._screens = None
         # setup the controllers, screen, and RAM buffers
         self.controllers = [self._controller_buffer(port) for port in range(2)]
         self.screen = self._screen_buffer()
         self.ram = self._ram_buffer()
         self.render_mode = render_mode
+        # setup a placeholder for the table of discrete actions
+        self._action_table = None
+        # setup a placeholder for the ring of the frame stack
+        self._frame_ring = None
+        # setup the statistics of the current and the last ended episode
+        self.episode_stats = _array(_LIB.EpisodeStats(self._env), (), EPISODE_STATS_DTYPE)
+        self.final_episode_stats = _array(_LIB.FinalEpisodeStats(self._env), (), EPISODE_STATS_DTYPE)
+        # setup the hot-path counters of the last frame and of all frames,
+        # which stay zero unless COUNTERS_ENABLED
+        self.frame_counters = _array(_LIB.FrameCounters(self._env), (), HOT_PATH_COUNTERS_DTYPE)
+        self.total_counters = _array(_LIB.TotalCounters(self._env), (), HOT_PATH_COUNTERS_DTYPE)
+        # setup the RAM watch results
+        self.watch = None
+        if self.ram_watch is not None:
+            self.set_ram_watch(self.ram_watch)
+        self._setup_stepper()
+
+    def _setup_stepper(self):
+        """
+        Setup the native stepper of `step` for the action table and watch.
+
+        The stepper presses the action, steps, and reads the reward, done
+        flag, and info of the RAM watch in a single call, so it is only used
+        with the native extension and if the subclass keeps the hooks that
+        it replaces.
 
-    def _screen_buffer(self):
+        Returns:
+            None
+
+        """
+        self._stepper = None
+        if _native is None or self._env is None:
+            return
+        hooks = ['_set_action', '_get_reward', '_get_done', '_get_info']
+        if any(getattr(type(self), hook) is not getattr(NESEnv, hook) for hook in hooks):
+            return
+        self._stepper = _native.Stepper(
+            self._env,
+            self.controllers[0].ctypes.data,
+            0 if self._action_table is None else len(self._action_table),
+            None if self.watch is None else self.watch.ctypes.data,
+            () if self.watch is None else self.watch.dtype.names[2:],
+        )
+
+    def _screen_buffer(self, address=None):
         """Setup the screen buffer from the C++ code."""
         # get the address of the screen
-        address = _LIB.Screen(self._env)
-        # create a buffer from the contents of the address location
-        buffer_ = ctypes.cast(address, ctypes.POINTER(SCREEN_TENSOR)).contents
-        # create a NumPy array from the buffer
-        screen = np.frombuffer(buffer_, dtype='uint8')
-        # reshape the screen from a column vector to a tensor
-        screen = screen.reshape(SCREEN_SHAPE_32_BIT)
-        # flip the bytes if the machine is little-endian (which it likely is)
-        if sys.byteorder == 'little':
-            # invert the little-endian BGRx channels to big-endian xRGB
-            screen = screen[:, :, ::-1]
-        # remove the 0th axis (padding from storing colors in 32 bit)
-        return screen[:, :, 1:]
+        if address is None:
+            address = _LIB.Screen(self._env)
+        # the screen is rendered in the layout of the observation, so it is
+        # used as a contiguous array without any copies or channel swaps
+        _, shape, dtype = PIXEL_FORMATS[self._pixel_format]
+        return _array(address, shape, dtype)
+
+    def set_screen_buffer(self, array=None):
+        """
+        Render the screen directly into a caller-owned array.
+
+        Args:
+            array (np.ndarray): a writable array with the shape and type of
+                the observation space, e.g., a slot `batch[i]` of a batch
+                tensor. Rows may be padded, but the pixels of a row must be
+                contiguous. None renders to the internal screen again
+
+        Returns:
+            None
+
+        """
+        if array is None:
+            _LIB.SetScreenBuffer(self._env, None, 0)
+            self.screen = self._screen_buffer()
+            return
+        shape, dtype = self.observation_space.shape, self.observation_space.dtype
+        if array.shape != shape or array.dtype != dtype:
+            msg = 'screen buffer must have shape {} and type {}'
+            raise ValueError(msg.format(shape, dtype))
+        if not array.flags.writeable:
+            raise ValueError('screen buffer must be writeable')
+        # the rows of the screen (of each plane) are the only strided axis
+        if self._pixel_format in {'chw', 'chw_float16'}:
+            stride = array.strides[1]
+            row_bytes = array.shape[2] * array.itemsize
+            is_valid = array.strides[2] == array.itemsize
+            is_valid = is_valid and array.strides[0] == stride * SCREEN_HEIGHT
+        else:
+            stride = array.strides[0]
+            row_bytes = array[0].nbytes
+            is_valid = array[0].flags['C_CONTIGUOUS']
+        if not is_valid or stride < row_bytes:
+            raise ValueError('screen buffer rows must be contiguous')
+        _LIB.SetScreenBuffer(self._env, array.ctypes.data, stride)
+        # hold a reference to the array while the emulator renders into it
+        self.screen = array
+        # caller-owned buffers are never double buffered
+        self._screens = None
+
+    def set_double_buffered(self, enabled=True):
+        """
+        Enable or disable double buffering of the screen.
+
+        When enabled, each frame renders to a back buffer that is swapped in
+        when the frame completes. A frame returned by `front_screen` is not
+        drawn over until the frame after next starts rendering, so other
+        threads can consume it without copying while the env keeps stepping.
+
+        Args:
+            enabled (bool): whether to double buffer the screen
+
+        Returns:
+            None
+
+        """
+        _LIB.SetDoubleBuffered(self._env, enabled)
+        if enabled:
+            # the pair of screens is fixed, the frame parity picks the front
+            self._screens = [
+                self._screen_buffer(_LIB.SequenceScreen(self._env, parity))
+                for parity in range(2)
+            ]
+        else:
+            self._screens = None
+        self._update_screen()
+
+    def _update_screen(self):
+        """Point the screen at the front buffer when double buffering."""
+        if self._screens is None:
+            if self.screen.ctypes.data != _LIB.Screen(self._env):
+                self.screen = self._screen_buffer()
+            return
+        self.screen = self._screens[self.frame_sequence & 1]
+
+    @property
+    def frame_sequence(self):
+        """Return the number of frames the emulator has rendered in full."""
+        return _LIB.FrameSequence(self._env)
+
+    def front_screen(self):
+        """
+        Return the latest completed frame.
+
+        Returns:
+            a tuple of:
+            - sequence (int): the frame sequence number of the frame
+            - screen (np.ndarray): a view of the frame, valid until the
+              frame after next starts rendering when double buffering
+
+        """
+        sequence = ctypes.c_uint64()
+        address = _LIB.FrontScreen(self._env, ctypes.byref(sequence))
+        if self._screens is not None:
+            return sequence.value, self._screens[sequence.value & 1]
+        return sequence.value, self._screen_buffer(address)
+
+    def convert_screen(self, pixel_format='rgb24'):
+        """
+        Convert the palette-index screen to a new array in another format.
+
+        Args:
+            pixel_format (str): the format to convert to (a key of
+                PIXEL_FORMATS)
+
+        Returns:
+            a new NumPy array with the screen in the given pixel format
+
+        """
+        if self._pixel_format != 'palette':
+            raise ValueError('only palette-index screens can be converted')
+        if pixel_format not in PIXEL_FORMATS:
+            raise ValueError('invalid pixel format: {}'.format(repr(pixel_format)))
+        value, shape, dtype = PIXEL_FORMATS[pixel_format]
+        output = np.empty(shape, dtype=dtype)
+        _LIB.ConvertScreen(self._env, output.ctypes.data, value)
+        return output
+
+    def _rgb_screen(self):
+        """Return the screen as an RGB matrix for rendering."""
+        if self._pixel_format == 'rgb24':
+            return self.screen
+        elif self._pixel_format == 'palette':
+            return self.convert_screen('rgb24')
+        elif self._pixel_format == 'bgr24':
+            return self.screen[:, :, ::-1]
+        elif self._pixel_format == 'rgba':
+            return self.screen[:, :, :3]
+        elif self._pixel_format == 'bgra':
+            return self.screen[:, :, 2::-1]
+        elif self._pixel_format == 'chw':
+            return self.screen.transpose(1, 2, 0)
+        # chw_float16
+        return (self.screen.transpose(1, 2, 0) * 255).round().astype(np.uint8)
 
     def _ram_buffer(self):
         """Setup the RAM buffer from the C++ code."""
@@ -223,21 +1217,363 @@ class NESEnv(gym.Env):
         # create a NumPy buffer from the binary data and return it
         return np.frombuffer(buffer_, dtype='uint8')
 
-    def _frame_advance(self, action):
+    @property
+    def rendering(self):
+        """Return True if the emulator renders frames to the screen."""
+        return _LIB.Rendering(self._env)
+
+    @rendering.setter
+    def rendering(self, enabled):
+        """
+        Enable or disable rendering frames to the screen.
+
+        Frames that are not observed can skip the pixel work without changing
+        the emulation. The screen keeps the last rendered pixels and the frame
+        sequence only counts frames that were rendered in full.
+
+        Args:
+            enabled (bool): whether to render frames to the screen
+
+        Returns:
+            None
+
+        """
+        _LIB.SetRendering(self._env, enabled)
+
+    def set_ram_watch(self, watch):
+        """
+        Evaluate expressions over RAM in the emulator after each frame.
+
+        Expressions support numbers (decimal, `0x` or `$` hex), `ram[address]`,
+        the names of earlier entries, the C operators (arithmetic, bitwise,
+        comparisons, logical, and `?:`), and the functions `bcd(x)` (packed
+        BCD byte), `digits(d, ...)` (decimal digits), `frame_delta(x)`
+        (change since the last frame), `abs(x)`, `min(a, b)`, and `max(a, b)`.
+
+        The expressions are evaluated after every frame, also the frames
+        that a step holds its action for, so `frame_delta` is the change over
+        a single frame. A reward of `frame_delta(x)` adds up to the change
+        over the step, but the info and non-linear expressions such as
+        `max(frame_delta(x), 0)` see the frames one at a time.
+
+        The entries named 'reward' and 'done' replace `_get_reward` and
+        `_get_done` (the reward is summed over the frames of a step), the
+        others make up the info of `_get_info`. The results are in `watch`,
+        a structured NumPy scalar that is updated in place.
+
+        The emulator accumulates the return of the 'reward' entry, the
+        maximum of a 'progress' entry, and the length and time of each
+        episode in `episode_stats`, and keeps those of the episode that the
+        last reset ended in `final_episode_stats`.
+
+        Args:
+            watch (dict, str, None): an ordered dict of names to expressions,
+                a spec of `name = expression` lines, or None to remove it
+
+        Returns:
+            None
+
+        """
+        spec = _watch_spec(watch)
+        error = ctypes.create_string_buffer(256)
+        if not _LIB.SetWatch(self._env, spec.encode('utf-8'), error, len(error)):
+            raise ValueError('invalid RAM watch: {}'.format(error.value.decode('utf-8')))
+        if watch is None:
+            self.watch = None
+            self._setup_stepper()
+            return
+        # view the results as a struct with a field for each name
+        size = _LIB.WatchSize(self._env)
+        names = [_LIB.WatchName(self._env, index).decode('utf-8') for index in range(size)]
+        dtype = np.dtype([(name, np.float64) for name in names])
+        self.watch = _array(_LIB.WatchResults(self._env), (), dtype)
+        self._setup_stepper()
+
+    def set_action_table(self, table=None):
+        """
+        Map discrete actions to joypad bytes in the emulator.
+
+        Once set, the actions passed to `step` are indexes in the table and
+        the action space is Discrete(N). `step` raises a ValueError for
+        indexes outside of the table.
+
+        Args:
+            table (array-like, None): the joypad byte of the first controller
+                of each action ([N]), the joypad bytes of both controllers of
+                each action ([N, 2]), or None to step with joypad bytes
+
+        Returns:
+            None
+
+        """
+        if table is None:
+            _LIB.SetActionTable(self._env, None, 0)
+            self._action_table = None
+            self.action_space = type(self).action_space
+            self._setup_stepper()
+            return
+        self._action_table = _action_table(table)
+        _LIB.SetActionTable(self._env, self._action_table.ctypes.data, len(self._action_table))
+        self.action_space = Discrete(len(self._action_table))
+        self._setup_stepper()
+
+    def set_stochasticity(self, sticky_actions=0.0, max_noops=0):
+        """
+        Make the emulator stochastic with sticky actions and no-op starts.
+
+        Both are drawn in the emulator from a generator seeded by `seed` (or
+        `reset(seed=...)`), so they apply to every frame of a multi-frame
+        step and are reproducible from the seed.
+
+        Args:
+            sticky_actions (float): the probability of repeating the buttons
+                of the last frame instead of the action in each frame
+            max_noops (int): the maximal number of frames without input after
+                each reset, the number is drawn uniformly from [0, max_noops]
+
+        Returns:
+            None
+
+        """
+        _check_stochasticity(sticky_actions, max_noops)
+        _LIB.SetStickyActions(self._env, sticky_actions)
+        _LIB.SetMaxNoops(self._env, max_noops)
+
+    def set_frame_stack(self, depth, downsample=1):
+        """
+        Keep a stack of the last frames of the screen in the emulator.
+
+        The frames are the luma of the screen, optionally downsampled by
+        averaging blocks of pixels. A frame is pushed at the end of each step
+        and the stack is filled with the screen on each reset. The frames are
+        kept in a ring of 2 * depth slots with each frame written twice, so
+        `frame_stack` is a view of the ring rather than a concatenation.
+
+        Args:
+            depth (int): the number of frames in the stack, None to disable it
+            downsample (int): the factor to downsample the frames by in both
+                dimensions, which must divide the height and width of the
+                screen
+
+        Returns:
+            None
+
+        """
+        if depth is None:
+            _LIB.SetFrameStack(self._env, 0, 1)
+            self._frame_ring = None
+            return
+        height, width = _frame_stack_shape(depth, downsample)
+        _LIB.SetFrameStack(self._env, depth, downsample)
+        address = _LIB.FrameStackBuffer(self._env)
+        self._frame_ring = _array(address, (2 * depth, height, width), np.uint8)
+
+    @property
+    def frame_stack(self):
+        """
+        Return the last frames from the oldest to the latest.
+
+        Returns:
+            a [depth, height, width] view of the ring of the frame stack that
+            the next step overwrites in part, or None without a frame stack
+
+        """
+        if self._frame_ring is None:
+            return None
+        offset = _LIB.FrameStackOffset(self._env)
+        return self._frame_ring[offset:offset + len(self._frame_ring) // 2]
+
+    def reset_counters(self):
+        """
+        Zero the hot-path counters in `frame_counters` and `total_counters`.
+
+        The counters count the accesses of the main bus and the picture bus
+        by region, the callbacks of each IO register, the OAM DMAs, NMIs,
+        and writes to the mapper registers of each frame. They are only
+        updated if the library is built with them (see COUNTERS_ENABLED).
+
+        Returns:
+            None
+
+        """
+        _LIB.ResetCounters(self._env)
+
+    def memory_footprint(self):
+        """
+        Return the memory the emulator uses by component.
+
+        Buffers that the caller owns, e.g., screens set by
+        `set_screen_buffer`, are not included.
+
+        Returns:
+            a structured NumPy scalar of the bytes of the ROM, the internal
+            screens, the backup, the caches (frame stack, profiler, RAM
+            watch, action table), the bus memories (RAM, VRAM, palette, OAM,
+            CHR RAM), the objects themselves, and their total
+
+        """
+        footprint = np.zeros((), dtype=MEMORY_FOOTPRINT_DTYPE)
+        _LIB.MemoryFootprint(self._env, footprint.ctypes.data)
+        return footprint
+
+    def set_profiling(self, enabled=True):
+        """
+        Enable or disable the profiler of the emulated 6502 code.
+
+        The profiler counts the hits and cycles of each opcode and of each
+        address of the program counter, and the cycles of each call stack
+        that JSR/RTS and interrupts/RTI form. The profile is kept when the
+        profiler is disabled, see `profile`, `flat_profile`, and
+        `folded_stacks`.
+
+        Args:
+            enabled (bool): whether the CPU reports its instructions
+
+        Returns:
+            None
+
+        """
+        _LIB.SetProfiling(self._env, enabled)
+
+    def clear_profile(self):
+        """Zero the profile of the emulated code."""
+        _LIB.ClearProfile(self._env)
+
+    @property
+    def profile(self):
+        """
+        Return the profile of the emulated code.
+
+        Returns:
+            a dict of views of the hits and cycles of each opcode [256] and
+            address [65536], and the cycles spent entering interrupts, or
+            None if the profiler was never enabled
+
+        """
+        address = _LIB.ProfileOpcodeHits(self._env)
+        if not address:
+            return None
+        return {
+            'opcode_hits': _array(address, (256,), np.uint64),
+            'opcode_cycles': _array(_LIB.ProfileOpcodeCycles(self._env), (256,), np.uint64),
+            'address_hits': _array(_LIB.ProfileAddressHits(self._env), (0x10000,), np.uint64),
+            'address_cycles': _array(_LIB.ProfileAddressCycles(self._env), (0x10000,), np.uint64),
+            'interrupt_cycles': _LIB.ProfileInterruptCycles(self._env),
+        }
+
+    def flat_profile(self, top=20):
+        """
+        Return a flat profile of the emulated code.
+
+        Args:
+            top (int): the number of rows of the tables (0 for all of them)
+
+        Returns:
+            a text table of the opcodes and a text table of the addresses
+            by descending cycles
+
+        """
+        return _LIB.FlatProfile(self._env, top).decode('utf-8')
+
+    def folded_stacks(self):
+        """
+        Return the cycles of each call stack of the emulated code.
+
+        Returns:
+            a line of `frame;frame;... cycles` per stack in the folded
+            format of flame graphs, where frames are the entry addresses of
+            the routines, `reset` for the root, and `nmi:` or `irq:` for
+            the interrupt handlers
+
+        """
+        return _LIB.FoldedStacks(self._env).decode('utf-8')
+
+    def set_cpu_tracing(self, enabled=True, capacity=0):
+        """
+        Enable or disable the trace of the instructions of the CPU.
+
+        The trace keeps the last instructions in a ring of fixed-size records
+        of the address, opcode, operand bytes, registers, CPU cycle, and the
+        position of the PPU. The records are kept when the trace is disabled,
+        see `cpu_trace` and `dump_cpu_trace`.
+
+        Args:
+            enabled (bool): whether the CPU records its instructions
+            capacity (int): the number of records of the ring, rounded up to
+                a power of two (0 for 65536 or to keep the current ring)
+
+        Returns:
+            None
+
+        """
+        _LIB.SetCpuTracing(self._env, enabled, capacity)
+
+    def clear_cpu_trace(self):
+        """Remove the records of the CPU trace."""
+        _LIB.ClearCpuTrace(self._env)
+
+    @property
+    def cpu_trace(self):
+        """
+        Return the records of the CPU trace.
+
+        Returns:
+            a copy of the records from the oldest to the latest as a NumPy
+            array of CPU_TRACE_RECORD_DTYPE
+
+        """
+        records = np.zeros(_LIB.CpuTraceSize(self._env), dtype=CPU_TRACE_RECORD_DTYPE)
+        count = _LIB.CpuTraceRecords(self._env, records.ctypes.data, len(records))
+        return records[:count]
+
+    def dump_cpu_trace(self, path):
+        """
+        Write the records of the CPU trace to a binary file.
+
+        The file is formatted as a log offline by `format_cpu_trace`.
+
+        Args:
+            path (str): the path of the file to write
+
+        Returns:
+            None
+
+        """
+        error = ctypes.create_string_buffer(256)
+        if not _LIB.DumpCpuTrace(self._env, os.fspath(path).encode('utf-8'), error, len(error)):
+            raise OSError(error.value.decode('utf-8'))
+
+    def _set_action(self, action):
+        """Press the buttons of an action on the controllers."""
+        if self._action_table is None:
+            self.controllers[0][:] = action
+        else:
+            _check_actions(action, len(self._action_table))
+            _LIB.SetAction(self._env, int(action))
+
+    def _frame_advance(self, action, frames=1):
         """
         Advance a frame in the emulator with an action.
 
         Args:
             action (byte): the action to press on the joy-pad
+            frames (int): the number of frames to hold the action for, only
+                the last of which is rendered
 
         Returns:
             None
 
         """
+        _check_frames(frames)
         # set the action on the controller
-        self.controllers[0][:] = action
+        self._set_action(action)
         # perform a step on the emulator
-        _LIB.Step(self._env)
+        if frames == 1:
+            _LIB.Step(self._env)
+        else:
+            _LIB.StepN(self._env, frames)
+        if self._screens is not None:
+            self._update_screen()
 
     def _backup(self):
         """Backup the NES state in the emulator."""
@@ -269,6 +1605,8 @@ class NESEnv(gym.Env):
             return []
         # set the random number seed for the NumPy random number generator
         self.np_random.seed(seed)
+        # set the seed of the sticky actions and no-op starts in the emulator
+        _LIB.Seed(self._env, seed)
         # return the list of seeds used by RNG(s) in the environment
         return [seed]
 
@@ -296,6 +1634,8 @@ class NESEnv(gym.Env):
             self._restore()
         else:
             _LIB.Reset(self._env)
+        if self._screens is not None:
+            self._update_screen()
         # call the after reset callback
         self._did_reset()
         # set the done flag to false
@@ -312,7 +1652,9 @@ class NESEnv(gym.Env):
         Run one frame of the NES and return the relevant observation data.
 
         Args:
-            action (byte): the bitmap determining which buttons to press
+            action (int): the index of the action in the action table (see
+                `set_action_table`), or without a table the bitmap of the
+                buttons of the first controller to press
 
         Returns:
             a tuple of:
@@ -325,16 +1667,25 @@ class NESEnv(gym.Env):
         # if the environment is done, raise an error
         if self.done:
             raise ValueError('cannot step in a done environment! call `reset`')
-        # set the action on the controller
-        self.controllers[0][:] = action
-        # pass the action to the emulator as an unsigned byte
-        _LIB.Step(self._env)
-        # get the reward for this step
-        reward = float(self._get_reward())
-        # get the done flag for this step
-        self.done = bool(self._get_done())
-        # get the info for this step
-        info = self._get_info()
+        if self._stepper is not None:
+            # press the action, step, and get the reward, done flag, and info
+            # of the RAM watch in a single native call
+            reward, self.done, info = self._stepper.step(action)
+            if self._screens is not None:
+                self._update_screen()
+        else:
+            # set the action on the controller
+            self._set_action(action)
+            # pass the action to the emulator as an unsigned byte
+            _LIB.Step(self._env)
+            if self._screens is not None:
+                self._update_screen()
+            # get the reward for this step
+            reward = float(self._get_reward())
+            # get the done flag for this step
+            self.done = bool(self._get_done())
+            # get the info for this step
+            info = self._get_info()
         self.truncated = self._get_truncated()
         # call the after step callback
         self._did_step(self.done)
@@ -348,11 +1699,15 @@ class NESEnv(gym.Env):
 
     def _get_reward(self):
         """Return the reward after a step occurs."""
-        return 0
+        if self.watch is None:
+            return 0
+        return float(self.watch['reward'])
 
     def _get_done(self):
         """Return True if the episode is over, False otherwise."""
-        return False
+        if self.watch is None:
+            return False
+        return bool(self.watch['done'])
 
     def _get_truncated(self):
         """Return True if truncated """
@@ -360,7 +1715,9 @@ class NESEnv(gym.Env):
 
     def _get_info(self):
         """Return the info after a step occurs."""
-        return {}
+        if self.watch is None:
+            return {}
+        return {name: self.watch[name].item() for name in self.watch.dtype.names[2:]}
 
     def _did_step(self, done):
         """
@@ -384,6 +1741,7 @@ class NESEnv(gym.Env):
         _LIB.Close(self._env)
         # deallocate the object locally
         self._env = None
+        self._stepper = None
         # if there is an image viewer open, delete it
         if self.viewer is not None:
             self.viewer.close()
@@ -419,9 +1777,9 @@ class NESEnv(gym.Env):
                         width=SCREEN_WIDTH,
                 )
             # show the screen on the image viewer
-            self.viewer.show(self.screen)
+            self.viewer.show(self._rgb_screen())
         elif self.render_mode == 'rgb_array':
-            return self.screen
+            return self._rgb_screen()
         else:
             # unpack the modes as comma delineated strings ('a', 'b', ...)
             render_modes = [repr(x) for x in self.metadata['render.modes']]
@@ -467,6 +1825,10 @@ class NESEnv(gym.Env):
     def load_state(self, state: Any):
         _LIB.LoadState(self._env, state)
 
+    def free_state(self, state: Any):
+        """Free a state that `save_state` returned, which cannot be loaded after."""
+        _LIB.FreeState(state)
+
     def serialize(self) -> bytes:
         size = ctypes.c_size_t()
         buf = _LIB.serialize(self._env, ctypes.byref(size))
@@ -475,8 +1837,26 @@ class NESEnv(gym.Env):
         return serialized_data
 
     def deserialize(self, data: bytes):
+        """
+        Load a state that `serialize` returned.
+
+        Args:
+            data: the serialized state
+
+        Returns:
+            None
+
+        Raises:
+            ValueError: if the state is truncated or does not fit the
+                emulator, e.g., its screen is in a pixel format other than
+                palette indexes or the one the emulator renders, in which
+                case the emulator keeps its current state
+
+        """
         buf = (ctypes.c_uint8 * len(data)).from_buffer_copy(data)
-        _LIB.deserialize(self._env, buf, len(data))
+        error = ctypes.create_string_buffer(256)
+        if not _LIB.deserialize(self._env, buf, len(data), error, len(error)):
+            raise ValueError('invalid state: {}'.format(error.value.decode('utf-8')))
 
     
 
@@ -0,0 +1,291 @@
+"""A batch of NES emulators in worker processes that share memory."""
+import ctypes
+import itertools
+import multiprocessing
+import os
+import weakref
+import numpy as np
+from .nes_env import _LIB
+from .nes_env import _action_table
+from .nes_env import _array
+from .nes_env import _check_actions
+from .nes_env import _check_frames
+from .nes_env import _check_pixel_format
+from .nes_env import _check_rom
+from .nes_env import _check_stochasticity
+from .nes_env import _frame_stack_shape
+from .nes_env import _stacked_frames
+from .nes_env import _watch_spec
+from .nes_env import _observation_space
+from .nes_env import EPISODE_STATS_DTYPE
+from .nes_env import PIXEL_FORMATS
+
+
+# the number of milliseconds to wait for workers between liveness checks
+_POLL_MS = 100
+# the counter of the names of the shared memory objects of this process
+_NAMES = itertools.count()
+
+
+def _run_worker(name, index):
+    """
+    Run the command loop of a worker process until the batch is closed.
+
+    Args:
+        name (str): the name of the shared memory object of the batch
+        index (int): the index of the worker
+
+    Returns:
+        None
+
+    """
+    error = ctypes.create_string_buffer(256)
+    if not _LIB.RunSharedWorker(name.encode('utf-8'), index, error, len(error)):
+        raise RuntimeError('shared batch worker failed: {}'.format(error.value.decode('utf-8')))
+
+
+def _close_batch(batch, workers):
+    """
+    Close the workers of a shared batch and release its shared memory.
+
+    Args:
+        batch (int): the pointer to the shared batch
+        workers (list): the worker processes of the batch
+
+    Returns:
+        None
+
+    """
+    _LIB.CloseSharedBatch(batch)
+    for worker in workers:
+        worker.join(timeout=1)
+        if worker.is_alive():
+            worker.terminate()
+
+
+class NESSharedBatch(object):
+    """A batch of NES emulators in worker processes with auto-reset."""
+
+    def __init__(self, rom_path, num_envs, num_workers=None, headless=False,
+        pixel_format='rgb', ram_watch=None, max_episode_steps=0,
+        sticky_actions=0.0, max_noops=0, action_table=None,
+        frame_stack_depth=None, frame_stack_downsample=1
+    ):
+        """
+        Create a new batch of NES emulators in worker processes.
+
+        The workers own the emulators and write the observations, frame
+        stacks, RAM, RAM watch results, and episode statistics straight into
+        a POSIX shared memory region that this process views as [N, ...]
+        arrays, so a step copies nothing through pipes. Episodes end and
+        reset like those of NESBatch.
+
+        Args:
+            rom_path (str): the path to the ROM for the emulators
+            num_envs (int): the number of emulators in the batch
+            num_workers (int): the number of worker processes, None for one
+                per CPU (at most one per emulator)
+            headless (bool): whether to skip rendering the screens
+            pixel_format (str): the format the screens are rendered in (see
+                NESEnv)
+            ram_watch (dict, str): the RAM watch evaluated by each emulator
+                after each frame (see NESEnv.set_ram_watch)
+            max_episode_steps (int): the number of steps after which episodes
+                are truncated, 0 for no limit
+            sticky_actions (float): the probability of repeating the buttons
+                of the last frame instead of the action in each frame
+            max_noops (int): the maximal number of frames without input after
+                each reset (see NESEnv.set_stochasticity)
+            action_table (array-like, None): the table of discrete actions
+                (see NESEnv.set_action_table) of at most 256 actions, or None
+                to step with joypad bytes
+            frame_stack_depth (int, None): the number of frames in the frame
+                stack of each emulator (see NESBatch.set_frame_stack), None
+                for no frame stacks. The region is sized for the stacks when
+                it is created, so they cannot be changed after
+            frame_stack_downsample (int): the factor to downsample the stacked
+                frames by
+
+        Returns:
+            None
+
+        """
+        if not hasattr(_LIB, 'CreateSharedBatch'):
+            raise OSError('shared memory batches are only supported on Linux')
+        _check_rom(rom_path)
+        pixel_format = _check_pixel_format(pixel_format)
+        _check_stochasticity(sticky_actions, max_noops)
+        if num_envs < 1:
+            raise ValueError('num_envs must be positive')
+        if num_workers is None:
+            num_workers = min(num_envs, os.cpu_count() or 1)
+        if not 1 <= num_workers <= num_envs:
+            raise ValueError('num_workers must be between 1 and num_envs')
+        if frame_stack_depth is not None:
+            stack_shape = _frame_stack_shape(frame_stack_depth, frame_stack_downsample)
+        self.num_envs = num_envs
+        self.single_observation_space = _observation_space(pixel_format)
+        # create the shared memory region with a name unique to this batch
+        self._name = '/nes_py_{}_{}'.format(os.getpid(), next(_NAMES))
+        error = ctypes.create_string_buffer(256)
+        spec = _watch_spec(ram_watch).encode('utf-8')
+        self._batch = _LIB.CreateSharedBatch(self._name.encode('utf-8'), rom_path,
+            num_envs, num_workers, headless, PIXEL_FORMATS[pixel_format][0],
+            spec, frame_stack_depth or 0, frame_stack_downsample, error, len(error))
+        if not self._batch:
+            raise ValueError('invalid shared batch: {}'.format(error.value.decode('utf-8')))
+        # spawn fresh interpreters, forking would copy the caller's threads
+        context = multiprocessing.get_context('spawn')
+        self._workers = [
+            context.Process(target=_run_worker, args=(self._name, index), daemon=True)
+            for index in range(num_workers)
+        ]
+        # close the batch if it is dropped or the interpreter exits without
+        # closing it
+        self._finalizer = weakref.finalize(self, _close_batch, self._batch, self._workers)
+        for worker in self._workers:
+            worker.start()
+        self._wait()
+        # every worker has attached, so the region is freed with the last
+        # mapping even if this process dies without closing the batch
+        _LIB.SharedBatchUnlink(self._batch)
+        _LIB.SharedBatchSetMaxEpisodeSteps(self._batch, max_episode_steps)
+        _LIB.SharedBatchSetStickyActions(self._batch, sticky_actions)
+        _LIB.SharedBatchSetMaxNoops(self._batch, max_noops)
+        self._wait()
+        self._num_actions = None
+        self.set_action_table(action_table)
+        # setup views of the shared buffers
+        space = self.single_observation_space
+        shape = (num_envs, ) + space.shape
+        self.observations = _array(_LIB.SharedBatchScreens(self._batch), shape, space.dtype)
+        self.final_observations = _array(_LIB.SharedBatchFinalScreens(self._batch), shape, space.dtype)
+        self.ram = _array(_LIB.SharedBatchRAM(self._batch), (num_envs, 0x800), np.uint8)
+        self.terminated = _array(_LIB.SharedBatchTerminated(self._batch), (num_envs, ), np.bool_)
+        self.truncated = _array(_LIB.SharedBatchTruncated(self._batch), (num_envs, ), np.bool_)
+        self.episode_stats = _array(_LIB.SharedBatchEpisodeStats(self._batch), (num_envs, ), EPISODE_STATS_DTYPE)
+        self.final_episode_stats = _array(_LIB.SharedBatchFinalEpisodeStats(self._batch), (num_envs, ), EPISODE_STATS_DTYPE)
+        # setup views of the rings of the frame stacks
+        self._frame_rings = None
+        if frame_stack_depth is not None:
+            shape = (num_envs, 2 * frame_stack_depth) + stack_shape
+            self._frame_rings = _array(_LIB.SharedBatchFrameStacks(self._batch), shape, np.uint8)
+            address = _LIB.SharedBatchFrameStackOffsets(self._batch)
+            self._frame_offsets = _array(address, (num_envs, ), np.int32)
+        size = _LIB.SharedBatchWatchSize(self._batch)
+        names = [_LIB.SharedBatchWatchName(self._batch, index).decode('utf-8') for index in range(size)]
+        dtype = np.dtype([(name, np.float64) for name in names])
+        self.results = _array(_LIB.SharedBatchResults(self._batch), (num_envs, ), dtype)
+
+    def _wait(self):
+        """Wait for the workers to finish the posted commands."""
+        while not _LIB.SharedBatchWait(self._batch, _POLL_MS):
+            if not all(worker.is_alive() for worker in self._workers):
+                self.close()
+                raise RuntimeError('a worker process of the shared batch died')
+
+    def set_action_table(self, table=None):
+        """
+        Map discrete actions to joypad bytes in each emulator.
+
+        Args:
+            table (array-like, None): the action table (see
+                NESEnv.set_action_table) of at most 256 actions, or None to
+                step with joypad bytes
+
+        Returns:
+            None
+
+        """
+        if table is None:
+            _LIB.SharedBatchSetActionTable(self._batch, None, 0)
+            self._num_actions = None
+        else:
+            table = _action_table(table)
+            if not _LIB.SharedBatchSetActionTable(self._batch, table.ctypes.data, len(table)):
+                raise ValueError('action table must have at most 256 actions')
+            self._num_actions = len(table)
+        self._wait()
+
+    @property
+    def stacked_observations(self):
+        """
+        Return the last frames of each emulator from the oldest to the latest.
+
+        Returns:
+            a [N, depth, height, width] array of the frame stacks (see
+            NESBatch.stacked_observations), or None without frame stacks
+
+        """
+        if self._frame_rings is None:
+            return None
+        return _stacked_frames(self._frame_rings, self._frame_offsets)
+
+    @property
+    def rewards(self):
+        """Return the rewards of the last step."""
+        return self.results['reward']
+
+    def backup(self):
+        """Save the current state of each emulator as its start state."""
+        _LIB.SharedBatchBackup(self._batch)
+        self._wait()
+
+    def reset(self, seed=None):
+        """
+        Reset each emulator to its start state.
+
+        Args:
+            seed (int): an optional seed of the sticky actions and no-op
+                starts, each emulator draws from its own stream of the seed
+
+        Returns:
+            the observations of the emulators
+
+        """
+        if seed is not None:
+            _LIB.SharedBatchSeed(self._batch, seed)
+        _LIB.SharedBatchReset(self._batch)
+        self._wait()
+        return self.observations
+
+    def step(self, actions, frames=1):
+        """
+        Step each emulator with an action (see NESBatch.step).
+
+        Args:
+            actions (np.ndarray): the action of each emulator, an index in the
+                action table or the joypad byte of the first controller
+            frames (int): the number of frames to hold the actions for, only
+                the last of which is rendered
+
+        Returns:
+            a tuple of observations, rewards, terminated, truncated, and info
+            as views of the shared region that the next step updates in place
+
+        """
+        actions = np.ascontiguousarray(actions, dtype=np.int32)
+        if actions.shape != (self.num_envs, ):
+            raise ValueError('expected {} actions'.format(self.num_envs))
+        _check_actions(actions, self._num_actions)
+        _check_frames(frames)
+        _LIB.StepSharedBatch(self._batch, actions.ctypes.data, frames)
+        self._wait()
+        info = {
+            'results': self.results,
+            'final_observations': self.final_observations,
+            'final_episode_stats': self.final_episode_stats,
+        }
+        return self.observations, self.rewards, self.terminated, self.truncated, info
+
+    def close(self):
+        """Close the workers and release the shared memory."""
+        # make sure the batch is not already closed
+        if self._batch is None:
+            raise ValueError('batch has already been closed.')
+        self._batch = None
+        self._finalizer()
+
+
+# explicitly define the outward facing API of this module
+__all__ = [NESSharedBatch.__name__]
@@ -0,0 +1,118 @@
+"""Test cases for the native extension module."""
+import os
+import time
+from threading import Thread
+from unittest import TestCase, skipIf
+import numpy as np
+from .rom_file_abs_path import rom_file_abs_path
+from nes_py.nes_env import NESEnv
+from nes_py.nes_env import _native
+
+
+# the actions to play in the tests, start the game and run right
+ACTIONS = [0] * 60 + [0b00001000, 0] * 5 + [0b10000000, 0b10000001] * 100
+
+
+class SMB1Env(NESEnv):
+    """An SMB1 environment with its reward, done flag, and info in RAM."""
+
+    ram_watch = {
+        'x_pos': 'ram[0x6d] * 0x100 + ram[0x86]',
+        'reward': 'frame_delta(x_pos)',
+        'done': 'ram[0xe] == 0x0b',
+    }
+
+
+class SMB1HookEnv(SMB1Env):
+    """An SMB1 environment with a Python hook, which steps through ctypes."""
+
+    def _get_reward(self):
+        return super()._get_reward()
+
+
+def create_smb1_env(cls=SMB1Env):
+    """Return a new SMB1 environment that was reset."""
+    env = cls(rom_file_abs_path("super-mario-bros-1.nes"))
+    env.reset()
+    return env
+
+
+@skipIf(_native is None, 'the native extension is not built')
+class ShouldStepNatively(TestCase):
+    def test(self):
+        env = create_smb1_env()
+        self.assertIsNotNone(env._stepper)
+        # the Python hooks of a subclass are kept
+        hooked = create_smb1_env(SMB1HookEnv)
+        self.assertIsNone(hooked._stepper)
+        for action in ACTIONS:
+            expected = hooked.step(action)
+            actual = env.step(action)
+            self.assertTrue(np.array_equal(expected[0], actual[0]))
+            self.assertEqual(expected[1:], actual[1:])
+            self.assertIsInstance(actual[1], float)
+            self.assertTrue(np.array_equal(hooked.ram, env.ram))
+        self.assertTrue(env.watch['x_pos'] > 40)
+        hooked.close()
+        env.close()
+
+
+@skipIf(_native is None, 'the native extension is not built')
+class ShouldCheckNativeSteps(TestCase):
+    def test(self):
+        env = create_smb1_env()
+        env.set_action_table([0, 0b10000000])
+        self.assertRaises(ValueError, env.step, 2)
+        self.assertRaises(ValueError, env.step, -1)
+        self.assertRaises(ValueError, env._stepper.step, 0, 0)
+        env.set_action_table(None)
+        self.assertRaises(OverflowError, env.step, 0x100)
+        env.set_ram_watch(None)
+        _, reward, done, _, info = env.step(0)
+        self.assertEqual((0.0, False, {}), (reward, done, info))
+        env.close()
+        self.assertIsNone(env._stepper)
+
+
+@skipIf(_native is None, 'the native extension is not built')
+class ShouldReleaseGILWhileStepping(TestCase):
+    def test(self):
+        env = create_smb1_env()
+        thread = Thread(target=env._stepper.step, args=(0, 600))
+        # the Python thread keeps running while the emulator steps natively
+        iterations = 0
+        thread.start()
+        while thread.is_alive():
+            iterations += 1
+        thread.join()
+        self.assertTrue(iterations > 100)
+        env.close()
+
+
+@skipIf(_native is None, 'the native extension is not built')
+@skipIf((os.cpu_count() or 1) < 2, 'stepping in threads only scales across cores')
+class ShouldScaleSteppingAcrossThreads(TestCase):
+    def test(self):
+        threads = min(os.cpu_count(), 4)
+        envs = [create_smb1_env() for _ in range(threads)]
+
+        def play(env):
+            for action in ACTIONS:
+                env.step(action)
+
+        start = time.perf_counter()
+        for env in envs:
+            play(env)
+        sequential = time.perf_counter() - start
+        for env in envs:
+            env.reset()
+        workers = [Thread(target=play, args=(env, )) for env in envs]
+        start = time.perf_counter()
+        for worker in workers:
+            worker.start()
+        for worker in workers:
+            worker.join()
+        parallel = time.perf_counter() - start
+        self.assertTrue(parallel < 0.75 * sequential)
+        for env in envs:
+            env.close()
@@ -0,0 +1,358 @@
+"""Test cases for the NESBatch class."""
+import json
+import os
+import tempfile
+from unittest import TestCase
+import numpy as np
+from .rom_file_abs_path import rom_file_abs_path
+from nes_py.nes_env import _LIB
+from nes_py.nes_env import _array
+from nes_py.nes_env import NESEnv
+from nes_py.nes_env import latency_stats
+from nes_py.nes_env import reset_latency
+from nes_py.nes_env import set_tracing
+from nes_py.nes_env import clear_trace
+from nes_py.nes_env import dump_trace
+from nes_py.nes_env import memory_totals
+from nes_py.nes_batch import NESBatch
+
+
+# the RAM watch of SMB1 that ends episodes when Mario dies
+SMB1_WATCH = {
+    'x_pos': 'ram[0x6d] * 0x100 + ram[0x86]',
+    'reward': 'frame_delta(x_pos)',
+    'done': 'ram[0xe] == 0x0b || ram[0xe] == 0x06',
+}
+
+
+def create_smb1_batch(num_envs, **kwargs):
+    """Return a new SMB1 batch."""
+    return NESBatch(rom_file_abs_path("super-mario-bros-1.nes"), num_envs, **kwargs)
+
+
+class ShouldRaiseValueErrorOnInvalidBatch(TestCase):
+    def test(self):
+        self.assertRaises(ValueError, create_smb1_batch, 0)
+        self.assertRaises(ValueError, NESBatch, rom_file_abs_path('blank'), 2)
+        self.assertRaises(ValueError, create_smb1_batch, 2, pixel_format='xrgb')
+        self.assertRaises(ValueError, create_smb1_batch, 2, ram_watch={'done': 'ram['})
+
+
+class ShouldStepBatchLikeEnvs(TestCase):
+    def test(self):
+        batch = create_smb1_batch(2, ram_watch=SMB1_WATCH)
+        env = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        env.set_ram_watch(SMB1_WATCH)
+        env.reset()
+        batch.reset()
+        self.assertEqual((2, 240, 256, 3), batch.observations.shape)
+        self.assertEqual(('reward', 'done', 'x_pos'), batch.results.dtype.names)
+        for action in [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 100:
+            _, reward, done, _, info = env.step(action)
+            observations, rewards, terminated, truncated, _ = batch.step([action, 0])
+            self.assertTrue(np.array_equal(env.screen, observations[0]))
+            self.assertEqual(reward, rewards[0])
+            self.assertEqual(info['x_pos'], batch.results['x_pos'][0])
+            self.assertFalse(terminated.any() or truncated.any())
+        env.close()
+        batch.close()
+        self.assertRaises(ValueError, batch.close)
+
+
+class ShouldAutoResetBatch(TestCase):
+    def test(self):
+        batch = create_smb1_batch(2, ram_watch=SMB1_WATCH, max_episode_steps=50)
+        unlimited = create_smb1_batch(2, ram_watch=SMB1_WATCH)
+        for b in (batch, unlimited):
+            b.reset()
+            for _ in range(10):
+                b.step([0, 0b00001000])
+            b.backup()
+        start = batch.reset().copy()
+        for step in range(1, 51):
+            observations, _, terminated, truncated, info = batch.step([0, 0])
+            unlimited.step([0, 0])
+            self.assertFalse(terminated.any())
+            self.assertEqual(step == 50, truncated.all())
+        # the final screen is kept and the start state is restored
+        self.assertTrue(np.array_equal(unlimited.observations, info['final_observations']))
+        self.assertTrue(np.array_equal(start, observations))
+        batch.close()
+        unlimited.close()
+
+
+class ShouldTerminateBatchWithRAMWatch(TestCase):
+    def test(self):
+        batch = create_smb1_batch(1, headless=True, ram_watch=SMB1_WATCH)
+        batch.reset()
+        batch.backup()
+        # start the game and run right into the first goomba
+        actions = [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 1000
+        for action in actions:
+            _, _, terminated, _, _ = batch.step([action])
+            if terminated[0]:
+                break
+        self.assertTrue(terminated[0])
+        self.assertEqual(1, batch.results['done'][0])
+        # the emulator restarts from its start state in the same step
+        self.assertEqual(0, batch.step([0])[1][0])
+        batch.close()
+
+
+class ShouldStepBatchWithActionTable(TestCase):
+    def test(self):
+        batch = create_smb1_batch(2, headless=True, ram_watch=SMB1_WATCH)
+        bytes_batch = create_smb1_batch(2, headless=True, ram_watch=SMB1_WATCH)
+        table = [[0, 0], [0b00001000, 0], [0b10000000, 0]]
+        batch.set_action_table(table)
+        batch.reset()
+        bytes_batch.reset()
+        for action in [0] * 60 + [1, 0] * 5 + [2] * 250:
+            batch.step(np.array([action, 0], dtype=np.int64))
+            bytes_batch.step([table[action][0], 0])
+            self.assertTrue(np.array_equal(bytes_batch.results, batch.results))
+        self.assertTrue(batch.results['x_pos'][0] > 40)
+        # indexes outside of the table are errors of the policy
+        self.assertRaises(ValueError, batch.step, [0, 3])
+        self.assertRaises(ValueError, batch.step_async, [-1], [0])
+        # a step runs at least one frame
+        steps = batch.episode_stats['length'].copy()
+        self.assertRaises(ValueError, batch.step, [0, 0], frames=0)
+        self.assertRaises(ValueError, batch.step_async, [0], [0], frames=-1)
+        self.assertTrue(np.array_equal(steps, batch.episode_stats['length']))
+        batch.close()
+        bytes_batch.close()
+
+
+class ShouldSeedBatchStreams(TestCase):
+    def test(self):
+        def start_rams(seed):
+            batch = create_smb1_batch(4, headless=True, max_noops=30)
+            batch.reset(seed=seed)
+            rams = [_array(_LIB.Memory(_LIB.BatchEmulator(batch._batch, i)), (2048, ), np.uint8).copy()
+                for i in range(4)]
+            batch.close()
+            return rams
+        self.assertRaises(ValueError, create_smb1_batch, 2, sticky_actions=-0.1)
+        rams = start_rams(1)
+        self.assertTrue(np.array_equal(rams, start_rams(1)))
+        self.assertTrue(any(not np.array_equal(rams[0], ram) for ram in rams[1:]))
+
+
+class ShouldStepBatchAsync(TestCase):
+    def test(self):
+        batch = create_smb1_batch(4, ram_watch=SMB1_WATCH, num_threads=3)
+        sync = create_smb1_batch(4, ram_watch=SMB1_WATCH)
+        batch.reset()
+        sync.reset()
+        actions = [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 100
+        # stepping every emulator with the workers matches stepping in order
+        for action in actions[:80]:
+            batch.step([action] * 4)
+            sync.step([action] * 4)
+            self.assertTrue(np.array_equal(sync.observations, batch.observations))
+        # sub-batches are collected as they finish
+        for action in actions[80:]:
+            batch.step_async([action, action], env_ids=[0, 2])
+            self.assertRaises(ValueError, batch.step_async, [action], env_ids=[2])
+            self.assertRaises(ValueError, batch.step_async, [action, action], env_ids=[1, 1])
+            batch.step_async([action, action], env_ids=[3, 1])
+            ready = list(batch.wait_any())
+            while len(ready) < 4:
+                ready += list(batch.wait_any())
+            self.assertEqual([0, 1, 2, 3], sorted(ready))
+            self.assertEqual(0, batch.in_flight)
+            sync.step([action] * 4)
+            self.assertTrue(np.array_equal(sync.observations, batch.observations))
+            self.assertTrue(np.array_equal(sync.results, batch.results))
+        self.assertEqual(0, len(batch.wait_any()))
+        batch.step_async([0] * 4)
+        self.assertEqual([0, 1, 2, 3], sorted(batch.wait_all()))
+        self.assertEqual(0, len(batch.poll()))
+        batch.close()
+        sync.close()
+
+
+class ShouldNotStepBatchWithStepsInFlight(TestCase):
+    def test(self):
+        for num_threads in [0, 2]:
+            batch = create_smb1_batch(3, num_threads=num_threads)
+            batch.reset()
+            batch.step_async([0, 0], env_ids=[0, 2])
+            self.assertRaises(RuntimeError, batch.step, [0] * 3)
+            # the completions of the caller are left to collect
+            self.assertEqual(2, batch.in_flight)
+            self.assertEqual([0, 2], sorted(batch.wait_all()))
+            batch.step([0] * 3)
+            self.assertEqual(0, batch.in_flight)
+            self.assertEqual(0, len(batch.poll()))
+            batch.close()
+
+
+class ShouldViewBatchRAMAsOneBlock(TestCase):
+    def test(self):
+        batch = create_smb1_batch(3, headless=True)
+        self.assertEqual((3, 0x800), batch.ram.shape)
+        self.assertEqual(0, batch.ram.ctypes.data % 64)
+        batch.reset()
+        for action in [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 250:
+            batch.step([action, 0, action])
+        for index in range(3):
+            emulator = _LIB.BatchEmulator(batch._batch, index)
+            ram = _array(_LIB.Memory(emulator), (0x800, ), np.uint8)
+            self.assertEqual(batch.ram[index].ctypes.data, ram.ctypes.data)
+        # a vectorized gather of the x positions of the whole batch
+        x_pos = batch.ram[:, 0x6d].astype(int) * 0x100 + batch.ram[:, 0x86]
+        self.assertEqual(x_pos[0], x_pos[2])
+        self.assertTrue(x_pos[0] > x_pos[1])
+        # a saved state copies the RAM into the block, not its storage
+        ram = batch.ram.copy()
+        batch.backup()
+        for _ in range(10):
+            batch.step([0b10000000] * 3)
+        self.assertFalse(np.array_equal(ram, batch.ram))
+        batch.reset()
+        self.assertTrue(np.array_equal(ram, batch.ram))
+        batch.close()
+
+
+class ShouldViewBatchFrameStacks(TestCase):
+    def test(self):
+        batch = create_smb1_batch(2, ram_watch=SMB1_WATCH, max_episode_steps=50)
+        env = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        self.assertIsNone(batch.stacked_observations)
+        self.assertRaises(ValueError, batch.set_frame_stack, 4, 7)
+        batch.set_frame_stack(4, 2)
+        env.set_frame_stack(4, 2)
+        batch.reset()
+        env.reset()
+        for action in [0] * 49:
+            batch.step([action, action])
+            env.step(action)
+            stacks = batch.stacked_observations
+            self.assertEqual((2, 4, 120, 128), stacks.shape)
+            self.assertTrue(np.shares_memory(stacks, batch._frame_rings))
+            self.assertTrue(np.array_equal(env.frame_stack, stacks[0]))
+            self.assertTrue(np.array_equal(stacks[0], stacks[1]))
+        # the stacks of auto-reset episodes are filled with the first screen
+        batch.step([0, 0])
+        self.assertTrue(batch.truncated.all())
+        stacks = batch.stacked_observations
+        self.assertTrue(all(np.array_equal(stacks[0, 0], frame) for frame in stacks[0]))
+        # stacks that start at different slots are gathered
+        batch.step_async([0], env_ids=[0])
+        batch.wait_all()
+        stacks = batch.stacked_observations
+        self.assertFalse(np.shares_memory(stacks, batch._frame_rings))
+        self.assertTrue(np.array_equal(stacks[0, :3], stacks[1, 1:]))
+        batch.close()
+        env.close()
+
+
+class ShouldAccumulateBatchEpisodeStats(TestCase):
+    def test(self):
+        watch = dict(SMB1_WATCH, progress='x_pos')
+        batch = create_smb1_batch(2, headless=True, ram_watch=watch, max_episode_steps=200)
+        batch.reset()
+        returns = np.zeros(2)
+        for action in [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 130:
+            _, rewards, _, truncated, info = batch.step([action, 0], frames=2)
+            returns += rewards
+            if not truncated.any():
+                self.assertTrue(np.array_equal(returns, batch.episode_stats['return']))
+        # the statistics of the truncated episodes are kept for the step
+        self.assertTrue(truncated.all())
+        stats = info['final_episode_stats']
+        self.assertTrue(np.array_equal([200, 200], stats['length']))
+        self.assertTrue(np.array_equal([400, 400], stats['frames']))
+        self.assertTrue(np.array_equal(returns, stats['return']))
+        self.assertTrue(stats['max_progress'][0] > stats['max_progress'][1])
+        self.assertTrue(np.array_equal([0, 0], batch.episode_stats['length']))
+        batch.close()
+
+
+class ShouldRecordBatchStepLatencies(TestCase):
+    def test(self):
+        batch = create_smb1_batch(3)
+        batch.reset()
+        reset_latency()
+        for _ in range(10):
+            batch.step(np.zeros(3, dtype=np.int32))
+        stats = latency_stats()
+        self.assertEqual(10, stats['batch_step']['count'])
+        # every emulator of the batch records its own steps
+        self.assertEqual(30, stats['step']['count'])
+        self.assertTrue(stats['step']['mean'] < stats['batch_step']['mean'])
+        batch.close()
+        # the worker threads record to histograms of their own that are
+        # merged when they are read, also after the threads exit
+        batch = create_smb1_batch(4, num_threads=2)
+        batch.reset()
+        reset_latency()
+        for _ in range(10):
+            batch.step(np.zeros(4, dtype=np.int32))
+        self.assertEqual(40, latency_stats()['step']['count'])
+        batch.close()
+        self.assertEqual(40, latency_stats()['step']['count'])
+
+
+class ShouldDumpChromeTraceOfBatchWorkers(TestCase):
+    def test(self):
+        batch = create_smb1_batch(2, num_threads=2)
+        batch.reset()
+        clear_trace()
+        # zones are only recorded while tracing
+        batch.step(np.zeros(2, dtype=np.int32))
+        set_tracing()
+        for _ in range(3):
+            batch.step(np.zeros(2, dtype=np.int32))
+        set_tracing(False)
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, 'trace.json')
+            dump_trace(path)
+            with open(path) as file:
+                trace = json.load(file)
+        events = [event for event in trace['traceEvents'] if event['ph'] == 'X']
+        names = [event['name'] for event in events]
+        self.assertEqual(3, names.count('batch_step'))
+        self.assertEqual(6, names.count('step_emulator'))
+        self.assertEqual(6, names.count('step'))
+        self.assertIn('render_frame', names)
+        self.assertIn('wait_task', names)
+        # the emulators step on the worker threads, which are named
+        threads = {event['args']['name']: event['tid'] for event in trace['traceEvents']
+                   if event['ph'] == 'M' and event['name'] == 'thread_name'}
+        workers = {threads['batch worker 0'], threads['batch worker 1']}
+        steps = [event for event in events if event['name'] == 'step_emulator']
+        self.assertEqual(workers, {event['tid'] for event in steps})
+        self.assertEqual({0, 1}, {event['args']['index'] for event in steps})
+        self.assertTrue(all(event['dur'] >= 0 for event in events))
+        # a clear removes the zones
+        clear_trace()
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, 'trace.json')
+            dump_trace(path)
+            with open(path) as file:
+                trace = json.load(file)
+        self.assertFalse([event for event in trace['traceEvents'] if event['ph'] == 'X'])
+        batch.close()
+
+
+class ShouldAccountBatchMemoryFootprint(TestCase):
+    def test(self):
+        rom_store = memory_totals()['rom_store']
+        batch = NESBatch(rom_file_abs_path('super-mario-bros-1.nes'), 3, pixel_format='palette')
+        self.assertEqual(rom_store['count'] + 3, memory_totals()['rom_store']['count'])
+        footprint = batch.memory_footprint()
+        self.assertEqual(3 * (0x8000 + 0x2000), footprint['rom'])
+        # the screens and final screens of the batch
+        self.assertTrue(footprint['framebuffer'] >= 2 * 3 * 240 * 256)
+        self.assertTrue(footprint['bus'] >= 3 * 2 * 0x800)
+        # the RAM lives in the block of the batch, not in the buses as well
+        env = NESEnv(rom_file_abs_path('super-mario-bros-1.nes'))
+        self.assertEqual(3 * env.memory_footprint()['bus'], footprint['bus'])
+        env.close()
+        batch.set_frame_stack(4, 2)
+        self.assertTrue(batch.memory_footprint()['caches'] >= footprint['caches'] + 3 * 8 * 120 * 128)
+        batch.close()
+        self.assertEqual(rom_store, memory_totals()['rom_store'])
@@ -1,10 +1,13 @@
 """Test cases for the NESEnv class."""
+import os
+import tempfile
 import time
-from unittest import TestCase
+from unittest import TestCase, skipIf, skipUnless
 import gymnasium as gym
 import numpy as np
 from .rom_file_abs_path import rom_file_abs_path
-from nes_py.nes_env import NESEnv
+from nes_py.nes_env import NESEnv, COUNTERS_ENABLED, latency_stats, reset_latency
+from nes_py.nes_env import MEMORY_FOOTPRINT_DTYPE, memory_totals, format_cpu_trace
 
 
 class ShouldRaiseTypeErrorOnInvalidROMPathType(TestCase):
@@ -209,4 +212,578 @@ class ShouldStepEnvSerializeDeserializeState(TestCase):
             assert time.time() - t_0 < 0.3
 
             # the two env should be in sync
-            self.assertTrue(np.array_equal(env.screen, env_2.screen))
\ No newline at end of file
+            self.assertTrue(np.array_equal(env.screen, env_2.screen))
+
+class ShouldDeserializeStateAcrossPixelFormats(TestCase):
+    def test(self):
+        path = rom_file_abs_path("super-mario-bros-1.nes")
+        env_palette = NESEnv(path, pixel_format="palette")
+        env_rgb = NESEnv(path, pixel_format="rgb24")
+        env_half = NESEnv(path, pixel_format="chw_float16")
+        for env in (env_palette, env_rgb, env_half):
+            env.reset()
+        for _ in range(60):
+            env_palette.step(0)
+        data = env_palette.serialize()
+        # palette indexes convert to the format of the emulator
+        env_rgb.deserialize(data)
+        self.assertTrue(np.array_equal(env_palette.convert_screen('rgb24'), env_rgb.screen))
+        env_half.deserialize(data)
+        self.assertTrue(np.array_equal(env_palette.convert_screen('chw_float16'), env_half.screen))
+        # the other formats only load into an emulator that renders them
+        screen = env_palette.screen.copy()
+        with self.assertRaises(ValueError):
+            env_palette.deserialize(env_rgb.serialize())
+        self.assertTrue(np.array_equal(screen, env_palette.screen))
+        # truncated states are rejected and leave the emulator as it was
+        for size in (0, 100, len(data) - 1):
+            with self.assertRaises(ValueError):
+                env_palette.deserialize(data[:size])
+        self.assertTrue(np.array_equal(screen, env_palette.screen))
+        self.assertEqual(data, env_palette.serialize())
+        for env in (env_palette, env_rgb, env_half):
+            env.close()
+
+
+class ShouldRenderPaletteIndexes(TestCase):
+    def test(self):
+        env = create_smb1_instance("rgb_array")
+        env_palette = NESEnv(
+            rom_file_abs_path("super-mario-bros-1.nes"),
+            render_mode="rgb_array",
+            pixel_format="palette",
+        )
+        env.reset()
+        env_palette.reset()
+        for _ in range(60):
+            env.step(0)
+            state, _, _, _, _ = env_palette.step(0)
+        self.assertEqual((240, 256), state.shape)
+        self.assertTrue(state.max() < 64)
+        # the converted screen should match the screen rendered in RGB
+        self.assertTrue(np.array_equal(env.screen, env_palette.convert_screen('rgb24')))
+        self.assertTrue(np.array_equal(env.screen, env_palette.render()))
+        chw = env_palette.convert_screen('chw')
+        self.assertTrue(np.array_equal(env.screen, chw.transpose(1, 2, 0)))
+        env.close()
+        env_palette.close()
+
+
+class ShouldRenderNativePixelFormats(TestCase):
+    def test(self):
+        path = rom_file_abs_path("super-mario-bros-1.nes")
+        formats = ['rgb24', 'bgr24', 'rgba', 'bgra', 'chw', 'chw_float16']
+        envs = [NESEnv(path, render_mode="rgb_array", pixel_format=f) for f in formats]
+        for env in envs:
+            env.reset()
+            for _ in range(60):
+                state, _, _, _, _ = env.step(0)
+            # observations are contiguous views of the C++ screen
+            self.assertTrue(state.flags['C_CONTIGUOUS'])
+            self.assertEqual(env.observation_space.shape, state.shape)
+            self.assertEqual(env.observation_space.dtype, state.dtype)
+        rgb = envs[0].screen
+        for env in envs[1:]:
+            self.assertTrue(np.array_equal(rgb, env.render()))
+        self.assertTrue(np.array_equal(rgb[:, :, ::-1], envs[1].screen))
+        self.assertTrue(np.all(envs[2].screen[:, :, 3] == 255))
+        for env in envs:
+            env.close()
+
+
+class ShouldRenderIntoCallerOwnedBuffers(TestCase):
+    def test(self):
+        path = rom_file_abs_path("super-mario-bros-1.nes")
+        envs = [NESEnv(path, render_mode="rgb_array") for _ in range(3)]
+        # a batch tensor and a tensor with padded rows
+        batch = np.zeros((2, 240, 256, 3), dtype=np.uint8)
+        padded = np.zeros((240, 300, 3), dtype=np.uint8)
+        for env in envs:
+            env.reset()
+        envs[1].set_screen_buffer(batch[1])
+        envs[2].set_screen_buffer(padded[:, :256])
+        for _ in range(60):
+            for env in envs:
+                env.step(0)
+        self.assertTrue(np.array_equal(envs[0].screen, batch[1]))
+        self.assertTrue(np.array_equal(envs[0].screen, padded[:, :256]))
+        self.assertFalse(padded[:, 256:].any())
+        self.assertFalse(batch[0].any())
+        # backups restore the frame into the caller-owned buffer
+        envs[1]._backup()
+        backup = batch[1].copy()
+        for _ in range(30):
+            envs[1].step(0)
+        envs[1]._restore()
+        self.assertTrue(np.array_equal(backup, batch[1]))
+        # releasing the buffer keeps the latest frame
+        envs[2].set_screen_buffer(None)
+        self.assertTrue(np.array_equal(envs[0].screen, envs[2].screen))
+        self.assertRaises(ValueError, envs[0].set_screen_buffer, batch[:, 0])
+        for env in envs:
+            env.close()
+
+
+class ShouldDoubleBufferScreen(TestCase):
+    def test(self):
+        env = create_smb1_instance("rgb_array")
+        env_double = create_smb1_instance("rgb_array")
+        env_double.set_double_buffered()
+        env.reset()
+        env_double.reset()
+        for _ in range(60):
+            env.step(0)
+            env_double.step(0)
+        sequence = env_double.frame_sequence
+        self.assertTrue(sequence >= 60)
+        self.assertTrue(np.array_equal(env.screen, env_double.screen))
+        # the front frame is untouched until the next frame completes
+        front_sequence, front = env_double.front_screen()
+        self.assertEqual(sequence, front_sequence)
+        backup = front.copy()
+        while env_double.frame_sequence == front_sequence + 1 or \
+                env_double.frame_sequence == front_sequence:
+            self.assertTrue(np.array_equal(backup, front))
+            env_double.step(0b10000000)
+        self.assertTrue(env_double.frame_sequence > sequence)
+        # disabling keeps the latest frame
+        screen = env_double.screen.copy()
+        env_double.set_double_buffered(False)
+        self.assertTrue(np.array_equal(screen, env_double.screen))
+        env.close()
+        env_double.close()
+
+
+class ShouldSkipRenderingUnobservedFrames(TestCase):
+    def test(self):
+        env = create_smb1_instance("rgb_array")
+        env_skip = create_smb1_instance("rgb_array")
+        env.reset()
+        env_skip.reset()
+        # skipping frames never changes the emulation (e.g., sprite 0 hits)
+        for action in [0, 0b10000000, 0b10000001, 0b00001000] * 50:
+            for _ in range(4):
+                env._frame_advance(action)
+            env_skip._frame_advance(action, 4)
+            self.assertTrue(np.array_equal(env.ram, env_skip.ram))
+            self.assertTrue(np.array_equal(env.screen, env_skip.screen))
+        # a step runs at least one frame
+        self.assertRaises(ValueError, env_skip._frame_advance, 0, 0)
+        self.assertTrue(env_skip.rendering)
+        # frames are not rendered or published without rendering
+        env_skip.rendering = False
+        sequence = env_skip.frame_sequence
+        screen = env_skip.screen.copy()
+        for _ in range(10):
+            env_skip._frame_advance(0b10000001)
+        self.assertEqual(sequence, env_skip.frame_sequence)
+        self.assertTrue(np.array_equal(screen, env_skip.screen))
+        env.close()
+        env_skip.close()
+
+
+class SMB1Watch(NESEnv):
+    """SMB1 with a RAM watch for the reward, done flag, and info."""
+
+    ram_watch = {
+        'x_pos': 'ram[0x6d] * 0x100 + ram[0x86]',
+        'time': 'digits(ram[0x7f8], ram[0x7f9], ram[0x7fa])',
+        'dying': 'ram[0xe] == 0x0b || ram[0xe] == 0x06',
+        'reward': 'frame_delta(x_pos) + min(frame_delta(time), 0) + (dying ? -25 : 0)',
+        'done': 'dying',
+    }
+
+
+class ShouldEvaluateRAMWatch(TestCase):
+    def test(self):
+        env = SMB1Watch(rom_file_abs_path("super-mario-bros-1.nes"))
+        self.assertEqual(('reward', 'done', 'x_pos', 'time', 'dying'), env.watch.dtype.names)
+        env.reset()
+        self.assertEqual(0, env._get_reward())
+        for action in [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 250:
+            ram = env.ram.copy()
+            _, reward, done, _, info = env.step(action)
+            x_pos = int(env.ram[0x6d]) * 0x100 + int(env.ram[0x86])
+            time = int(env.ram[0x7f8]) * 100 + int(env.ram[0x7f9]) * 10 + int(env.ram[0x7fa])
+            last_x_pos = int(ram[0x6d]) * 0x100 + int(ram[0x86])
+            last_time = int(ram[0x7f8]) * 100 + int(ram[0x7f9]) * 10 + int(ram[0x7fa])
+            self.assertEqual(x_pos, info['x_pos'])
+            self.assertEqual(time, info['time'])
+            self.assertEqual(x_pos - last_x_pos + min(time - last_time, 0), reward)
+            self.assertFalse(done)
+        self.assertTrue(info['x_pos'] > 40)
+        # the reward of skipped frames is summed
+        x_pos = info['x_pos']
+        env._frame_advance(0b10000000, 4)
+        self.assertEqual(env.watch['x_pos'] - x_pos, env._get_reward())
+        env.close()
+
+
+class ShouldRaiseValueErrorOnInvalidRAMWatch(TestCase):
+    def test(self):
+        env = create_smb1_instance()
+        self.assertRaises(ValueError, env.set_ram_watch, {'x': 'ram[0x6d'})
+        self.assertRaises(ValueError, env.set_ram_watch, {'x': 'y + 1'})
+        self.assertRaises(ValueError, env.set_ram_watch, {'x': 'bcd(1, 2)'})
+        self.assertRaises(ValueError, env.set_ram_watch, 'x = 1\nx = 2')
+        self.assertRaises(ValueError, env.set_ram_watch, 'frame_delta = 1')
+        # the nesting of expressions is bounded instead of the recursion
+        self.assertRaises(ValueError, env.set_ram_watch, 'x = ' + '(' * 100000 + '1' + ')' * 100000)
+        self.assertRaises(ValueError, env.set_ram_watch, 'x = ' + '-' * 100000 + '1')
+        self.assertRaises(ValueError, env.set_ram_watch, 'x = ' + '1 ? ' * 100000 + '1' + ' : 0' * 100000)
+        self.assertIsNone(env.watch)
+        env.set_ram_watch('x = ' + '(' * 200 + '1' + ')' * 200)
+        self.assertEqual(1, env.watch['x'])
+        env.set_ram_watch('a = 7 / 2; b = -a * 2 >= -7 ? 0x10 >> 2 : $ff  # comment\nc = bcd($42) % 5')
+        self.assertEqual((3.5, 4, 2), (env.watch['a'], env.watch['b'], env.watch['c']))
+        env.set_ram_watch(None)
+        self.assertIsNone(env.watch)
+        self.assertEqual({}, env._get_info())
+        env.close()
+
+
+class ShouldSaturateRAMWatchIntegers(TestCase):
+    def test(self):
+        env = create_smb1_instance()
+        env.reset()
+        env.set_ram_watch('a = ~1e30; b = (1e300 * 1e300) | 0; c = (-1e300 * 1e300) & -1; d = (0 / 0) | 0; e = ram[1 / 0]')
+        self.assertEqual(-2.0 ** 63, env.watch['a'])
+        self.assertEqual(2.0 ** 63, env.watch['b'])
+        self.assertEqual(-2.0 ** 63, env.watch['c'])
+        self.assertEqual(0, env.watch['d'])
+        self.assertEqual(env.ram[0x7ff], env.watch['e'])
+        env.close()
+
+
+class ShouldMapDiscreteActionsInCore(TestCase):
+    def test(self):
+        env = create_smb1_instance()
+        env_table = create_smb1_instance()
+        table = [0, 0b00001000, 0b10000000, 0b10000010]
+        self.assertRaises(ValueError, env_table.set_action_table, [])
+        self.assertRaises(ValueError, env_table.set_action_table, [256])
+        self.assertRaises(ValueError, env_table.set_action_table, [[0, 0, 0]])
+        env_table.set_action_table(table)
+        self.assertEqual(4, env_table.action_space.n)
+        env.reset()
+        env_table.reset()
+        for action in [0] * 60 + [1, 0] * 5 + [2] * 50 + [3] * 50:
+            env.step(table[action])
+            env_table.step(action)
+            self.assertTrue(np.array_equal(env.ram, env_table.ram))
+            self.assertEqual(table[action], env_table.controllers[0][0])
+        # indexes outside of the table are errors of the policy
+        self.assertRaises(ValueError, env_table.step, len(table))
+        self.assertRaises(ValueError, env_table.step, -1)
+        env_table.set_action_table(None)
+        self.assertEqual(NESEnv.action_space, env_table.action_space)
+        env.close()
+        env_table.close()
+
+
+def play_smb1_stochastic(seed, sticky_actions=0.0, max_noops=0, frames=1):
+    """Play SMB1 with stochasticity and return the RAM after each step."""
+    env = create_smb1_instance()
+    env.set_stochasticity(sticky_actions, max_noops)
+    env.reset(seed=seed)
+    rams = [env.ram.copy()]
+    for action in [0] * 60 + [0b00001000, 0] * 5 + [0b10000000, 0b10000010] * 50:
+        env._frame_advance(action, frames)
+        rams.append(env.ram.copy())
+    env.close()
+    return np.array(rams)
+
+
+class ShouldApplyStickyActionsInCore(TestCase):
+    def test(self):
+        env = create_smb1_instance()
+        self.assertRaises(ValueError, env.set_stochasticity, 1.5)
+        self.assertRaises(ValueError, env.set_stochasticity, 0.0, -1)
+        # the buttons released by the reset are repeated forever
+        env.set_stochasticity(1.0)
+        env.reset()
+        for _ in range(10):
+            env.step(0b10000000)
+            self.assertEqual(0, env.controllers[0][0])
+        env.close()
+        # sticky actions are reproducible from a seed
+        rams = play_smb1_stochastic(1, sticky_actions=0.25)
+        self.assertTrue(np.array_equal(rams, play_smb1_stochastic(1, sticky_actions=0.25)))
+        self.assertFalse(np.array_equal(rams, play_smb1_stochastic(2, sticky_actions=0.25)))
+        self.assertFalse(np.array_equal(rams, play_smb1_stochastic(1)))
+        # multi-frame steps draw for every frame
+        rams = play_smb1_stochastic(3, sticky_actions=0.25, frames=4)
+        self.assertTrue(np.array_equal(rams, play_smb1_stochastic(3, sticky_actions=0.25, frames=4)))
+
+
+class ShouldRunRandomNoopsOnReset(TestCase):
+    def test(self):
+        starts = [play_smb1_stochastic(seed, max_noops=30)[0] for seed in range(4)]
+        self.assertTrue(np.array_equal(starts[0], play_smb1_stochastic(0, max_noops=30)[0]))
+        self.assertTrue(any(not np.array_equal(starts[0], start) for start in starts[1:]))
+        self.assertTrue(np.array_equal(play_smb1_stochastic(0)[0], play_smb1_stochastic(1)[0]))
+
+
+def luma(screen, downsample=1):
+    """Return the luma of an RGB screen, downsampled by block averages."""
+    screen = screen.astype(np.int64)
+    frame = (77 * screen[..., 0] + 150 * screen[..., 1] + 29 * screen[..., 2] + 128) >> 8
+    height, width = frame.shape
+    blocks = frame.reshape(height // downsample, downsample, width // downsample, downsample)
+    area = downsample * downsample
+    return ((blocks.sum(axis=(1, 3)) + area // 2) // area).astype(np.uint8)
+
+
+class ShouldStackFramesInCore(TestCase):
+    def test(self):
+        env = create_smb1_instance()
+        self.assertIsNone(env.frame_stack)
+        self.assertRaises(ValueError, env.set_frame_stack, 0)
+        self.assertRaises(ValueError, env.set_frame_stack, 4, 3)
+        for downsample in (1, 2):
+            env.set_frame_stack(4, downsample)
+            env.reset()
+            frames = [luma(env.screen, downsample)] * 4
+            for action in [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 20:
+                env.step(action)
+                frames = frames[1:] + [luma(env.screen, downsample)]
+                stack = env.frame_stack
+                self.assertEqual((4, 240 // downsample, 256 // downsample), stack.shape)
+                self.assertTrue(np.shares_memory(stack, env._frame_ring))
+                self.assertTrue(np.array_equal(np.array(frames), stack))
+        # the luma of palette indexes matches the luma of RGB screens
+        palette = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"), pixel_format='palette')
+        palette.set_frame_stack(2)
+        palette.reset()
+        env.set_frame_stack(2)
+        env.reset()
+        for action in [0] * 40:
+            palette.step(action)
+            env.step(action)
+        self.assertTrue(np.array_equal(env.frame_stack, palette.frame_stack))
+        env.set_frame_stack(None)
+        self.assertIsNone(env.frame_stack)
+        env.close()
+        palette.close()
+
+
+class ShouldAccumulateEpisodeStatsInCore(TestCase):
+    def test(self):
+        env = SMB1Watch(rom_file_abs_path("super-mario-bros-1.nes"))
+        env.set_ram_watch(dict(SMB1Watch.ram_watch, progress='x_pos'))
+        self.assertEqual(0, env.final_episode_stats['length'])
+        env.reset()
+        total = 0
+        max_x = env.watch['x_pos']
+        actions = [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 250
+        for action in actions:
+            _, reward, _, _, info = env.step(action)
+            total += reward
+            max_x = max(max_x, info['x_pos'])
+        stats = env.episode_stats
+        self.assertEqual(len(actions), stats['length'])
+        self.assertEqual(len(actions), stats['frames'])
+        self.assertEqual(total, stats['return'])
+        self.assertEqual(max_x, stats['max_progress'])
+        self.assertTrue(stats['seconds'] > 0)
+        # a reset snapshots the episode and starts a new one
+        snapshot = stats.copy()
+        env.reset()
+        self.assertEqual(snapshot, env.final_episode_stats)
+        self.assertEqual(0, env.episode_stats['length'])
+        env.close()
+
+
+@skipIf(COUNTERS_ENABLED, 'the library is built with the hot-path counters')
+class ShouldCompileOutHotPathCounters(TestCase):
+    def test(self):
+        env = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        env.reset()
+        for _ in range(10):
+            env.step(0)
+        self.assertEqual(0, env.total_counters['bus_reads'].sum())
+        self.assertEqual(0, env.frame_counters['nmis'])
+        env.close()
+
+
+@skipUnless(COUNTERS_ENABLED, 'the library is built without the hot-path counters')
+class ShouldCountHotPathsPerFrame(TestCase):
+    def test(self):
+        env = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        env.reset()
+        for _ in range(60):
+            env.step(0)
+        env.reset_counters()
+        self.assertEqual(0, env.total_counters['bus_reads'].sum())
+        for _ in range(10):
+            env.step(0)
+        frame = env.frame_counters.copy()
+        total = env.total_counters.copy()
+        # the game waits for one NMI per frame and copies the sprites in it
+        self.assertEqual(1, frame['nmis'])
+        self.assertEqual(1, frame['oam_dmas'])
+        self.assertEqual(10, total['nmis'])
+        # every instruction is fetched from PRG-ROM
+        self.assertTrue(frame['bus_reads'][6] > 1000)
+        self.assertTrue(frame['bus_reads'][0] > 0)
+        # the game polls the joypad and writes the OAMDMA register
+        self.assertTrue(frame['register_reads'][10] > 0)
+        self.assertEqual(frame['oam_dmas'], frame['register_writes'][8])
+        # the renderer reads the pattern and name tables and the palette
+        self.assertTrue(frame['picture_reads'][0] > 0)
+        self.assertTrue(frame['picture_reads'][1] > 0)
+        self.assertTrue(frame['picture_reads'][2] > 0)
+        # the totals are the sum of the frames
+        for field in ('bus_reads', 'bus_writes', 'picture_reads'):
+            self.assertTrue((total[field] >= frame[field]).all())
+        env.close()
+
+
+class ShouldProfileEmulatedCode(TestCase):
+    def test(self):
+        env = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        self.assertIsNone(env.profile)
+        env.reset()
+        env.set_profiling()
+        frames = 120
+        for _ in range(frames):
+            env.step(0)
+        env.set_profiling(False)
+        profile = env.profile
+        # every cycle of the CPU is in an instruction or an interrupt entry,
+        # up to the instructions that straddle the first and last frame
+        cycles = profile['address_cycles'].sum() + profile['interrupt_cycles']
+        self.assertEqual(profile['opcode_cycles'].sum(), profile['address_cycles'].sum())
+        self.assertEqual(profile['opcode_hits'].sum(), profile['address_hits'].sum())
+        self.assertTrue(abs(int(cycles) - frames * 29781) < 3000)
+        # the game takes at most one NMI per frame, 7 cycles each
+        self.assertEqual(0, profile['interrupt_cycles'] % 7)
+        self.assertTrue(frames * 7 // 2 < profile['interrupt_cycles'] <= frames * 7)
+        # the code runs from PRG-ROM
+        self.assertEqual(0, profile['address_hits'][:0x8000].sum())
+        # the profile stays the same while disabled
+        env.step(0)
+        self.assertEqual(cycles, profile['address_cycles'].sum() + profile['interrupt_cycles'])
+        flat = env.flat_profile(top=5)
+        self.assertIn('total cycles', flat)
+        self.assertIn('JSR', env.flat_profile(top=0))
+        # the folded stacks add up to the same cycles
+        stacks = env.folded_stacks().splitlines()
+        self.assertTrue(any(line.startswith('reset;nmi:$') for line in stacks))
+        self.assertEqual(cycles, sum(int(line.rsplit(' ', 1)[1]) for line in stacks))
+        env.clear_profile()
+        self.assertEqual(0, profile['opcode_hits'].sum())
+        self.assertEqual('', env.folded_stacks())
+        env.close()
+
+
+class ShouldRecordStepLatencies(TestCase):
+    def test(self):
+        env = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        env.reset()
+        env.set_frame_stack(4)
+        reset_latency()
+        for _ in range(50):
+            env.step(0)
+        env._backup()
+        env._restore()
+        stats = latency_stats()
+        self.assertEqual(50, stats['step']['count'])
+        self.assertEqual(50, stats['emulation']['count'])
+        self.assertEqual(50, stats['preprocess']['count'])
+        self.assertEqual(2, stats['snapshot']['count'])
+        self.assertEqual(0, stats['batch_step']['count'])
+        step = stats['step']
+        self.assertTrue(0 < step['p50'] <= step['p90'] <= step['p99'] <= step['max'])
+        # a step takes at least the time of its frames
+        self.assertTrue(stats['emulation']['mean'] <= step['mean'])
+        # a window starts over for one section or all of them
+        reset_latency('snapshot')
+        self.assertEqual(0, latency_stats()['snapshot']['count'])
+        self.assertEqual(50, latency_stats()['step']['count'])
+        reset_latency()
+        self.assertEqual(0, latency_stats()['step']['max'])
+        env.close()
+
+
+class ShouldAccountMemoryFootprint(TestCase):
+    def test(self):
+        before = memory_totals()
+        env = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        env.reset()
+        # 2 banks of PRG ROM and 1 bank of CHR ROM
+        rom_store = memory_totals()['rom_store']
+        self.assertEqual(before['rom_store']['bytes'] + 0x8000 + 0x2000, rom_store['bytes'])
+        self.assertEqual(before['rom_store']['count'] + 1, rom_store['count'])
+        footprint = env.memory_footprint()
+        self.assertEqual(0x8000 + 0x2000, footprint['rom'])
+        self.assertTrue(footprint['framebuffer'] >= 256 * 240)
+        self.assertTrue(footprint['bus'] >= 0x800 + 0x800 + 0x20 + 0x100)
+        self.assertEqual(
+            footprint['total'],
+            sum(footprint[name] for name in MEMORY_FOOTPRINT_DTYPE.names[:-1]),
+        )
+        # the frame stack is a cache
+        env.set_frame_stack(4)
+        self.assertTrue(env.memory_footprint()['caches'] >= footprint['caches'] + 8 * 240 * 256)
+        # saved states join the snapshot pool until they are freed
+        snapshots = memory_totals()['snapshot_pool']
+        state = env.save_state()
+        pool = memory_totals()['snapshot_pool']
+        self.assertEqual(snapshots['count'] + 1, pool['count'])
+        self.assertTrue(pool['bytes'] - snapshots['bytes'] >= 0x800 + footprint['framebuffer'])
+        env.free_state(state)
+        self.assertEqual(snapshots, memory_totals()['snapshot_pool'])
+        # backups are accounted once however often they are taken
+        env._backup()
+        env._backup()
+        self.assertEqual(snapshots['count'] + 1, memory_totals()['snapshot_pool']['count'])
+        env.close()
+        self.assertEqual(before, memory_totals())
+
+
+class ShouldTraceCpuInstructions(TestCase):
+    def test(self):
+        traced = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        plain = NESEnv(rom_file_abs_path("super-mario-bros-1.nes"))
+        traced.reset()
+        plain.reset()
+        self.assertEqual(0, len(traced.cpu_trace))
+        # the ring is rounded up to a power of two
+        traced.set_cpu_tracing(True, 1000)
+        for _ in range(5):
+            traced.step(0)
+            plain.step(0)
+        # the trace does not change the emulation
+        self.assertTrue(np.array_equal(plain.ram, traced.ram))
+        records = traced.cpu_trace
+        self.assertEqual(1024, len(records))
+        self.assertTrue(np.all(np.diff(records['cycle'].astype(np.int64)) > 0))
+        self.assertTrue(np.all(records['scanline'] <= 261))
+        self.assertTrue(np.all(records['dot'] <= 341))
+        self.assertTrue(np.all((1 <= records['length']) & (records['length'] <= 3)))
+        # the records are kept while the trace is disabled
+        traced.set_cpu_tracing(False)
+        traced.step(0)
+        self.assertTrue(np.array_equal(records, traced.cpu_trace))
+        with tempfile.TemporaryDirectory() as directory:
+            trace_path = os.path.join(directory, 'trace.bin')
+            log_path = os.path.join(directory, 'trace.log')
+            traced.dump_cpu_trace(trace_path)
+            self.assertEqual(16 + 20 * 1024, os.path.getsize(trace_path))
+            format_cpu_trace(trace_path, log_path)
+            with open(log_path) as log:
+                lines = log.read().splitlines()
+            self.assertEqual(1024, len(lines))
+            # the columns of nestest.log
+            first = records[0]
+            self.assertTrue(lines[0].startswith('%04X  %02X' % (first['pc'], first['opcode'])))
+            self.assertEqual('A:%02X' % first['a'], lines[0][48:52])
+            self.assertTrue(lines[-1].endswith('CYC:%d' % records[-1]['cycle']))
+            # a log is not a trace
+            with self.assertRaises(OSError):
+                format_cpu_trace(log_path, os.path.join(directory, 'other.log'))
+        traced.clear_cpu_trace()
+        self.assertEqual(0, len(traced.cpu_trace))
+        traced.close()
+        plain.close()
@@ -0,0 +1,97 @@
+"""Test cases for the NESSharedBatch class."""
+import gc
+import os
+import sys
+from unittest import TestCase
+from unittest import skipIf
+import numpy as np
+from .rom_file_abs_path import rom_file_abs_path
+from .test_nes_batch import create_smb1_batch
+from .test_nes_batch import SMB1_WATCH
+from nes_py.nes_shared_batch import NESSharedBatch
+
+
+def create_smb1_shared_batch(num_envs, **kwargs):
+    """Return a new SMB1 batch in worker processes."""
+    return NESSharedBatch(rom_file_abs_path("super-mario-bros-1.nes"), num_envs, **kwargs)
+
+
+@skipIf(not sys.platform.startswith('linux'), 'shared memory batches require Linux')
+class ShouldRaiseValueErrorOnInvalidSharedBatch(TestCase):
+    def test(self):
+        self.assertRaises(ValueError, create_smb1_shared_batch, 0)
+        self.assertRaises(ValueError, create_smb1_shared_batch, 2, num_workers=3)
+        self.assertRaises(ValueError, create_smb1_shared_batch, 2, ram_watch={'done': 'ram['})
+
+
+@skipIf(not sys.platform.startswith('linux'), 'shared memory batches require Linux')
+class ShouldStepSharedBatchLikeBatch(TestCase):
+    def test(self):
+        actions = [0] * 60 + [0b00001000, 0] * 5 + [0b10000000] * 150
+        steps = len(actions)
+        shared = create_smb1_shared_batch(3, num_workers=2, ram_watch=SMB1_WATCH,
+            max_episode_steps=steps, max_noops=10)
+        batch = create_smb1_batch(3, ram_watch=SMB1_WATCH, max_episode_steps=steps, max_noops=10)
+        self.assertEqual((3, 0x800), shared.ram.shape)
+        self.assertEqual(batch.results.dtype, shared.results.dtype)
+        self.assertTrue(np.array_equal(batch.reset(seed=4), shared.reset(seed=4)))
+        for action in actions:
+            observations, rewards, terminated, truncated, _ = shared.step([action, 0, action])
+            batch.step([action, 0, action])
+            self.assertTrue(np.array_equal(batch.observations, observations))
+            self.assertTrue(np.array_equal(batch.results, shared.results))
+            self.assertTrue(np.array_equal(batch.truncated, truncated))
+        # the episodes were truncated and reset in the workers
+        self.assertTrue(truncated.all())
+        self.assertTrue(np.array_equal(batch.final_observations, shared.final_observations))
+        shared.close()
+        batch.close()
+        self.assertRaises(ValueError, shared.close)
+
+
+@skipIf(not sys.platform.startswith('linux'), 'shared memory batches require Linux')
+class ShouldStepSharedBatchWithActionTableAndFrameStacks(TestCase):
+    def test(self):
+        table = [0, 0b00001000, 0b10000000]
+        actions = [0] * 60 + [1, 0] * 5 + [2] * 60
+        self.assertRaises(ValueError, create_smb1_shared_batch, 2, frame_stack_depth=4,
+            frame_stack_downsample=7)
+        shared = create_smb1_shared_batch(3, num_workers=2, ram_watch=SMB1_WATCH,
+            max_episode_steps=100, action_table=table, frame_stack_depth=4,
+            frame_stack_downsample=2)
+        batch = create_smb1_batch(3, ram_watch=SMB1_WATCH, max_episode_steps=100)
+        batch.set_action_table(table)
+        batch.set_frame_stack(4, 2)
+        self.assertRaises(ValueError, shared.set_action_table, [0] * 257)
+        self.assertRaises(ValueError, shared.step, [0, 3, 0])
+        # a step runs at least one frame
+        self.assertRaises(ValueError, shared.step, [0, 1, 0], frames=0)
+        self.assertEqual((3, 4, 120, 128), shared.stacked_observations.shape)
+        shared.reset(seed=1)
+        batch.reset(seed=1)
+        for action in actions:
+            _, _, _, _, info = shared.step([action, 0, action])
+            batch.step([action, 0, action])
+            self.assertTrue(np.array_equal(batch.stacked_observations, shared.stacked_observations))
+            self.assertTrue(np.array_equal(batch.episode_stats['return'], shared.episode_stats['return']))
+            self.assertTrue(np.array_equal(batch.episode_stats['length'], shared.episode_stats['length']))
+        # the episodes were truncated after 100 steps
+        self.assertTrue(np.array_equal([100] * 3, info['final_episode_stats']['length']))
+        shared.close()
+        batch.close()
+
+
+@skipIf(not sys.platform.startswith('linux'), 'shared memory batches require Linux')
+class ShouldUnlinkSharedMemoryOfSharedBatch(TestCase):
+    def test(self):
+        shared = create_smb1_shared_batch(2, num_workers=2)
+        path = os.path.join('/dev/shm', shared._name.lstrip('/'))
+        # the name is unlinked as soon as the workers attach
+        self.assertFalse(os.path.exists(path))
+        shared.reset()
+        shared.step([0, 0])
+        # a batch that is dropped without closing it closes its workers
+        workers = shared._workers
+        del shared
+        gc.collect()
+        self.assertFalse(any(worker.is_alive() for worker in workers))
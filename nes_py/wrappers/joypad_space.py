@@ -3,6 +3,7 @@ from typing import Any
 import gymnasium as gym
 from gymnasium import Env
 from gymnasium import Wrapper
+from ..nes_env import NESEnv
 
 
 class JoypadSpace(Wrapper):
@@ -55,6 +56,10 @@ class JoypadSpace(Wrapper):
             # set this action maps value to the byte action value
             self._action_map[action] = byte_action
             self._action_meanings[action] = ' '.join(button_list)
+        # map the actions in the emulator if nothing sits in between
+        self._is_mapped_in_core = isinstance(env, NESEnv)
+        if self._is_mapped_in_core:
+            env.set_action_table([self._action_map[a] for a in range(len(actions))])
 
     def step(self, action):
         """
@@ -72,6 +77,8 @@ class JoypadSpace(Wrapper):
 
         """
         # take the step and record the output
+        if self._is_mapped_in_core:
+            return self.env.step(action)
         return self.env.step(self._action_map[action])
 
     def reset(self, seed: int | None = None, options: dict[str, Any] | None = None):
@@ -1,5 +1,6 @@
 """The setup script for installing and distributing the nes-py package."""
 import os
+import sys
 from glob import glob
 from setuptools import setup, find_packages, Extension
 
@@ -22,16 +23,30 @@ SOURCES = glob('nes_py/nes/src/*.cpp') + glob('nes_py/nes/src/mappers/*.cpp')
 INCLUDE_DIRS = ['nes_py/nes/include']
 # Build arguments to pass to the compiler
 EXTRA_COMPILE_ARGS = ['-std=c++2a', '-pipe', '-O3']
+# Macros to define, NES_PY_COUNTERS=1 builds the hot-path counters in
+DEFINE_MACROS = [('NES_COUNTERS', None)] if os.environ.get('NES_PY_COUNTERS') == '1' else []
+# Libraries to link against, POSIX shared memory needs librt on older glibc
+LIBRARIES = ['rt'] if sys.platform.startswith('linux') else []
 # The official extension using the name, source, headers, and build args
 LIB_NES_ENV = Extension(LIB_NAME,
     sources=SOURCES,
     include_dirs=INCLUDE_DIRS,
     extra_compile_args=EXTRA_COMPILE_ARGS,
+    define_macros=DEFINE_MACROS,
+    libraries=LIBRARIES,
+)
+# The name of the CPython extension module that steps the emulators natively
+NATIVE_NAME = 'nes_py._native'
+# The extension module calls into lib_nes_env through the entry points that
+# nes_env binds, so it only compiles its own source
+NATIVE = Extension(NATIVE_NAME,
+    sources=glob('nes_py/nes/python/*.cpp'),
+    extra_compile_args=EXTRA_COMPILE_ARGS,
 )
 
 
 setup(
     packages=find_packages(exclude=['tests', '*.tests', '*.tests.*']),
-    ext_modules=[LIB_NES_ENV],
+    ext_modules=[LIB_NES_ENV, NATIVE],
     zip_safe=False,
 )